@@ -12,6 +12,8 @@ import sys
 import os
 from datetime import datetime
 
+from kpm_columnar import load_dataset
+
 def analyze_dataset(csv_path):
     """Analyze the collected KPM metrics dataset."""
     
@@ -19,8 +21,8 @@ def analyze_dataset(csv_path):
     print("  FlexRIC KPM Metrics Dataset Analysis")
     print("="*60)
     
-    # Load data
-    df = pd.read_csv(csv_path)
+    # Load data (CSV or columnar .kpmc)
+    df = load_dataset(csv_path)
     print(f"\n📁 Dataset: {csv_path}")
     print(f"📊 Shape: {df.shape[0]} samples × {df.shape[1]} features")
     
@@ -76,14 +78,21 @@ def analyze_dataset(csv_path):
     
     for direction in ['dl', 'ul']:
         aggr_col = f'{direction}_aggr_tbs'
-        if aggr_col in df.columns:
+        rate_col = f'{direction}_mac_kbps'
+        dir_name = 'Downlink' if direction == 'dl' else 'Uplink'
+        if rate_col in df.columns:
+            # Rates derived by the collector, per UE and wrap/reset aware
+            print(f"  {dir_name} Throughput: {df[rate_col].mean():.2f} kbps per UE")
+            goodput_col = f'{direction}_goodput_kbps'
+            if goodput_col in df.columns:
+                print(f"    Goodput: {df[goodput_col].mean():.2f} kbps")
+        elif aggr_col in df.columns:
             # Calculate throughput from aggregated TBS
             tbs_diff = df[aggr_col].diff().dropna()
             tbs_diff = tbs_diff[tbs_diff >= 0]  # Remove negative diffs (rollover)
             if len(tbs_diff) > 0:
                 avg_tbs_per_sample = tbs_diff.mean()
                 throughput_kbps = avg_tbs_per_sample * sample_rate * 8 / 1000
-                dir_name = 'Downlink' if direction == 'dl' else 'Uplink'
                 print(f"  {dir_name} Throughput: {throughput_kbps:.2f} kbps")
                 print(f"    Total Data: {df[aggr_col].max() - df[aggr_col].min():.0f} bytes")
     
@@ -116,6 +125,8 @@ def analyze_dataset(csv_path):
         print(f"  TX Packets: {total_tx}")
         print(f"  Retransmissions: {total_retx}")
         print(f"  Retx Rate: {retx_rate:.2f}%")
+        if 'rlc_retx_per_s' in df.columns:
+            print(f"  Retransmissions/s: {df['rlc_retx_per_s'].mean():.2f}")
         
         if retx_rate < 1:
             quality = "Excellent ✅"
@@ -0,0 +1,234 @@
+/*
+ * Pipeline benchmark
+ * ==================
+ *
+ * Drives synthetic MAC, RLC, PDCP, GTP and KPM indications through the same
+ * ind_proc_handle path FlexRIC's callbacks use, into one node's writer and
+ * output sink, and reports what the hot path costs:
+ *
+ *   indications/s, ns per UE record for each SM, allocations per
+ *   indication, and bytes the sink wrote
+ *
+ * No RIC is involved. Each tick is one 10 ms MAC/RLC/PDCP/GTP report for
+ * every UE, with KPM every --kpm-every ticks. Payloads are built up front
+ * (see synth_ind.h) and only their counters change between ticks, so their
+ * construction is not measured. Rows never drop: a full writer ring holds
+ * the tick up, so the rate is what the writer and sink sustain, not just
+ * the callbacks.
+ *
+ *   bench_pipeline --ues=256 --meas=7 --ticks=5000 --output=/tmp/b.csv
+ *
+ * Any collector option applies too (--output=x.kpmc, --window=500,
+ * --sms=mac,kpm, ...).
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#include "collector_cfg.h"
+#include "ind_proc.h"
+#include "kpm_meas.h"
+#include "node_ctx.h"
+#include "stop_event.h"
+#include "synth_ind.h"
+
+#include "../../../../src/util/ngran_types.h"
+#include "../../../../src/util/time_now_us.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_TICK_US 10000
+
+// --- Allocation counting -----------------------------------------------------
+
+// glibc's own entry points, so every allocation in the process is counted
+// while the benchmark runs
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+
+static _Atomic bool counting;
+static _Atomic uint64_t allocs;
+
+void *malloc(size_t size) {
+  if (atomic_load_explicit(&counting, memory_order_relaxed))
+    atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+  if (atomic_load_explicit(&counting, memory_order_relaxed))
+    atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+  return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size) {
+  if (atomic_load_explicit(&counting, memory_order_relaxed))
+    atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+  return __libc_realloc(p, size);
+}
+
+// --- Options -----------------------------------------------------------------
+
+typedef struct {
+  uint32_t ues;
+  uint32_t meas;
+  uint32_t ticks;
+  uint32_t kpm_every;
+} bench_opts_t;
+
+static bool take_opt(char const *arg, char const *key, uint32_t *dst) {
+  size_t const len = strlen(key);
+  if (strncmp(arg, key, len) != 0 || arg[len] != '=')
+    return false;
+  char *end = NULL;
+  unsigned long const v = strtoul(arg + len + 1, &end, 10);
+  if (*end != '\0' || v > UINT32_MAX) {
+    fprintf(stderr, "%s: invalid value\n", key);
+    exit(1);
+  }
+  *dst = (uint32_t)v;
+  return true;
+}
+
+// Takes the benchmark's own flags out of argv, leaving the collector's
+static void parse_opts(bench_opts_t *o, int *argc, char *argv[]) {
+  int out = 1;
+  for (int i = 1; i < *argc; i++) {
+    char const *a = argv[i];
+    if (strcmp(a, "--help") == 0) {
+      printf("Usage: %s [--ues=N] [--meas=N] [--ticks=N] [--kpm-every=N] "
+             "[collector options]\n\n"
+             "  --ues=N        UEs per report, 1 to %d (default 64)\n"
+             "  --meas=N       KPM records per UE, 1 to %d; past %d they are "
+             "names the collector does not know (default %d)\n"
+             "  --ticks=N      10 ms report rounds (default 2000)\n"
+             "  --kpm-every=N  KPM report every N ticks (default 10)\n",
+             argv[0], SYNTH_MAX_UES, KPM_MAX_MEAS, KPM_MEAS_COUNT,
+             KPM_MEAS_COUNT);
+      exit(0);
+    }
+    if (!take_opt(a, "--ues", &o->ues) && !take_opt(a, "--meas", &o->meas) &&
+        !take_opt(a, "--ticks", &o->ticks) &&
+        !take_opt(a, "--kpm-every", &o->kpm_every))
+      argv[out++] = argv[i];
+  }
+  argv[out] = NULL;
+  *argc = out;
+}
+
+// --- Run ---------------------------------------------------------------------
+
+int main(int argc, char *argv[]) {
+  bench_opts_t o = {.ues = 64, .meas = KPM_MEAS_COUNT, .ticks = 2000,
+                    .kpm_every = 10};
+  parse_opts(&o, &argc, argv);
+
+  collector_cfg_t cfg;
+  collector_cfg_defaults(&cfg);
+  snprintf(cfg.output, sizeof(cfg.output), "/tmp/kpm_bench.csv");
+  cfg.max_samples = 0;
+  cfg.print_interval = 0;
+  if (!collector_cfg_parse(&cfg, &argc, argv))
+    return 1;
+  if (argc > 1) {
+    fprintf(stderr, "Unknown option %s\n", argv[1]);
+    return 1;
+  }
+  if (o.ues < 1 || o.ues > SYNTH_MAX_UES || o.meas < 1 ||
+      o.meas > KPM_MAX_MEAS || o.ticks < 1 || o.kpm_every < 1) {
+    fprintf(stderr, "--ues must be 1..%d, --meas 1..%d, --ticks and "
+                    "--kpm-every >= 1\n",
+            SYNTH_MAX_UES, KPM_MAX_MEAS);
+    return 1;
+  }
+
+  static synth_ind_t pl;
+  if (!synth_ind_build(&pl, o.ues, o.meas) || !stop_event_init())
+    return 1;
+
+  static node_ctx_t n;
+  global_e2_node_id_t id = {.type = ngran_gNB, .nb_id = {.nb_id = 1}};
+  if (!node_ctx_open(&n, 0, &id, 0, &cfg, false))
+    return 1;
+  atomic_store(&n.live, true);
+
+  ind_proc_t proc;
+  ind_proc_init(&proc, &cfg);
+  proc.lossless = true;
+
+  printf("Pipeline benchmark: %u UEs, %u KPM records per UE, %u ticks, "
+         "KPM every %u\n",
+         o.ues, o.meas, o.ticks, o.kpm_every);
+  printf("Output: %s\n", n.path);
+
+  node_sub_e const order[] = {NODE_SUB_MAC, NODE_SUB_RLC, NODE_SUB_PDCP,
+                              NODE_SUB_GTP, NODE_SUB_KPM};
+  int64_t sm_ns[NODE_SUB_COUNT] = {0};
+  uint64_t sm_ind[NODE_SUB_COUNT] = {0};
+  int64_t const ts0 = time_now_us();
+
+  atomic_store(&counting, true);
+  int64_t const t0 = lat_now_ns();
+
+  for (uint64_t tick = 0; tick < o.ticks; tick++) {
+    int64_t const ts = ts0 + (int64_t)tick * BENCH_TICK_US;
+    synth_ind_advance(&pl, tick, ts);
+    proc.clock_us = ts;
+
+    for (size_t k = 0; k < sizeof(order) / sizeof(order[0]); k++) {
+      node_sub_e const s = order[k];
+      if (!(cfg.sms & CFG_SMS_BIT(s)) ||
+          (s == NODE_SUB_KPM && tick % o.kpm_every != 0))
+        continue;
+      int64_t const t = lat_now_ns();
+      ind_proc_handle(&proc, &n, &pl.rd[s]);
+      sm_ns[s] += lat_now_ns() - t;
+      sm_ind[s]++;
+    }
+  }
+
+  int64_t const t1 = lat_now_ns();
+  node_ctx_retire(&n);
+  node_ctx_stop(&n);
+  int64_t const t2 = lat_now_ns();
+  atomic_store(&counting, false);
+  uint64_t const bytes = node_ctx_bytes(&n);
+
+  uint64_t n_ind = 0;
+  int64_t cb_ns = 0;
+  for (size_t s = 0; s < NODE_SUB_COUNT; s++) {
+    n_ind += sm_ind[s];
+    cb_ns += sm_ns[s];
+  }
+  double const run_s = (double)(t2 - t0) / 1e9;
+
+  printf("\nIndications: %lu in %.3f s, %.3f s of it in callbacks, %.3f s "
+         "draining\n",
+         n_ind, run_s, (double)cb_ns / 1e9, (double)(t2 - t1) / 1e9);
+  printf("  Indications/s: %.0f\n", (double)n_ind / run_s);
+  printf("  ns per UE record:");
+  for (size_t k = 0; k < sizeof(order) / sizeof(order[0]); k++) {
+    node_sub_e const s = order[k];
+    if (sm_ind[s])
+      printf(" %s %.1f", node_sub_name[s],
+             (double)sm_ns[s] / (double)(sm_ind[s] * o.ues));
+  }
+  printf("\n  Allocations per indication: %.3f (%lu)\n",
+         (double)atomic_load(&allocs) / (double)n_ind, atomic_load(&allocs));
+  printf("  Rows: %lu, bytes written: %lu (%.1f per row, %.1f MB/s)\n",
+         n.writer.rows, bytes,
+         n.writer.rows ? (double)bytes / (double)n.writer.rows : 0.0,
+         (double)bytes / run_s / 1e6);
+  if (ue_table_len(&n.ues) < o.ues)
+    printf("  UEs tracked: %zu of %u, the UE table is full at %d per node\n",
+           ue_table_len(&n.ues), o.ues, UE_TABLE_MAX_LOAD);
+
+  node_ctx_print_stats(&n);
+  node_ctx_close(&n);
+  synth_ind_free(&pl);
+  stop_event_close();
+  return 0;
+}
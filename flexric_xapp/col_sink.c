@@ -0,0 +1,251 @@
+/*
+ * Columnar row sink (.kpmc)
+ * =========================
+ *
+ * Fixed-schema binary format meant to be mmap'ed by the analysis scripts
+ * (see kpm_columnar.py). All integers are little-endian.
+ *
+ *   file header   64 bytes
+ *     char     magic[8]      "KPMCOL\0\1"
+ *     uint32   version       1
+ *     uint32   n_cols
+ *     uint32   chunk_rows    row capacity of a chunk
+ *     uint32   header_size   64 + n_cols * 48
+ *     uint8    reserved[40]
+ *   column descriptors, n_cols x 48 bytes
+ *     char     name[40]      NUL padded, same names as the CSV header
+ *     uint8    type          col_type_e
+ *     uint8    elem_size
+ *     uint8    reserved[6]
+ *   chunks, until EOF
+ *     char     magic[4]      "CHNK"
+ *     uint32   n_rows
+ *     uint64   chunk_size    bytes, including this 16 byte header
+ *     per column: n_rows * elem_size bytes, zero padded to 8
+ *
+ * Every column of a chunk is 8-byte aligned, so a reader can wrap it in an
+ * array without copying.
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#include "row_sink.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define COL_VERSION 1
+#define COL_HEADER_SIZE 64
+#define COL_DESC_SIZE 48
+#define COL_NAME_LEN 40
+
+typedef enum {
+  COL_I8 = 1,
+  COL_U8 = 2,
+  COL_U16 = 3,
+  COL_I32 = 4,
+  COL_U32 = 5,
+  COL_I64 = 6,
+  COL_U64 = 7,
+  COL_F32 = 8,
+  COL_F64 = 9,
+} col_type_e;
+
+typedef struct {
+  char const *name;
+  col_type_e type;
+  uint8_t size;
+  size_t offset;
+} col_def_t;
+
+#define COL(name, type, field)                                                 \
+  {name, type, sizeof(((ue_metrics_t *)0)->field), offsetof(ue_metrics_t, field)}
+
+static col_def_t const schema[] = {
+    COL("timestamp", COL_I64, timestamp),
+    COL("rnti", COL_U32, rnti),
+    COL("cqi", COL_U8, cqi),
+    COL("pusch_snr", COL_F32, pusch_snr),
+    COL("pucch_snr", COL_F32, pucch_snr),
+    COL("dl_bler", COL_F32, dl_bler),
+    COL("ul_bler", COL_F32, ul_bler),
+    COL("dl_mcs1", COL_U8, dl_mcs1),
+    COL("dl_mcs2", COL_U8, dl_mcs2),
+    COL("ul_mcs1", COL_U8, ul_mcs1),
+    COL("ul_mcs2", COL_U8, ul_mcs2),
+    COL("dl_tbs", COL_U64, dl_tbs),
+    COL("ul_tbs", COL_U64, ul_tbs),
+    COL("dl_aggr_tbs", COL_U64, dl_aggr_tbs),
+    COL("ul_aggr_tbs", COL_U64, ul_aggr_tbs),
+    COL("dl_prb", COL_U32, dl_prb),
+    COL("ul_prb", COL_U32, ul_prb),
+    COL("dl_sched_rb", COL_U32, dl_sched_rb),
+    COL("ul_sched_rb", COL_U32, ul_sched_rb),
+    COL("bsr", COL_U32, bsr),
+    COL("phr", COL_I8, phr),
+    COL("frame", COL_U16, frame),
+    COL("slot", COL_U16, slot),
+    COL("rlc_tx_pkts", COL_U32, rlc_tx_pkts),
+    COL("rlc_tx_bytes", COL_U32, rlc_tx_bytes),
+    COL("rlc_rx_pkts", COL_U32, rlc_rx_pkts),
+    COL("rlc_rx_bytes", COL_U32, rlc_rx_bytes),
+    COL("rlc_txbuf", COL_U32, rlc_txbuf),
+    COL("rlc_rxbuf", COL_U32, rlc_rxbuf),
+    COL("rlc_retx", COL_U32, rlc_retx),
+    COL("pdcp_tx_pkts", COL_U32, pdcp_tx_pkts),
+    COL("pdcp_tx_bytes", COL_U32, pdcp_tx_bytes),
+    COL("pdcp_rx_pkts", COL_U32, pdcp_rx_pkts),
+    COL("pdcp_rx_bytes", COL_U32, pdcp_rx_bytes),
+    COL("dl_thp_kbps", COL_F64, dl_thp_kbps),
+    COL("ul_thp_kbps", COL_F64, ul_thp_kbps),
+    COL("rlc_sdu_delay_us", COL_F64, rlc_sdu_delay_us),
+    COL("pdcp_vol_dl_kb", COL_I32, pdcp_sdu_vol_dl_kb),
+    COL("pdcp_vol_ul_kb", COL_I32, pdcp_sdu_vol_ul_kb),
+    COL("prb_tot_dl", COL_I32, prb_tot_dl),
+    COL("prb_tot_ul", COL_I32, prb_tot_ul),
+    COL("rlc_age_ms", COL_F64, rlc_age_ms),
+    COL("pdcp_age_ms", COL_F64, pdcp_age_ms),
+    COL("kpm_age_ms", COL_F64, kpm_age_ms),
+    COL("dl_mac_kbps", COL_F64, dl_mac_kbps),
+    COL("ul_mac_kbps", COL_F64, ul_mac_kbps),
+    COL("dl_goodput_kbps", COL_F64, dl_goodput_kbps),
+    COL("ul_goodput_kbps", COL_F64, ul_goodput_kbps),
+    COL("rlc_tx_kbps", COL_F64, rlc_tx_kbps),
+    COL("rlc_rx_kbps", COL_F64, rlc_rx_kbps),
+    COL("rlc_retx_per_s", COL_F64, rlc_retx_per_s),
+    COL("pdcp_tx_kbps", COL_F64, pdcp_tx_kbps),
+    COL("pdcp_rx_kbps", COL_F64, pdcp_rx_kbps),
+    COL("gtp_teid_gnb", COL_U32, gtp_teid_gnb),
+    COL("gtp_teid_upf", COL_U32, gtp_teid_upf),
+    COL("gtp_qfi", COL_U8, gtp_qfi),
+    COL("gtp_tunnels", COL_U8, gtp_tunnels),
+    COL("ue_rows", COL_U32, ue_rows),
+    COL("ue_first_ts", COL_I64, first_ts),
+    COL("ue_final", COL_U8, final),
+    COL("trig", COL_U8, trig),
+    COL("mac_ver", COL_U32, mac_ver),
+    COL("rlc_ver", COL_U32, rlc_ver),
+    COL("pdcp_ver", COL_U32, pdcp_ver),
+    COL("gtp_ver", COL_U32, gtp_ver),
+    COL("kpm_ver", COL_U32, kpm_ver),
+};
+
+#define N_COLS (sizeof(schema) / sizeof(schema[0]))
+
+typedef struct {
+  row_sink_t base;
+  FILE *f;
+  size_t chunk_rows;
+  size_t n_rows;
+  uint8_t *cols[N_COLS];
+} col_sink_t;
+
+static size_t pad8(size_t n) { return (n + 7) & ~(size_t)7; }
+
+static void write_file_header(col_sink_t *c) {
+  uint8_t hdr[COL_HEADER_SIZE] = {0};
+  uint32_t const v[4] = {COL_VERSION, (uint32_t)N_COLS,
+                         (uint32_t)c->chunk_rows,
+                         (uint32_t)(COL_HEADER_SIZE + N_COLS * COL_DESC_SIZE)};
+  memcpy(hdr, "KPMCOL\0\1", 8);
+  memcpy(hdr + 8, v, sizeof(v));
+  fwrite(hdr, 1, sizeof(hdr), c->f);
+
+  for (size_t i = 0; i < N_COLS; i++) {
+    uint8_t desc[COL_DESC_SIZE] = {0};
+    strncpy((char *)desc, schema[i].name, COL_NAME_LEN - 1);
+    desc[COL_NAME_LEN] = schema[i].type;
+    desc[COL_NAME_LEN + 1] = schema[i].size;
+    fwrite(desc, 1, sizeof(desc), c->f);
+  }
+}
+
+// Bytes of the chunk the buffered rows make, its 16-byte header included
+static uint64_t chunk_size(col_sink_t const *c) {
+  uint64_t size = 16;
+  for (size_t i = 0; i < N_COLS; i++)
+    size += pad8(c->n_rows * schema[i].size);
+  return size;
+}
+
+static void write_chunk(col_sink_t *c) {
+  if (c->n_rows == 0)
+    return;
+
+  uint64_t size = chunk_size(c);
+  uint32_t const n_rows = (uint32_t)c->n_rows;
+  fwrite("CHNK", 1, 4, c->f);
+  fwrite(&n_rows, sizeof(n_rows), 1, c->f);
+  fwrite(&size, sizeof(size), 1, c->f);
+
+  static uint8_t const zeros[8] = {0};
+  for (size_t i = 0; i < N_COLS; i++) {
+    size_t const bytes = c->n_rows * schema[i].size;
+    fwrite(c->cols[i], 1, bytes, c->f);
+    fwrite(zeros, 1, pad8(bytes) - bytes, c->f);
+  }
+  c->n_rows = 0;
+}
+
+static void col_write(row_sink_t *s, ue_metrics_t const *m) {
+  col_sink_t *c = (col_sink_t *)s;
+  uint8_t const *src = (uint8_t const *)m;
+
+  for (size_t i = 0; i < N_COLS; i++)
+    memcpy(c->cols[i] + c->n_rows * schema[i].size, src + schema[i].offset,
+           schema[i].size);
+
+  if (++c->n_rows == c->chunk_rows)
+    write_chunk(c);
+}
+
+// Chunks are only ever written whole, so a flush just syncs stdio
+static void col_flush(row_sink_t *s) { fflush(((col_sink_t *)s)->f); }
+
+// The buffered rows count as the chunk close writes for them
+static uint64_t col_bytes(row_sink_t *s) {
+  col_sink_t *c = (col_sink_t *)s;
+  long const pos = ftell(c->f);
+  uint64_t const pending = c->n_rows ? chunk_size(c) : 0;
+  return (pos > 0 ? (uint64_t)pos : 0) + pending;
+}
+
+static void col_close(row_sink_t *s) {
+  col_sink_t *c = (col_sink_t *)s;
+  write_chunk(c);
+  fclose(c->f);
+  for (size_t i = 0; i < N_COLS; i++)
+    free(c->cols[i]);
+  free(c);
+}
+
+row_sink_t *col_sink_open(char const *path, size_t chunk_rows) {
+  col_sink_t *c = calloc(1, sizeof(*c));
+  if (!c)
+    return NULL;
+
+  c->chunk_rows = chunk_rows;
+  for (size_t i = 0; i < N_COLS; i++) {
+    c->cols[i] = malloc(chunk_rows * schema[i].size);
+    if (!c->cols[i])
+      goto fail;
+  }
+
+  c->f = fopen(path, "wb");
+  if (!c->f)
+    goto fail;
+  write_file_header(c);
+
+  c->base.write = col_write;
+  c->base.flush = col_flush;
+  c->base.close = col_close;
+  c->base.bytes = col_bytes;
+  return &c->base;
+
+fail:
+  for (size_t i = 0; i < N_COLS; i++)
+    free(c->cols[i]);
+  free(c);
+  return NULL;
+}
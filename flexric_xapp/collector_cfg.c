@@ -0,0 +1,807 @@
+/*
+ * Collector configuration
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#include "collector_cfg.h"
+#include "kpm_pool.h"
+#include "row_pub.h"
+#include "sub_fanout.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef OUTPUT_FILE
+#define OUTPUT_FILE "/tmp/kpm_metrics_dataset.csv"
+#endif
+
+#define CFG_MAX_LINE 1024
+
+uint32_t const cfg_interval_ms[] = {1, 2, 5, 10, 100, 1000};
+size_t const cfg_interval_count =
+    sizeof(cfg_interval_ms) / sizeof(cfg_interval_ms[0]);
+
+static char const *const interval_str[] = {"1_ms",  "2_ms",   "5_ms",
+                                           "10_ms", "100_ms", "1000_ms"};
+
+static char const *const sm_name[CFG_SM_COUNT] = {
+    [CFG_SM_MAC] = "MAC",
+    [CFG_SM_RLC] = "RLC",
+    [CFG_SM_PDCP] = "PDCP",
+    [CFG_SM_GTP] = "GTP",
+};
+
+void collector_cfg_defaults(collector_cfg_t *cfg) {
+  memset(cfg, 0, sizeof(*cfg));
+  snprintf(cfg->output, sizeof(cfg->output), "%s", OUTPUT_FILE);
+  cfg->csv_flush.max_bytes = CSV_SINK_FLUSH_BYTES;
+  cfg->csv_flush.max_ms = CSV_SINK_FLUSH_MS;
+  cfg->rotate.zstd_level = rot_sink_zstd_available() ? ROT_SINK_ZSTD_LEVEL : 0;
+  cfg->print_interval = 100;
+  cfg->stats_interval_s = 10;
+  cfg->metrics_port = 0;
+  snprintf(cfg->metrics_addr, sizeof(cfg->metrics_addr), "0.0.0.0");
+  cfg->shm_slots = ROW_PUB_SHM_SLOTS;
+  cfg->replay_speed = 1;
+
+  cfg->max_samples = 1000;
+  cfg->duration_s = 0;
+  cfg->node_poll_ms = 1000;
+  // Parallel setup is opt-in, see sub_threads in collector_cfg.h
+  cfg->sub_threads = 1;
+
+  cfg->sms = KPM_SMS;
+  for (size_t i = 0; i < CFG_SM_COUNT; i++)
+    cfg->sm_interval_ms[i] = 10;
+
+  cfg->kpm_gran_ms = 100;
+  cfg->kpm_period_ms = 100;
+  cfg->kpm_workers = 2;
+  cfg->kpm_parallel_ues = 128;
+  for (size_t i = 0; i < KPM_MEAS_COUNT; i++)
+    cfg->kpm_meas_on[i] = KPM_MEAS_BUILT(i);
+
+  cfg->align = CFG_ALIGN_PARTIAL;
+  cfg->align_window_ms = 100;
+  cfg->align_sources = CFG_SRC_ALL;
+  cfg->ue_ttl_ms = 10000;
+
+  cfg->trig.n = 0;
+  cfg->trig_coarse_ms = 100;
+  cfg->trig_hold_ms = 2000;
+  cfg->trig_tau_ms = 1000;
+  cfg->trig_history = 256;
+  cfg->feat.n = 0;
+}
+
+unsigned collector_cfg_kpm_meas(collector_cfg_t const *cfg) {
+  unsigned m = 0;
+  for (size_t i = 0; i < KPM_MEAS_COUNT; i++) {
+    if (cfg->kpm_meas_on[i])
+      m |= KPM_MEAS_BIT(i);
+  }
+  return m;
+}
+
+uint32_t collector_cfg_sub_interval(collector_cfg_t const *cfg, cfg_sm_e sm,
+                                    bool fine) {
+  bool const switched = sm == CFG_SM_MAC || sm == CFG_SM_RLC;
+  if (cfg->trig.n && switched && !fine)
+    return cfg->trig_coarse_ms;
+  return cfg->sm_interval_ms[sm];
+}
+
+bool collector_cfg_windowed(collector_cfg_t const *cfg) {
+  for (size_t i = 0; i < ROW_AGG_COUNT; i++) {
+    if (cfg->window_ms[i])
+      return true;
+  }
+  return false;
+}
+
+char const *collector_cfg_interval_str(uint32_t ms) {
+  for (size_t i = 0; i < cfg_interval_count; i++) {
+    if (cfg_interval_ms[i] == ms)
+      return interval_str[i];
+  }
+  return NULL;
+}
+
+// --- Value parsers -----------------------------------------------------------
+
+typedef enum {
+  OPT_PATH,
+  OPT_U64,
+  OPT_U32,
+  OPT_SIZE,
+  OPT_INTERVAL,     // One SM interval
+  OPT_INTERVAL_ALL, // Every SM interval at once
+  OPT_WINDOW_ALL,   // Every aggregation window at once
+  OPT_MEAS_LIST,
+  OPT_ALIGN,
+  OPT_SOURCES,
+  OPT_SMS,
+  OPT_TRIGGER,
+  OPT_FEATURES,
+} opt_kind_e;
+
+typedef struct {
+  char const *key;
+  opt_kind_e kind;
+  size_t off;
+  char const *help;
+} opt_def_t;
+
+#define OFF(field) offsetof(collector_cfg_t, field)
+
+static opt_def_t const opts[] = {
+    {"output", OPT_PATH, OFF(output), "Output file (.kpmc = columnar)"},
+    {"samples", OPT_U64, OFF(max_samples),
+     "Stop after N rows, or N window summaries with windows on "
+     "(0 = no limit)"},
+    {"duration", OPT_U32, OFF(duration_s),
+     "Stop after N seconds (0 = no limit)"},
+    {"node-poll", OPT_U32, OFF(node_poll_ms),
+     "Check for new and departed E2 nodes every N ms"},
+    {"sub-threads", OPT_U32, OFF(sub_threads),
+     "Subscription requests in flight at once (1 = one at a time)"},
+    {"sms", OPT_SMS, OFF(sms),
+     "SMs to subscribe: mac,rlc,pdcp,gtp,kpm, or \"all\""},
+    {"interval", OPT_INTERVAL_ALL, 0, "MAC/RLC/PDCP/GTP interval in ms"},
+    {"mac-interval", OPT_INTERVAL, OFF(sm_interval_ms[CFG_SM_MAC]),
+     "MAC interval in ms"},
+    {"rlc-interval", OPT_INTERVAL, OFF(sm_interval_ms[CFG_SM_RLC]),
+     "RLC interval in ms"},
+    {"pdcp-interval", OPT_INTERVAL, OFF(sm_interval_ms[CFG_SM_PDCP]),
+     "PDCP interval in ms"},
+    {"gtp-interval", OPT_INTERVAL, OFF(sm_interval_ms[CFG_SM_GTP]),
+     "GTP interval in ms"},
+    {"rotate-mb", OPT_U32, OFF(rotate.max_mb),
+     "Start a new output segment at N MB (0 = no size limit)"},
+    {"rotate-s", OPT_U32, OFF(rotate.max_s),
+     "Start a new output segment every N seconds (0 = no time limit)"},
+    {"rotate-keep", OPT_U32, OFF(rotate.keep),
+     "Keep only the newest N finished segments (0 = all)"},
+    {"rotate-zstd", OPT_U32, OFF(rotate.zstd_level),
+     "zstd level for finished segments (0 = uncompressed)"},
+    {"window", OPT_WINDOW_ALL, 0,
+     "Write MAC/RLC/PDCP/KPM summaries over N ms windows (0 = raw rows)"},
+    {"mac-window", OPT_U32, OFF(window_ms[ROW_AGG_MAC]),
+     "MAC summary window in ms (0 = left out)"},
+    {"rlc-window", OPT_U32, OFF(window_ms[ROW_AGG_RLC]),
+     "RLC summary window in ms (0 = left out)"},
+    {"pdcp-window", OPT_U32, OFF(window_ms[ROW_AGG_PDCP]),
+     "PDCP summary window in ms (0 = left out)"},
+    {"kpm-window", OPT_U32, OFF(window_ms[ROW_AGG_KPM]),
+     "KPM summary window in ms (0 = left out)"},
+    {"kpm-gran", OPT_U32, OFF(kpm_gran_ms), "KPM granularity period in ms"},
+    {"kpm-period", OPT_U32, OFF(kpm_period_ms), "KPM report period in ms"},
+    {"kpm-workers", OPT_U32, OFF(kpm_workers),
+     "Threads decoding large KPM reports (0 = none)"},
+    {"kpm-parallel-ues", OPT_U32, OFF(kpm_parallel_ues),
+     "Decode KPM reports with at least N UEs on the workers"},
+    {"kpm-meas", OPT_MEAS_LIST, 0,
+     "Comma-separated KPM measurements, or \"all\""},
+    {"flush-bytes", OPT_SIZE, OFF(csv_flush.max_bytes),
+     "CSV write threshold in bytes (0 = off)"},
+    {"flush-ms", OPT_U32, OFF(csv_flush.max_ms),
+     "CSV write deadline in ms (0 = off)"},
+    {"print-interval", OPT_U64, OFF(print_interval),
+     "Console line every N rows (0 = quiet)"},
+    {"stats-interval", OPT_U32, OFF(stats_interval_s),
+     "Latency summary every N seconds (0 = off)"},
+    {"metrics-port", OPT_U32, OFF(metrics_port),
+     "Serve Prometheus metrics on this port (0 = off)"},
+    {"metrics-addr", OPT_PATH, OFF(metrics_addr),
+     "IPv4 address the metrics endpoint binds to"},
+    {"shm", OPT_PATH, OFF(shm_name),
+     "Publish rows to this shared memory ring, e.g. /kpm_rows"},
+    {"shm-slots", OPT_U32, OFF(shm_slots),
+     "Shared memory ring size in rows (power of two)"},
+    {"zmq", OPT_PATH, OFF(zmq_endpoint),
+     "Publish rows on this ZeroMQ endpoint, e.g. tcp://*:5556"},
+    {"record", OPT_PATH, OFF(record),
+     "Record every indication to this log for --replay"},
+    {"replay", OPT_PATH, OFF(replay),
+     "Replay a recorded indication log instead of connecting to the RIC"},
+    {"replay-speed", OPT_U32, OFF(replay_speed),
+     "Replay at N times the recorded pace (0 = as fast as possible)"},
+    {"replay-lossy", OPT_U32, OFF(replay_lossy),
+     "1 = drop rows the writer cannot keep up with, as a live run does"},
+    {"report", OPT_PATH, OFF(report),
+     "Write a JSON summary of the run to this file at the end"},
+    {"align", OPT_ALIGN, OFF(align), "Join policy: partial or wait-all"},
+    {"align-window", OPT_U32, OFF(align_window_ms),
+     "Max source age in ms to count as fresh"},
+    {"align-sources", OPT_SOURCES, OFF(align_sources),
+     "Sources joined with MAC: rlc,pdcp,kpm"},
+    {"ue-ttl", OPT_U32, OFF(ue_ttl_ms),
+     "Evict a UE silent for this many ms (0 = never)"},
+    {"trigger", OPT_TRIGGER, OFF(trig),
+     "Fine MAC/RLC while a rule holds, e.g. \"dl_bler>0.1,cqi<7,"
+     "pusch_snr~3\""},
+    {"trigger-coarse", OPT_INTERVAL, OFF(trig_coarse_ms),
+     "MAC/RLC interval in ms while no trigger holds"},
+    {"trigger-hold", OPT_U32, OFF(trig_hold_ms),
+     "Keep a UE hot this many ms after a rule last fired"},
+    {"trigger-tau", OPT_U32, OFF(trig_tau_ms),
+     "Time constant in ms of the ~ rules' EWMA"},
+    {"trigger-history", OPT_U32, OFF(trig_history),
+     "Held rows per node written out when a UE turns hot"},
+    {"features", OPT_FEATURES, OFF(feat),
+     "Rolling UE features over the last N samples, e.g. \"10,50\" "
+     "(0 = off)"},
+};
+
+#define N_OPTS (sizeof(opts) / sizeof(opts[0]))
+
+static bool parse_u64(char const *s, uint64_t *out) {
+  if (!isdigit((unsigned char)*s))
+    return false;
+  char *end = NULL;
+  errno = 0;
+  unsigned long long const v = strtoull(s, &end, 10);
+  if (errno != 0 || *end != '\0')
+    return false;
+  *out = v;
+  return true;
+}
+
+static bool parse_meas_list(collector_cfg_t *cfg, char const *s) {
+  if (strcmp(s, "all") == 0) {
+    for (size_t i = 0; i < KPM_MEAS_COUNT; i++)
+      cfg->kpm_meas_on[i] = KPM_MEAS_BUILT(i);
+    return true;
+  }
+
+  bool on[KPM_MEAS_COUNT] = {false};
+  while (*s) {
+    size_t const len = strcspn(s, ",");
+    kpm_meas_e const m = kpm_meas_find(s, len);
+    if (m == KPM_MEAS_UNKNOWN) {
+      fprintf(stderr, "Unknown KPM measurement '%.*s'\n", (int)len, s);
+      return false;
+    }
+    if (!KPM_MEAS_BUILT(m)) {
+      fprintf(stderr, "KPM measurement %s is not built in\n", kpm_meas[m].name);
+      return false;
+    }
+    on[m] = true;
+    s += len;
+    if (*s == ',')
+      s++;
+  }
+  memcpy(cfg->kpm_meas_on, on, sizeof(on));
+  return true;
+}
+
+// Bit i of the CFG_SRC_* mask
+static char const *const src_name[] = {"rlc", "pdcp", "kpm"};
+#define N_SRC (sizeof(src_name) / sizeof(src_name[0]))
+
+// Bit i of the CFG_SMS_* mask
+static char const *const sms_name[] = {"mac", "rlc", "pdcp", "gtp", "kpm"};
+#define N_SMS (sizeof(sms_name) / sizeof(sms_name[0]))
+
+_Static_assert(CFG_SMS_ALL == (1u << N_SMS) - 1, "sms_name[] is out of date");
+_Static_assert((KPM_SMS & CFG_SMS_MAC) && (KPM_SMS & ~CFG_SMS_ALL) == 0,
+               "KPM_SMS must include mac and name known SMs only");
+
+// Comma-separated names, bit i set for names[i]
+static bool parse_mask(unsigned *mask, char const *s,
+                       char const *const names[], size_t n_names,
+                       char const *what) {
+  unsigned m = 0;
+  while (*s) {
+    size_t const len = strcspn(s, ",");
+    size_t i = 0;
+    while (i < n_names && !(strlen(names[i]) == len &&
+                            memcmp(names[i], s, len) == 0))
+      i++;
+    if (i == n_names) {
+      fprintf(stderr, "Unknown %s '%.*s'\n", what, (int)len, s);
+      return false;
+    }
+    m |= 1u << i;
+    s += len;
+    if (*s == ',')
+      s++;
+  }
+  *mask = m;
+  return true;
+}
+
+static opt_def_t const *find_opt(char const *key, size_t len) {
+  for (size_t i = 0; i < N_OPTS; i++) {
+    if (strlen(opts[i].key) == len && memcmp(opts[i].key, key, len) == 0)
+      return &opts[i];
+  }
+  return NULL;
+}
+
+static bool apply(collector_cfg_t *cfg, opt_def_t const *o, char const *val) {
+  char *base = (char *)cfg;
+  uint64_t v = 0;
+
+  switch (o->kind) {
+  case OPT_PATH:
+    if (*val == '\0' || strlen(val) >= CFG_MAX_PATH)
+      break;
+    memcpy(base + o->off, val, strlen(val) + 1);
+    return true;
+
+  case OPT_U64:
+    if (!parse_u64(val, &v))
+      break;
+    *(uint64_t *)(base + o->off) = v;
+    return true;
+
+  case OPT_U32:
+    if (!parse_u64(val, &v) || v > UINT32_MAX)
+      break;
+    *(uint32_t *)(base + o->off) = (uint32_t)v;
+    return true;
+
+  case OPT_WINDOW_ALL:
+    if (!parse_u64(val, &v) || v > UINT32_MAX)
+      break;
+    for (size_t i = 0; i < ROW_AGG_COUNT; i++)
+      cfg->window_ms[i] = (uint32_t)v;
+    return true;
+
+  case OPT_SIZE:
+    if (!parse_u64(val, &v))
+      break;
+    *(size_t *)(base + o->off) = (size_t)v;
+    return true;
+
+  case OPT_INTERVAL:
+  case OPT_INTERVAL_ALL:
+    if (!parse_u64(val, &v) || v > UINT32_MAX ||
+        !collector_cfg_interval_str((uint32_t)v)) {
+      fprintf(stderr, "--%s: interval must be one of 1, 2, 5, 10, 100, 1000\n",
+              o->key);
+      return false;
+    }
+    if (o->kind == OPT_INTERVAL) {
+      *(uint32_t *)(base + o->off) = (uint32_t)v;
+    } else {
+      for (size_t i = 0; i < CFG_SM_COUNT; i++)
+        cfg->sm_interval_ms[i] = (uint32_t)v;
+    }
+    return true;
+
+  case OPT_MEAS_LIST:
+    return parse_meas_list(cfg, val);
+
+  case OPT_ALIGN:
+    if (strcmp(val, "partial") == 0)
+      cfg->align = CFG_ALIGN_PARTIAL;
+    else if (strcmp(val, "wait-all") == 0)
+      cfg->align = CFG_ALIGN_WAIT_ALL;
+    else
+      break;
+    return true;
+
+  case OPT_TRIGGER:
+    return trig_rules_parse(&cfg->trig, val);
+
+  case OPT_FEATURES:
+    return feat_windows_parse(&cfg->feat, val);
+
+  case OPT_SOURCES:
+    return parse_mask(&cfg->align_sources, val, src_name, N_SRC, "source");
+
+  case OPT_SMS:
+    if (strcmp(val, "all") == 0) {
+      cfg->sms = KPM_SMS;
+      return true;
+    }
+    if (!parse_mask(&cfg->sms, val, sms_name, N_SMS, "SM"))
+      return false;
+    for (size_t i = 0; i < N_SMS; i++) {
+      if ((cfg->sms & ~KPM_SMS) & (1u << i)) {
+        fprintf(stderr, "SM %s is not built in\n", sms_name[i]);
+        return false;
+      }
+    }
+    return true;
+  }
+
+  fprintf(stderr, "--%s: invalid value '%s'\n", o->key, val);
+  return false;
+}
+
+// --- Config file -------------------------------------------------------------
+
+static char *trim(char *s) {
+  while (isspace((unsigned char)*s))
+    s++;
+  char *e = s + strlen(s);
+  while (e > s && isspace((unsigned char)e[-1]))
+    *--e = '\0';
+  return s;
+}
+
+bool collector_cfg_load_file(collector_cfg_t *cfg, char const *path) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    fprintf(stderr, "Cannot open config file %s: %s\n", path, strerror(errno));
+    return false;
+  }
+
+  char line[CFG_MAX_LINE];
+  unsigned lineno = 0;
+  bool ok = true;
+
+  while (ok && fgets(line, sizeof(line), f)) {
+    lineno++;
+    char *hash = strchr(line, '#');
+    if (hash)
+      *hash = '\0';
+
+    char *s = trim(line);
+    if (*s == '\0')
+      continue;
+
+    char *eq = strchr(s, '=');
+    if (!eq) {
+      fprintf(stderr, "%s:%u: expected key = value\n", path, lineno);
+      ok = false;
+      break;
+    }
+    *eq = '\0';
+    char *key = trim(s);
+    char *val = trim(eq + 1);
+
+    opt_def_t const *o = find_opt(key, strlen(key));
+    if (!o) {
+      fprintf(stderr, "%s:%u: unknown key '%s'\n", path, lineno, key);
+      ok = false;
+      break;
+    }
+    ok = apply(cfg, o, val);
+  }
+
+  fclose(f);
+  return ok;
+}
+
+// --- Command line ------------------------------------------------------------
+
+static void usage(char const *prog) {
+  printf("Usage: %s [collector options] [FlexRIC options]\n\n", prog);
+  printf("  --config=FILE          Read options from FILE (key = value)\n");
+  for (size_t i = 0; i < N_OPTS; i++)
+    printf("  --%-20s %s\n", opts[i].key, opts[i].help);
+  printf("\nSMs:");
+  for (size_t i = 0; i < N_SMS; i++) {
+    if (KPM_SMS & (1u << i))
+      printf(" %s", sms_name[i]);
+  }
+  printf("\nKPM measurements:");
+  for (size_t i = 0; i < KPM_MEAS_COUNT; i++) {
+    if (KPM_MEAS_BUILT(i))
+      printf(" %s", kpm_meas[i].name);
+  }
+  printf("\nAny other argument is passed to FlexRIC (e.g. -c <conf>).\n");
+}
+
+// The coarse interval must actually be coarser than the SMs it switches
+static bool trig_cfg_ok(collector_cfg_t const *cfg) {
+  for (size_t i = 0; i < cfg->trig.n; i++) {
+    trig_field_t const *f = &trig_field[cfg->trig.r[i].field];
+    if (f->src == TRIG_SRC_RLC && !(cfg->sms & CFG_SMS_RLC)) {
+      fprintf(stderr, "Trigger field %s needs the RLC SM\n", f->fld.name);
+      return false;
+    }
+  }
+  cfg_sm_e const sw[] = {CFG_SM_MAC, CFG_SM_RLC};
+  for (size_t i = 0; i < sizeof(sw) / sizeof(sw[0]); i++) {
+    if ((cfg->sms & CFG_SMS_BIT(sw[i])) &&
+        cfg->trig_coarse_ms <= cfg->sm_interval_ms[sw[i]]) {
+      fprintf(stderr, "--trigger-coarse must exceed the %s interval\n",
+              sms_name[sw[i]]);
+      return false;
+    }
+  }
+  if (cfg->trig_hold_ms == 0 || cfg->trig_tau_ms == 0) {
+    fprintf(stderr, "--trigger-hold and --trigger-tau must be > 0\n");
+    return false;
+  }
+  if (cfg->trig_history > TRIG_MAX_HISTORY) {
+    fprintf(stderr, "--trigger-history must be <= %d\n", TRIG_MAX_HISTORY);
+    return false;
+  }
+  return true;
+}
+
+static bool validate(collector_cfg_t const *cfg) {
+  if (cfg->kpm_gran_ms == 0 || cfg->kpm_period_ms == 0 ||
+      cfg->kpm_gran_ms > cfg->kpm_period_ms) {
+    fprintf(stderr, "KPM granularity must be > 0 and <= the report period\n");
+    return false;
+  }
+
+  if (cfg->kpm_workers > KPM_POOL_MAX_WORKERS || cfg->kpm_parallel_ues == 0) {
+    fprintf(stderr, "--kpm-workers must be <= %d and --kpm-parallel-ues "
+                    "> 0\n",
+            KPM_POOL_MAX_WORKERS);
+    return false;
+  }
+
+  if (rot_policy_active(&cfg->rotate) && collector_cfg_windowed(cfg)) {
+    fprintf(stderr, "Segment rotation applies to raw rows, not to window "
+                    "summaries\n");
+    return false;
+  }
+
+  if (rot_policy_active(&cfg->rotate) && cfg->rotate.zstd_level &&
+      !rot_sink_zstd_available()) {
+    fprintf(stderr, "Built without zstd (-DKPM_WITH_ZSTD=ON); use "
+                    "--rotate-zstd=0\n");
+    return false;
+  }
+
+  if (cfg->rotate.zstd_level > 19) {
+    fprintf(stderr, "The zstd level must be <= 19\n");
+    return false;
+  }
+
+  if (cfg->replay_lossy > 1) {
+    fprintf(stderr, "--replay-lossy must be 0 or 1\n");
+    return false;
+  }
+
+  if (cfg->record[0] && cfg->replay[0]) {
+    fprintf(stderr, "--record and --replay do not go together\n");
+    return false;
+  }
+
+  if (cfg->node_poll_ms == 0) {
+    fprintf(stderr, "The node poll period must be > 0\n");
+    return false;
+  }
+
+  if (cfg->sub_threads == 0 || cfg->sub_threads > SUB_FANOUT_MAX_THREADS) {
+    fprintf(stderr, "--sub-threads must be 1..%d\n", SUB_FANOUT_MAX_THREADS);
+    return false;
+  }
+
+  if (cfg->align_window_ms == 0) {
+    fprintf(stderr, "The alignment window must be > 0\n");
+    return false;
+  }
+
+  // A UE would be evicted between two MAC reports of its own. With
+  // triggers, a quiet UE only reports at the coarse interval.
+  uint32_t const mac_ms = collector_cfg_sub_interval(cfg, CFG_SM_MAC, false);
+  if (cfg->ue_ttl_ms && cfg->ue_ttl_ms <= mac_ms) {
+    fprintf(stderr, "The UE TTL must be longer than the %s interval\n",
+            cfg->trig.n ? "trigger-coarse" : "MAC");
+    return false;
+  }
+
+  if (cfg->trig.n && !trig_cfg_ok(cfg))
+    return false;
+
+  if (cfg->metrics_port > 65535) {
+    fprintf(stderr, "The metrics port must be <= 65535\n");
+    return false;
+  }
+
+  // shm_open wants "/name"; the per-node suffix must fit, too
+  if (cfg->shm_name[0] &&
+      (cfg->shm_name[0] != '/' || strchr(cfg->shm_name + 1, '/') ||
+       strlen(cfg->shm_name) > 200)) {
+    fprintf(stderr, "The shm name must look like /name\n");
+    return false;
+  }
+
+  uint32_t const slots = cfg->shm_slots;
+  if (slots < 2 || (slots & (slots - 1)) != 0) {
+    fprintf(stderr, "The shm ring size must be a power of two >= 2\n");
+    return false;
+  }
+
+  if (!(cfg->sms & CFG_SMS_BIT(CFG_SM_MAC))) {
+    fprintf(stderr, "Rows are built on MAC reports, so --sms needs mac\n");
+    return false;
+  }
+
+  size_t n_meas = 0;
+  for (size_t i = 0; i < KPM_MEAS_COUNT; i++)
+    n_meas += cfg->kpm_meas_on[i];
+  if (n_meas == 0) {
+    fprintf(stderr, "At least one KPM measurement must be selected\n");
+    return false;
+  }
+  return true;
+}
+
+// Splits "--key=value" / "--key value"; returns the number of argv slots
+// used, 0 if argv[i] is not a collector flag
+static int split_flag(int argc, char *argv[], int i, char const **key,
+                      size_t *key_len, char const **val) {
+  char const *a = argv[i];
+  if (strncmp(a, "--", 2) != 0)
+    return 0;
+  a += 2;
+
+  char const *eq = strchr(a, '=');
+  *key = a;
+  *key_len = eq ? (size_t)(eq - a) : strlen(a);
+  if (eq) {
+    *val = eq + 1;
+    return 1;
+  }
+  *val = i + 1 < argc ? argv[i + 1] : NULL;
+  return 2;
+}
+
+bool collector_cfg_parse(collector_cfg_t *cfg, int *argc, char *argv[]) {
+  char const *key, *val;
+  size_t key_len;
+
+  // The config file goes first so flags override it wherever they appear
+  for (int i = 1; i < *argc; i++) {
+    if (strcmp(argv[i], "--help") == 0) {
+      usage(argv[0]);
+      exit(0);
+    }
+    int const n = split_flag(*argc, argv, i, &key, &key_len, &val);
+    if (n == 0 || key_len != 6 || memcmp(key, "config", 6) != 0)
+      continue;
+    if (!val) {
+      fprintf(stderr, "--config needs a value\n");
+      return false;
+    }
+    if (!collector_cfg_load_file(cfg, val))
+      return false;
+    i += n - 1;
+  }
+
+  int out = 1;
+  for (int i = 1; i < *argc; i++) {
+    int const n = split_flag(*argc, argv, i, &key, &key_len, &val);
+    bool const is_config = n && key_len == 6 && memcmp(key, "config", 6) == 0;
+    opt_def_t const *o = n ? find_opt(key, key_len) : NULL;
+
+    if (!o && !is_config) {
+      argv[out++] = argv[i];
+      continue;
+    }
+    if (!val) {
+      fprintf(stderr, "--%.*s needs a value\n", (int)key_len, key);
+      return false;
+    }
+    if (o && !apply(cfg, o, val))
+      return false;
+    i += n - 1;
+  }
+  argv[out] = NULL;
+  *argc = out;
+
+  // An SM that is not subscribed is never waited for
+  if (!(cfg->sms & CFG_SMS_BIT(CFG_SM_RLC)))
+    cfg->align_sources &= ~CFG_SRC_RLC;
+  if (!(cfg->sms & CFG_SMS_BIT(CFG_SM_PDCP)))
+    cfg->align_sources &= ~CFG_SRC_PDCP;
+  if (!(cfg->sms & CFG_SMS_KPM))
+    cfg->align_sources &= ~CFG_SRC_KPM;
+
+  return validate(cfg);
+}
+
+void collector_cfg_print(collector_cfg_t const *cfg) {
+  printf("Output: %s\n", cfg->output);
+  if (cfg->max_samples)
+    printf("Target: %lu %s\n", cfg->max_samples,
+           collector_cfg_windowed(cfg) ? "window summaries" : "samples");
+  if (cfg->duration_s)
+    printf("Duration: %u s\n", cfg->duration_s);
+  printf("Node poll: %u ms, %u subscriptions at once\n", cfg->node_poll_ms,
+         cfg->sub_threads);
+
+  printf("Intervals:");
+  for (size_t i = 0; i < CFG_SM_COUNT; i++) {
+    if (cfg->sms & CFG_SMS_BIT(i))
+      printf(" %s=%ums", sm_name[i], cfg->sm_interval_ms[i]);
+    else
+      printf(" %s=off", sm_name[i]);
+  }
+  if (!(cfg->sms & CFG_SMS_KPM))
+    printf("\nKPM: off");
+  else
+    printf("\nKPM: gran=%ums period=%ums meas=", cfg->kpm_gran_ms,
+           cfg->kpm_period_ms);
+
+  char const *sep = "";
+  for (size_t i = 0; i < KPM_MEAS_COUNT && (cfg->sms & CFG_SMS_KPM); i++) {
+    if (cfg->kpm_meas_on[i]) {
+      printf("%s%s", sep, kpm_meas[i].name);
+      sep = ",";
+    }
+  }
+  if ((cfg->sms & CFG_SMS_KPM) && cfg->kpm_workers)
+    printf(", %u decode workers from %u UEs", cfg->kpm_workers,
+           cfg->kpm_parallel_ues);
+
+  if (rot_policy_active(&cfg->rotate)) {
+    rot_policy_t const *r = &cfg->rotate;
+    printf("\nRotate:");
+    if (r->max_mb)
+      printf(" %u MB", r->max_mb);
+    if (r->max_s)
+      printf(" %u s", r->max_s);
+    if (r->keep)
+      printf(", keep %u", r->keep);
+    if (r->zstd_level)
+      printf(", zstd %u", r->zstd_level);
+    else
+      printf(", uncompressed");
+  }
+
+  if (collector_cfg_windowed(cfg)) {
+    printf("\nWindows:");
+    for (size_t i = 0; i < ROW_AGG_COUNT; i++) {
+      if (cfg->window_ms[i])
+        printf(" %s=%ums", row_agg_src_name[i], cfg->window_ms[i]);
+    }
+  }
+
+  printf("\nAlign: %s, window=%ums, sources=",
+         cfg->align == CFG_ALIGN_WAIT_ALL ? "wait-all" : "partial",
+         cfg->align_window_ms);
+  sep = "";
+  for (size_t i = 0; i < N_SRC; i++) {
+    if (cfg->align_sources & (1u << i)) {
+      printf("%s%s", sep, src_name[i]);
+      sep = ",";
+    }
+  }
+  printf("%s\n", *sep ? "" : "none");
+
+  if (cfg->trig.n) {
+    printf("Trigger: ");
+    trig_rules_print(&cfg->trig);
+    printf(", coarse=%ums, hold=%ums, tau=%ums, history=%u\n",
+           cfg->trig_coarse_ms, cfg->trig_hold_ms, cfg->trig_tau_ms,
+           cfg->trig_history);
+  }
+
+  if (cfg->feat.n) {
+    printf("Features: windows ");
+    feat_windows_print(&cfg->feat);
+    printf(" samples\n");
+  }
+
+  if (cfg->ue_ttl_ms)
+    printf("UE TTL: %ums\n", cfg->ue_ttl_ms);
+  else
+    printf("UE TTL: off\n");
+
+  if (cfg->metrics_port)
+    printf("Metrics: http://%s:%u/metrics\n", cfg->metrics_addr,
+           cfg->metrics_port);
+  if (cfg->shm_name[0])
+    printf("Publish: shm %s (%u slots)\n", cfg->shm_name, cfg->shm_slots);
+  if (cfg->zmq_endpoint[0])
+    printf("Publish: ZeroMQ %s\n", cfg->zmq_endpoint);
+  if (cfg->record[0])
+    printf("Record: %s\n", cfg->record);
+  if (cfg->replay[0] && cfg->replay_speed)
+    printf("Replay: %s at %ux\n", cfg->replay, cfg->replay_speed);
+  else if (cfg->replay[0])
+    printf("Replay: %s, unpaced\n", cfg->replay);
+  if (cfg->replay[0] && cfg->replay_lossy)
+    printf("Replay: rows dropped when the writer falls behind\n");
+  if (cfg->report[0])
+    printf("Report: %s\n", cfg->report);
+  printf("\n");
+}
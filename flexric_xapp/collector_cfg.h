@@ -0,0 +1,190 @@
+/*
+ * Collector configuration
+ * =======================
+ *
+ * Settings are built up in three layers: compiled-in defaults, an optional
+ * key = value config file (--config=FILE), then command-line flags. Flags
+ * the collector does not know are left in argv for init_fr_args.
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#ifndef COLLECTOR_CFG_H
+#define COLLECTOR_CFG_H
+
+#include "kpm_meas.h"
+#include "row_agg.h"
+#include "rot_sink.h"
+#include "row_sink.h"
+#include "trigger.h"
+#include "ue_feat.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CFG_MAX_PATH 256
+
+typedef enum {
+  CFG_SM_MAC = 0,
+  CFG_SM_RLC,
+  CFG_SM_PDCP,
+  CFG_SM_GTP,
+
+  CFG_SM_COUNT
+} cfg_sm_e;
+
+// KPM has no report interval, so it is not a cfg_sm_e; its bit comes right
+// after theirs
+#define CFG_SM_KPM CFG_SM_COUNT
+
+// SMs subscribed on each node: bit i is cfg_sm_e i, then KPM
+#define CFG_SMS_BIT(sm) (1u << (sm))
+#define CFG_SMS_MAC CFG_SMS_BIT(CFG_SM_MAC)
+#define CFG_SMS_RLC CFG_SMS_BIT(CFG_SM_RLC)
+#define CFG_SMS_PDCP CFG_SMS_BIT(CFG_SM_PDCP)
+#define CFG_SMS_GTP CFG_SMS_BIT(CFG_SM_GTP)
+#define CFG_SMS_KPM CFG_SMS_BIT(CFG_SM_KPM)
+#define CFG_SMS_ALL (CFG_SMS_BIT(CFG_SM_KPM + 1) - 1)
+
+// SMs compiled in, e.g. -DKPM_SMS="(CFG_SMS_MAC|CFG_SMS_KPM)". --sms can
+// only pick from these, and the callbacks of the others are left out.
+#ifndef KPM_SMS
+#define KPM_SMS CFG_SMS_ALL
+#endif
+#define CFG_SM_BUILT(sm) ((KPM_SMS & CFG_SMS_BIT(sm)) != 0)
+
+// How a MAC sample is joined with the other sources (see align_row)
+typedef enum {
+  CFG_ALIGN_PARTIAL = 0, // Emit on MAC with whatever is fresh
+  CFG_ALIGN_WAIT_ALL,    // Hold the row until every required source is fresh
+} cfg_align_e;
+
+// Sources a MAC sample is joined with
+#define CFG_SRC_RLC (1u << 0)
+#define CFG_SRC_PDCP (1u << 1)
+#define CFG_SRC_KPM (1u << 2)
+#define CFG_SRC_ALL (CFG_SRC_RLC | CFG_SRC_PDCP | CFG_SRC_KPM)
+
+typedef struct {
+  // Output; a ".kpmc" suffix selects the columnar sink
+  char output[CFG_MAX_PATH];
+  csv_flush_policy_t csv_flush;
+  uint64_t print_interval; // Console line every N rows, 0 = quiet
+  uint32_t stats_interval_s; // Latency/rate summary period, 0 = off
+
+  // Raw rows in rotating, compressed segments (see rot_sink.h); off unless
+  // a size or time limit is set
+  rot_policy_t rotate;
+
+  // Window summaries per SM instead of raw rows (see row_agg.h), in ms.
+  // All 0 = raw rows.
+  uint32_t window_ms[ROW_AGG_COUNT];
+
+  // Prometheus endpoint (GET /metrics), 0 = off
+  uint32_t metrics_port;
+  char metrics_addr[CFG_MAX_PATH];
+
+  // Row publishing (see row_pub.h); empty = off
+  char shm_name[CFG_MAX_PATH];
+  uint32_t shm_slots;
+  char zmq_endpoint[CFG_MAX_PATH];
+
+  // Indication log (see ind_log.h); empty = off. A replay takes the place
+  // of the RIC. replay_speed is a multiple of the recorded pace, 0 = as
+  // fast as the pipeline goes.
+  char record[CFG_MAX_PATH];
+  char replay[CFG_MAX_PATH];
+  uint32_t replay_speed;
+  // 1 = rows a full writer ring cannot take are dropped as in a live run,
+  // instead of holding the replay up
+  uint32_t replay_lossy;
+
+  // JSON summary of the run, written at the end (see run_report.h); empty
+  // = off
+  char report[CFG_MAX_PATH];
+
+  // Stop conditions, 0 = no limit. Whichever is hit first ends the run.
+  // The duration counts from the first attached node. max_samples counts
+  // window summaries instead of rows when windows are on (see row_agg.h).
+  uint64_t max_samples;
+  uint32_t duration_s;
+
+  // E2 node list diff period (see node_watch.h)
+  uint32_t node_poll_ms;
+
+  // Subscriptions of newly attached nodes issued at once, 1 = one after
+  // the other (see sub_fanout.h). More is opt-in: FlexRIC does not promise
+  // report_sm_xapp_api is safe from several threads.
+  uint32_t sub_threads;
+
+  // SMs to subscribe, CFG_SMS_* mask. One left out costs no E2 traffic
+  // and no callback work.
+  unsigned sms;
+
+  // MAC/RLC/PDCP/GTP report interval in ms, one of cfg_interval_ms[]
+  uint32_t sm_interval_ms[CFG_SM_COUNT];
+
+  // KPM subscription
+  uint32_t kpm_gran_ms;
+  uint32_t kpm_period_ms;
+  bool kpm_meas_on[KPM_MEAS_COUNT];
+
+  // Reports with at least kpm_parallel_ues UEs are decoded on a pool of
+  // kpm_workers threads (see kpm_pool.h); 0 workers = always on the caller
+  uint32_t kpm_workers;
+  uint32_t kpm_parallel_ues;
+
+  // Join: a source is fresh if its latest report is at most align_window_ms
+  // older than the MAC sample
+  cfg_align_e align;
+  uint32_t align_window_ms;
+  unsigned align_sources; // CFG_SRC_* mask
+
+  // A UE without any report for this long (stream time) is evicted: it gets
+  // one last row with ue_final set and its table entry is freed. 0 keeps
+  // every UE until the collector stops.
+  uint32_t ue_ttl_ms;
+
+  // Sampling triggers (see trigger.h). Without rules MAC/RLC stay at their
+  // interval; with them they run at trig_coarse_ms until a rule fires.
+  trig_rules_t trig;
+  uint32_t trig_coarse_ms;
+  uint32_t trig_hold_ms;
+  uint32_t trig_tau_ms;
+  uint32_t trig_history; // Rows held per node
+
+  // Rolling per-UE features over these windows (see ue_feat.h); none = off
+  feat_windows_t feat;
+} collector_cfg_t;
+
+// Intervals the FlexRIC MAC/RLC/PDCP/GTP SMs accept
+extern uint32_t const cfg_interval_ms[];
+extern size_t const cfg_interval_count;
+
+void collector_cfg_defaults(collector_cfg_t *cfg);
+
+// Applies --config and the collector flags, compacting argv so only the
+// remaining (FlexRIC) arguments are left. Returns false on a bad flag or
+// value after printing why; exits after --help.
+bool collector_cfg_parse(collector_cfg_t *cfg, int *argc, char *argv[]);
+
+// Same keys as the long flags, without the leading "--"
+bool collector_cfg_load_file(collector_cfg_t *cfg, char const *path);
+
+// kpm_meas_on as a KPM_MEAS_BIT mask
+unsigned collector_cfg_kpm_meas(collector_cfg_t const *cfg);
+
+// Subscription interval of an SM: its own, or the coarse one for MAC/RLC
+// while no trigger holds the node fine
+uint32_t collector_cfg_sub_interval(collector_cfg_t const *cfg, cfg_sm_e sm,
+                                    bool fine);
+
+// True if any SM is aggregated into windows
+bool collector_cfg_windowed(collector_cfg_t const *cfg);
+
+// "10_ms" style string for report_sm_xapp_api
+char const *collector_cfg_interval_str(uint32_t ms);
+
+void collector_cfg_print(collector_cfg_t const *cfg);
+
+#endif
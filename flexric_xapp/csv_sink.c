@@ -0,0 +1,330 @@
+/*
+ * CSV row sink
+ * ============
+ *
+ * Rows are formatted with the small integer/fixed-point routines below
+ * into one large buffer, which goes to write(2) once the flush policy
+ * triggers. Output matches the previous printf formatting.
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#include "row_sink.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// "%.4f" of -DBL_MAX is 315 characters. A row is at worst 19 float columns
+// of that and 47 integer ones of 20, each with its separator:
+// 19 * 316 + 47 * 21 = 6991 bytes
+#define CSV_MAX_FIXED 320
+#define CSV_MAX_ROW 8192
+
+typedef struct {
+  row_sink_t base;
+  int fd;
+  csv_flush_policy_t policy;
+
+  char *buf;
+  size_t len;
+  int64_t first_buffered_us; // When the oldest unwritten row was buffered
+
+  // Stats
+  int64_t opened_us;
+  uint64_t bytes_written;
+  uint64_t batches;
+} csv_sink_t;
+
+static char const header[] =
+    "timestamp,rnti,cqi,pusch_snr,pucch_snr,"
+    "dl_bler,ul_bler,dl_mcs1,dl_mcs2,ul_mcs1,ul_mcs2,"
+    "dl_tbs,ul_tbs,dl_aggr_tbs,ul_aggr_tbs,"
+    "dl_prb,ul_prb,dl_sched_rb,ul_sched_rb,"
+    "bsr,phr,frame,slot,"
+    "rlc_tx_pkts,rlc_tx_bytes,rlc_rx_pkts,rlc_rx_bytes,"
+    "rlc_txbuf,rlc_rxbuf,rlc_retx,"
+    "pdcp_tx_pkts,pdcp_tx_bytes,pdcp_rx_pkts,pdcp_rx_bytes,"
+    "dl_thp_kbps,ul_thp_kbps,rlc_sdu_delay_us,"
+    "pdcp_vol_dl_kb,pdcp_vol_ul_kb,prb_tot_dl,prb_tot_ul,"
+    "rlc_age_ms,pdcp_age_ms,kpm_age_ms,"
+    "dl_mac_kbps,ul_mac_kbps,dl_goodput_kbps,ul_goodput_kbps,"
+    "rlc_tx_kbps,rlc_rx_kbps,rlc_retx_per_s,pdcp_tx_kbps,pdcp_rx_kbps,"
+    "gtp_teid_gnb,gtp_teid_upf,gtp_qfi,gtp_tunnels,"
+    "ue_rows,ue_first_ts,ue_final,trig,"
+    "mac_ver,rlc_ver,pdcp_ver,gtp_ver,kpm_ver\n";
+
+static int64_t mono_us(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (int64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+// --- Formatting --------------------------------------------------------------
+
+static char const digits2[201] = "00010203040506070809"
+                                 "10111213141516171819"
+                                 "20212223242526272829"
+                                 "30313233343536373839"
+                                 "40414243444546474849"
+                                 "50515253545556575859"
+                                 "60616263646566676869"
+                                 "70717273747576777879"
+                                 "80818283848586878889"
+                                 "90919293949596979899";
+
+static char *fmt_u64(char *p, uint64_t v) {
+  char tmp[20];
+  char *t = tmp + sizeof(tmp);
+
+  while (v >= 100) {
+    uint64_t const r = v % 100;
+    v /= 100;
+    t -= 2;
+    memcpy(t, &digits2[r * 2], 2);
+  }
+  if (v >= 10) {
+    t -= 2;
+    memcpy(t, &digits2[v * 2], 2);
+  } else {
+    *--t = (char)('0' + v);
+  }
+
+  size_t const n = (size_t)(tmp + sizeof(tmp) - t);
+  memcpy(p, t, n);
+  return p + n;
+}
+
+static char *fmt_i64(char *p, int64_t v) {
+  if (v < 0) {
+    *p++ = '-';
+    return fmt_u64(p, (uint64_t)0 - (uint64_t)v);
+  }
+  return fmt_u64(p, (uint64_t)v);
+}
+
+// Same output as "%.<prec>f"; the rare cases it cannot get exactly right
+// fall back to snprintf
+static char *fmt_fixed(char *p, double v, unsigned prec) {
+  static double const scale[] = {1, 10, 100, 1000, 10000};
+  static uint64_t const iscale[] = {1, 10, 100, 1000, 10000};
+
+  double const a = fabs(v);
+  double const t = a * scale[prec];
+
+  // The multiply can round either way across a .5 boundary, so values that
+  // land next to one are left to printf, which rounds the exact binary value
+  if (!isfinite(v) || a >= 1e14 || fabs(t - floor(t) - 0.5) < 1e-6)
+    return p + snprintf(p, CSV_MAX_FIXED, "%.*f", (int)prec, v);
+
+  uint64_t const scaled = (uint64_t)(t + 0.5);
+  if (signbit(v))
+    *p++ = '-';
+  p = fmt_u64(p, scaled / iscale[prec]);
+  *p++ = '.';
+
+  uint64_t frac = scaled % iscale[prec];
+  for (unsigned i = prec; i > 0; i--) {
+    p[i - 1] = (char)('0' + frac % 10);
+    frac /= 10;
+  }
+  return p + prec;
+}
+
+#define U(v) (p = fmt_u64(p, (v)), *p++ = ',')
+#define I(v) (p = fmt_i64(p, (v)), *p++ = ',')
+#define F(v, n) (p = fmt_fixed(p, (v), (n)), *p++ = ',')
+
+static size_t format_row(char *p0, ue_metrics_t const *m) {
+  char *p = p0;
+
+  I(m->timestamp);
+  U(m->rnti);
+  U(m->cqi);
+  F(m->pusch_snr, 2);
+  F(m->pucch_snr, 2);
+  F(m->dl_bler, 4);
+  F(m->ul_bler, 4);
+  U(m->dl_mcs1);
+  U(m->dl_mcs2);
+  U(m->ul_mcs1);
+  U(m->ul_mcs2);
+  U(m->dl_tbs);
+  U(m->ul_tbs);
+  U(m->dl_aggr_tbs);
+  U(m->ul_aggr_tbs);
+  U(m->dl_prb);
+  U(m->ul_prb);
+  U(m->dl_sched_rb);
+  U(m->ul_sched_rb);
+  U(m->bsr);
+  I(m->phr);
+  U(m->frame);
+  U(m->slot);
+  U(m->rlc_tx_pkts);
+  U(m->rlc_tx_bytes);
+  U(m->rlc_rx_pkts);
+  U(m->rlc_rx_bytes);
+  U(m->rlc_txbuf);
+  U(m->rlc_rxbuf);
+  U(m->rlc_retx);
+  U(m->pdcp_tx_pkts);
+  U(m->pdcp_tx_bytes);
+  U(m->pdcp_rx_pkts);
+  U(m->pdcp_rx_bytes);
+  F(m->dl_thp_kbps, 2);
+  F(m->ul_thp_kbps, 2);
+  F(m->rlc_sdu_delay_us, 2);
+  I(m->pdcp_sdu_vol_dl_kb);
+  I(m->pdcp_sdu_vol_ul_kb);
+  I(m->prb_tot_dl);
+  I(m->prb_tot_ul);
+  F(m->rlc_age_ms, 3);
+  F(m->pdcp_age_ms, 3);
+  F(m->kpm_age_ms, 3);
+  F(m->dl_mac_kbps, 2);
+  F(m->ul_mac_kbps, 2);
+  F(m->dl_goodput_kbps, 2);
+  F(m->ul_goodput_kbps, 2);
+  F(m->rlc_tx_kbps, 2);
+  F(m->rlc_rx_kbps, 2);
+  F(m->rlc_retx_per_s, 2);
+  F(m->pdcp_tx_kbps, 2);
+  F(m->pdcp_rx_kbps, 2);
+  U(m->gtp_teid_gnb);
+  U(m->gtp_teid_upf);
+  U(m->gtp_qfi);
+  U(m->gtp_tunnels);
+  U(m->ue_rows);
+  I(m->first_ts);
+  U(m->final);
+  U(m->trig);
+  U(m->mac_ver);
+  U(m->rlc_ver);
+  U(m->pdcp_ver);
+  U(m->gtp_ver);
+  U(m->kpm_ver);
+
+  p[-1] = '\n';
+  return (size_t)(p - p0);
+}
+
+#undef U
+#undef I
+#undef F
+
+// --- Buffer management -------------------------------------------------------
+
+static void write_out(csv_sink_t *c) {
+  size_t off = 0;
+  while (off < c->len) {
+    ssize_t const n = write(c->fd, c->buf + off, c->len - off);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("csv_sink: write");
+      break;
+    }
+    off += (size_t)n;
+  }
+
+  if (c->len > 0) {
+    c->bytes_written += off;
+    c->batches++;
+  }
+  c->len = 0;
+}
+
+static void csv_write(row_sink_t *s, ue_metrics_t const *m) {
+  csv_sink_t *c = (csv_sink_t *)s;
+
+  if (CSV_SINK_BUF_SIZE - c->len < CSV_MAX_ROW)
+    write_out(c);
+
+  if (c->len == 0)
+    c->first_buffered_us = mono_us();
+  c->len += format_row(c->buf + c->len, m);
+
+  if (c->policy.max_bytes && c->len >= c->policy.max_bytes)
+    write_out(c);
+}
+
+static void csv_tick(row_sink_t *s) {
+  csv_sink_t *c = (csv_sink_t *)s;
+  if (c->len == 0 || c->policy.max_ms == 0)
+    return;
+  if (mono_us() - c->first_buffered_us >= (int64_t)c->policy.max_ms * 1000)
+    write_out(c);
+}
+
+static void csv_flush(row_sink_t *s) { write_out((csv_sink_t *)s); }
+
+static void csv_print_stats(row_sink_t *s) {
+  csv_sink_t *c = (csv_sink_t *)s;
+  double const secs = (double)(mono_us() - c->opened_us) / 1e6;
+
+  printf("    CSV: %lu bytes in %lu writes, %.1f KiB/s, avg batch %.1f KiB\n",
+         c->bytes_written, c->batches,
+         secs > 0 ? (double)c->bytes_written / 1024.0 / secs : 0.0,
+         c->batches ? (double)c->bytes_written / 1024.0 / (double)c->batches
+                    : 0.0);
+}
+
+static uint64_t csv_bytes(row_sink_t *s) {
+  csv_sink_t *c = (csv_sink_t *)s;
+  return c->bytes_written + c->len;
+}
+
+static void csv_close(row_sink_t *s) {
+  csv_sink_t *c = (csv_sink_t *)s;
+  write_out(c);
+  close(c->fd);
+  free(c->buf);
+  free(c);
+}
+
+row_sink_t *csv_sink_open(char const *path, csv_flush_policy_t policy) {
+  csv_sink_t *c = calloc(1, sizeof(*c));
+  if (!c)
+    return NULL;
+
+  c->buf = malloc(CSV_SINK_BUF_SIZE);
+  c->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (!c->buf || c->fd < 0) {
+    if (c->fd >= 0)
+      close(c->fd);
+    free(c->buf);
+    free(c);
+    return NULL;
+  }
+
+  if (policy.max_bytes > CSV_SINK_BUF_SIZE - CSV_MAX_ROW)
+    policy.max_bytes = CSV_SINK_BUF_SIZE - CSV_MAX_ROW;
+  c->policy = policy;
+  c->opened_us = mono_us();
+
+  // Header goes out immediately so an empty capture is still a valid CSV
+  memcpy(c->buf, header, sizeof(header) - 1);
+  c->len = sizeof(header) - 1;
+  write_out(c);
+
+  c->base.write = csv_write;
+  c->base.flush = csv_flush;
+  c->base.close = csv_close;
+  c->base.tick = csv_tick;
+  c->base.print_stats = csv_print_stats;
+  c->base.bytes = csv_bytes;
+  return &c->base;
+}
+
+row_sink_t *row_sink_open(char const *path, csv_flush_policy_t csv_policy) {
+  size_t const len = strlen(path);
+  if (len > 5 && strcmp(path + len - 5, ".kpmc") == 0)
+    return col_sink_open(path, COL_SINK_CHUNK_ROWS);
+  return csv_sink_open(path, csv_policy);
+}
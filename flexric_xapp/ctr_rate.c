@@ -0,0 +1,43 @@
+/*
+ * Counter rates
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#include "ctr_rate.h"
+
+#include <math.h>
+
+ctr_rate_step_e ctr_rate_update(ctr_rate_t *c, uint64_t val, unsigned bits,
+                                int64_t ts_us, double *per_s) {
+  uint64_t const mask = bits >= 64 ? UINT64_MAX : (1ull << bits) - 1;
+  uint64_t const quarter = mask / 4;
+  ctr_rate_t const prev = *c;
+
+  val &= mask;
+  c->val = val;
+  c->ts = ts_us;
+  *per_s = NAN;
+
+  if (prev.ts == 0)
+    return CTR_RATE_FIRST;
+
+  int64_t const dt = ts_us - prev.ts;
+  if (dt <= 0 || dt > (int64_t)CTR_RATE_GAP_MS * 1000)
+    return CTR_RATE_GAP;
+
+  ctr_rate_step_e step = CTR_RATE_OK;
+  if (val < prev.val) {
+    if (prev.val < mask - quarter || val > quarter)
+      return CTR_RATE_RESET;
+    step = CTR_RATE_WRAP;
+  }
+
+  // Modular difference, which is also right across a wrap. A reset that
+  // lands above the old value shows up as an implausible jump instead.
+  uint64_t const delta = (val - prev.val) & mask;
+  if (delta > quarter)
+    return CTR_RATE_RESET;
+  *per_s = (double)delta * 1e6 / (double)dt;
+  return step;
+}
@@ -0,0 +1,48 @@
+/*
+ * Counter rates
+ * =============
+ *
+ * Per-second rates of the cumulative counters the SMs report (aggregate
+ * TBS, RLC/PDCP bytes, RLC retransmissions). Each counter keeps its last
+ * value and the time it was sampled.
+ *
+ * A counter that goes down either wrapped (it is only 32 bits wide) or was
+ * reset: the UE re-attached, or its RNTI now belongs to a new UE whose
+ * counters start from zero. A drop is taken as a wrap only if the old value
+ * was in the top quarter of the counter's range and the new one is in the
+ * bottom quarter. Any other drop is a reset, and so is a rise of more than a
+ * quarter of the range in one step. After a reset, or a gap longer than
+ * CTR_RATE_GAP_MS, the sample becomes the new baseline and has no rate (NaN)
+ * rather than a made-up spike.
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#ifndef CTR_RATE_H
+#define CTR_RATE_H
+
+#include <stdint.h>
+
+// A longer silence means the baseline may belong to another UE
+#define CTR_RATE_GAP_MS 5000
+
+typedef enum {
+  CTR_RATE_OK = 0,
+  CTR_RATE_FIRST, // No baseline yet
+  CTR_RATE_WRAP,  // Counter wrapped; the rate is still valid
+  CTR_RATE_RESET, // Counter went back; new baseline
+  CTR_RATE_GAP,   // Too long since the baseline, or time went back
+} ctr_rate_step_e;
+
+typedef struct {
+  uint64_t val;
+  int64_t ts; // When val was sampled (us), 0 = no baseline
+} ctr_rate_t;
+
+// Takes the next sample of a counter `bits` wide (32 or 64). *per_s gets
+// the increase per second since the previous sample, or NaN unless the
+// result is CTR_RATE_OK or CTR_RATE_WRAP.
+ctr_rate_step_e ctr_rate_update(ctr_rate_t *c, uint64_t val, unsigned bits,
+                                int64_t ts_us, double *per_s);
+
+#endif
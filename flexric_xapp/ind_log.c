@@ -0,0 +1,586 @@
+/*
+ * Indication log
+ *
+ * A KPM payload (after its ind_log_ind_t, count = UE reports) is the
+ * totals below, so the reader can size its arrays once, then per UE:
+ *
+ *   uint32 n_info, uint32 n_data
+ *   per info:   uint32 meas_type_e, uint32 name length or id, name bytes
+ *   per data:   uint32 n_rec
+ *   per record: uint32 meas_value_e, 8 bytes (int_val widened, or real_val)
+ *
+ * Labels, incomplete flags, granularity and the UE ids are not kept.
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#include "ind_log.h"
+
+#include "../../../../src/util/time_now_us.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  uint32_t n_info;
+  uint32_t n_data;
+  uint32_t n_rec;
+  uint32_t name_bytes;
+} kpm_totals_t;
+
+// Records larger than this are taken as damage
+#define IND_LOG_MAX_REC (64u << 20)
+
+static size_t const pool_size[IND_POOL_COUNT] = {
+    [IND_POOL_NODE] = sizeof(e2_node_connected_xapp_t),
+    [IND_POOL_RF] = sizeof(sm_ran_function_t),
+    [IND_POOL_CU_DU] = sizeof(uint64_t),
+    [IND_POOL_UE] = sizeof(meas_report_per_ue_t),
+    [IND_POOL_INFO] = sizeof(meas_info_format_1_lst_t),
+    [IND_POOL_DATA] = sizeof(meas_data_lst_t),
+    [IND_POOL_REC] = sizeof(meas_record_lst_t),
+};
+
+static void fill_hdr(ind_log_hdr_t *h) {
+  memset(h, 0, sizeof(*h));
+  memcpy(h->magic, IND_LOG_MAGIC, sizeof(h->magic));
+  h->version = IND_LOG_VERSION;
+  h->hdr_size = sizeof(*h);
+  h->mac_ue_size = sizeof(mac_ue_stats_impl_t);
+  h->rlc_rb_size = sizeof(rlc_radio_bearer_stats_t);
+  h->pdcp_rb_size = sizeof(pdcp_radio_bearer_stats_t);
+  h->gtp_size = sizeof(gtp_ngu_t_stats_t);
+}
+
+// --- Recording ---------------------------------------------------------------
+
+bool ind_log_writer_open(ind_log_writer_t *w, char const *path) {
+  memset(w, 0, sizeof(*w));
+  snprintf(w->path, sizeof(w->path), "%s", path);
+  w->f = fopen(path, "wb");
+  if (!w->f) {
+    perror(path);
+    return false;
+  }
+  setvbuf(w->f, NULL, _IOFBF, 1u << 20);
+
+  ind_log_hdr_t h;
+  fill_hdr(&h);
+  h.start_us = time_now_us();
+  if (fwrite(&h, sizeof(h), 1, w->f) != 1) {
+    perror(path);
+    fclose(w->f);
+    return false;
+  }
+  w->bytes = sizeof(h);
+  pthread_mutex_init(&w->mtx, NULL);
+  return true;
+}
+
+// Appends to the record being built; false once out of memory
+static bool put(ind_log_writer_t *w, void const *p, size_t n) {
+  if (w->len + n > w->cap) {
+    size_t cap = w->cap ? w->cap : 4096;
+    while (cap < w->len + n)
+      cap *= 2;
+    unsigned char *buf = realloc(w->buf, cap);
+    if (!buf)
+      return false;
+    w->buf = buf;
+    w->cap = cap;
+  }
+  memcpy(w->buf + w->len, p, n);
+  w->len += n;
+  return true;
+}
+
+static bool put_u32(ind_log_writer_t *w, uint32_t v) {
+  return put(w, &v, sizeof(v));
+}
+
+static void begin(ind_log_writer_t *w, ind_log_rec_e type, int64_t ts) {
+  ind_log_rec_t const rec = {.type = type, .ts = ts};
+  w->len = 0;
+  put(w, &rec, sizeof(rec));
+}
+
+// Patches the payload length in and writes the record out whole
+static void finish(ind_log_writer_t *w, bool ok) {
+  ind_log_rec_t *rec = (ind_log_rec_t *)w->buf;
+  if (!ok || w->len < sizeof(*rec) ||
+      w->len - sizeof(*rec) > IND_LOG_MAX_REC) {
+    w->failed++;
+    return;
+  }
+  rec->len = (uint32_t)(w->len - sizeof(*rec));
+  if (fwrite(w->buf, w->len, 1, w->f) != 1) {
+    w->failed++;
+    return;
+  }
+  w->records++;
+  w->bytes += w->len;
+}
+
+void ind_log_write_nodes(ind_log_writer_t *w, int64_t ts,
+                         e2_node_arr_xapp_t const *nodes) {
+  pthread_mutex_lock(&w->mtx);
+  begin(w, IND_LOG_NODES, ts);
+  bool ok = put_u32(w, nodes->len);
+  for (size_t i = 0; ok && i < nodes->len; i++) {
+    e2_node_connected_xapp_t const *e2 = &nodes->n[i];
+    ind_log_node_t const node = {
+        .type = (uint32_t)e2->id.type,
+        .nb_id = e2->id.nb_id.nb_id,
+        .mcc = e2->id.plmn.mcc,
+        .mnc = e2->id.plmn.mnc,
+        .mnc_digit_len = e2->id.plmn.mnc_digit_len,
+        .has_cu_du_id = e2->id.cu_du_id != NULL,
+        .n_rf = (uint32_t)e2->len_rf,
+        .cu_du_id = e2->id.cu_du_id ? *e2->id.cu_du_id : 0,
+    };
+    ok = put(w, &node, sizeof(node));
+    for (size_t j = 0; ok && j < e2->len_rf; j++) {
+      uint16_t const id = e2->rf[j].id;
+      ok = put(w, &id, sizeof(id));
+    }
+  }
+  finish(w, ok);
+  pthread_mutex_unlock(&w->mtx);
+}
+
+static bool put_kpm(ind_log_writer_t *w, kpm_ind_msg_format_3_t const *f3) {
+  kpm_totals_t tot = {0};
+  for (size_t i = 0; i < f3->ue_meas_report_lst_len; i++) {
+    kpm_ind_msg_format_1_t const *f1 =
+        &f3->meas_report_per_ue[i].ind_msg_format_1;
+    tot.n_info += (uint32_t)f1->meas_info_lst_len;
+    tot.n_data += (uint32_t)f1->meas_data_lst_len;
+    for (size_t j = 0; j < f1->meas_info_lst_len; j++) {
+      meas_type_t const *t = &f1->meas_info_lst[j].meas_type;
+      if (t->type == NAME_MEAS_TYPE)
+        tot.name_bytes += (uint32_t)t->name.len;
+    }
+    for (size_t j = 0; j < f1->meas_data_lst_len; j++)
+      tot.n_rec += (uint32_t)f1->meas_data_lst[j].meas_record_len;
+  }
+
+  bool ok = put(w, &tot, sizeof(tot));
+  for (size_t i = 0; ok && i < f3->ue_meas_report_lst_len; i++) {
+    kpm_ind_msg_format_1_t const *f1 =
+        &f3->meas_report_per_ue[i].ind_msg_format_1;
+    ok = put_u32(w, (uint32_t)f1->meas_info_lst_len) &&
+         put_u32(w, (uint32_t)f1->meas_data_lst_len);
+
+    for (size_t j = 0; ok && j < f1->meas_info_lst_len; j++) {
+      meas_type_t const *t = &f1->meas_info_lst[j].meas_type;
+      ok = put_u32(w, (uint32_t)t->type);
+      if (t->type == NAME_MEAS_TYPE)
+        ok = ok && put_u32(w, (uint32_t)t->name.len) &&
+             put(w, t->name.buf, t->name.len);
+      else
+        ok = ok && put_u32(w, t->id);
+    }
+
+    for (size_t j = 0; ok && j < f1->meas_data_lst_len; j++) {
+      meas_data_lst_t const *d = &f1->meas_data_lst[j];
+      ok = put_u32(w, (uint32_t)d->meas_record_len);
+      for (size_t z = 0; ok && z < d->meas_record_len; z++) {
+        meas_record_lst_t const *rec = &d->meas_record_lst[z];
+        uint64_t bits = rec->int_val;
+        if (rec->value == REAL_MEAS_VALUE)
+          memcpy(&bits, &rec->real_val, sizeof(bits));
+        ok = put_u32(w, (uint32_t)rec->value) && put(w, &bits, sizeof(bits));
+      }
+    }
+  }
+  return ok;
+}
+
+void ind_log_write_ind(ind_log_writer_t *w, int64_t ts, uint32_t slot,
+                       uint32_t nb_id, sm_ag_if_rd_t const *rd) {
+  sm_ag_if_rd_ind_t const *ind = &rd->ind;
+  ind_log_ind_t h = {.slot = slot, .nb_id = nb_id, .sm = ind->type};
+  void const *arr = NULL;
+  size_t size = 0;
+
+  switch (ind->type) {
+  case MAC_STATS_V0:
+    h.count = ind->mac.msg.len_ue_stats;
+    h.tstamp = ind->mac.msg.tstamp;
+    arr = ind->mac.msg.ue_stats;
+    size = sizeof(mac_ue_stats_impl_t);
+    break;
+  case RLC_STATS_V0:
+    h.count = ind->rlc.msg.len;
+    h.tstamp = ind->rlc.msg.tstamp;
+    arr = ind->rlc.msg.rb;
+    size = sizeof(rlc_radio_bearer_stats_t);
+    break;
+  case PDCP_STATS_V0:
+    h.count = ind->pdcp.msg.len;
+    h.tstamp = ind->pdcp.msg.tstamp;
+    arr = ind->pdcp.msg.rb;
+    size = sizeof(pdcp_radio_bearer_stats_t);
+    break;
+  case GTP_STATS_V0:
+    h.count = ind->gtp.msg.len;
+    h.tstamp = ind->gtp.msg.tstamp;
+    arr = ind->gtp.msg.ngut;
+    size = sizeof(gtp_ngu_t_stats_t);
+    break;
+  case KPM_STATS_V3_0:
+    h.count = (uint32_t)ind->kpm.ind.msg.frm_3.ue_meas_report_lst_len;
+    h.tstamp = (int64_t)
+        ind->kpm.ind.hdr.kpm_ric_ind_hdr_format_1.collectStartTime;
+    break;
+  default:
+    return;
+  }
+
+  pthread_mutex_lock(&w->mtx);
+  begin(w, IND_LOG_IND, ts);
+  bool ok = put(w, &h, sizeof(h));
+  if (ind->type == KPM_STATS_V3_0)
+    ok = ok && put_kpm(w, &ind->kpm.ind.msg.frm_3);
+  else if (h.count)
+    ok = ok && put(w, arr, (size_t)h.count * size);
+  finish(w, ok);
+  pthread_mutex_unlock(&w->mtx);
+}
+
+void ind_log_writer_close(ind_log_writer_t *w) {
+  if (!w->f)
+    return;
+  if (fclose(w->f) != 0)
+    perror(w->path);
+  printf("Recorded %lu indication log records (%.1f MB) to %s",
+         w->records, (double)w->bytes / (1 << 20), w->path);
+  if (w->failed)
+    printf(", %lu lost", w->failed);
+  printf("\n");
+  pthread_mutex_destroy(&w->mtx);
+  free(w->buf);
+  memset(w, 0, sizeof(*w));
+}
+
+// --- Replay ------------------------------------------------------------------
+
+bool ind_log_reader_open(ind_log_reader_t *r, char const *path) {
+  memset(r, 0, sizeof(*r));
+  snprintf(r->path, sizeof(r->path), "%s", path);
+  r->f = fopen(path, "rb");
+  if (!r->f) {
+    perror(path);
+    return false;
+  }
+  setvbuf(r->f, NULL, _IOFBF, 1u << 20);
+
+  ind_log_hdr_t want;
+  fill_hdr(&want);
+  ind_log_hdr_t *h = &r->hdr;
+  char const *why = NULL;
+  if (fread(h, sizeof(*h), 1, r->f) != 1 ||
+      memcmp(h->magic, want.magic, sizeof(h->magic)) != 0)
+    why = "not an indication log";
+  else if (h->version != want.version || h->hdr_size != want.hdr_size)
+    why = "unsupported log version";
+  else if (h->mac_ue_size != want.mac_ue_size ||
+           h->rlc_rb_size != want.rlc_rb_size ||
+           h->pdcp_rb_size != want.pdcp_rb_size ||
+           h->gtp_size != want.gtp_size)
+    why = "recorded with different SM struct layouts";
+  if (why) {
+    fprintf(stderr, "%s: %s\n", path, why);
+    fclose(r->f);
+    r->f = NULL;
+    return false;
+  }
+  return true;
+}
+
+// Room for n entries of a pool; earlier contents are not kept
+static void *pool(ind_log_reader_t *r, ind_pool_e p, size_t n) {
+  if (n > r->pool_cap[p]) {
+    size_t cap = r->pool_cap[p] ? r->pool_cap[p] : 64;
+    while (cap < n)
+      cap *= 2;
+    void *mem = realloc(r->pool[p], cap * pool_size[p]);
+    if (!mem)
+      return NULL;
+    r->pool[p] = mem;
+    r->pool_cap[p] = cap;
+  }
+  return r->pool[p];
+}
+
+// Bounds-checked walk over a payload
+typedef struct {
+  unsigned char const *p;
+  unsigned char const *end;
+  bool ok;
+} cursor_t;
+
+static void const *take(cursor_t *c, size_t n) {
+  if (!c->ok || (size_t)(c->end - c->p) < n) {
+    c->ok = false;
+    return NULL;
+  }
+  void const *p = c->p;
+  c->p += n;
+  return p;
+}
+
+static uint32_t take_u32(cursor_t *c) {
+  uint32_t v = 0;
+  void const *p = take(c, sizeof(v));
+  if (p)
+    memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static bool read_nodes(ind_log_reader_t *r, cursor_t *c, ind_log_entry_t *e) {
+  uint32_t const n = take_u32(c);
+  if (!c->ok || n > UINT8_MAX)
+    return false;
+
+  // Every node has at least its fixed part, which bounds the RAN functions
+  size_t const max_rf = (size_t)(c->end - c->p) / sizeof(uint16_t);
+  e2_node_connected_xapp_t *nodes = pool(r, IND_POOL_NODE, n);
+  sm_ran_function_t *rf = pool(r, IND_POOL_RF, max_rf);
+  uint64_t *cu_du = pool(r, IND_POOL_CU_DU, n);
+  if ((n && (!nodes || !cu_du)) || (max_rf && !rf))
+    return false;
+
+  size_t used_rf = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    ind_log_node_t node;
+    void const *p = take(c, sizeof(node));
+    if (!p)
+      return false;
+    memcpy(&node, p, sizeof(node));
+
+    e2_node_connected_xapp_t *e2 = &nodes[i];
+    memset(e2, 0, sizeof(*e2));
+    e2->id.type = (ngran_node_t)node.type;
+    e2->id.nb_id.nb_id = node.nb_id;
+    e2->id.plmn.mcc = node.mcc;
+    e2->id.plmn.mnc = node.mnc;
+    e2->id.plmn.mnc_digit_len = node.mnc_digit_len;
+    if (node.has_cu_du_id) {
+      cu_du[i] = node.cu_du_id;
+      e2->id.cu_du_id = &cu_du[i];
+    }
+
+    if (node.n_rf > max_rf - used_rf)
+      return false;
+    e2->rf = &rf[used_rf];
+    e2->len_rf = node.n_rf;
+    for (uint32_t j = 0; j < node.n_rf; j++) {
+      uint16_t id = 0;
+      void const *q = take(c, sizeof(id));
+      if (!q)
+        return false;
+      memcpy(&id, q, sizeof(id));
+      memset(&rf[used_rf], 0, sizeof(rf[used_rf]));
+      rf[used_rf++].id = id;
+    }
+  }
+
+  e->nodes.n = nodes;
+  e->nodes.len = (uint8_t)n;
+  return c->ok;
+}
+
+static bool read_kpm(ind_log_reader_t *r, cursor_t *c, uint32_t n_ue,
+                     kpm_ind_msg_format_3_t *f3) {
+  kpm_totals_t tot;
+  void const *p = take(c, sizeof(tot));
+  if (!p)
+    return false;
+  memcpy(&tot, p, sizeof(tot));
+
+  // Each entry takes at least 4 bytes of payload, which bounds the totals
+  size_t const left = (size_t)(c->end - c->p);
+  if (tot.n_info > left / 4 || tot.n_data > left / 4 || tot.n_rec > left / 4 ||
+      n_ue > left / 8)
+    return false;
+
+  meas_report_per_ue_t *ue = pool(r, IND_POOL_UE, n_ue);
+  meas_info_format_1_lst_t *info = pool(r, IND_POOL_INFO, tot.n_info);
+  meas_data_lst_t *data = pool(r, IND_POOL_DATA, tot.n_data);
+  meas_record_lst_t *rec = pool(r, IND_POOL_REC, tot.n_rec);
+  if ((n_ue && !ue) || (tot.n_info && !info) || (tot.n_data && !data) ||
+      (tot.n_rec && !rec))
+    return false;
+
+  size_t i_info = 0, i_data = 0, i_rec = 0;
+  for (uint32_t i = 0; i < n_ue; i++) {
+    memset(&ue[i], 0, sizeof(ue[i]));
+    kpm_ind_msg_format_1_t *f1 = &ue[i].ind_msg_format_1;
+    uint32_t const n_info = take_u32(c);
+    uint32_t const n_data = take_u32(c);
+    if (!c->ok || n_info > tot.n_info - i_info ||
+        n_data > tot.n_data - i_data)
+      return false;
+
+    f1->meas_info_lst = &info[i_info];
+    f1->meas_info_lst_len = n_info;
+    for (uint32_t j = 0; j < n_info; j++) {
+      meas_info_format_1_lst_t *m = &info[i_info++];
+      memset(m, 0, sizeof(*m));
+      m->meas_type.type = (meas_type_e)take_u32(c);
+      uint32_t const v = take_u32(c);
+      if (m->meas_type.type == NAME_MEAS_TYPE) {
+        // Names stay in the payload; nothing reads them as C strings
+        m->meas_type.name.buf = (uint8_t *)take(c, v);
+        m->meas_type.name.len = v;
+      } else {
+        m->meas_type.id = (uint16_t)v;
+      }
+    }
+
+    f1->meas_data_lst = &data[i_data];
+    f1->meas_data_lst_len = n_data;
+    for (uint32_t j = 0; j < n_data; j++) {
+      meas_data_lst_t *d = &data[i_data++];
+      memset(d, 0, sizeof(*d));
+      uint32_t const n_rec = take_u32(c);
+      if (!c->ok || n_rec > tot.n_rec - i_rec)
+        return false;
+      d->meas_record_lst = &rec[i_rec];
+      d->meas_record_len = n_rec;
+      for (uint32_t z = 0; z < n_rec; z++) {
+        meas_record_lst_t *m = &rec[i_rec++];
+        memset(m, 0, sizeof(*m));
+        m->value = (meas_value_e)take_u32(c);
+        uint64_t bits = 0;
+        void const *q = take(c, sizeof(bits));
+        if (q)
+          memcpy(&bits, q, sizeof(bits));
+        if (m->value == REAL_MEAS_VALUE)
+          memcpy(&m->real_val, &bits, sizeof(bits));
+        else
+          m->int_val = (uint32_t)bits;
+      }
+    }
+    if (!c->ok)
+      return false;
+  }
+
+  f3->meas_report_per_ue = ue;
+  f3->ue_meas_report_lst_len = n_ue;
+  return true;
+}
+
+static bool read_ind(ind_log_reader_t *r, cursor_t *c, ind_log_entry_t *e) {
+  ind_log_ind_t h;
+  void const *p = take(c, sizeof(h));
+  if (!p)
+    return false;
+  memcpy(&h, p, sizeof(h));
+  e->slot = h.slot;
+  e->nb_id = h.nb_id;
+
+  sm_ag_if_rd_t *rd = &e->rd;
+  memset(rd, 0, sizeof(*rd));
+  rd->type = INDICATION_MSG_AGENT_IF_ANS_V0;
+  rd->ind.type = (sm_ag_if_rd_ind_e)h.sm;
+
+  // The payload buffer is malloc-aligned and ind_log_ind_t is 8-byte
+  // sized, so the stats arrays can be used where they are
+  size_t size = 0;
+  switch (rd->ind.type) {
+  case MAC_STATS_V0:
+    size = sizeof(mac_ue_stats_impl_t);
+    break;
+  case RLC_STATS_V0:
+    size = sizeof(rlc_radio_bearer_stats_t);
+    break;
+  case PDCP_STATS_V0:
+    size = sizeof(pdcp_radio_bearer_stats_t);
+    break;
+  case GTP_STATS_V0:
+    size = sizeof(gtp_ngu_t_stats_t);
+    break;
+  case KPM_STATS_V3_0:
+    rd->ind.kpm.ind.hdr.kpm_ric_ind_hdr_format_1.collectStartTime =
+        (uint64_t)h.tstamp;
+    rd->ind.kpm.ind.msg.type = FORMAT_3_INDICATION_MESSAGE;
+    return read_kpm(r, c, h.count, &rd->ind.kpm.ind.msg.frm_3);
+  default:
+    return false;
+  }
+
+  if (h.count > (size_t)(c->end - c->p) / size)
+    return false;
+  void *arr = (void *)take(c, (size_t)h.count * size);
+  switch (rd->ind.type) {
+  case MAC_STATS_V0:
+    rd->ind.mac.msg = (mac_ind_msg_t){
+        .len_ue_stats = h.count, .ue_stats = arr, .tstamp = h.tstamp};
+    break;
+  case RLC_STATS_V0:
+    rd->ind.rlc.msg =
+        (rlc_ind_msg_t){.len = h.count, .rb = arr, .tstamp = h.tstamp};
+    break;
+  case PDCP_STATS_V0:
+    rd->ind.pdcp.msg =
+        (pdcp_ind_msg_t){.len = h.count, .rb = arr, .tstamp = h.tstamp};
+    break;
+  default:
+    rd->ind.gtp.msg =
+        (gtp_ind_msg_t){.len = h.count, .ngut = arr, .tstamp = h.tstamp};
+    break;
+  }
+  return c->ok;
+}
+
+bool ind_log_reader_next(ind_log_reader_t *r, ind_log_entry_t *e) {
+  ind_log_rec_t rec;
+  if (!r->f || fread(&rec, sizeof(rec), 1, r->f) != 1)
+    return false;
+  if (rec.len > IND_LOG_MAX_REC) {
+    fprintf(stderr, "%s: damaged record after %lu\n", r->path, r->records);
+    return false;
+  }
+
+  if (rec.len > r->payload_cap) {
+    size_t cap = r->payload_cap ? r->payload_cap : 4096;
+    while (cap < rec.len)
+      cap *= 2;
+    unsigned char *buf = realloc(r->payload, cap);
+    if (!buf)
+      return false;
+    r->payload = buf;
+    r->payload_cap = cap;
+  }
+  if (rec.len && fread(r->payload, rec.len, 1, r->f) != 1) {
+    fprintf(stderr, "%s: log ends inside record %lu\n", r->path, r->records);
+    return false;
+  }
+
+  memset(e, 0, sizeof(*e));
+  e->type = (ind_log_rec_e)rec.type;
+  e->ts = rec.ts;
+  cursor_t c = {r->payload, r->payload + rec.len, true};
+  bool ok = false;
+  if (e->type == IND_LOG_NODES)
+    ok = read_nodes(r, &c, e);
+  else if (e->type == IND_LOG_IND)
+    ok = read_ind(r, &c, e);
+  if (!ok) {
+    fprintf(stderr, "%s: damaged record %lu\n", r->path, r->records);
+    return false;
+  }
+  r->records++;
+  return true;
+}
+
+void ind_log_reader_close(ind_log_reader_t *r) {
+  if (r->f)
+    fclose(r->f);
+  free(r->payload);
+  for (size_t i = 0; i < IND_POOL_COUNT; i++)
+    free(r->pool[i]);
+  memset(r, 0, sizeof(*r));
+}
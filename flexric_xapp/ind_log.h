@@ -0,0 +1,168 @@
+/*
+ * Indication log
+ * ==============
+ *
+ * --record=FILE keeps every indication the collector handles, as FlexRIC
+ * decoded it, in a compact binary log. --replay=FILE later feeds such a log
+ * through the same callbacks without a RIC, gNB or UE, at the recorded pace
+ * or faster. The same log always gives the same rows, so it serves both as
+ * a throughput benchmark and as a way to rebuild a dataset after new
+ * derived fields are added.
+ *
+ * The file is an ind_log_hdr_t and then records, each an ind_log_rec_t and
+ * its payload, all in host byte order:
+ *
+ *   IND_LOG_NODES  The RIC's node list at one poll: a uint32 node count,
+ *                  then per node an ind_log_node_t and its RAN function
+ *                  ids (uint16 each). Replay diffs these like live polls.
+ *   IND_LOG_IND    One indication: an ind_log_ind_t, then for MAC, RLC,
+ *                  PDCP and GTP the SM's own stats array (count entries).
+ *                  KPM keeps only what on_kpm reads: see ind_log.c.
+ *
+ * The stats arrays are copied as they are, so a log only replays on a
+ * build with the same SM struct layouts. The header records their sizes
+ * and the reader refuses a log that does not match.
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#ifndef IND_LOG_H
+#define IND_LOG_H
+
+#include "../../../../src/xApp/e42_xapp_api.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define IND_LOG_MAGIC "KPMREC\0\0"
+#define IND_LOG_VERSION 1
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t hdr_size; // sizeof(ind_log_hdr_t)
+  uint32_t mac_ue_size; // sizeof(mac_ue_stats_impl_t)
+  uint32_t rlc_rb_size; // sizeof(rlc_radio_bearer_stats_t)
+  uint32_t pdcp_rb_size; // sizeof(pdcp_radio_bearer_stats_t)
+  uint32_t gtp_size; // sizeof(gtp_ngu_t_stats_t)
+  int64_t start_us; // When recording started (us since epoch)
+} ind_log_hdr_t;
+
+typedef enum {
+  IND_LOG_NODES = 1,
+  IND_LOG_IND,
+} ind_log_rec_e;
+
+typedef struct {
+  uint32_t type; // ind_log_rec_e
+  uint32_t len;  // Payload bytes that follow
+  int64_t ts;    // When the collector got it (us since epoch)
+} ind_log_rec_t;
+
+typedef struct {
+  uint32_t type; // ngran_node_t
+  uint32_t nb_id;
+  uint16_t mcc;
+  uint16_t mnc;
+  uint16_t mnc_digit_len;
+  uint16_t has_cu_du_id;
+  uint32_t n_rf;
+  uint64_t cu_du_id;
+} ind_log_node_t;
+
+typedef struct {
+  uint32_t slot;  // Node slot it was handled on
+  uint32_t nb_id; // Checked against the slot's node on replay
+  uint32_t sm;    // sm_ag_if_rd_ind_e
+  uint32_t count; // Stats array entries, or KPM UE reports
+  int64_t tstamp; // SM tstamp, or KPM collectStartTime
+} ind_log_ind_t;
+
+_Static_assert(sizeof(ind_log_hdr_t) == 40, "ind_log_hdr_t layout changed");
+_Static_assert(sizeof(ind_log_rec_t) == 16, "ind_log_rec_t layout changed");
+_Static_assert(sizeof(ind_log_node_t) == 32, "ind_log_node_t layout changed");
+_Static_assert(sizeof(ind_log_ind_t) == 24, "ind_log_ind_t layout changed");
+
+// --- Recording ---------------------------------------------------------------
+
+// Safe from any thread; records are written whole, in arrival order
+typedef struct {
+  FILE *f;
+  char path[256];
+  pthread_mutex_t mtx;
+
+  // Under mtx: the record being built
+  unsigned char *buf;
+  size_t len;
+  size_t cap;
+
+  uint64_t records;
+  uint64_t bytes;
+  uint64_t failed; // Records lost to allocation or write errors
+} ind_log_writer_t;
+
+bool ind_log_writer_open(ind_log_writer_t *w, char const *path);
+
+void ind_log_write_nodes(ind_log_writer_t *w, int64_t ts,
+                         e2_node_arr_xapp_t const *nodes);
+
+void ind_log_write_ind(ind_log_writer_t *w, int64_t ts, uint32_t slot,
+                       uint32_t nb_id, sm_ag_if_rd_t const *rd);
+
+void ind_log_writer_close(ind_log_writer_t *w);
+
+// --- Replay ------------------------------------------------------------------
+
+typedef struct {
+  ind_log_rec_e type;
+  int64_t ts;
+
+  // IND_LOG_NODES, owned by the reader
+  e2_node_arr_xapp_t nodes;
+
+  // IND_LOG_IND
+  uint32_t slot;
+  uint32_t nb_id;
+  sm_ag_if_rd_t rd;
+} ind_log_entry_t;
+
+// Arrays an entry is rebuilt into. Stats arrays and KPM names point into
+// the payload itself.
+typedef enum {
+  IND_POOL_NODE = 0, // e2_node_connected_xapp_t
+  IND_POOL_RF,       // sm_ran_function_t
+  IND_POOL_CU_DU,    // uint64_t
+  IND_POOL_UE,       // meas_report_per_ue_t
+  IND_POOL_INFO,     // meas_info_format_1_lst_t
+  IND_POOL_DATA,     // meas_data_lst_t
+  IND_POOL_REC,      // meas_record_lst_t
+
+  IND_POOL_COUNT
+} ind_pool_e;
+
+typedef struct {
+  FILE *f;
+  char path[256];
+  ind_log_hdr_t hdr;
+
+  // Reused from record to record
+  unsigned char *payload;
+  size_t payload_cap;
+  void *pool[IND_POOL_COUNT];
+  size_t pool_cap[IND_POOL_COUNT];
+
+  uint64_t records;
+} ind_log_reader_t;
+
+bool ind_log_reader_open(ind_log_reader_t *r, char const *path);
+
+// The next record. Everything it points to stays valid until the next
+// call. False at the end of the log, or at a damaged or cut-off record.
+bool ind_log_reader_next(ind_log_reader_t *r, ind_log_entry_t *e);
+
+void ind_log_reader_close(ind_log_reader_t *r);
+
+#endif
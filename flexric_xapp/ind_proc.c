@@ -0,0 +1,780 @@
+/*
+ * Indication processing
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#include "ind_proc.h"
+#include "kpm_meas.h"
+#include "stop_event.h"
+
+#include "../../../../src/sm/kpm_sm/kpm_sm_v03.00/ie/kpm_data_ie.h"
+#include "../../../../src/util/time_now_us.h"
+
+#include <assert.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+_Static_assert((int)NODE_SUB_MAC == CFG_SM_MAC &&
+                   (int)NODE_SUB_RLC == CFG_SM_RLC &&
+                   (int)NODE_SUB_PDCP == CFG_SM_PDCP &&
+                   (int)NODE_SUB_GTP == CFG_SM_GTP &&
+                   (int)NODE_SUB_KPM == CFG_SM_KPM,
+               "node_sub_e must follow the CFG_SMS_* bits");
+
+void ind_proc_init(ind_proc_t *p, collector_cfg_t const *cfg) {
+  memset(p, 0, sizeof(*p));
+  p->cfg = cfg;
+  atomic_init(&p->samples, 0);
+}
+
+// Time an indication is taken to arrive at
+static int64_t now_us(ind_proc_t const *p) {
+  return p->clock_us ? p->clock_us : time_now_us();
+}
+
+// Queues a record for the node's writer. A replay has no deadline, so it
+// waits for room instead of dropping: the same log always gives the same
+// output. A stop ends the wait, as the writer may be gone by then. A drop
+// is counted only for a record given up on, and a thread without a ring
+// of its own gives up at once. Caller holds n->mtx.
+static bool push_rec(ind_proc_t *p, node_ctx_t *n, ue_metrics_t const *m) {
+  for (;;) {
+    row_writer_push_e const res = row_writer_try_push(&n->writer, m);
+    if (res == ROW_WRITER_OK)
+      return true;
+    if (res == ROW_WRITER_NO_RING || !p->lossless || stop_event_raised()) {
+      row_writer_drop(&n->writer);
+      return false;
+    }
+    sched_yield();
+  }
+}
+
+// Hands a row to the node's writer thread. Caller holds n->mtx. False if
+// the budget is used up or the ring is full. With windows on, the budget
+// counts summaries instead and is kept by the window sink (see row_agg.h).
+static bool push_row(ind_proc_t *p, node_ctx_t *n, ue_metrics_t *m) {
+  // Nodes race for the shared sample budget, so reserve before pushing
+  uint64_t const target =
+      collector_cfg_windowed(p->cfg) ? 0 : p->cfg->max_samples;
+  uint64_t c = atomic_load_explicit(&p->samples, memory_order_relaxed);
+  do {
+    if (target && c >= target)
+      return false;
+  } while (!atomic_compare_exchange_weak_explicit(
+      &p->samples, &c, c + 1, memory_order_relaxed, memory_order_relaxed));
+
+  m->enq_ns = lat_now_ns();
+  m->ue_rows++;
+  if (!push_rec(p, n, m)) {
+    m->ue_rows--;
+    atomic_fetch_sub_explicit(&p->samples, 1, memory_order_relaxed);
+    return false;
+  }
+
+  if (c + 1 == target) {
+    printf("\nReached target of %lu samples\n", target);
+    stop_event_raise();
+  }
+  return true;
+}
+
+// Queues one RLC/PDCP/KPM report for the window summaries of its SM, if
+// that SM has any. Such a record is not a row and has no budget; a replay
+// waits for room as it does for rows. Caller holds n->mtx.
+static void push_report(ind_proc_t *p, node_ctx_t *n, ue_metrics_t const *m,
+                        ue_rec_e rec, row_agg_src_e src) {
+  if (p->cfg->window_ms[src] == 0)
+    return;
+
+  ue_metrics_t r = *m;
+  r.rec = (uint8_t)rec;
+  r.enq_ns = 0;
+  push_rec(p, n, &r);
+}
+
+// Whether a row goes out now under the sampling triggers. A hot UE's rows
+// all do; a quiet one's are thinned to the coarse rate, the rest held.
+// Coarse reports jitter around their interval, so 3/4 of it is enough.
+static bool trig_admit(ind_proc_t *p, node_ctx_t *n, ue_metrics_t *m) {
+  trig_ue_t *u = &n->trig->ue[m - n->ues.ues];
+  if (u->hot_until > m->timestamp) {
+    m->trig = TRIG_ROW_HOT;
+    return true;
+  }
+
+  m->trig = TRIG_ROW_STEADY;
+  int64_t const coarse = (int64_t)p->cfg->trig_coarse_ms * 1000;
+  if (u->out_ts == 0 || m->timestamp - u->out_ts >= coarse / 4 * 3) {
+    u->out_ts = m->timestamp;
+    return true;
+  }
+  trig_node_hold(n->trig, m);
+  return false;
+}
+
+// Hands the UE snapshot to the node's writer thread. Caller holds n->mtx.
+// False if the row was not written (no MAC yet, held by the triggers,
+// budget used up, ring full).
+static bool emit_row(ind_proc_t *p, node_ctx_t *n, ue_metrics_t *m) {
+  if (!m->mac_valid)
+    return false;
+  if (n->trig && !trig_admit(p, n, m))
+    return false;
+  return push_row(p, n, m);
+}
+
+typedef struct {
+  ind_proc_t *p;
+  node_ctx_t *n;
+  ue_metrics_t *ue; // Table record the held rows belong to
+} release_t;
+
+static bool emit_held(void *arg, ue_metrics_t *h) {
+  release_t *r = arg;
+  h->trig = TRIG_ROW_HISTORY;
+  h->ue_rows = r->ue->ue_rows;
+  if (!push_row(r->p, r->n, h))
+    return false;
+  r->ue->ue_rows = h->ue_rows;
+  return true;
+}
+
+// Runs the rules on the UE's latest src report. A UE that turns hot has
+// its held rows written first, and the node is flagged fine for the main
+// thread to resubscribe. Caller holds n->mtx.
+static void trig_update(ind_proc_t *p, node_ctx_t *n, ue_metrics_t *m,
+                        trig_src_e src, int64_t now) {
+  collector_cfg_t const *cfg = p->cfg;
+  trig_node_t *t = n->trig;
+  trig_ue_t *u = &t->ue[m - n->ues.ues];
+  if (!trig_eval(&cfg->trig, src, u, m, now, (int64_t)cfg->trig_tau_ms * 1000))
+    return;
+
+  if (u->hot_until <= now) {
+    t->fired++;
+    release_t r = {p, n, m};
+    trig_node_release(t, m->rnti, emit_held, &r);
+  }
+  u->hot_until = now + (int64_t)cfg->trig_hold_ms * 1000;
+  if (u->hot_until > t->fine_until)
+    t->fine_until = u->hot_until;
+
+  if (!atomic_load_explicit(&t->want_fine, memory_order_relaxed)) {
+    atomic_store_explicit(&t->want_fine, true, memory_order_relaxed);
+    stop_event_nudge();
+  }
+}
+
+// Back to coarse once the last hot UE has cooled down. Caller holds n->mtx.
+static void trig_cool(node_ctx_t *n, int64_t now) {
+  trig_node_t *t = n->trig;
+  if (now >= t->fine_until &&
+      atomic_load_explicit(&t->want_fine, memory_order_relaxed)) {
+    atomic_store_explicit(&t->want_fine, false, memory_order_relaxed);
+    stop_event_nudge();
+  }
+}
+
+// Table entry of a UE named in a report received at now, NULL if the table
+// is full. Caller holds n->mtx.
+static ue_metrics_t *track(node_ctx_t *n, uint32_t rnti, int64_t now) {
+  ue_metrics_t *m = ue_table_upsert(&n->ues, rnti);
+  if (!m || m->first_ts != 0)
+    return m;
+  m->first_ts = now;
+  if (n->trig)
+    memset(&n->trig->ue[m - n->ues.ues], 0, sizeof(trig_ue_t));
+  return m;
+}
+
+static bool fresh(int64_t src_ts, int64_t ts, int64_t window_us) {
+  return src_ts != 0 && llabs(ts - src_ts) <= window_us;
+}
+
+static double age_ms(int64_t src_ts, int64_t ts) {
+  return src_ts ? (double)(ts - src_ts) / 1000.0 : NAN;
+}
+
+// Joins the UE's MAC sample with its latest RLC/PDCP report and the node's
+// KPM totals. Under wait-all the sample stays pending until every required
+// source is within the window of it. Caller holds n->mtx.
+static void align_row(ind_proc_t *p, node_ctx_t *n, ue_metrics_t *m) {
+  int64_t const window = (int64_t)p->cfg->align_window_ms * 1000;
+  unsigned const req = p->cfg->align_sources;
+  int64_t const ts = m->timestamp;
+
+  bool const complete =
+      (!(req & CFG_SRC_RLC) || fresh(m->rlc_ts, ts, window)) &&
+      (!(req & CFG_SRC_PDCP) || fresh(m->pdcp_ts, ts, window)) &&
+      (!(req & CFG_SRC_KPM) || fresh(n->kpm.ts, ts, window));
+
+  if (!complete && p->cfg->align == CFG_ALIGN_WAIT_ALL) {
+    m->pending = 1;
+    return;
+  }
+  m->pending = 0;
+  m->dl_thp_kbps = n->kpm.dl_thp_kbps;
+  m->ul_thp_kbps = n->kpm.ul_thp_kbps;
+  m->rlc_sdu_delay_us = n->kpm.rlc_sdu_delay_us;
+  m->pdcp_sdu_vol_dl_kb = n->kpm.pdcp_sdu_vol_dl_kb;
+  m->pdcp_sdu_vol_ul_kb = n->kpm.pdcp_sdu_vol_ul_kb;
+  m->prb_tot_dl = n->kpm.prb_tot_dl;
+  m->prb_tot_ul = n->kpm.prb_tot_ul;
+  m->kpm_valid = n->kpm.kpm_valid;
+  m->kpm_ts = n->kpm.ts;
+  m->kpm_ver = n->kpm.seq;
+
+  m->rlc_age_ms = age_ms(m->rlc_ts, ts);
+  m->pdcp_age_ms = age_ms(m->pdcp_ts, ts);
+  m->kpm_age_ms = age_ms(n->kpm.ts, ts);
+
+  if (emit_row(p, n, m)) {
+    if (complete)
+      n->rows_complete++;
+    else
+      n->rows_partial++;
+  }
+}
+
+// A source report arrived for a UE with a held MAC sample
+static void retry_pending(ind_proc_t *p, node_ctx_t *n, ue_metrics_t *m,
+                          int64_t now) {
+  if (now - m->timestamp > (int64_t)p->cfg->align_window_ms * 1000) {
+    m->pending = 0;
+    n->rows_dropped++;
+    return;
+  }
+  align_row(p, n, m);
+}
+
+// Last row of an evicted UE: its latest state, stamped with the eviction
+// time and flagged final. It is outside the sample budget, so every UE that
+// had a row gets one. Caller holds n->mtx.
+static void emit_final(ind_proc_t *p, node_ctx_t *n, ue_metrics_t const *m,
+                       int64_t now) {
+  if (m->ue_rows == 0)
+    return;
+
+  ue_metrics_t f = *m;
+  f.timestamp = now;
+  f.ue_rows++;
+  f.final = 1;
+  f.pending = 0;
+  f.rlc_age_ms = age_ms(f.rlc_ts, now);
+  f.pdcp_age_ms = age_ms(f.pdcp_ts, now);
+  f.kpm_age_ms = age_ms(f.kpm_ts, now);
+
+  f.enq_ns = lat_now_ns();
+  push_rec(p, n, &f);
+}
+
+static int64_t last_seen(ue_metrics_t const *m) {
+  int64_t t = m->timestamp;
+  if (m->rlc_ts > t)
+    t = m->rlc_ts;
+  if (m->pdcp_ts > t)
+    t = m->pdcp_ts;
+  if (m->gtp_ts > t)
+    t = m->gtp_ts;
+  return t;
+}
+
+// Frees the entries of UEs that no SM reported for ue_ttl_ms. Runs on the
+// stream clock, so a replay evicts the same UEs at any speed. Removal does
+// not move pool entries, so the scan can drop them as it goes. Caller
+// holds n->mtx.
+static void evict_idle(ind_proc_t *p, node_ctx_t *n, int64_t now) {
+  int64_t const ttl = (int64_t)p->cfg->ue_ttl_ms * 1000;
+  int64_t const every = ttl / 4 < 1000000 ? ttl / 4 : 1000000;
+  if (ttl == 0 || now - n->evict_ts < every)
+    return;
+  n->evict_ts = now;
+
+  for (size_t i = 0; i < UE_TABLE_MAX_LOAD; i++) {
+    ue_metrics_t *m = ue_table_at(&n->ues, i);
+    if (!m || now - last_seen(m) < ttl)
+      continue;
+    if (m->pending)
+      n->rows_dropped++;
+    emit_final(p, n, m, now);
+    if (n->trig)
+      trig_node_release(n->trig, m->rnti, NULL, NULL);
+    ue_table_remove(&n->ues, m->rnti);
+    atomic_fetch_add_explicit(&n->evicted, 1, memory_order_relaxed);
+  }
+}
+
+// Per-second rate of one cumulative counter. Caller holds n->mtx.
+static double ctr_rate(node_ctx_t *n, ctr_rate_t *c, uint64_t val,
+                       unsigned bits, int64_t ts) {
+  double r;
+  switch (ctr_rate_update(c, val, bits, ts, &r)) {
+  case CTR_RATE_WRAP:
+    n->ctr_wraps++;
+    break;
+  case CTR_RATE_RESET:
+  case CTR_RATE_GAP:
+    n->ctr_resets++;
+    break;
+  default:
+    break;
+  }
+  return r;
+}
+
+static double kbps(double bytes_per_s) { return bytes_per_s * 8.0 / 1000.0; }
+
+static double goodput(double kbps, float bler) {
+  double const ok = bler < 0 ? 1.0 : bler > 1 ? 0.0 : 1.0 - bler;
+  return kbps * ok;
+}
+
+// Rates are timed by the node's own report timestamp when there is one,
+// so transport jitter does not show up as rate noise
+static int64_t rate_ts(int64_t tstamp, int64_t now) {
+  return tstamp > 0 ? tstamp : now;
+}
+
+// MAC callback
+static void on_mac(ind_proc_t *p, node_ctx_t *n, sm_ag_if_rd_t const *rd) {
+  assert(rd != NULL);
+  assert(rd->type == INDICATION_MSG_AGENT_IF_ANS_V0);
+  assert(rd->ind.type == MAC_STATS_V0);
+
+  mac_ind_msg_t const *msg = &rd->ind.mac.msg;
+  if (msg->len_ue_stats == 0)
+    return;
+
+  int64_t const now = now_us(p);
+  int64_t const ts = rate_ts(msg->tstamp, now);
+
+  pthread_mutex_lock(&n->mtx);
+
+  for (size_t i = 0; i < msg->len_ue_stats; i++) {
+    mac_ue_stats_impl_t const *ue = &msg->ue_stats[i];
+    ue_metrics_t *m = track(n, ue->rnti, now);
+    if (!m)
+      continue;
+    if (ue_table_write_begin(&n->ues, m))
+      m->mac_ver++;
+
+    // The previous sample never got its sources in time
+    if (m->pending) {
+      m->pending = 0;
+      n->rows_dropped++;
+    }
+
+    m->timestamp = now;
+    m->cqi = ue->wb_cqi;
+    m->pusch_snr = ue->pusch_snr;
+    m->pucch_snr = ue->pucch_snr;
+    m->dl_bler = ue->dl_bler;
+    m->ul_bler = ue->ul_bler;
+    m->dl_mcs1 = ue->dl_mcs1;
+    m->dl_mcs2 = ue->dl_mcs2;
+    m->ul_mcs1 = ue->ul_mcs1;
+    m->ul_mcs2 = ue->ul_mcs2;
+    m->dl_tbs = ue->dl_curr_tbs;
+    m->ul_tbs = ue->ul_curr_tbs;
+    m->dl_aggr_tbs = ue->dl_aggr_tbs;
+    m->ul_aggr_tbs = ue->ul_aggr_tbs;
+    m->dl_prb = ue->dl_aggr_prb;
+    m->ul_prb = ue->ul_aggr_prb;
+    m->dl_sched_rb = ue->dl_sched_rb;
+    m->ul_sched_rb = ue->ul_sched_rb;
+    m->bsr = ue->bsr;
+    m->phr = ue->phr;
+    m->frame = ue->frame;
+    m->slot = ue->slot;
+    m->mac_valid = 1;
+
+    ctr_rate_t *c = ue_table_ctr(&n->ues, m);
+    m->dl_mac_kbps =
+        kbps(ctr_rate(n, &c[UE_CTR_DL_TBS], m->dl_aggr_tbs, 64, ts));
+    m->ul_mac_kbps =
+        kbps(ctr_rate(n, &c[UE_CTR_UL_TBS], m->ul_aggr_tbs, 64, ts));
+    m->dl_goodput_kbps = goodput(m->dl_mac_kbps, m->dl_bler);
+    m->ul_goodput_kbps = goodput(m->ul_mac_kbps, m->ul_bler);
+
+    if (n->trig)
+      trig_update(p, n, m, TRIG_SRC_MAC, now);
+
+    // At most one row per UE per MAC tick
+    align_row(p, n, m);
+    ue_table_write_end(&n->ues, m);
+  }
+
+  if (n->trig)
+    trig_cool(n, now);
+  evict_idle(p, n, now);
+  pthread_mutex_unlock(&n->mtx);
+}
+
+// RLC callback
+static void on_rlc(ind_proc_t *p, node_ctx_t *n, sm_ag_if_rd_t const *rd) {
+  assert(rd != NULL);
+  assert(rd->type == INDICATION_MSG_AGENT_IF_ANS_V0);
+  assert(rd->ind.type == RLC_STATS_V0);
+
+  rlc_ind_msg_t const *msg = &rd->ind.rlc.msg;
+  if (msg->len == 0)
+    return;
+
+  int64_t const now = now_us(p);
+  int64_t const ts = rate_ts(msg->tstamp, now);
+
+  pthread_mutex_lock(&n->mtx);
+
+  // Bearer counters are summed per UE; clear the UEs in this report first
+  for (size_t i = 0; i < msg->len; i++) {
+    ue_metrics_t *m = track(n, msg->rb[i].rnti, now);
+    if (!m)
+      continue;
+    if (ue_table_write_begin(&n->ues, m))
+      m->rlc_ver++;
+    m->rlc_tx_pkts = m->rlc_tx_bytes = 0;
+    m->rlc_rx_pkts = m->rlc_rx_bytes = 0;
+    m->rlc_txbuf = m->rlc_rxbuf = 0;
+    m->rlc_retx = 0;
+    m->rlc_ts = now;
+  }
+
+  for (size_t i = 0; i < msg->len; i++) {
+    rlc_radio_bearer_stats_t const *rb = &msg->rb[i];
+    ue_metrics_t *m = ue_table_find(&n->ues, rb->rnti);
+    if (!m)
+      continue;
+    m->rlc_tx_pkts += rb->txpdu_pkts;
+    m->rlc_tx_bytes += rb->txpdu_bytes;
+    m->rlc_rx_pkts += rb->rxpdu_pkts;
+    m->rlc_rx_bytes += rb->rxpdu_bytes;
+    m->rlc_txbuf += rb->txbuf_occ_bytes;
+    m->rlc_rxbuf += rb->rxbuf_occ_bytes;
+    m->rlc_retx += rb->txpdu_retx_pkts;
+    m->rlc_valid = 1;
+  }
+
+  for (size_t i = 0; i < msg->len; i++) {
+    ue_metrics_t *m = ue_table_find(&n->ues, msg->rb[i].rnti);
+    if (!m)
+      continue;
+
+    // Once per UE, however many bearers it has
+    ctr_rate_t *c = ue_table_ctr(&n->ues, m);
+    if (c[UE_CTR_RLC_TX].ts != ts) {
+      m->rlc_tx_kbps = kbps(ctr_rate(n, &c[UE_CTR_RLC_TX], m->rlc_tx_bytes,
+                                     32, ts));
+      m->rlc_rx_kbps = kbps(ctr_rate(n, &c[UE_CTR_RLC_RX], m->rlc_rx_bytes,
+                                     32, ts));
+      m->rlc_retx_per_s =
+          ctr_rate(n, &c[UE_CTR_RLC_RETX], m->rlc_retx, 32, ts);
+      if (n->trig)
+        trig_update(p, n, m, TRIG_SRC_RLC, now);
+      push_report(p, n, m, UE_REC_RLC, ROW_AGG_RLC);
+    }
+
+    if (m->pending)
+      retry_pending(p, n, m, now);
+  }
+
+  // A UE is published once all of its entries are in
+  for (size_t i = 0; i < msg->len; i++) {
+    ue_metrics_t *m = ue_table_find(&n->ues, msg->rb[i].rnti);
+    if (m)
+      ue_table_write_end(&n->ues, m);
+  }
+  pthread_mutex_unlock(&n->mtx);
+}
+
+// PDCP callback
+static void on_pdcp(ind_proc_t *p, node_ctx_t *n, sm_ag_if_rd_t const *rd) {
+  assert(rd != NULL);
+  assert(rd->type == INDICATION_MSG_AGENT_IF_ANS_V0);
+  assert(rd->ind.type == PDCP_STATS_V0);
+
+  pdcp_ind_msg_t const *msg = &rd->ind.pdcp.msg;
+  if (msg->len == 0)
+    return;
+
+  int64_t const now = now_us(p);
+  int64_t const ts = rate_ts(msg->tstamp, now);
+
+  pthread_mutex_lock(&n->mtx);
+
+  for (size_t i = 0; i < msg->len; i++) {
+    ue_metrics_t *m = track(n, msg->rb[i].rnti, now);
+    if (!m)
+      continue;
+    if (ue_table_write_begin(&n->ues, m))
+      m->pdcp_ver++;
+    m->pdcp_tx_pkts = m->pdcp_tx_bytes = 0;
+    m->pdcp_rx_pkts = m->pdcp_rx_bytes = 0;
+    m->pdcp_ts = now;
+  }
+
+  for (size_t i = 0; i < msg->len; i++) {
+    pdcp_radio_bearer_stats_t const *rb = &msg->rb[i];
+    ue_metrics_t *m = ue_table_find(&n->ues, rb->rnti);
+    if (!m)
+      continue;
+    m->pdcp_tx_pkts += rb->txpdu_pkts;
+    m->pdcp_tx_bytes += rb->txpdu_bytes;
+    m->pdcp_rx_pkts += rb->rxpdu_pkts;
+    m->pdcp_rx_bytes += rb->rxpdu_bytes;
+    m->pdcp_valid = 1;
+  }
+
+  for (size_t i = 0; i < msg->len; i++) {
+    ue_metrics_t *m = ue_table_find(&n->ues, msg->rb[i].rnti);
+    if (!m)
+      continue;
+
+    ctr_rate_t *c = ue_table_ctr(&n->ues, m);
+    if (c[UE_CTR_PDCP_TX].ts != ts) {
+      m->pdcp_tx_kbps = kbps(ctr_rate(n, &c[UE_CTR_PDCP_TX], m->pdcp_tx_bytes,
+                                      32, ts));
+      m->pdcp_rx_kbps = kbps(ctr_rate(n, &c[UE_CTR_PDCP_RX], m->pdcp_rx_bytes,
+                                      32, ts));
+      push_report(p, n, m, UE_REC_PDCP, ROW_AGG_PDCP);
+    }
+
+    if (m->pending)
+      retry_pending(p, n, m, now);
+  }
+
+  // A UE is published once all of its entries are in
+  for (size_t i = 0; i < msg->len; i++) {
+    ue_metrics_t *m = ue_table_find(&n->ues, msg->rb[i].rnti);
+    if (m)
+      ue_table_write_end(&n->ues, m);
+  }
+  pthread_mutex_unlock(&n->mtx);
+}
+
+// GTP callback
+static void on_gtp(ind_proc_t *p, node_ctx_t *n, sm_ag_if_rd_t const *rd) {
+  assert(rd != NULL);
+  assert(rd->type == INDICATION_MSG_AGENT_IF_ANS_V0);
+  assert(rd->ind.type == GTP_STATS_V0);
+
+  gtp_ind_msg_t const *msg = &rd->ind.gtp.msg;
+  if (msg->len == 0)
+    return;
+
+  int64_t const now = now_us(p);
+
+  pthread_mutex_lock(&n->mtx);
+
+  // Tunnels are counted per UE; clear the UEs in this report first
+  for (size_t i = 0; i < msg->len; i++) {
+    ue_metrics_t *m = track(n, msg->ngut[i].rnti, now);
+    if (!m)
+      continue;
+    if (ue_table_write_begin(&n->ues, m))
+      m->gtp_ver++;
+    m->gtp_tunnels = 0;
+    m->gtp_ts = now;
+  }
+
+  for (size_t i = 0; i < msg->len; i++) {
+    gtp_ngu_t_stats_t const *t = &msg->ngut[i];
+    ue_metrics_t *m = ue_table_find(&n->ues, t->rnti);
+    if (!m)
+      continue;
+
+    // The lowest QFI is the default flow, so the row keeps that tunnel
+    if (m->gtp_tunnels == 0 || t->qfi < m->gtp_qfi) {
+      m->gtp_teid_gnb = t->teidgnb;
+      m->gtp_teid_upf = t->teidupf;
+      m->gtp_qfi = t->qfi;
+    }
+    if (m->gtp_tunnels < UINT8_MAX)
+      m->gtp_tunnels++;
+    m->gtp_valid = 1;
+  }
+
+  // A UE is published once all of its entries are in
+  for (size_t i = 0; i < msg->len; i++) {
+    ue_metrics_t *m = ue_table_find(&n->ues, msg->ngut[i].rnti);
+    if (m)
+      ue_table_write_end(&n->ues, m);
+  }
+  pthread_mutex_unlock(&n->mtx);
+}
+
+// KPM callback - for throughput metrics
+static void on_kpm(ind_proc_t *p, node_ctx_t *n, sm_ag_if_rd_t const *rd) {
+  assert(rd != NULL);
+  assert(rd->type == INDICATION_MSG_AGENT_IF_ANS_V0);
+  assert(rd->ind.type == KPM_STATS_V3_0);
+
+  kpm_ind_data_t const *ind = &rd->ind.kpm.ind;
+  kpm_ind_msg_format_3_t const *msg_frm_3 = &ind->msg.frm_3;
+
+  if (msg_frm_3->ue_meas_report_lst_len == 0)
+    return;
+
+  // The slots are summed in UE order either way, so the totals do not
+  // depend on who decoded them
+  size_t const n_ues = msg_frm_3->ue_meas_report_lst_len;
+  kpm_ue_meas_t const *par = NULL;
+  if (p->kpm_pool && n_ues >= p->cfg->kpm_parallel_ues)
+    par = kpm_pool_decode(p->kpm_pool, msg_frm_3);
+
+  kpm_totals_t tot = {0};
+  size_t n_delay = 0;
+
+  for (size_t i = 0; i < n_ues; i++) {
+    kpm_ue_meas_t one;
+    kpm_ue_meas_t const *u = &one;
+    if (par)
+      u = &par[i];
+    else
+      kpm_meas_decode_ue(&msg_frm_3->meas_report_per_ue[i].ind_msg_format_1,
+                         &one);
+
+    double const *v = u->v;
+    tot.dl_thp_kbps += v[KPM_UE_THP_DL];
+    tot.ul_thp_kbps += v[KPM_UE_THP_UL];
+    tot.rlc_sdu_delay_us += v[KPM_RLC_SDU_DELAY_DL];
+    n_delay += (u->seen & KPM_MEAS_BIT(KPM_RLC_SDU_DELAY_DL)) != 0;
+    tot.pdcp_sdu_vol_dl_kb += (int32_t)v[KPM_PDCP_SDU_VOL_DL];
+    tot.pdcp_sdu_vol_ul_kb += (int32_t)v[KPM_PDCP_SDU_VOL_UL];
+    tot.prb_tot_dl += (int32_t)v[KPM_PRB_TOT_DL];
+    tot.prb_tot_ul += (int32_t)v[KPM_PRB_TOT_UL];
+  }
+  if (par)
+    kpm_pool_done(p->kpm_pool);
+
+  // Volumes, throughput and PRBs are summed over UEs; delay is the UE mean
+  if (n_delay > 0)
+    tot.rlc_sdu_delay_us /= (double)n_delay;
+  tot.kpm_valid = 1;
+  tot.ts = now_us(p);
+
+  pthread_mutex_lock(&n->mtx);
+  tot.seq = n->kpm.seq + 1;
+  n->kpm = tot;
+
+  if (p->cfg->window_ms[ROW_AGG_KPM]) {
+    ue_metrics_t r = {0};
+    r.timestamp = tot.ts;
+    r.dl_thp_kbps = tot.dl_thp_kbps;
+    r.ul_thp_kbps = tot.ul_thp_kbps;
+    r.rlc_sdu_delay_us = tot.rlc_sdu_delay_us;
+    r.pdcp_sdu_vol_dl_kb = tot.pdcp_sdu_vol_dl_kb;
+    r.pdcp_sdu_vol_ul_kb = tot.pdcp_sdu_vol_ul_kb;
+    r.prb_tot_dl = tot.prb_tot_dl;
+    r.prb_tot_ul = tot.prb_tot_ul;
+    r.kpm_valid = 1;
+    r.kpm_ts = tot.ts;
+    r.kpm_ver = tot.seq;
+    push_report(p, n, &r, UE_REC_KPM, ROW_AGG_KPM);
+  }
+
+  // KPM is node level, so it can complete any held sample
+  if (p->cfg->align == CFG_ALIGN_WAIT_ALL) {
+    for (size_t i = 0; i < UE_TABLE_MAX_LOAD; i++) {
+      ue_metrics_t *m = ue_table_at(&n->ues, i);
+      if (m && m->pending) {
+        ue_table_write_begin(&n->ues, m);
+        retry_pending(p, n, m, tot.ts);
+        ue_table_write_end(&n->ues, m);
+      }
+    }
+  }
+  pthread_mutex_unlock(&n->mtx);
+}
+
+// Which subscription an indication belongs to, and the E2 node's own
+// timestamp of it in us (0 if the SM does not carry one)
+static node_sub_e classify(sm_ag_if_rd_t const *rd, int64_t *src_us) {
+  switch (rd->ind.type) {
+  case MAC_STATS_V0:
+    *src_us = rd->ind.mac.msg.tstamp;
+    return NODE_SUB_MAC;
+  case RLC_STATS_V0:
+    *src_us = rd->ind.rlc.msg.tstamp;
+    return NODE_SUB_RLC;
+  case PDCP_STATS_V0:
+    *src_us = rd->ind.pdcp.msg.tstamp;
+    return NODE_SUB_PDCP;
+  case GTP_STATS_V0:
+    *src_us = rd->ind.gtp.msg.tstamp;
+    return NODE_SUB_GTP;
+  case KPM_STATS_V3_0:
+    *src_us =
+        (int64_t)rd->ind.kpm.ind.hdr.kpm_ric_ind_hdr_format_1.collectStartTime;
+    return NODE_SUB_KPM;
+  default:
+    *src_us = 0;
+    return NODE_SUB_COUNT;
+  }
+}
+
+void ind_proc_handle(ind_proc_t *p, node_ctx_t *n, sm_ag_if_rd_t const *rd) {
+  // Late indications between the stop and the unsubscribe are dropped
+  if (stop_event_raised())
+    return;
+
+  // A retired slot may still get the odd late indication
+  if (!node_ctx_enter(n))
+    return;
+
+  int64_t const t0 = lat_now_ns();
+  int64_t src_us = 0;
+  node_sub_e const sub = classify(rd, &src_us);
+  // SMs left out of --sms only show up when replaying a fuller log
+  if (sub == NODE_SUB_COUNT || !(p->cfg->sms & CFG_SMS_BIT(sub))) {
+    node_ctx_leave(n);
+    return;
+  }
+
+  if (p->log)
+    ind_log_write_ind(p->log, time_now_us(), (uint32_t)n->slot,
+                      n->id.nb_id.nb_id, rd);
+
+  // Skews between the node and RIC clocks show up as values <= 0
+  sub_lat_t *l = &n->lat[sub];
+  if (src_us > 0) {
+    int64_t const e2_us = now_us(p) - src_us;
+    if (e2_us >= 0)
+      lat_hist_record(&l->e2_us, (uint64_t)e2_us);
+  }
+
+  // The CFG_SM_BUILT tests are constants: a build without an SM has no
+  // code for it here
+  switch (sub) {
+  case NODE_SUB_MAC:
+    on_mac(p, n, rd);
+    break;
+  case NODE_SUB_RLC:
+    if (CFG_SM_BUILT(CFG_SM_RLC))
+      on_rlc(p, n, rd);
+    break;
+  case NODE_SUB_PDCP:
+    if (CFG_SM_BUILT(CFG_SM_PDCP))
+      on_pdcp(p, n, rd);
+    break;
+  case NODE_SUB_GTP:
+    if (CFG_SM_BUILT(CFG_SM_GTP))
+      on_gtp(p, n, rd);
+    break;
+  case NODE_SUB_KPM:
+    if (CFG_SM_BUILT(CFG_SM_KPM))
+      on_kpm(p, n, rd);
+    break;
+  default:
+    break;
+  }
+
+  lat_hist_record(&l->cb_ns, (uint64_t)(lat_now_ns() - t0));
+  atomic_fetch_add_explicit(&l->ind, 1, memory_order_relaxed);
+  node_ctx_leave(n);
+}
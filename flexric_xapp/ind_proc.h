@@ -0,0 +1,51 @@
+/*
+ * Indication processing
+ * =====================
+ *
+ * What every MAC, RLC, PDCP, GTP and KPM indication goes through, whoever
+ * delivers it: FlexRIC's callbacks, a replay (see ind_log.h) or the
+ * pipeline benchmark. An indication updates its node's UE table and
+ * derived rates, and the MAC sample is joined with the other sources (see
+ * align_row) into a row for the node's writer thread.
+ *
+ * ind_proc_handle is safe from any thread. Indications for one node are
+ * serialized on its mtx.
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#ifndef IND_PROC_H
+#define IND_PROC_H
+
+#include "../../../../src/xApp/e42_xapp_api.h"
+
+#include "collector_cfg.h"
+#include "ind_log.h"
+#include "kpm_pool.h"
+#include "node_ctx.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+  collector_cfg_t const *cfg;
+  _Atomic uint64_t samples; // Rows reserved against cfg->max_samples
+
+  // Set up before the first indication
+  ind_log_writer_t *log; // Every indication is recorded here, if set
+  bool lossless; // Wait for a full writer ring instead of dropping the row
+  kpm_pool_t *kpm_pool; // Decodes large KPM reports, if set
+
+  // When indications arrive (us since epoch), 0 = the wall clock. Whoever
+  // sets it must also be the only thread delivering indications.
+  int64_t clock_us;
+} ind_proc_t;
+
+void ind_proc_init(ind_proc_t *p, collector_cfg_t const *cfg);
+
+// One indication for node n. Dropped once the stop event is raised or the
+// node is no longer live.
+void ind_proc_handle(ind_proc_t *p, node_ctx_t *n, sm_ag_if_rd_t const *rd);
+
+#endif
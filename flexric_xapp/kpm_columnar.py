@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""
+Reader for the collector's columnar .kpmc format
+================================================
+The file is memory-mapped and every column of every chunk is exposed as a
+numpy view into the mapping, so nothing is parsed or copied until columns
+spanning several chunks are concatenated. See col_sink.c for the layout.
+"""
+
+import mmap
+import struct
+import sys
+
+import numpy as np
+import pandas as pd
+
+MAGIC = b"KPMCOL\x00\x01"
+HEADER_SIZE = 64
+DESC_SIZE = 48
+NAME_LEN = 40
+CHUNK_HEADER_SIZE = 16
+
+# col_type_e in col_sink.c
+DTYPES = {
+    1: np.dtype('<i1'), 2: np.dtype('<u1'), 3: np.dtype('<u2'),
+    4: np.dtype('<i4'), 5: np.dtype('<u4'), 6: np.dtype('<i8'),
+    7: np.dtype('<u8'), 8: np.dtype('<f4'), 9: np.dtype('<f8'),
+}
+
+
+def _pad8(n):
+    return (n + 7) & ~7
+
+
+def read_schema(buf):
+    """Return ([(name, dtype)], header_size) from the file header."""
+    if bytes(buf[:8]) != MAGIC:
+        raise ValueError("not a .kpmc file")
+    version, n_cols, _chunk_rows, header_size = struct.unpack_from('<4I', buf, 8)
+    if version != 1:
+        raise ValueError(f"unsupported .kpmc version {version}")
+
+    schema = []
+    for i in range(n_cols):
+        off = HEADER_SIZE + i * DESC_SIZE
+        name = bytes(buf[off:off + NAME_LEN]).split(b'\x00', 1)[0].decode()
+        schema.append((name, DTYPES[buf[off + NAME_LEN]]))
+    return schema, header_size
+
+
+def iter_chunks(buf):
+    """Yield one {column: ndarray view} dict per chunk. No data is copied."""
+    schema, off = read_schema(buf)
+    end = len(buf)
+    while off + CHUNK_HEADER_SIZE <= end:
+        if bytes(buf[off:off + 4]) != b"CHNK":
+            raise ValueError(f"corrupt chunk header at offset {off}")
+        n_rows, size = struct.unpack_from('<IQ', buf, off + 4)
+        if off + size > end:
+            break  # truncated tail, e.g. collector killed mid-write
+        col_off = off + CHUNK_HEADER_SIZE
+        chunk = {}
+        for name, dtype in schema:
+            chunk[name] = np.frombuffer(buf, dtype=dtype, count=n_rows,
+                                        offset=col_off)
+            col_off += _pad8(n_rows * dtype.itemsize)
+        yield chunk
+        off += size
+
+
+def open_kpmc(path):
+    """Memory-map a .kpmc file. Keep the returned mmap alive while using views."""
+    with open(path, 'rb') as f:
+        return mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+
+
+def read_columns(path):
+    """Return {column: ndarray}. Single-chunk files stay zero-copy."""
+    buf = open_kpmc(path)
+    chunks = list(iter_chunks(buf))
+    schema, _ = read_schema(buf)
+    if not chunks:
+        return {name: np.empty(0, dtype) for name, dtype in schema}
+    if len(chunks) == 1:
+        return chunks[0]
+    return {name: np.concatenate([c[name] for c in chunks])
+            for name, _ in schema}
+
+
+def load_dataset(path):
+    """Load a collector dataset as a DataFrame, whatever its format."""
+    if str(path).endswith('_segments.csv') or str(path).endswith('.zst'):
+        import kpm_segments
+        if str(path).endswith('.zst'):
+            return kpm_segments.load_segment(str(path))
+        return kpm_segments.load_segments(str(path))
+    if str(path).endswith('.kpmc'):
+        return pd.DataFrame(read_columns(path), copy=False)
+    return pd.read_csv(path)
+
+
+def main():
+    if len(sys.argv) < 2:
+        print("Usage: kpm_columnar.py <dataset.kpmc> [out.csv]")
+        sys.exit(1)
+
+    df = load_dataset(sys.argv[1])
+    print(f"{df.shape[0]} rows x {df.shape[1]} columns")
+    if len(sys.argv) > 2:
+        df.to_csv(sys.argv[2], index=False)
+        print(f"Wrote {sys.argv[2]}")
+    else:
+        print(df.head())
+
+
+if __name__ == '__main__':
+    main()
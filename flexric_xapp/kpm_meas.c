@@ -0,0 +1,84 @@
+/*
+ * KPM measurement resolver
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#include "kpm_meas.h"
+
+#include <string.h>
+
+#define MEAS(str, type, unit) {str, sizeof(str) - 1, type, unit}
+
+kpm_meas_def_t const kpm_meas[KPM_MEAS_COUNT] = {
+    [KPM_UE_THP_DL] = MEAS("DRB.UEThpDl", REAL_MEAS_VALUE, "kbps"),
+    [KPM_UE_THP_UL] = MEAS("DRB.UEThpUl", REAL_MEAS_VALUE, "kbps"),
+    [KPM_RLC_SDU_DELAY_DL] =
+        MEAS("DRB.RlcSduDelayDl", REAL_MEAS_VALUE, "μs"),
+    [KPM_PDCP_SDU_VOL_DL] =
+        MEAS("DRB.PdcpSduVolumeDL", INTEGER_MEAS_VALUE, "kb"),
+    [KPM_PDCP_SDU_VOL_UL] =
+        MEAS("DRB.PdcpSduVolumeUL", INTEGER_MEAS_VALUE, "kb"),
+    [KPM_PRB_TOT_DL] = MEAS("RRU.PrbTotDl", INTEGER_MEAS_VALUE, "PRBs"),
+    [KPM_PRB_TOT_UL] = MEAS("RRU.PrbTotUl", INTEGER_MEAS_VALUE, "PRBs"),
+};
+
+_Static_assert(KPM_MEAS_COUNT < 32, "KPM_MEAS_SET is a 32 bit mask");
+_Static_assert(KPM_MEAS_SET != 0 && (KPM_MEAS_SET & ~KPM_MEAS_SET_GNB) == 0,
+               "KPM_MEAS_SET must name known measurements");
+
+// Length is checked first, so at most two memcmp run per name
+kpm_meas_e kpm_meas_find(char const *name, size_t len) {
+  for (size_t i = 0; i < KPM_MEAS_COUNT; i++) {
+    if (kpm_meas[i].len == len && memcmp(kpm_meas[i].name, name, len) == 0)
+      return (kpm_meas_e)i;
+  }
+  return KPM_MEAS_UNKNOWN;
+}
+
+// Same as kpm_meas_find, but unrolled: KPM_MEAS_BUILT is then a constant
+// per entry, so only the compares for built measurements are left
+static kpm_meas_e find_built(char const *name, size_t len) {
+#pragma GCC unroll 32
+  for (size_t i = 0; i < KPM_MEAS_COUNT; i++) {
+    if (KPM_MEAS_BUILT(i) && kpm_meas[i].len == len &&
+        memcmp(kpm_meas[i].name, name, len) == 0)
+      return (kpm_meas_e)i;
+  }
+  return KPM_MEAS_UNKNOWN;
+}
+
+size_t kpm_meas_resolve(meas_info_format_1_lst_t const *lst, size_t len,
+                        kpm_meas_e slot[KPM_MAX_MEAS]) {
+  if (len > KPM_MAX_MEAS)
+    len = KPM_MAX_MEAS;
+
+  for (size_t i = 0; i < len; i++) {
+    slot[i] = lst[i].meas_type.type == NAME_MEAS_TYPE
+                  ? find_built((char const *)lst[i].meas_type.name.buf,
+                               lst[i].meas_type.name.len)
+                  : KPM_MEAS_UNKNOWN;
+  }
+  return len;
+}
+
+void kpm_meas_decode_ue(kpm_ind_msg_format_1_t const *msg, kpm_ue_meas_t *out) {
+  memset(out, 0, sizeof(*out));
+
+  // Names are resolved once per UE report, not once per record
+  kpm_meas_e slot[KPM_MAX_MEAS];
+  size_t const n_meas =
+      kpm_meas_resolve(msg->meas_info_lst, msg->meas_info_lst_len, slot);
+
+  for (size_t j = 0; j < msg->meas_data_lst_len; j++) {
+    meas_data_lst_t const *data = &msg->meas_data_lst[j];
+    size_t const n_rec =
+        data->meas_record_len < n_meas ? data->meas_record_len : n_meas;
+
+    for (size_t z = 0; z < n_rec; z++) {
+      kpm_meas_e const s = slot[z];
+      if (kpm_meas_value(&data->meas_record_lst[z], s, &out->v[s]))
+        out->seen |= KPM_MEAS_BIT(s);
+    }
+  }
+}
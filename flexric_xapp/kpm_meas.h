@@ -0,0 +1,100 @@
+/*
+ * KPM measurement resolver
+ * ========================
+ *
+ * The measurement names are the ones kpm_sub.c requests, so each
+ * meas_info_lst entry is mapped to a slot once per UE report and the record
+ * loops only do indexed stores. The collector and xapp_kpm_moni both decode
+ * KPM reports through these.
+ *
+ * Which measurements a binary knows is fixed at compile time by
+ * KPM_MEAS_SET, e.g. -DKPM_MEAS_SET=KPM_MEAS_SET_DU for an image that only
+ * ever talks to DUs. The others are never requested, and the resolver does
+ * not even compare names against them.
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#ifndef KPM_MEAS_H
+#define KPM_MEAS_H
+
+#include "../../../../src/sm/kpm_sm/kpm_sm_v03.00/ie/kpm_data_ie.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// meas_info_lst entries past this are ignored
+#define KPM_MAX_MEAS 64
+
+typedef enum {
+  KPM_UE_THP_DL = 0,
+  KPM_UE_THP_UL,
+  KPM_RLC_SDU_DELAY_DL,
+  KPM_PDCP_SDU_VOL_DL,
+  KPM_PDCP_SDU_VOL_UL,
+  KPM_PRB_TOT_DL,
+  KPM_PRB_TOT_UL,
+
+  KPM_MEAS_COUNT,
+  KPM_MEAS_UNKNOWN = KPM_MEAS_COUNT
+} kpm_meas_e;
+
+#define KPM_MEAS_BIT(m) (1u << (m))
+
+// What each NG-RAN node type reports (3GPP TS 28.552, 32.425 for eNB)
+#define KPM_MEAS_SET_GNB ((1u << KPM_MEAS_COUNT) - 1)
+#define KPM_MEAS_SET_ENB                                                      \
+  (KPM_MEAS_BIT(KPM_PDCP_SDU_VOL_DL) | KPM_MEAS_BIT(KPM_PDCP_SDU_VOL_UL) |    \
+   KPM_MEAS_BIT(KPM_PRB_TOT_DL) | KPM_MEAS_BIT(KPM_PRB_TOT_UL))
+// gNB-CU and gNB-CU-UP
+#define KPM_MEAS_SET_CU                                                       \
+  (KPM_MEAS_BIT(KPM_PDCP_SDU_VOL_DL) | KPM_MEAS_BIT(KPM_PDCP_SDU_VOL_UL))
+#define KPM_MEAS_SET_DU                                                       \
+  (KPM_MEAS_BIT(KPM_RLC_SDU_DELAY_DL) | KPM_MEAS_BIT(KPM_UE_THP_DL) |         \
+   KPM_MEAS_BIT(KPM_UE_THP_UL) | KPM_MEAS_BIT(KPM_PRB_TOT_DL) |               \
+   KPM_MEAS_BIT(KPM_PRB_TOT_UL))
+
+// Measurements compiled in
+#ifndef KPM_MEAS_SET
+#define KPM_MEAS_SET KPM_MEAS_SET_GNB
+#endif
+#define KPM_MEAS_BUILT(m) ((KPM_MEAS_SET & KPM_MEAS_BIT(m)) != 0)
+
+typedef struct {
+  char const *name; // 3GPP TS 28.552
+  size_t len;
+  meas_value_e value; // Records of any other type are ignored
+  char const *unit;
+} kpm_meas_def_t;
+
+extern kpm_meas_def_t const kpm_meas[KPM_MEAS_COUNT];
+
+// KPM_MEAS_UNKNOWN if the name is not in kpm_meas[]. Finds measurements
+// that are not built in too, so option parsing can say so.
+kpm_meas_e kpm_meas_find(char const *name, size_t len);
+
+// Fills slot[i] for every meas_info_lst entry; returns the entries resolved.
+// Names outside KPM_MEAS_SET resolve to KPM_MEAS_UNKNOWN.
+size_t kpm_meas_resolve(meas_info_format_1_lst_t const *lst, size_t len,
+                        kpm_meas_e slot[KPM_MAX_MEAS]);
+
+// A record's value, if slot s is a known measurement and the record has its
+// type
+static inline bool kpm_meas_value(meas_record_lst_t const *rec, kpm_meas_e s,
+                                  double *v) {
+  if (s == KPM_MEAS_UNKNOWN || rec->value != kpm_meas[s].value)
+    return false;
+  *v = rec->value == REAL_MEAS_VALUE ? rec->real_val : rec->int_val;
+  return true;
+}
+
+// One UE report of a Format 3 indication, by slot. The latest granularity
+// period wins; seen has KPM_MEAS_BIT(s) set for the slots that had a value.
+typedef struct {
+  double v[KPM_MEAS_COUNT + 1];
+  unsigned seen;
+} kpm_ue_meas_t;
+
+void kpm_meas_decode_ue(kpm_ind_msg_format_1_t const *msg, kpm_ue_meas_t *out);
+
+#endif
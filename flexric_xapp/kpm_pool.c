@@ -0,0 +1,145 @@
+/*
+ * KPM decode pool
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#include "kpm_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Claims chunks of the report until none are left. Every slot is written
+// by exactly one thread.
+static void run(kpm_pool_t *p, kpm_ind_msg_format_3_t const *msg, size_t n) {
+  for (;;) {
+    size_t const lo = atomic_fetch_add_explicit(&p->next, 1,
+                                                memory_order_relaxed) *
+                      KPM_POOL_CHUNK;
+    if (lo >= n)
+      return;
+    size_t const hi = lo + KPM_POOL_CHUNK < n ? lo + KPM_POOL_CHUNK : n;
+    for (size_t i = lo; i < hi; i++)
+      kpm_meas_decode_ue(&msg->meas_report_per_ue[i].ind_msg_format_1,
+                         &p->out[i]);
+  }
+}
+
+static void *worker(void *arg) {
+  kpm_pool_t *p = arg;
+
+  pthread_mutex_lock(&p->mtx);
+  uint64_t seen = p->gen;
+  for (;;) {
+    while (!p->stop && p->gen == seen)
+      pthread_cond_wait(&p->work, &p->mtx);
+    if (p->stop)
+      break;
+    seen = p->gen;
+
+    // Woken after the caller finished it alone
+    if (p->n_ues == 0)
+      continue;
+
+    kpm_ind_msg_format_3_t const *msg = p->msg;
+    size_t const n = p->n_ues;
+    p->busy++;
+    pthread_mutex_unlock(&p->mtx);
+
+    run(p, msg, n);
+
+    pthread_mutex_lock(&p->mtx);
+    if (--p->busy == 0)
+      pthread_cond_signal(&p->idle);
+  }
+  pthread_mutex_unlock(&p->mtx);
+  return NULL;
+}
+
+bool kpm_pool_start(kpm_pool_t *p, unsigned workers) {
+  memset(p, 0, sizeof(*p));
+  if (workers == 0 || workers > KPM_POOL_MAX_WORKERS)
+    return false;
+
+  pthread_mutex_init(&p->submit, NULL);
+  pthread_mutex_init(&p->mtx, NULL);
+  pthread_cond_init(&p->work, NULL);
+  pthread_cond_init(&p->idle, NULL);
+
+  for (unsigned i = 0; i < workers; i++) {
+    if (pthread_create(&p->threads[i], NULL, worker, p) != 0) {
+      kpm_pool_stop(p);
+      return false;
+    }
+    p->workers++;
+  }
+  return true;
+}
+
+void kpm_pool_stop(kpm_pool_t *p) {
+  pthread_mutex_lock(&p->mtx);
+  p->stop = true;
+  pthread_cond_broadcast(&p->work);
+  pthread_mutex_unlock(&p->mtx);
+
+  for (unsigned i = 0; i < p->workers; i++)
+    pthread_join(p->threads[i], NULL);
+  p->workers = 0;
+
+  pthread_cond_destroy(&p->idle);
+  pthread_cond_destroy(&p->work);
+  pthread_mutex_destroy(&p->mtx);
+  pthread_mutex_destroy(&p->submit);
+  free(p->out);
+  p->out = NULL;
+}
+
+kpm_ue_meas_t const *kpm_pool_decode(kpm_pool_t *p,
+                                     kpm_ind_msg_format_3_t const *msg) {
+  if (pthread_mutex_trylock(&p->submit) != 0) {
+    atomic_fetch_add_explicit(&p->fallback, 1, memory_order_relaxed);
+    return NULL;
+  }
+
+  size_t const n = msg->ue_meas_report_lst_len;
+  if (n > p->out_cap) {
+    kpm_ue_meas_t *out = realloc(p->out, n * sizeof(*out));
+    if (!out) {
+      pthread_mutex_unlock(&p->submit);
+      return NULL;
+    }
+    p->out = out;
+    p->out_cap = n;
+  }
+
+  pthread_mutex_lock(&p->mtx);
+  p->msg = msg;
+  p->n_ues = n;
+  atomic_store_explicit(&p->next, 0, memory_order_relaxed);
+  p->gen++;
+  pthread_cond_broadcast(&p->work);
+  pthread_mutex_unlock(&p->mtx);
+
+  run(p, msg, n);
+
+  // The workers that took the report may still be on their last chunk;
+  // their stores are visible once busy drops under mtx
+  pthread_mutex_lock(&p->mtx);
+  while (p->busy)
+    pthread_cond_wait(&p->idle, &p->mtx);
+  p->n_ues = 0;
+  p->msg = NULL;
+  pthread_mutex_unlock(&p->mtx);
+
+  atomic_fetch_add_explicit(&p->parallel, 1, memory_order_relaxed);
+  return p->out;
+}
+
+void kpm_pool_done(kpm_pool_t *p) { pthread_mutex_unlock(&p->submit); }
+
+void kpm_pool_print_stats(kpm_pool_t *p) {
+  printf("  KPM decode: %u workers, %lu reports in parallel, %lu decoded "
+         "alone while busy\n",
+         p->workers, atomic_load(&p->parallel), atomic_load(&p->fallback));
+}
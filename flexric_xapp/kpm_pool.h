@@ -0,0 +1,86 @@
+/*
+ * KPM decode pool
+ * ===============
+ *
+ * A Format 3 report from a DU carries one measurement list per UE, and
+ * with hundreds of UEs decoding it is most of a KPM callback. Reports
+ * with at least --kpm-parallel-ues UEs are split into chunks of UEs that
+ * a few persistent workers and the calling thread decode together. Each
+ * UE's values go to its own slot of a shared array, so the workers take
+ * no lock while they decode and never touch the UE tables.
+ *
+ * The indication is FlexRIC's and only valid during the callback, so the
+ * caller still waits for its report to be decoded; the pool cuts that wait
+ * by the number of workers rather than hiding it. Totals are summed from
+ * the slots in UE order afterwards, so they come out bit for bit the same
+ * as a sequential decode.
+ *
+ * One report is decoded at a time. A callback that finds the pool busy
+ * with another node's report decodes its own on its thread instead of
+ * waiting.
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#ifndef KPM_POOL_H
+#define KPM_POOL_H
+
+#include "kpm_meas.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define KPM_POOL_MAX_WORKERS 8
+
+// UEs a thread claims at a time
+#define KPM_POOL_CHUNK 16
+
+typedef struct {
+  pthread_t threads[KPM_POOL_MAX_WORKERS];
+  unsigned workers;
+
+  // Held by the report being decoded; tried, never waited for
+  pthread_mutex_t submit;
+
+  // The current report, published under mtx with gen bumped. busy counts
+  // the workers that took it; the caller waits for it to drop to 0.
+  pthread_mutex_t mtx;
+  pthread_cond_t work;
+  pthread_cond_t idle;
+  uint64_t gen;
+  unsigned busy;
+  bool stop;
+  kpm_ind_msg_format_3_t const *msg;
+  size_t n_ues; // 0 once the report is done
+  _Atomic size_t next; // Next chunk to claim
+
+  // One slot per UE report, grown as needed under submit
+  kpm_ue_meas_t *out;
+  size_t out_cap;
+
+  // Stats
+  _Atomic uint64_t parallel; // Reports decoded by the pool
+  _Atomic uint64_t fallback; // Found it busy and decoded on the caller
+} kpm_pool_t;
+
+// Starts workers (1..KPM_POOL_MAX_WORKERS) threads
+bool kpm_pool_start(kpm_pool_t *p, unsigned workers);
+
+// Joins the workers; no decode may be running
+void kpm_pool_stop(kpm_pool_t *p);
+
+// Decodes every UE report of msg and returns them by UE, valid until
+// kpm_pool_done. NULL, and nothing to release, if the pool is busy or out
+// of memory: the caller decodes the report itself.
+kpm_ue_meas_t const *kpm_pool_decode(kpm_pool_t *p,
+                                     kpm_ind_msg_format_3_t const *msg);
+
+// Frees the pool for the next report
+void kpm_pool_done(kpm_pool_t *p);
+
+void kpm_pool_print_stats(kpm_pool_t *p);
+
+#endif
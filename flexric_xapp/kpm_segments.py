@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""
+Reader for the collector's rotated output segments
+==================================================
+With --rotate-mb / --rotate-s the collector writes kpm_s00000.csv.zst,
+kpm_s00001.csv.zst, ... and lists them in kpm_segments.csv with their time
+ranges. Compressed segments also end with an index footer (see rot_sink.h)
+that read_footer() parses without decompressing anything.
+
+Decompression uses the zstandard module if it is installed, else the zstd
+command line tool.
+"""
+
+import io
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+
+import pandas as pd
+
+FRAME_MAGIC = 0x184d2a5b
+INDEX_MAGIC = 0x494d504b
+INDEX_FMT = '<IIIIqqQQ'  # rot_index_t
+INDEX_SIZE = struct.calcsize(INDEX_FMT)
+FRAME_SIZE = 8 + INDEX_SIZE
+
+
+def read_footer(path):
+    """Return the footer of a compressed segment as a dict, or None."""
+    with open(path, 'rb') as f:
+        f.seek(0, os.SEEK_END)
+        if f.tell() < FRAME_SIZE:
+            return None
+        f.seek(-FRAME_SIZE, os.SEEK_END)
+        buf = f.read(FRAME_SIZE)
+    frame_magic, size = struct.unpack_from('<II', buf, 0)
+    if frame_magic != FRAME_MAGIC or size != INDEX_SIZE:
+        return None
+    magic, version, seq, _, first_ts, last_ts, rows, raw_bytes = \
+        struct.unpack_from(INDEX_FMT, buf, 8)
+    if magic != INDEX_MAGIC or version != 1:
+        return None
+    return {'seq': seq, 'first_ts': first_ts, 'last_ts': last_ts,
+            'rows': rows, 'raw_bytes': raw_bytes}
+
+
+def read_manifest(path):
+    """The segment list as a DataFrame, with 'path' resolved."""
+    df = pd.read_csv(path)
+    base = os.path.dirname(os.path.abspath(path))
+    df['path'] = [os.path.join(base, f) for f in df['file']]
+    return df
+
+
+def _decompress(path):
+    try:
+        import zstandard
+        with open(path, 'rb') as f:
+            return zstandard.ZstdDecompressor().stream_reader(f).read()
+    except ImportError:
+        return subprocess.run(['zstd', '-dcq', path], check=True,
+                              stdout=subprocess.PIPE).stdout
+
+
+def load_segment(path):
+    """One segment as a DataFrame, whatever its format."""
+    from kpm_columnar import load_dataset
+    if not path.endswith('.zst'):
+        return load_dataset(path)
+
+    raw = _decompress(path)
+    inner = path[:-len('.zst')]
+    if inner.endswith('.kpmc'):
+        # The columnar reader maps a file, so give it one
+        with tempfile.NamedTemporaryFile(suffix='.kpmc') as tmp:
+            tmp.write(raw)
+            tmp.flush()
+            return load_dataset(tmp.name).copy()
+    return pd.read_csv(io.BytesIO(raw))
+
+
+def load_segments(manifest, t0=None, t1=None):
+    """Rows of every segment overlapping [t0, t1] (us since epoch)."""
+    seg = read_manifest(manifest)
+    if t0 is not None:
+        seg = seg[seg['last_ts'] >= t0]
+    if t1 is not None:
+        seg = seg[seg['first_ts'] <= t1]
+
+    frames = [load_segment(p) for p in seg['path'] if os.path.exists(p)]
+    if not frames:
+        return pd.DataFrame()
+    df = pd.concat(frames, ignore_index=True)
+    if t0 is not None:
+        df = df[df['timestamp'] >= t0]
+    if t1 is not None:
+        df = df[df['timestamp'] <= t1]
+    return df.reset_index(drop=True)
+
+
+def main():
+    if len(sys.argv) < 2:
+        print("Usage: kpm_segments.py <stem_segments.csv | segment.zst> "
+              "[out.csv]")
+        sys.exit(1)
+
+    src = sys.argv[1]
+    if src.endswith('.zst') and len(sys.argv) == 2:
+        print(read_footer(src))
+        return
+
+    df = load_segments(src) if src.endswith('_segments.csv') \
+        else load_segment(src)
+    print(f"{df.shape[0]} rows x {df.shape[1]} columns")
+    if len(sys.argv) > 2:
+        df.to_csv(sys.argv[2], index=False)
+        print(f"Wrote {sys.argv[2]}")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+"""
+Reader for the collector's shared memory row rings
+==================================================
+The collector (--shm=/name) publishes every row it writes into a broadcast
+ring in /dev/shm, one per E2 node. Any number of readers can follow a ring
+without a FlexRIC subscription of their own. See row_pub.h for the layout.
+"""
+
+import mmap
+import struct
+import sys
+import time
+
+import numpy as np
+import pandas as pd
+
+MAGIC = 0x524d504b
+VERSION = 4
+HEADER_SIZE = 64
+HEAD_OFFSET = 24
+
+# row_pub_rec_t
+REC_DTYPE = np.dtype([
+    ('timestamp', '<i8'), ('ue_first_ts', '<i8'),
+    ('dl_tbs', '<u8'), ('ul_tbs', '<u8'),
+    ('dl_aggr_tbs', '<u8'), ('ul_aggr_tbs', '<u8'),
+    ('dl_thp_kbps', '<f8'), ('ul_thp_kbps', '<f8'),
+    ('rlc_sdu_delay_us', '<f8'),
+    ('rlc_age_ms', '<f8'), ('pdcp_age_ms', '<f8'), ('kpm_age_ms', '<f8'),
+    ('dl_mac_kbps', '<f8'), ('ul_mac_kbps', '<f8'),
+    ('dl_goodput_kbps', '<f8'), ('ul_goodput_kbps', '<f8'),
+    ('rlc_tx_kbps', '<f8'), ('rlc_rx_kbps', '<f8'), ('rlc_retx_per_s', '<f8'),
+    ('pdcp_tx_kbps', '<f8'), ('pdcp_rx_kbps', '<f8'),
+    ('nb_id', '<u4'), ('rnti', '<u4'),
+    ('dl_prb', '<u4'), ('ul_prb', '<u4'),
+    ('dl_sched_rb', '<u4'), ('ul_sched_rb', '<u4'),
+    ('bsr', '<u4'),
+    ('rlc_tx_pkts', '<u4'), ('rlc_tx_bytes', '<u4'),
+    ('rlc_rx_pkts', '<u4'), ('rlc_rx_bytes', '<u4'),
+    ('rlc_txbuf', '<u4'), ('rlc_rxbuf', '<u4'),
+    ('rlc_retx', '<u4'),
+    ('pdcp_tx_pkts', '<u4'), ('pdcp_tx_bytes', '<u4'),
+    ('pdcp_rx_pkts', '<u4'), ('pdcp_rx_bytes', '<u4'),
+    ('gtp_teid_gnb', '<u4'), ('gtp_teid_upf', '<u4'),
+    ('ue_rows', '<u4'),
+    ('mac_ver', '<u4'), ('rlc_ver', '<u4'), ('pdcp_ver', '<u4'),
+    ('gtp_ver', '<u4'), ('kpm_ver', '<u4'),
+    ('pdcp_vol_dl_kb', '<i4'), ('pdcp_vol_ul_kb', '<i4'),
+    ('prb_tot_dl', '<i4'), ('prb_tot_ul', '<i4'),
+    ('pusch_snr', '<f4'), ('pucch_snr', '<f4'),
+    ('dl_bler', '<f4'), ('ul_bler', '<f4'),
+    ('frame', '<u2'), ('slot', '<u2'),
+    ('cqi', 'u1'),
+    ('dl_mcs1', 'u1'), ('dl_mcs2', 'u1'), ('ul_mcs1', 'u1'), ('ul_mcs2', 'u1'),
+    ('phr', 'i1'),
+    ('gtp_qfi', 'u1'), ('gtp_tunnels', 'u1'),
+    ('trig', 'u1'),
+    ('valid', 'u1'),
+    ('reserved', 'V2'),
+])
+assert REC_DTYPE.itemsize == 320
+
+SLOT_DTYPE = np.dtype([('seq', '<u8'), ('rec', REC_DTYPE)])
+
+
+class Ring:
+    """One node's ring. Keep it open while using the arrays it returns."""
+
+    def __init__(self, name):
+        path = '/dev/shm/' + name.lstrip('/')
+        with open(path, 'rb') as f:
+            self.buf = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+
+        magic, version, rec_size, slot_size, capacity, nb_id = \
+            struct.unpack_from('<IHHIII', self.buf, 0)
+        if magic != MAGIC:
+            raise ValueError(f"{path}: not a collector ring")
+        if version != VERSION or rec_size != REC_DTYPE.itemsize or \
+                slot_size != SLOT_DTYPE.itemsize:
+            raise ValueError(f"{path}: unsupported ring version {version}")
+
+        self.capacity = capacity
+        self.nb_id = nb_id
+        self.slots = np.frombuffer(self.buf, dtype=SLOT_DTYPE, count=capacity,
+                                   offset=HEADER_SIZE)
+
+    def head(self):
+        """Number of records published so far."""
+        return struct.unpack_from('<Q', self.buf, HEAD_OFFSET)[0]
+
+    def closed(self):
+        return struct.unpack_from('<I', self.buf, 20)[0] != 0
+
+    def read(self, pos):
+        """Return (records, next_pos, lost) for everything after pos."""
+        head = self.head()
+        lost = 0
+        if head - pos > self.capacity:
+            lost = head - self.capacity - pos
+            pos = head - self.capacity
+        if pos >= head:
+            return np.empty(0, REC_DTYPE), pos, lost
+
+        n = np.arange(pos, head, dtype=np.uint64)
+        idx = n % np.uint64(self.capacity)
+        copy = self.slots[idx]  # fancy indexing copies
+
+        # A slot is good if it held record n before and after the copy
+        want = 2 * n + 2
+        ok = (copy['seq'] == want) & (self.slots['seq'][idx] == want)
+        lost += int(np.count_nonzero(~ok))
+        return copy['rec'][ok], head, lost
+
+
+def follow(name, from_start=False, poll_s=0.01):
+    """Yield (records, lost) batches until the collector closes the ring."""
+    ring = Ring(name)
+    pos = max(0, ring.head() - ring.capacity) if from_start else ring.head()
+    while True:
+        closed = ring.closed()
+        recs, pos, lost = ring.read(pos)
+        if len(recs) or lost:
+            yield recs, lost
+        elif closed:
+            return
+        else:
+            time.sleep(poll_s)
+
+
+def to_frame(recs):
+    """Records as a DataFrame with the CSV column names."""
+    cols = [n for n in REC_DTYPE.names if n != 'reserved']
+    return pd.DataFrame({n: recs[n] for n in cols})
+
+
+def main():
+    if len(sys.argv) < 2:
+        print("Usage: kpm_shm.py </ring_name> [out.csv]")
+        sys.exit(1)
+
+    out = sys.argv[2] if len(sys.argv) > 2 else None
+    rows = lost = 0
+    header = True
+    t0 = time.time()
+    try:
+        for recs, n_lost in follow(sys.argv[1], from_start=True):
+            rows += len(recs)
+            lost += n_lost
+            if out and len(recs):
+                to_frame(recs).to_csv(out, mode='w' if header else 'a',
+                                      header=header, index=False)
+                header = False
+            elif not out and len(recs):
+                r = recs[-1]
+                print(f"\r{rows} rows, {lost} lost, "
+                      f"{rows / max(time.time() - t0, 1e-9):.0f} rows/s, "
+                      f"last RNTI {r['rnti']} CQI {r['cqi']}", end='')
+    except KeyboardInterrupt:
+        pass
+    print(f"\n{rows} rows, {lost} lost")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,173 @@
+/*
+ * KPM subscription templates
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#include "kpm_sub.h"
+#include "kpm_meas.h"
+
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Measurements each node type can report
+static unsigned const tmpl_meas[KPM_TMPL_COUNT] = {
+    [KPM_TMPL_GNB] = KPM_MEAS_SET_GNB,
+    [KPM_TMPL_ENB] = KPM_MEAS_SET_ENB,
+    [KPM_TMPL_CU] = KPM_MEAS_SET_CU,
+    [KPM_TMPL_DU] = KPM_MEAS_SET_DU,
+};
+
+static bool tmpl_of(ngran_node_t type, kpm_tmpl_e *t) {
+  switch (type) {
+  case ngran_gNB:
+    *t = KPM_TMPL_GNB;
+    return true;
+  case ngran_eNB:
+    *t = KPM_TMPL_ENB;
+    return true;
+  case ngran_gNB_CU:
+  case ngran_gNB_CUUP:
+    *t = KPM_TMPL_CU;
+    return true;
+  case ngran_gNB_DU:
+    *t = KPM_TMPL_DU;
+    return true;
+  default:
+    return false;
+  }
+}
+
+// --- Arena -------------------------------------------------------------------
+
+// Zeroed, suitably aligned for any of the KPM structs; NULL when full
+static void *arena_alloc(kpm_arena_t *a, size_t n, size_t size) {
+  size_t const align = alignof(max_align_t);
+  size_t const off = (a->used + align - 1) & ~(align - 1);
+  if (size && n > (a->cap - off) / size)
+    return NULL;
+  a->used = off + n * size;
+  // Space handed back by a failed build is reused, so clear it every time
+  memset(a->base + off, 0, n * size);
+  return a->base + off;
+}
+
+#define ARENA_NEW(a, type, n) ((type *)arena_alloc((a), (n), sizeof(type)))
+
+// --- Template ----------------------------------------------------------------
+
+static bool build_meas_info(kpm_arena_t *a, meas_info_format_1_lst_t *dst,
+                            kpm_meas_def_t const *m) {
+  uint8_t *name = ARENA_NEW(a, uint8_t, m->len);
+  label_info_lst_t *label = ARENA_NEW(a, label_info_lst_t, 1);
+  enum_value_e *no_label = ARENA_NEW(a, enum_value_e, 1);
+  if (!name || !label || !no_label)
+    return false;
+
+  memcpy(name, m->name, m->len);
+  dst->meas_type.type = NAME_MEAS_TYPE;
+  dst->meas_type.name.buf = name;
+  dst->meas_type.name.len = m->len;
+
+  // Required: Label info
+  *no_label = TRUE_ENUM_VALUE;
+  label->noLabel = no_label;
+  dst->label_info_lst_len = 1;
+  dst->label_info_lst = label;
+  return true;
+}
+
+// Matching condition: S-NSSAI with SST = 1
+static bool build_filter(kpm_arena_t *a, test_info_lst_t *dst) {
+  test_cond_e *cond = ARENA_NEW(a, test_cond_e, 1);
+  test_cond_value_t *val = ARENA_NEW(a, test_cond_value_t, 1);
+  int64_t *sst = ARENA_NEW(a, int64_t, 1);
+  if (!cond || !val || !sst)
+    return false;
+
+  *cond = EQUAL_TEST_COND;
+  *sst = 1;
+  val->type = INTEGER_TEST_COND_VALUE;
+  val->int_value = sst;
+
+  dst->test_cond_type = S_NSSAI_TEST_COND_TYPE;
+  dst->S_NSSAI = TRUE_TEST_COND_TYPE;
+  dst->test_cond = cond;
+  dst->test_cond_value = val;
+  return true;
+}
+
+static kpm_sub_data_t *build(kpm_arena_t *a, kpm_sub_cache_t const *c,
+                             unsigned mask) {
+  mask &= c->meas & KPM_MEAS_SET;
+  size_t n_meas = 0;
+  for (size_t i = 0; i < KPM_MEAS_COUNT; i++)
+    n_meas += (mask & KPM_MEAS_BIT(i)) != 0;
+  if (n_meas == 0)
+    return NULL;
+
+  kpm_sub_data_t *sub = ARENA_NEW(a, kpm_sub_data_t, 1);
+  kpm_act_def_t *ad = ARENA_NEW(a, kpm_act_def_t, 1);
+  matching_condition_format_4_lst_t *match =
+      ARENA_NEW(a, matching_condition_format_4_lst_t, 1);
+  meas_info_format_1_lst_t *info =
+      ARENA_NEW(a, meas_info_format_1_lst_t, n_meas);
+  if (!sub || !ad || !match || !info || !build_filter(a, &match->test_info_lst))
+    return NULL;
+
+  for (size_t i = 0, j = 0; i < KPM_MEAS_COUNT; i++) {
+    if ((mask & KPM_MEAS_BIT(i)) &&
+        !build_meas_info(a, &info[j++], &kpm_meas[i]))
+      return NULL;
+  }
+
+  sub->ev_trg_def.type = FORMAT_1_RIC_EVENT_TRIGGER;
+  sub->ev_trg_def.kpm_ric_event_trigger_format_1.report_period_ms =
+      c->period_ms;
+  sub->sz_ad = 1;
+  sub->ad = ad;
+
+  // Format 4 for UE-level measurements
+  ad->type = FORMAT_4_ACTION_DEFINITION;
+  ad->frm_4.matching_cond_lst_len = 1;
+  ad->frm_4.matching_cond_lst = match;
+  ad->frm_4.action_def_format_1.gran_period_ms = c->gran_ms;
+  ad->frm_4.action_def_format_1.meas_info_lst_len = n_meas;
+  ad->frm_4.action_def_format_1.meas_info_lst = info;
+  return sub;
+}
+
+bool kpm_sub_cache_init(kpm_sub_cache_t *c, unsigned meas, uint32_t period_ms,
+                        uint32_t gran_ms) {
+  memset(c, 0, sizeof(*c));
+  c->meas = meas;
+  c->period_ms = period_ms;
+  c->gran_ms = gran_ms;
+  c->arena.cap = KPM_SUB_ARENA_SIZE;
+  c->arena.base = malloc(c->arena.cap);
+  return c->arena.base != NULL;
+}
+
+kpm_sub_data_t *kpm_sub_for(kpm_sub_cache_t *c, ngran_node_t type) {
+  kpm_tmpl_e t;
+  if (!tmpl_of(type, &t))
+    return NULL;
+
+  if (!c->built[t]) {
+    size_t const mark = c->arena.used;
+    c->tmpl[t] = build(&c->arena, c, tmpl_meas[t]);
+    c->built[t] = true;
+    // A half-built template is never handed out; give the space back
+    if (!c->tmpl[t])
+      c->arena.used = mark;
+  }
+  return c->tmpl[t];
+}
+
+void kpm_sub_cache_free(kpm_sub_cache_t *c) {
+  free(c->arena.base);
+  memset(c, 0, sizeof(*c));
+}
@@ -0,0 +1,68 @@
+/*
+ * KPM subscription templates
+ * ==========================
+ *
+ * A KPM subscription is a deep tree of small objects: action definition,
+ * matching condition, test condition, one measurement entry with its label
+ * list per measurement, and the measurement names. Building it with one
+ * calloc per object for every node costs dozens of allocations per node on
+ * every (re)subscription.
+ *
+ * Here the tree is laid out in one arena instead, once per NG-RAN node
+ * type, and the same template is passed to every node of that type.
+ * report_sm_xapp_api only reads and encodes the data, so a template can be
+ * reused any number of times. Everything goes away with one
+ * kpm_sub_cache_free. Never hand a template to free_kpm_sub_data.
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#ifndef KPM_SUB_H
+#define KPM_SUB_H
+
+#include "../../../../src/sm/kpm_sm/kpm_sm_v03.00/ie/kpm_data_ie.h"
+#include "../../../../src/util/ngran_types.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Four templates with every measurement take about 3 KiB
+#define KPM_SUB_ARENA_SIZE (16u << 10)
+
+typedef enum {
+  KPM_TMPL_GNB = 0,
+  KPM_TMPL_ENB,
+  KPM_TMPL_CU, // gNB-CU and gNB-CU-UP
+  KPM_TMPL_DU,
+
+  KPM_TMPL_COUNT
+} kpm_tmpl_e;
+
+typedef struct {
+  unsigned char *base;
+  size_t used;
+  size_t cap;
+} kpm_arena_t;
+
+typedef struct {
+  kpm_arena_t arena;
+  kpm_sub_data_t *tmpl[KPM_TMPL_COUNT]; // Built on first use
+  bool built[KPM_TMPL_COUNT];
+
+  unsigned meas; // KPM_MEAS_BIT mask to request
+  uint32_t period_ms;
+  uint32_t gran_ms;
+} kpm_sub_cache_t;
+
+bool kpm_sub_cache_init(kpm_sub_cache_t *c, unsigned meas, uint32_t period_ms,
+                        uint32_t gran_ms);
+
+// The subscription for a node of this type: the requested measurements the
+// type can report and the binary is built with. NULL if there are none
+// (e.g. gNB-CU-CP).
+kpm_sub_data_t *kpm_sub_for(kpm_sub_cache_t *c, ngran_node_t type);
+
+void kpm_sub_cache_free(kpm_sub_cache_t *c);
+
+#endif
@@ -0,0 +1,65 @@
+/*
+ * Latency histograms
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#include "lat_hist.h"
+
+// Values below LAT_HIST_SUB map 1:1; above, the top LAT_HIST_SUB_BITS + 1
+// significant bits select the bucket
+static size_t bucket_of(uint64_t v) {
+  if (v < LAT_HIST_SUB)
+    return (size_t)v;
+
+  unsigned const msb = 63u - (unsigned)__builtin_clzll(v);
+  unsigned const shift = msb - LAT_HIST_SUB_BITS;
+  size_t const sub = (size_t)(v >> shift) & (LAT_HIST_SUB - 1);
+  return (size_t)(shift + 1) * LAT_HIST_SUB + sub;
+}
+
+// Midpoint of the values a bucket holds
+static uint64_t value_of(size_t idx) {
+  if (idx < LAT_HIST_SUB)
+    return idx;
+
+  unsigned const shift = (unsigned)(idx / LAT_HIST_SUB) - 1;
+  uint64_t const lo = (uint64_t)(LAT_HIST_SUB + idx % LAT_HIST_SUB) << shift;
+  return lo + (((uint64_t)1 << shift) >> 1);
+}
+
+void lat_hist_record(lat_hist_t *h, uint64_t v) {
+  atomic_fetch_add_explicit(&h->b[bucket_of(v)], 1, memory_order_relaxed);
+}
+
+void lat_hist_drain(lat_hist_t *h, lat_snap_t *s) {
+  for (size_t i = 0; i < LAT_HIST_BUCKETS; i++) {
+    uint64_t const n =
+        atomic_exchange_explicit(&h->b[i], 0, memory_order_relaxed);
+    s->b[i] += n;
+    s->count += n;
+  }
+}
+
+void lat_snap_merge(lat_snap_t *dst, lat_snap_t const *src) {
+  for (size_t i = 0; i < LAT_HIST_BUCKETS; i++)
+    dst->b[i] += src->b[i];
+  dst->count += src->count;
+}
+
+uint64_t lat_snap_quantile(lat_snap_t const *s, double q) {
+  if (s->count == 0)
+    return 0;
+
+  uint64_t rank = (uint64_t)(q * (double)s->count + 0.5);
+  if (rank == 0)
+    rank = 1;
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < LAT_HIST_BUCKETS; i++) {
+    seen += s->b[i];
+    if (seen >= rank)
+      return value_of(i);
+  }
+  return value_of(LAT_HIST_BUCKETS - 1);
+}
@@ -0,0 +1,54 @@
+/*
+ * Latency histograms
+ * ==================
+ *
+ * Log-linear (HDR style) histogram: every power of two is split into
+ * LAT_HIST_SUB linear buckets, so any recorded value is reported within
+ * 1/LAT_HIST_SUB (~6%) of its true value over the whole uint64 range.
+ *
+ * Recording is one relaxed atomic increment, so the callback threads and
+ * the writer thread never take a lock; a reporter periodically moves the
+ * counts into a plain snapshot with lat_hist_drain.
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#ifndef LAT_HIST_H
+#define LAT_HIST_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#define LAT_HIST_SUB_BITS 4
+#define LAT_HIST_SUB (1u << LAT_HIST_SUB_BITS)
+#define LAT_HIST_BUCKETS ((64 - LAT_HIST_SUB_BITS + 1) * LAT_HIST_SUB)
+
+typedef struct {
+  _Atomic uint64_t b[LAT_HIST_BUCKETS];
+} lat_hist_t;
+
+typedef struct {
+  uint64_t b[LAT_HIST_BUCKETS];
+  uint64_t count;
+} lat_snap_t;
+
+static inline int64_t lat_now_ns(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+void lat_hist_record(lat_hist_t *h, uint64_t v);
+
+// Moves every count from h into s (h is left empty)
+void lat_hist_drain(lat_hist_t *h, lat_snap_t *s);
+
+// Adds src into dst
+void lat_snap_merge(lat_snap_t *dst, lat_snap_t const *src);
+
+// Value at quantile q (0..1); 0 for an empty snapshot
+uint64_t lat_snap_quantile(lat_snap_t const *s, double q);
+
+#endif
@@ -0,0 +1,106 @@
+#!/bin/bash
+# loadtest.sh
+# Scale test: replays synthetic N gNB x M UE logs through the collector
+#
+# Every scenario gets a log from loadtest_gen (MAC/RLC/PDCP/GTP every
+# PERIOD_MS, KPM every KPM_MS), which the real collector binary replays at
+# SPEED times the recorded pace with --replay-lossy=1, so rows it cannot
+# keep up with are dropped as in a live run. The per-run reports
+# (--report) are gathered into one JSON file:
+#
+#   NODES="4 8" UES="64 128" SECONDS_PER_RUN=10 ./loadtest.sh
+#
+# SPEED=0 replays as fast as the collector goes, which shows where it tops
+# out rather than how it holds a given load. Extra collector flags go in
+# XAPP_ARGS.
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+BUILD_DIR=${BUILD_DIR:-$SCRIPT_DIR/build}
+OUT_DIR=${OUT_DIR:-$SCRIPT_DIR/loadtest-results}
+NODES=${NODES:-"1 4 8"}
+UES=${UES:-"32 128"}
+SECONDS_PER_RUN=${SECONDS_PER_RUN:-10}
+PERIOD_MS=${PERIOD_MS:-10}
+KPM_MS=${KPM_MS:-100}
+SPEED=${SPEED:-1}
+XAPP_ARGS=${XAPP_ARGS:-}
+KEEP_LOGS=${KEEP_LOGS:-0}
+
+GEN="$BUILD_DIR/loadtest_gen"
+COLLECTOR="$BUILD_DIR/xapp_kpm_metrics_collector"
+for b in "$GEN" "$COLLECTOR"; do
+    if [ ! -x "$b" ]; then
+        echo "[ERROR] $b not found; build with cmake first (KPM_BUILD_BENCH=ON)"
+        exit 1
+    fi
+done
+
+TIMESTAMP=$(date +%Y%m%d_%H%M%S)
+RUN_DIR="$OUT_DIR/$TIMESTAMP"
+mkdir -p "$RUN_DIR"
+REPORT="$OUT_DIR/loadtest_${TIMESTAMP}.json"
+REVISION=$(git -C "$SCRIPT_DIR" describe --always --dirty 2>/dev/null || echo unknown)
+
+echo "[INFO] Load test $TIMESTAMP ($REVISION): nodes {$NODES} x UEs {$UES}, ${SECONDS_PER_RUN}s each, speed ${SPEED}x"
+
+RUNS=()
+for n in $NODES; do
+    for u in $UES; do
+        name="n${n}_u${u}"
+        log="$RUN_DIR/$name.kpmrec"
+        echo ""
+        echo "[INFO] $n gNBs x $u UEs..."
+        "$GEN" --nodes="$n" --ues="$u" --seconds="$SECONDS_PER_RUN" \
+            --period-ms="$PERIOD_MS" --kpm-ms="$KPM_MS" --output="$log" \
+            > "$RUN_DIR/$name.gen.txt"
+
+        # The collector's own output goes to a file per run; rows are
+        # written as in production so the output rate is a real one
+        if ! "$COLLECTOR" --replay="$log" --replay-speed="$SPEED" \
+            --replay-lossy=1 --samples=0 --stats-interval=0 \
+            --output="$RUN_DIR/$name.csv" --report="$RUN_DIR/$name.json" \
+            $XAPP_ARGS > "$RUN_DIR/$name.txt" 2>&1; then
+            echo "[WARN] Collector failed, see $RUN_DIR/$name.txt"
+        fi
+        [ "$KEEP_LOGS" = 1 ] || rm -f "$log"
+
+        if [ -f "$RUN_DIR/$name.json" ]; then
+            RUNS+=("$n:$u:$RUN_DIR/$name.json")
+            python3 - "$RUN_DIR/$name.json" <<'EOF'
+import json, sys
+r = json.load(open(sys.argv[1]))
+i, rows = r["indications"], r["rows"]
+cb = i["callback_us"]
+print("       %.0f ind/s, %.0f rows/s, %d dropped, callback p50/p99/p999 "
+      "%.1f/%.1f/%.1f us, %.1f MB/s, %.1f MiB RSS, max lag %d ms" % (
+          i["per_s"], rows["per_s"],
+          rows["dropped_ring"] + rows["dropped_incomplete"],
+          cb["p50"], cb["p99"], cb["p999"], r["output"]["mb_per_s"],
+          r["memory"]["max_rss_kb"] / 1024.0, r["replay"]["max_lag_ms"]))
+EOF
+        fi
+    done
+done
+
+# One file for the whole sweep: the scenario next to each collector report
+python3 - "$REPORT" "$TIMESTAMP" "$REVISION" "$SECONDS_PER_RUN" \
+    "$PERIOD_MS" "$KPM_MS" "$SPEED" "${RUNS[@]}" <<'EOF'
+import json, sys
+out, ts, rev, secs, period, kpm, speed = sys.argv[1:8]
+runs = []
+for arg in sys.argv[8:]:
+    nodes, ues, path = arg.split(":", 2)
+    runs.append({
+        "scenario": {"nodes": int(nodes), "ues_per_node": int(ues),
+                     "seconds": int(secs), "period_ms": int(period),
+                     "kpm_ms": int(kpm), "speed": int(speed)},
+        "collector": json.load(open(path)),
+    })
+json.dump({"loadtest_version": 1, "timestamp": ts, "revision": rev,
+           "runs": runs}, open(out, "w"), indent=2)
+EOF
+
+echo ""
+echo "[SUCCESS] Report: $REPORT (${#RUNS[@]} runs)"
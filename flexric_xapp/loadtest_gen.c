@@ -0,0 +1,185 @@
+/*
+ * Load test generator
+ * ===================
+ *
+ * Writes an indication log (see ind_log.h) as a RIC with N gNBs of M UEs
+ * each would have delivered it. The collector then replays the log as it
+ * would a recording (loadtest.sh does both):
+ *
+ *   loadtest_gen --nodes=8 --ues=64 --seconds=10 --output=/tmp/load.kpmrec
+ *   xapp_kpm_metrics_collector --replay=/tmp/load.kpmrec --replay-speed=1
+ *
+ * Every node sends MAC, RLC, PDCP and GTP every --period-ms and KPM every
+ * --kpm-ms, with the payloads of synth_ind.h. The nodes are spread evenly
+ * over each period, the way independent gNBs would be, rather than all
+ * reporting in the same microsecond. A log takes roughly
+ * nodes * ues * seconds * 40 KiB.
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#include "ind_log.h"
+#include "node_ctx.h"
+#include "synth_ind.h"
+
+#include "../../../../src/util/ngran_types.h"
+#include "../../../../src/util/time_now_us.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GEN_NB_ID_BASE 1000
+
+typedef struct {
+  uint32_t nodes;
+  uint32_t ues;
+  uint32_t seconds;
+  uint32_t period_ms;
+  uint32_t kpm_ms;
+  uint32_t meas;
+  char const *output;
+} gen_opts_t;
+
+static bool take_opt(char const *arg, char const *key, uint32_t *dst) {
+  size_t const len = strlen(key);
+  if (strncmp(arg, key, len) != 0 || arg[len] != '=')
+    return false;
+  char *end = NULL;
+  unsigned long const v = strtoul(arg + len + 1, &end, 10);
+  if (*end != '\0' || v > UINT32_MAX) {
+    fprintf(stderr, "%s: invalid value\n", key);
+    exit(1);
+  }
+  *dst = (uint32_t)v;
+  return true;
+}
+
+static void usage(char const *prog) {
+  printf("Usage: %s [--nodes=N] [--ues=N] [--seconds=N] [--period-ms=N] "
+         "[--kpm-ms=N] [--meas=N] [--output=FILE]\n\n"
+         "  --nodes=N      gNBs, 1 to %d (default 4)\n"
+         "  --ues=N        UEs per gNB, 1 to %d (default 64)\n"
+         "  --seconds=N    Length of the log (default 10)\n"
+         "  --period-ms=N  MAC/RLC/PDCP/GTP report period (default 10)\n"
+         "  --kpm-ms=N     KPM report period, a multiple of the above "
+         "(default 100)\n"
+         "  --meas=N       KPM records per UE, 1 to %d (default %d)\n"
+         "  --output=FILE  Log to write (default /tmp/kpm_load.kpmrec)\n",
+         prog, NODE_CTX_MAX, SYNTH_MAX_UES, KPM_MAX_MEAS, KPM_MEAS_COUNT);
+}
+
+static void parse_opts(gen_opts_t *o, int argc, char *argv[]) {
+  for (int i = 1; i < argc; i++) {
+    char const *a = argv[i];
+    if (strcmp(a, "--help") == 0) {
+      usage(argv[0]);
+      exit(0);
+    }
+    if (strncmp(a, "--output=", 9) == 0) {
+      o->output = a + 9;
+      continue;
+    }
+    if (!take_opt(a, "--nodes", &o->nodes) && !take_opt(a, "--ues", &o->ues) &&
+        !take_opt(a, "--seconds", &o->seconds) &&
+        !take_opt(a, "--period-ms", &o->period_ms) &&
+        !take_opt(a, "--kpm-ms", &o->kpm_ms) &&
+        !take_opt(a, "--meas", &o->meas)) {
+      fprintf(stderr, "Unknown option %s\n", a);
+      exit(1);
+    }
+  }
+}
+
+// The RIC's node list: N gNBs with the five RAN functions the collector
+// subscribes
+static bool build_nodes(e2_node_arr_xapp_t *arr, uint32_t n) {
+  static uint16_t const rf_ids[] = {2, 142, 143, 144, 148};
+  size_t const n_rf = sizeof(rf_ids) / sizeof(rf_ids[0]);
+
+  arr->len = (uint8_t)n;
+  arr->n = calloc(n, sizeof(*arr->n));
+  sm_ran_function_t *rf = calloc((size_t)n * n_rf, sizeof(*rf));
+  if (!arr->n || !rf) {
+    free(arr->n);
+    free(rf);
+    return false;
+  }
+  for (uint32_t k = 0; k < n; k++) {
+    e2_node_connected_xapp_t *e2 = &arr->n[k];
+    e2->id.type = ngran_gNB;
+    e2->id.plmn = (plmn_t){.mcc = 1, .mnc = 1, .mnc_digit_len = 2};
+    e2->id.nb_id.nb_id = GEN_NB_ID_BASE + k;
+    e2->rf = &rf[(size_t)k * n_rf];
+    e2->len_rf = n_rf;
+    for (size_t j = 0; j < n_rf; j++)
+      e2->rf[j].id = rf_ids[j];
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  gen_opts_t o = {.nodes = 4,
+                  .ues = 64,
+                  .seconds = 10,
+                  .period_ms = 10,
+                  .kpm_ms = 100,
+                  .meas = KPM_MEAS_COUNT,
+                  .output = "/tmp/kpm_load.kpmrec"};
+  parse_opts(&o, argc, argv);
+  if (o.nodes < 1 || o.nodes > NODE_CTX_MAX || o.ues < 1 ||
+      o.ues > SYNTH_MAX_UES || o.meas < 1 || o.meas > KPM_MAX_MEAS ||
+      o.seconds < 1 || o.period_ms < 1 || o.kpm_ms < o.period_ms ||
+      o.kpm_ms % o.period_ms != 0) {
+    fprintf(stderr, "--nodes must be 1..%d, --ues 1..%d, --meas 1..%d, "
+                    "--seconds and --period-ms >= 1, and --kpm-ms a "
+                    "multiple of --period-ms\n",
+            NODE_CTX_MAX, SYNTH_MAX_UES, KPM_MAX_MEAS);
+    return 1;
+  }
+
+  static synth_ind_t pl;
+  e2_node_arr_xapp_t nodes;
+  if (!synth_ind_build(&pl, o.ues, o.meas) || !build_nodes(&nodes, o.nodes)) {
+    fprintf(stderr, "Memory exhausted\n");
+    return 1;
+  }
+
+  ind_log_writer_t w;
+  if (!ind_log_writer_open(&w, o.output))
+    return 1;
+
+  printf("Load test log: %u gNBs x %u UEs, %u s, MAC/RLC/PDCP/GTP every %u "
+         "ms, KPM every %u ms\n",
+         o.nodes, o.ues, o.seconds, o.period_ms, o.kpm_ms);
+
+  // The replay attaches the nodes in list order, so node k gets slot k
+  int64_t const period_us = (int64_t)o.period_ms * 1000;
+  int64_t const ts0 = time_now_us();
+  uint64_t const ticks = (uint64_t)o.seconds * 1000 / o.period_ms;
+  uint32_t const kpm_every = o.kpm_ms / o.period_ms;
+  ind_log_write_nodes(&w, ts0, &nodes);
+
+  for (uint64_t tick = 0; tick < ticks; tick++) {
+    int64_t const tick_us = ts0 + (int64_t)tick * period_us;
+    synth_ind_advance(&pl, tick, tick_us);
+    for (uint32_t k = 0; k < o.nodes; k++) {
+      int64_t const ts = tick_us + period_us * k / o.nodes;
+      synth_ind_stamp(&pl, ts);
+      for (size_t s = 0; s < NODE_SUB_COUNT; s++) {
+        if (s == NODE_SUB_KPM && tick % kpm_every != 0)
+          continue;
+        ind_log_write_ind(&w, ts, k, GEN_NB_ID_BASE + k, &pl.rd[s]);
+      }
+    }
+  }
+
+  // Lost records would only show up as a lighter load
+  bool const ok = w.failed == 0;
+  ind_log_writer_close(&w);
+
+  free(nodes.n[0].rf);
+  free(nodes.n);
+  synth_ind_free(&pl);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,1061 @@
+/*
+ * gNB log merger
+ * ==============
+ *
+ * Native replacement for the per-line regex loop of merge_metrics.py. The
+ * nr-softmodem log is memory-mapped and cut into line-aligned chunks that
+ * worker threads scan in parallel. Between marker lines a thread only runs
+ * a SIMD substring search for "Frame.Slot", "UE RNTI " and "sch_rounds ";
+ * a line with a candidate is then matched against the same four patterns
+ * merge_metrics.py uses, in the same order:
+ *
+ *   Frame.Slot <frame>.<slot>
+ *   UE RNTI <hex> ... in-sync|out-of-sync ... PH <n> dB ... PCMAX <n> dBm
+ *       ... average RSRP <n>
+ *   UE <hex>: dlsch_rounds <r0>/<r1>/<r2>/<r3>, dlsch_errors <n>
+ *   UE <hex>: ulsch_rounds <r0>/<r1>/<r2>/<r3>, ulsch_errors <n>
+ *
+ * UE lines are stamped with the Frame.Slot line before them, and lines for
+ * the same (frame, slot, rnti) are folded field by field, later lines
+ * winning. The result is sorted and merge-joined against the collector's
+ * dataset on (rnti, frame, slot): a row takes the UE's latest log entry at
+ * or before its own frame and slot, at most --lookback frames back, across
+ * the 1024 frame wrap.
+ *
+ *   merge_gnb_log [--threads=N] [--lookback=F] DATASET GNB_LOG OUT_CSV
+ *
+ * DATASET is a collector CSV or .kpmc file. OUT_CSV has one line per
+ * dataset row, in dataset order, with the log_* columns merge_metrics.py
+ * adds; a column is empty where no entry matched.
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#define _GNU_SOURCE // memmem
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#define MERGE_FRAMES 1024
+#define MERGE_LOOKBACK 200              // Frames, as in merge_metrics.py
+#define MERGE_CHUNK_BYTES (16u << 20)   // Log bytes per unit of work
+#define MERGE_MAX_THREADS 64
+#define MERGE_OUT_BUF (1u << 20)
+
+// --- Substring search --------------------------------------------------------
+
+// Offset of the first needle (k >= 2 bytes) in p[0, n), or n. Positions
+// where both the needle's first and last bytes match are found a vector at
+// a time; only those are compared in full.
+static size_t find(char const *p, size_t n, char const *needle, size_t k) {
+  size_t i = 0;
+  if (n < k)
+    return n;
+
+#if defined(__AVX2__)
+  __m256i const first = _mm256_set1_epi8(needle[0]);
+  __m256i const last = _mm256_set1_epi8(needle[k - 1]);
+  for (; i + k - 1 + 32 <= n; i += 32) {
+    __m256i const a = _mm256_loadu_si256((__m256i const *)(p + i));
+    __m256i const b = _mm256_loadu_si256((__m256i const *)(p + i + k - 1));
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+        _mm256_and_si256(_mm256_cmpeq_epi8(a, first),
+                         _mm256_cmpeq_epi8(b, last)));
+    while (mask) {
+      unsigned const bit = (unsigned)__builtin_ctz(mask);
+      if (memcmp(p + i + bit + 1, needle + 1, k - 2) == 0)
+        return i + bit;
+      mask &= mask - 1;
+    }
+  }
+#elif defined(__SSE2__)
+  __m128i const first = _mm_set1_epi8(needle[0]);
+  __m128i const last = _mm_set1_epi8(needle[k - 1]);
+  for (; i + k - 1 + 16 <= n; i += 16) {
+    __m128i const a = _mm_loadu_si128((__m128i const *)(p + i));
+    __m128i const b = _mm_loadu_si128((__m128i const *)(p + i + k - 1));
+    unsigned mask = (unsigned)_mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+    while (mask) {
+      unsigned const bit = (unsigned)__builtin_ctz(mask);
+      if (memcmp(p + i + bit + 1, needle + 1, k - 2) == 0)
+        return i + bit;
+      mask &= mask - 1;
+    }
+  }
+#endif
+
+  // The tail, or everything without SIMD
+  char const *hit = memmem(p + i, n - i, needle, k);
+  return hit ? (size_t)(hit - p) : n;
+}
+
+#define LIT(s) s, sizeof(s) - 1
+
+// --- Line patterns -----------------------------------------------------------
+
+// A cursor over one line
+typedef struct {
+  char const *p;
+  char const *end;
+} span_t;
+
+static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+static int hex_val(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+static bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+}
+
+// Moves s past the next needle; false if there is none
+static bool skip_to(span_t *s, char const *needle, size_t k) {
+  size_t const n = (size_t)(s->end - s->p);
+  size_t const at = find(s->p, n, needle, k);
+  if (at == n)
+    return false;
+  s->p += at + k;
+  return true;
+}
+
+// \d+ at s (Python ints are unbounded; these saturate)
+static bool take_uint(span_t *s, int64_t *v) {
+  if (s->p == s->end || !is_digit(*s->p))
+    return false;
+  uint64_t x = 0;
+  while (s->p < s->end && is_digit(*s->p)) {
+    x = x < UINT64_MAX / 10 ? x * 10 + (uint64_t)(*s->p - '0') : UINT64_MAX;
+    s->p++;
+  }
+  *v = x > INT64_MAX ? INT64_MAX : (int64_t)x;
+  return true;
+}
+
+// -?\d+ at s
+static bool take_int(span_t *s, int64_t *v) {
+  span_t t = *s;
+  bool const neg = t.p < t.end && *t.p == '-';
+  t.p += neg;
+  if (!take_uint(&t, v))
+    return false;
+  if (neg)
+    *v = -*v;
+  *s = t;
+  return true;
+}
+
+// [0-9a-fA-F]+ at s
+static bool take_hex(span_t *s, uint64_t *v) {
+  if (s->p == s->end || hex_val(*s->p) < 0)
+    return false;
+  uint64_t x = 0;
+  while (s->p < s->end && hex_val(*s->p) >= 0)
+    x = (x << 4) | (uint64_t)hex_val(*s->p++);
+  *v = x;
+  return true;
+}
+
+static bool take_lit(span_t *s, char const *lit, size_t k) {
+  if ((size_t)(s->end - s->p) < k || memcmp(s->p, lit, k) != 0)
+    return false;
+  s->p += k;
+  return true;
+}
+
+// .*?(-?\d+)\s*<unit>: the first number followed by the unit. A digit run
+// either is followed by it or is not, so runs are tried whole.
+static bool take_num_before(span_t *s, int64_t *v, char const *unit,
+                            size_t k) {
+  for (char const *p = s->p; p < s->end; p++) {
+    if (!is_digit(*p))
+      continue;
+    span_t t = {p > s->p && p[-1] == '-' ? p - 1 : p, s->end};
+    int64_t x;
+    take_int(&t, &x);
+    while (t.p < t.end && is_space(*t.p))
+      t.p++;
+    if (take_lit(&t, unit, k)) {
+      *v = x;
+      *s = t;
+      return true;
+    }
+    while (p + 1 < s->end && is_digit(p[1]))
+      p++;
+  }
+  return false;
+}
+
+typedef enum { EV_FRAME = 0, EV_UE, EV_DL, EV_UL } ev_kind_e;
+
+// One matched log line, in log order
+typedef struct {
+  uint8_t kind;  // ev_kind_e
+  uint8_t sync;  // EV_UE: 0 = in-sync, 1 = out-of-sync
+  uint64_t id;   // EV_FRAME: frame, else the RNTI
+  int64_t v[3];  // slot | ph, pcmax, rsrp | retransmissions, errors
+} ev_t;
+
+// Frame\.Slot\s+(\d+)\.(\d+)
+static bool match_frame(span_t s, ev_t *e) {
+  while (skip_to(&s, LIT("Frame.Slot"))) {
+    span_t t = s;
+    if (t.p == t.end || !is_space(*t.p))
+      continue;
+    while (t.p < t.end && is_space(*t.p))
+      t.p++;
+    int64_t f, sl;
+    if (take_uint(&t, &f) && take_lit(&t, LIT(".")) && take_uint(&t, &sl)) {
+      *e = (ev_t){.kind = EV_FRAME, .id = (uint64_t)f, .v = {sl}};
+      return true;
+    }
+  }
+  return false;
+}
+
+// UE RNTI (hex).*?(in-sync|out-of-sync).*?PH.*?(-?\d+)\s*dB.*?PCMAX.*?
+// (-?\d+)\s*dBm.*?average RSRP (-?\d+)
+static bool match_ue(span_t s, ev_t *e) {
+  while (skip_to(&s, LIT("UE RNTI "))) {
+    span_t t = s;
+    uint64_t rnti;
+    if (!take_hex(&t, &rnti))
+      continue;
+
+    size_t const n = (size_t)(t.end - t.p);
+    size_t const in = find(t.p, n, LIT("in-sync"));
+    size_t const out = find(t.p, n, LIT("out-of-sync"));
+    if (in == n && out == n)
+      return false;
+    uint8_t const sync = out < in;
+    t.p += sync ? out + sizeof("out-of-sync") - 1 : in + sizeof("in-sync") - 1;
+
+    int64_t ph, pcmax, rsrp;
+    if (!skip_to(&t, LIT("PH")) || !take_num_before(&t, &ph, LIT("dB")) ||
+        !skip_to(&t, LIT("PCMAX")) ||
+        !take_num_before(&t, &pcmax, LIT("dBm")))
+      return false;
+    while (skip_to(&t, LIT("average RSRP "))) {
+      if (take_int(&t, &rsrp)) {
+        *e = (ev_t){.kind = EV_UE, .sync = sync, .id = rnti,
+                    .v = {ph, pcmax, rsrp}};
+        return true;
+      }
+    }
+    return false;
+  }
+  return false;
+}
+
+// UE (hex): <dir>sch_rounds (\d+)/(\d+)/(\d+)/(\d+), <dir>sch_errors (\d+)
+static bool match_rounds(span_t s, ev_t *e, bool ul) {
+  char const *const rounds = ul ? ": ulsch_rounds " : ": dlsch_rounds ";
+  char const *const errors = ul ? ", ulsch_errors " : ", dlsch_errors ";
+  char const *const line = s.p;
+
+  while (skip_to(&s, rounds, 15)) {
+    // Back over the RNTI to "UE "
+    char const *colon = s.p - 15;
+    char const *h = colon;
+    while (h > line && hex_val(h[-1]) >= 0)
+      h--;
+    if (h == colon || h - line < 3 || memcmp(h - 3, "UE ", 3) != 0)
+      continue;
+
+    span_t t = s;
+    int64_t r[4], err;
+    if (!take_uint(&t, &r[0]) || !take_lit(&t, LIT("/")) ||
+        !take_uint(&t, &r[1]) || !take_lit(&t, LIT("/")) ||
+        !take_uint(&t, &r[2]) || !take_lit(&t, LIT("/")) ||
+        !take_uint(&t, &r[3]) || !take_lit(&t, errors, 15) ||
+        !take_uint(&t, &err))
+      continue;
+
+    span_t hex = {h, colon};
+    uint64_t rnti;
+    take_hex(&hex, &rnti);
+    *e = (ev_t){.kind = ul ? EV_UL : EV_DL, .id = rnti,
+                .v = {r[1] + r[2] + r[3], err}};
+    return true;
+  }
+  return false;
+}
+
+// The first pattern the line matches, in merge_metrics.py's order
+static bool match_line(char const *p, char const *end, ev_t *e) {
+  span_t const s = {p, end};
+  return match_frame(s, e) || match_ue(s, e) || match_rounds(s, e, false) ||
+         match_rounds(s, e, true);
+}
+
+// --- Parallel scan -----------------------------------------------------------
+
+typedef struct {
+  char const *p;
+  size_t len;
+  ev_t *ev;
+  size_t n_ev;
+  size_t cap;
+  bool oom;
+} chunk_t;
+
+typedef struct {
+  chunk_t *chunks;
+  size_t n_chunks;
+  _Atomic size_t next;
+} scan_t;
+
+static void push_ev(chunk_t *c, ev_t const *e) {
+  if (c->n_ev == c->cap) {
+    size_t const cap = c->cap ? c->cap * 2 : 1024;
+    ev_t *ev = realloc(c->ev, cap * sizeof(*ev));
+    if (!ev) {
+      c->oom = true;
+      return;
+    }
+    c->ev = ev;
+    c->cap = cap;
+  }
+  c->ev[c->n_ev++] = *e;
+}
+
+static void scan_chunk(chunk_t *c) {
+  static struct {
+    char const *s;
+    size_t k;
+  } const marker[] = {{LIT("Frame.Slot")}, {LIT("UE RNTI ")},
+                      {LIT("sch_rounds ")}};
+#define N_MARKERS (sizeof(marker) / sizeof(marker[0]))
+
+  char const *const base = c->p;
+  size_t const n = c->len;
+  size_t next[N_MARKERS];
+  for (size_t m = 0; m < N_MARKERS; m++)
+    next[m] = find(base, n, marker[m].s, marker[m].k);
+
+  for (;;) {
+    size_t at = n;
+    for (size_t m = 0; m < N_MARKERS; m++)
+      at = next[m] < at ? next[m] : at;
+    if (at == n)
+      break;
+
+    // Chunks start at a line, so the search back stays inside this one
+    char const *ls = base + at;
+    while (ls > base && ls[-1] != '\n')
+      ls--;
+    char const *le = memchr(base + at, '\n', n - at);
+    if (!le)
+      le = base + n;
+
+    ev_t e;
+    if (match_line(ls, le, &e))
+      push_ev(c, &e);
+
+    size_t const from = (size_t)(le - base) + (le < base + n);
+    for (size_t m = 0; m < N_MARKERS; m++) {
+      if (next[m] < from)
+        next[m] = from + find(base + from, n - from, marker[m].s, marker[m].k);
+    }
+  }
+#undef N_MARKERS
+}
+
+static void *scan_worker(void *arg) {
+  scan_t *s = arg;
+  for (;;) {
+    size_t const i = atomic_fetch_add_explicit(&s->next, 1,
+                                               memory_order_relaxed);
+    if (i >= s->n_chunks)
+      return NULL;
+    scan_chunk(&s->chunks[i]);
+  }
+}
+
+// --- Log entries -------------------------------------------------------------
+
+#define HAS_UE (1u << 0)
+#define HAS_DL (1u << 1)
+#define HAS_UL (1u << 2)
+
+// Everything the log says about one (rnti, frame, slot)
+typedef struct {
+  uint64_t rnti;
+  int64_t frame, slot;
+  uint64_t seq; // Log order, so later lines win when folding
+  unsigned has;
+  uint8_t sync;
+  int64_t ph, pcmax, rsrp;
+  int64_t harq_dl, dlsch_err;
+  int64_t harq_ul, ulsch_err;
+} entry_t;
+
+static int cmp_entry(void const *a, void const *b) {
+  entry_t const *x = a, *y = b;
+  if (x->rnti != y->rnti)
+    return x->rnti < y->rnti ? -1 : 1;
+  if (x->frame != y->frame)
+    return x->frame < y->frame ? -1 : 1;
+  if (x->slot != y->slot)
+    return x->slot < y->slot ? -1 : 1;
+  return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+static void fold_into(entry_t *d, entry_t const *s) {
+  if (s->has & HAS_UE) {
+    d->sync = s->sync;
+    d->ph = s->ph;
+    d->pcmax = s->pcmax;
+    d->rsrp = s->rsrp;
+  }
+  if (s->has & HAS_DL) {
+    d->harq_dl = s->harq_dl;
+    d->dlsch_err = s->dlsch_err;
+  }
+  if (s->has & HAS_UL) {
+    d->harq_ul = s->harq_ul;
+    d->ulsch_err = s->ulsch_err;
+  }
+  d->has |= s->has;
+}
+
+// Stamps the UE lines with their Frame.Slot and folds them per key. Lines
+// before the first Frame.Slot, and frames outside 0..1023, can never match
+// a row and are left out. Returns the entry count, sorted.
+static size_t build_entries(chunk_t const *chunks, size_t n_chunks,
+                            entry_t **out) {
+  size_t total = 0;
+  for (size_t i = 0; i < n_chunks; i++)
+    total += chunks[i].n_ev;
+
+  entry_t *en = malloc((total ? total : 1) * sizeof(*en));
+  if (!en)
+    return SIZE_MAX;
+
+  size_t n = 0;
+  uint64_t seq = 0;
+  bool have_frame = false;
+  int64_t frame = 0, slot = 0;
+
+  for (size_t i = 0; i < n_chunks; i++) {
+    for (size_t j = 0; j < chunks[i].n_ev; j++) {
+      ev_t const *e = &chunks[i].ev[j];
+      if (e->kind == EV_FRAME) {
+        have_frame = true;
+        frame = e->id > INT64_MAX ? INT64_MAX : (int64_t)e->id;
+        slot = e->v[0];
+        continue;
+      }
+      if (!have_frame || frame >= MERGE_FRAMES)
+        continue;
+
+      entry_t *x = &en[n++];
+      *x = (entry_t){.rnti = e->id, .frame = frame, .slot = slot,
+                     .seq = seq++};
+      switch (e->kind) {
+      case EV_UE:
+        x->has = HAS_UE;
+        x->sync = e->sync;
+        x->ph = e->v[0];
+        x->pcmax = e->v[1];
+        x->rsrp = e->v[2];
+        break;
+      case EV_DL:
+        x->has = HAS_DL;
+        x->harq_dl = e->v[0];
+        x->dlsch_err = e->v[1];
+        break;
+      default:
+        x->has = HAS_UL;
+        x->harq_ul = e->v[0];
+        x->ulsch_err = e->v[1];
+        break;
+      }
+    }
+  }
+
+  qsort(en, n, sizeof(*en), cmp_entry);
+
+  size_t w = 0;
+  for (size_t r = 0; r < n; r++) {
+    if (w && en[w - 1].rnti == en[r].rnti && en[w - 1].frame == en[r].frame &&
+        en[w - 1].slot == en[r].slot)
+      fold_into(&en[w - 1], &en[r]);
+    else
+      en[w++] = en[r];
+  }
+
+  *out = en;
+  return w;
+}
+
+// --- Dataset -----------------------------------------------------------------
+
+typedef struct {
+  uint64_t rnti;
+  int64_t frame, slot;
+  bool ok;
+} row_key_t;
+
+typedef struct {
+  row_key_t *rows;
+  size_t n;
+  size_t cap;
+} rows_t;
+
+static bool push_row(rows_t *r, row_key_t const *k) {
+  if (r->n == r->cap) {
+    size_t const cap = r->cap ? r->cap * 2 : 65536;
+    row_key_t *rows = realloc(r->rows, cap * sizeof(*rows));
+    if (!rows)
+      return false;
+    r->rows = rows;
+    r->cap = cap;
+  }
+  r->rows[r->n++] = *k;
+  return true;
+}
+
+typedef struct {
+  char const *p;
+  size_t len;
+  void *map;
+  size_t map_len;
+} mapped_t;
+
+static bool map_file(char const *path, mapped_t *m) {
+  memset(m, 0, sizeof(*m));
+  int const fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    fprintf(stderr, "Cannot stat %s: %s\n", path, strerror(errno));
+    close(fd);
+    return false;
+  }
+  m->len = (size_t)st.st_size;
+  if (m->len) {
+    m->map = mmap(NULL, m->len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (m->map == MAP_FAILED) {
+      fprintf(stderr, "Cannot map %s: %s\n", path, strerror(errno));
+      close(fd);
+      return false;
+    }
+    madvise(m->map, m->len, MADV_SEQUENTIAL);
+    m->map_len = m->len;
+    m->p = m->map;
+  }
+  close(fd);
+  return true;
+}
+
+static void unmap_file(mapped_t *m) {
+  if (m->map_len)
+    munmap(m->map, m->map_len);
+}
+
+// A whole CSV field that is an (optionally negative) integer
+static bool field_int(char const *p, char const *end, int64_t *v) {
+  span_t s = {p, end};
+  return take_int(&s, v) && s.p == end;
+}
+
+static bool read_csv(mapped_t const *m, rows_t *rows) {
+  if (m->len == 0) {
+    fprintf(stderr, "Dataset is empty\n");
+    return false;
+  }
+  char const *p = m->p;
+  char const *const end = m->p + m->len;
+
+  char const *nl = memchr(p, '\n', (size_t)(end - p));
+  char const *he = nl ? nl : end;
+  if (he > p && he[-1] == '\r')
+    he--;
+
+  // Column positions of the join keys
+  int col[3] = {-1, -1, -1};
+  static char const *const key[3] = {"rnti", "frame", "slot"};
+  int i = 0;
+  for (char const *f = p; f <= he; i++) {
+    char const *fe = memchr(f, ',', (size_t)(he - f));
+    if (!fe)
+      fe = he;
+    for (int k = 0; k < 3; k++) {
+      if ((size_t)(fe - f) == strlen(key[k]) && memcmp(f, key[k], fe - f) == 0)
+        col[k] = i;
+    }
+    f = fe + 1;
+  }
+  for (int k = 0; k < 3; k++) {
+    if (col[k] < 0) {
+      fprintf(stderr, "Dataset has no %s column\n", key[k]);
+      return false;
+    }
+  }
+
+  for (p = nl ? nl + 1 : end; p < end;) {
+    nl = memchr(p, '\n', (size_t)(end - p));
+    char const *le = nl ? nl : end;
+    char const *next = nl ? nl + 1 : end;
+    if (le > p && le[-1] == '\r')
+      le--;
+    if (le == p) {
+      p = next;
+      continue;
+    }
+
+    int64_t v[3] = {0};
+    int got = 0;
+    i = 0;
+    for (char const *f = p; f <= le; i++) {
+      char const *fe = memchr(f, ',', (size_t)(le - f));
+      if (!fe)
+        fe = le;
+      for (int k = 0; k < 3; k++) {
+        if (col[k] == i && field_int(f, fe, &v[k]))
+          got |= 1 << k;
+      }
+      f = fe + 1;
+    }
+
+    row_key_t const r = {.rnti = (uint64_t)v[0], .frame = v[1], .slot = v[2],
+                         .ok = got == 7 && v[0] >= 0};
+    if (!push_row(rows, &r))
+      return false;
+    p = next;
+  }
+  return true;
+}
+
+// .kpmc layout: see col_sink.c
+#define KPMC_HEADER 64
+#define KPMC_DESC 48
+#define KPMC_NAME 40
+
+static int64_t kpmc_int(uint8_t const *p, uint8_t type) {
+  int8_t i8;
+  uint16_t u16;
+  int32_t i32;
+  uint32_t u32;
+  int64_t i64;
+
+  switch (type) {
+  case 1:
+    memcpy(&i8, p, sizeof(i8));
+    return i8;
+  case 2:
+    return p[0];
+  case 3:
+    memcpy(&u16, p, sizeof(u16));
+    return u16;
+  case 4:
+    memcpy(&i32, p, sizeof(i32));
+    return i32;
+  case 5:
+    memcpy(&u32, p, sizeof(u32));
+    return u32;
+  default: // 6 and 7; u64 RNTIs or frames that big never match anyway
+    memcpy(&i64, p, sizeof(i64));
+    return i64;
+  }
+}
+
+static size_t pad8(size_t n) { return (n + 7) & ~(size_t)7; }
+
+static bool read_kpmc(mapped_t const *m, rows_t *rows) {
+  uint8_t const *const b = (uint8_t const *)m->p;
+  if (m->len < KPMC_HEADER || memcmp(b, "KPMCOL\0\1", 8) != 0) {
+    fprintf(stderr, "Not a .kpmc file\n");
+    return false;
+  }
+  uint32_t hv[4];
+  memcpy(hv, b + 8, sizeof(hv));
+  uint32_t const n_cols = hv[1];
+  size_t const hdr = hv[3];
+  if (hv[0] != 1 || hdr != KPMC_HEADER + (size_t)n_cols * KPMC_DESC ||
+      hdr > m->len) {
+    fprintf(stderr, "Unsupported .kpmc header\n");
+    return false;
+  }
+
+  static char const *const key[3] = {"rnti", "frame", "slot"};
+  int col[3] = {-1, -1, -1};
+  uint8_t type[3] = {0}, size[3] = {0};
+  for (uint32_t c = 0; c < n_cols; c++) {
+    uint8_t const *d = b + KPMC_HEADER + (size_t)c * KPMC_DESC;
+    for (int k = 0; k < 3; k++) {
+      if (strncmp((char const *)d, key[k], KPMC_NAME) == 0) {
+        col[k] = (int)c;
+        type[k] = d[KPMC_NAME];
+        size[k] = d[KPMC_NAME + 1];
+      }
+    }
+  }
+  for (int k = 0; k < 3; k++) {
+    if (col[k] < 0 || type[k] < 1 || type[k] > 7) {
+      fprintf(stderr, "Dataset has no integer %s column\n", key[k]);
+      return false;
+    }
+  }
+
+  size_t off = hdr;
+  while (off + 16 <= m->len) {
+    if (memcmp(b + off, "CHNK", 4) != 0) {
+      fprintf(stderr, "Corrupt chunk header at offset %zu\n", off);
+      return false;
+    }
+    uint32_t n_rows;
+    uint64_t chunk_size;
+    memcpy(&n_rows, b + off + 4, 4);
+    memcpy(&chunk_size, b + off + 8, 8);
+    if (chunk_size < 16 || chunk_size > m->len - off)
+      break; // Truncated tail, e.g. the collector was killed mid-write
+
+    // Column starts within the chunk
+    uint8_t const *base[3] = {NULL};
+    size_t col_off = off + 16;
+    for (uint32_t c = 0; c < n_cols; c++) {
+      uint8_t const elem = b[KPMC_HEADER + (size_t)c * KPMC_DESC + KPMC_NAME + 1];
+      for (int k = 0; k < 3; k++) {
+        if (col[k] == (int)c)
+          base[k] = b + col_off;
+      }
+      col_off += pad8((size_t)n_rows * elem);
+    }
+    if (col_off > off + chunk_size)
+      break;
+
+    for (uint32_t r = 0; r < n_rows; r++) {
+      int64_t v[3];
+      for (int k = 0; k < 3; k++)
+        v[k] = kpmc_int(base[k] + (size_t)r * size[k], type[k]);
+      row_key_t const row = {.rnti = (uint64_t)v[0], .frame = v[1],
+                             .slot = v[2], .ok = v[0] >= 0};
+      if (!push_row(rows, &row))
+        return false;
+    }
+    off += chunk_size;
+  }
+  return true;
+}
+
+// --- Join --------------------------------------------------------------------
+
+static row_key_t const *sort_rows; // qsort has no user pointer
+
+static int cmp_row(void const *a, void const *b) {
+  row_key_t const *x = &sort_rows[*(size_t const *)a];
+  row_key_t const *y = &sort_rows[*(size_t const *)b];
+  if (x->rnti != y->rnti)
+    return x->rnti < y->rnti ? -1 : 1;
+  if (x->frame != y->frame)
+    return x->frame < y->frame ? -1 : 1;
+  if (x->slot != y->slot)
+    return x->slot < y->slot ? -1 : 1;
+  return *(size_t const *)a < *(size_t const *)b ? -1 : 1;
+}
+
+static bool entry_le(entry_t const *e, int64_t frame, int64_t slot) {
+  return e->frame < frame || (e->frame == frame && e->slot <= slot);
+}
+
+// match[i] = the entry row i takes, or SIZE_MAX
+static bool join(row_key_t *rows, size_t n_rows, entry_t const *en,
+                 size_t n_en, int64_t lookback, size_t *match) {
+  size_t *order = malloc((n_rows ? n_rows : 1) * sizeof(*order));
+  if (!order)
+    return false;
+
+  size_t n = 0;
+  for (size_t i = 0; i < n_rows; i++) {
+    match[i] = SIZE_MAX;
+    if (!rows[i].ok)
+      continue;
+    // Rows are matched on the frame number as the log prints it
+    rows[i].frame = ((rows[i].frame % MERGE_FRAMES) + MERGE_FRAMES) %
+                    MERGE_FRAMES;
+    order[n++] = i;
+  }
+  sort_rows = rows;
+  qsort(order, n, sizeof(*order), cmp_row);
+
+  // Both sides are sorted on (rnti, frame, slot), so one pass does it
+  size_t lo = 0, hi = 0, j = 0;
+  uint64_t cur = 0;
+  bool have = false;
+  for (size_t k = 0; k < n; k++) {
+    row_key_t const *r = &rows[order[k]];
+    if (!have || r->rnti != cur) {
+      have = true;
+      cur = r->rnti;
+      while (lo < n_en && en[lo].rnti < cur)
+        lo++;
+      hi = lo;
+      while (hi < n_en && en[hi].rnti == cur)
+        hi++;
+      j = lo;
+    }
+    if (lo == hi)
+      continue;
+
+    while (j < hi && entry_le(&en[j], r->frame, r->slot))
+      j++;
+
+    // Nothing at or before the row in this frame cycle: the UE's last
+    // entry is from the previous cycle
+    size_t const c = j > lo ? j - 1 : hi - 1;
+    int64_t const age = r->frame - en[c].frame + (j > lo ? 0 : MERGE_FRAMES);
+    if (age < lookback)
+      match[order[k]] = c;
+  }
+
+  free(order);
+  return true;
+}
+
+// --- Output ------------------------------------------------------------------
+
+typedef struct {
+  FILE *f;
+  char buf[MERGE_OUT_BUF];
+  size_t len;
+  bool err;
+} out_t;
+
+static void out_flush(out_t *o) {
+  if (o->len && fwrite(o->buf, 1, o->len, o->f) != o->len)
+    o->err = true;
+  o->len = 0;
+}
+
+static void out_str(out_t *o, char const *s) {
+  size_t const k = strlen(s);
+  if (MERGE_OUT_BUF - o->len < k + 1)
+    out_flush(o);
+  memcpy(o->buf + o->len, s, k);
+  o->len += k;
+}
+
+static void out_int(out_t *o, bool has, int64_t v, char sep) {
+  char tmp[32];
+  int const k = has ? snprintf(tmp, sizeof(tmp), "%ld%c", v, sep)
+                    : snprintf(tmp, sizeof(tmp), "%c", sep);
+  if (MERGE_OUT_BUF - o->len < (size_t)k + 1)
+    out_flush(o);
+  memcpy(o->buf + o->len, tmp, (size_t)k);
+  o->len += (size_t)k;
+}
+
+static bool write_out(char const *path, size_t n_rows, size_t const *match,
+                      entry_t const *en) {
+  static out_t o;
+  o.f = fopen(path, "w");
+  if (!o.f) {
+    fprintf(stderr, "Cannot create %s: %s\n", path, strerror(errno));
+    return false;
+  }
+  o.len = 0;
+  o.err = false;
+
+  out_str(&o, "log_rsrp,log_ph,log_pcmax,log_sync,log_harq_dl,log_harq_ul,"
+              "log_dlsch_err,log_ulsch_err\n");
+  for (size_t i = 0; i < n_rows; i++) {
+    entry_t const *e = match[i] != SIZE_MAX ? &en[match[i]] : NULL;
+    bool const ue = e && (e->has & HAS_UE);
+    bool const dl = e && (e->has & HAS_DL);
+    bool const ul = e && (e->has & HAS_UL);
+    out_int(&o, ue, ue ? e->rsrp : 0, ',');
+    out_int(&o, ue, ue ? e->ph : 0, ',');
+    out_int(&o, ue, ue ? e->pcmax : 0, ',');
+    out_str(&o, ue ? (e->sync ? "out-of-sync," : "in-sync,") : ",");
+    out_int(&o, dl, dl ? e->harq_dl : 0, ',');
+    out_int(&o, ul, ul ? e->harq_ul : 0, ',');
+    out_int(&o, dl, dl ? e->dlsch_err : 0, ',');
+    out_int(&o, ul, ul ? e->ulsch_err : 0, '\n');
+  }
+  out_flush(&o);
+
+  bool const ok = !o.err && fclose(o.f) == 0;
+  if (!ok)
+    fprintf(stderr, "Cannot write %s\n", path);
+  return ok;
+}
+
+// --- Main --------------------------------------------------------------------
+
+static double mono_s(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+static bool ends_with(char const *s, char const *suffix) {
+  size_t const n = strlen(s), k = strlen(suffix);
+  return n >= k && strcmp(s + n - k, suffix) == 0;
+}
+
+static void usage(char const *prog) {
+  fprintf(stderr,
+          "Usage: %s [--threads=N] [--lookback=FRAMES] DATASET GNB_LOG "
+          "OUT_CSV\n"
+          "  DATASET   collector output (.csv or .kpmc)\n"
+          "  GNB_LOG   nr-softmodem log\n"
+          "  OUT_CSV   log_* columns, one line per dataset row\n",
+          prog);
+}
+
+int main(int argc, char *argv[]) {
+  long threads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads < 1)
+    threads = 1;
+  long lookback = MERGE_LOOKBACK;
+  char const *pos[3];
+  int n_pos = 0;
+
+  for (int i = 1; i < argc; i++) {
+    char *end = NULL;
+    if (strncmp(argv[i], "--threads=", 10) == 0) {
+      threads = strtol(argv[i] + 10, &end, 10);
+      if (*end || threads < 1)
+        threads = 0;
+    } else if (strncmp(argv[i], "--lookback=", 11) == 0) {
+      lookback = strtol(argv[i] + 11, &end, 10);
+      if (*end || lookback < 1 || lookback > MERGE_FRAMES)
+        lookback = 0;
+    } else if (argv[i][0] == '-' || n_pos == 3) {
+      usage(argv[0]);
+      return 1;
+    } else {
+      pos[n_pos++] = argv[i];
+    }
+  }
+  if (n_pos != 3 || threads < 1 || lookback < 1) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (threads > MERGE_MAX_THREADS)
+    threads = MERGE_MAX_THREADS;
+
+  // Dataset keys
+  mapped_t ds;
+  rows_t rows = {0};
+  if (!map_file(pos[0], &ds))
+    return 1;
+  bool const ds_ok =
+      ends_with(pos[0], ".kpmc") ? read_kpmc(&ds, &rows) : read_csv(&ds, &rows);
+  unmap_file(&ds);
+  if (!ds_ok)
+    return 1;
+
+  // Log scan: line-aligned chunks, handed out to the workers as they free up
+  mapped_t log;
+  if (!map_file(pos[1], &log))
+    return 1;
+  double const t0 = mono_s();
+
+  size_t n_chunks = log.len / MERGE_CHUNK_BYTES + 1;
+  if (n_chunks < (size_t)threads)
+    n_chunks = (size_t)threads;
+  chunk_t *chunks = calloc(n_chunks, sizeof(*chunks));
+  if (!chunks) {
+    fprintf(stderr, "Out of memory\n");
+    return 1;
+  }
+  size_t start = 0, used = 0;
+  for (size_t i = 0; i < n_chunks && start < log.len; i++) {
+    size_t stop = i + 1 == n_chunks ? log.len : log.len / n_chunks * (i + 1);
+    if (stop < start)
+      stop = start;
+    char const *nl = stop < log.len ? memchr(log.p + stop, '\n',
+                                             log.len - stop)
+                                    : NULL;
+    stop = nl ? (size_t)(nl - log.p) + 1 : log.len;
+    chunks[used++] = (chunk_t){.p = log.p + start, .len = stop - start};
+    start = stop;
+  }
+
+  scan_t scan = {.chunks = chunks, .n_chunks = used};
+  atomic_init(&scan.next, 0);
+  pthread_t tid[MERGE_MAX_THREADS];
+  long started = 0;
+  for (; started < threads - 1; started++) {
+    if (pthread_create(&tid[started], NULL, scan_worker, &scan) != 0)
+      break;
+  }
+  scan_worker(&scan);
+  for (long i = 0; i < started; i++)
+    pthread_join(tid[i], NULL);
+  double const t1 = mono_s();
+
+  size_t n_ev[4] = {0};
+  for (size_t i = 0; i < used; i++) {
+    if (chunks[i].oom) {
+      fprintf(stderr, "Out of memory scanning the log\n");
+      return 1;
+    }
+    for (size_t j = 0; j < chunks[i].n_ev; j++)
+      n_ev[chunks[i].ev[j].kind]++;
+  }
+
+  entry_t *en = NULL;
+  size_t const n_en = build_entries(chunks, used, &en);
+  for (size_t i = 0; i < used; i++)
+    free(chunks[i].ev);
+  free(chunks);
+  unmap_file(&log);
+  if (n_en == SIZE_MAX) {
+    fprintf(stderr, "Out of memory\n");
+    return 1;
+  }
+
+  size_t *match = malloc((rows.n ? rows.n : 1) * sizeof(*match));
+  if (!match || !join(rows.rows, rows.n, en, n_en, lookback, match)) {
+    fprintf(stderr, "Out of memory\n");
+    return 1;
+  }
+  size_t matched = 0;
+  for (size_t i = 0; i < rows.n; i++)
+    matched += match[i] != SIZE_MAX;
+
+  bool const ok = write_out(pos[2], rows.n, match, en);
+  double const t2 = mono_s();
+
+  double const mb = (double)log.len / 1e6;
+  printf("Scanned %.1f MB of log in %.3f s (%.0f MB/s, %ld threads): %zu "
+         "Frame.Slot, %zu UE, %zu dlsch, %zu ulsch lines\n",
+         mb, t1 - t0, t1 > t0 ? mb / (t1 - t0) : 0.0, started + 1,
+         n_ev[EV_FRAME], n_ev[EV_UE], n_ev[EV_DL], n_ev[EV_UL]);
+  printf("Joined %zu rows with %zu log entries in %.3f s: %zu matched\n",
+         rows.n, n_en, t2 - t1, matched);
+
+  free(match);
+  free(en);
+  free(rows.rows);
+  return ok ? 0 : 1;
+}
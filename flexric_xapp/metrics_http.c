@@ -0,0 +1,501 @@
+/*
+ * Metrics endpoint
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#include "metrics_http.h"
+
+#include "../../../../src/util/time_now_us.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define HTTP_MAX_REQUEST 4096
+#define HTTP_IO_TIMEOUT_S 2
+
+// --- Metric table ------------------------------------------------------------
+
+// Which source must have reported for the value to mean anything
+typedef enum { SRC_MAC, SRC_RLC, SRC_PDCP, SRC_GTP, SRC_KPM } src_e;
+
+typedef struct {
+  ue_field_t fld;
+  char const *type;
+  char const *help;
+  src_e src;
+} metric_def_t;
+
+#define METRIC(name, type, help, src, kind, field)                             \
+  {UE_FIELD(name, kind, field), type, help, src}
+
+// KPM is node level (see kpm_totals_t), so those come out once per node
+static metric_def_t const metrics[] = {
+    METRIC("kpm_ue_cqi", "gauge", "Wideband CQI", SRC_MAC, U8, cqi),
+    METRIC("kpm_ue_pusch_snr_db", "gauge", "PUSCH SNR", SRC_MAC, F32,
+           pusch_snr),
+    METRIC("kpm_ue_pucch_snr_db", "gauge", "PUCCH SNR", SRC_MAC, F32,
+           pucch_snr),
+    METRIC("kpm_ue_dl_bler", "gauge", "Downlink BLER", SRC_MAC, F32, dl_bler),
+    METRIC("kpm_ue_ul_bler", "gauge", "Uplink BLER", SRC_MAC, F32, ul_bler),
+    METRIC("kpm_ue_dl_mcs", "gauge", "Downlink MCS", SRC_MAC, U8, dl_mcs1),
+    METRIC("kpm_ue_ul_mcs", "gauge", "Uplink MCS", SRC_MAC, U8, ul_mcs1),
+    METRIC("kpm_ue_dl_tbs_bytes", "gauge", "Current downlink TBS", SRC_MAC, U64,
+           dl_tbs),
+    METRIC("kpm_ue_ul_tbs_bytes", "gauge", "Current uplink TBS", SRC_MAC, U64,
+           ul_tbs),
+    METRIC("kpm_ue_dl_aggr_tbs_bytes_total", "counter", "Downlink TBS sum",
+           SRC_MAC, U64, dl_aggr_tbs),
+    METRIC("kpm_ue_ul_aggr_tbs_bytes_total", "counter", "Uplink TBS sum",
+           SRC_MAC, U64, ul_aggr_tbs),
+    METRIC("kpm_ue_dl_prb_total", "counter", "Downlink PRBs allocated", SRC_MAC,
+           U32, dl_prb),
+    METRIC("kpm_ue_ul_prb_total", "counter", "Uplink PRBs allocated", SRC_MAC,
+           U32, ul_prb),
+    METRIC("kpm_ue_dl_sched_rb", "gauge", "Downlink RBs in the last slot",
+           SRC_MAC, U32, dl_sched_rb),
+    METRIC("kpm_ue_ul_sched_rb", "gauge", "Uplink RBs in the last slot",
+           SRC_MAC, U32, ul_sched_rb),
+    METRIC("kpm_ue_bsr_bytes", "gauge", "Buffer status report", SRC_MAC, U32,
+           bsr),
+    METRIC("kpm_ue_phr_db", "gauge", "Power headroom", SRC_MAC, I8, phr),
+    METRIC("kpm_ue_rlc_txbuf_bytes", "gauge", "RLC transmit buffer occupancy",
+           SRC_RLC, U32, rlc_txbuf),
+    METRIC("kpm_ue_rlc_rxbuf_bytes", "gauge", "RLC receive buffer occupancy",
+           SRC_RLC, U32, rlc_rxbuf),
+    METRIC("kpm_ue_rlc_tx_bytes_total", "counter", "RLC PDU bytes sent",
+           SRC_RLC, U32, rlc_tx_bytes),
+    METRIC("kpm_ue_rlc_rx_bytes_total", "counter", "RLC PDU bytes received",
+           SRC_RLC, U32, rlc_rx_bytes),
+    METRIC("kpm_ue_rlc_retx_total", "counter", "RLC PDUs retransmitted",
+           SRC_RLC, U32, rlc_retx),
+    METRIC("kpm_ue_pdcp_tx_bytes_total", "counter", "PDCP PDU bytes sent",
+           SRC_PDCP, U32, pdcp_tx_bytes),
+    METRIC("kpm_ue_pdcp_rx_bytes_total", "counter", "PDCP PDU bytes received",
+           SRC_PDCP, U32, pdcp_rx_bytes),
+    METRIC("kpm_ue_gtp_tunnels", "gauge", "GTP NG-U tunnels", SRC_GTP, U8,
+           gtp_tunnels),
+    METRIC("kpm_node_dl_thp_kbps", "gauge", "KPM downlink throughput, all UEs",
+           SRC_KPM, F64, dl_thp_kbps),
+    METRIC("kpm_node_ul_thp_kbps", "gauge", "KPM uplink throughput, all UEs",
+           SRC_KPM, F64, ul_thp_kbps),
+    METRIC("kpm_node_rlc_sdu_delay_us", "gauge", "KPM RLC SDU delay, UE mean",
+           SRC_KPM, F64, rlc_sdu_delay_us),
+    METRIC("kpm_node_prb_tot_dl", "gauge", "KPM downlink PRBs used", SRC_KPM,
+           I32, prb_tot_dl),
+    METRIC("kpm_node_prb_tot_ul", "gauge", "KPM uplink PRBs used", SRC_KPM, I32,
+           prb_tot_ul),
+};
+
+#undef METRIC
+
+#define N_METRICS (sizeof(metrics) / sizeof(metrics[0]))
+
+static bool has_src(ue_metrics_t const *m, src_e src) {
+  switch (src) {
+  case SRC_MAC:
+    return m->mac_valid;
+  case SRC_RLC:
+    return m->rlc_valid;
+  case SRC_PDCP:
+    return m->pdcp_valid;
+  case SRC_GTP:
+    return m->gtp_valid;
+  case SRC_KPM:
+    return m->kpm_valid;
+  }
+  return false;
+}
+
+// --- Rendering ---------------------------------------------------------------
+
+typedef struct {
+  metrics_http_t *h;
+  size_t len;
+  bool oom;
+} out_t;
+
+static void out_printf(out_t *o, char const *fmt, ...) {
+  if (o->oom)
+    return;
+
+  for (;;) {
+    size_t const room = o->h->body_cap - o->len;
+    va_list ap;
+    va_start(ap, fmt);
+    int const n = vsnprintf(o->h->body + o->len, room, fmt, ap);
+    va_end(ap);
+    if (n < 0) {
+      o->oom = true;
+      return;
+    }
+    if ((size_t)n < room) {
+      o->len += (size_t)n;
+      return;
+    }
+
+    size_t const cap = o->h->body_cap * 2 + (size_t)n;
+    char *body = realloc(o->h->body, cap);
+    if (!body) {
+      o->oom = true;
+      return;
+    }
+    o->h->body = body;
+    o->h->body_cap = cap;
+  }
+}
+
+// 64-bit byte counters are printed as integers so they keep every digit
+static void out_value(out_t *o, ue_metrics_t const *m, metric_def_t const *d) {
+  if (d->fld.type == UE_FIELD_U64)
+    out_printf(o, " %" PRIu64 "\n",
+               *(uint64_t const *)((char const *)m + d->fld.off));
+  else
+    out_printf(o, " %.9g\n", ue_field_value(m, &d->fld));
+}
+
+// Caller holds the watcher's mtx, so no listed node is retired meanwhile
+static size_t render_nodes(metrics_http_t *h, node_ctx_t *nodes,
+                           size_t const *live, size_t n_live) {
+  static size_t n_ues[NODE_CTX_MAX];
+  static size_t tracked[NODE_CTX_MAX];
+  static uint64_t rows[NODE_CTX_MAX];
+  static uint64_t evicted[NODE_CTX_MAX];
+  static ue_metrics_t const *latest[NODE_CTX_MAX];
+
+  // Copy every node out first; the copies take no lock the callbacks use
+  int64_t newest = 0;
+  for (size_t k = 0; k < n_live; k++) {
+    size_t const i = live[k];
+    ue_metrics_t *snap = h->snap + i * UE_TABLE_MAX_LOAD;
+    size_t const n = node_ctx_snapshot(&nodes[i], snap, UE_TABLE_MAX_LOAD);
+    rows[i] = atomic_load_explicit(&nodes[i].writer.rows,
+                                   memory_order_relaxed);
+    evicted[i] = atomic_load_explicit(&nodes[i].evicted,
+                                      memory_order_relaxed);
+    tracked[i] = n;
+    for (size_t j = 0; j < n; j++) {
+      if (snap[j].timestamp > newest)
+        newest = snap[j].timestamp;
+    }
+  }
+
+  // Staleness runs on the sample clock, so a replay's recorded timestamps
+  // are not all stale. Between samples it runs on with the wall clock.
+  int64_t const wall = time_now_us();
+  if (newest > h->sample_ts) {
+    h->sample_ts = newest;
+    h->sample_wall_us = wall;
+  }
+  int64_t const now =
+      h->sample_ts ? h->sample_ts + (wall - h->sample_wall_us) : wall;
+  int64_t const cutoff = now - (int64_t)METRICS_HTTP_STALE_S * 1000000;
+
+  // Drop stale UEs; the newest row carries the node's latest KPM totals
+  for (size_t k = 0; k < n_live; k++) {
+    size_t const i = live[k];
+    ue_metrics_t *snap = h->snap + i * UE_TABLE_MAX_LOAD;
+    size_t const n = tracked[i];
+    n_ues[i] = 0;
+    latest[i] = NULL;
+    for (size_t j = 0; j < n; j++) {
+      if (snap[j].timestamp < cutoff)
+        continue;
+      snap[n_ues[i]] = snap[j];
+      if (!latest[i] || snap[n_ues[i]].timestamp > latest[i]->timestamp)
+        latest[i] = &snap[n_ues[i]];
+      n_ues[i]++;
+    }
+  }
+
+  out_t o = {.h = h};
+
+  for (size_t mi = 0; mi < N_METRICS; mi++) {
+    metric_def_t const *d = &metrics[mi];
+    char const *name = d->fld.name;
+    out_printf(&o, "# HELP %s %s\n# TYPE %s %s\n", name, d->help, name,
+               d->type);
+
+    for (size_t k = 0; k < n_live; k++) {
+      size_t const i = live[k];
+      node_ctx_t const *n = &nodes[i];
+      ue_metrics_t const *snap = h->snap + i * UE_TABLE_MAX_LOAD;
+
+      if (d->src == SRC_KPM) {
+        if (latest[i] && has_src(latest[i], SRC_KPM)) {
+          out_printf(&o, "%s{node=\"%zu\",nb_id=\"%u\"}", name, n->slot,
+                     n->id.nb_id.nb_id);
+          out_value(&o, latest[i], d);
+        }
+        continue;
+      }
+
+      for (size_t j = 0; j < n_ues[i]; j++) {
+        if (!has_src(&snap[j], d->src))
+          continue;
+        out_printf(&o, "%s{node=\"%zu\",nb_id=\"%u\",rnti=\"%u\"}", name,
+                   n->slot, n->id.nb_id.nb_id, snap[j].rnti);
+        out_value(&o, &snap[j], d);
+      }
+    }
+  }
+
+  out_printf(&o, "# HELP kpm_ue_last_sample_timestamp_seconds Wall time of "
+                 "the UE's latest MAC sample\n"
+                 "# TYPE kpm_ue_last_sample_timestamp_seconds gauge\n");
+  for (size_t k = 0; k < n_live; k++) {
+    size_t const i = live[k];
+    ue_metrics_t const *snap = h->snap + i * UE_TABLE_MAX_LOAD;
+    for (size_t j = 0; j < n_ues[i]; j++)
+      out_printf(&o,
+                 "kpm_ue_last_sample_timestamp_seconds{node=\"%zu\","
+                 "nb_id=\"%u\",rnti=\"%u\"} %.6f\n",
+                 i, nodes[i].id.nb_id.nb_id, snap[j].rnti,
+                 (double)snap[j].timestamp / 1e6);
+  }
+
+  out_printf(&o, "# HELP kpm_node_ues UEs seen in the last %d s\n"
+                 "# TYPE kpm_node_ues gauge\n",
+             METRICS_HTTP_STALE_S);
+  for (size_t k = 0; k < n_live; k++)
+    out_printf(&o, "kpm_node_ues{node=\"%zu\",nb_id=\"%u\"} %zu\n", live[k],
+               nodes[live[k]].id.nb_id.nb_id, n_ues[live[k]]);
+
+  out_printf(&o, "# HELP kpm_node_ues_tracked UEs holding a table entry "
+                 "(of %d)\n"
+                 "# TYPE kpm_node_ues_tracked gauge\n",
+             UE_TABLE_MAX_LOAD);
+  for (size_t k = 0; k < n_live; k++)
+    out_printf(&o, "kpm_node_ues_tracked{node=\"%zu\",nb_id=\"%u\"} %zu\n",
+               live[k], nodes[live[k]].id.nb_id.nb_id, tracked[live[k]]);
+
+  out_printf(&o, "# HELP kpm_node_ues_evicted_total UEs evicted after "
+                 "ue-ttl without a report\n"
+                 "# TYPE kpm_node_ues_evicted_total counter\n");
+  for (size_t k = 0; k < n_live; k++)
+    out_printf(&o,
+               "kpm_node_ues_evicted_total{node=\"%zu\",nb_id=\"%u\"} "
+               "%" PRIu64 "\n",
+               live[k], nodes[live[k]].id.nb_id.nb_id, evicted[live[k]]);
+
+  out_printf(&o, "# HELP kpm_node_rows_total Rows handed to the output\n"
+                 "# TYPE kpm_node_rows_total counter\n");
+  for (size_t k = 0; k < n_live; k++)
+    out_printf(&o, "kpm_node_rows_total{node=\"%zu\",nb_id=\"%u\"} %" PRIu64
+                   "\n",
+               live[k], nodes[live[k]].id.nb_id.nb_id, rows[live[k]]);
+
+  out_printf(&o, "# HELP kpm_node_indications_total Indications received\n"
+                 "# TYPE kpm_node_indications_total counter\n");
+  for (size_t k = 0; k < n_live; k++) {
+    node_ctx_t *n = &nodes[live[k]];
+    for (size_t s = 0; s < NODE_SUB_COUNT; s++) {
+      if (!n->sub[s].success)
+        continue;
+      out_printf(&o,
+                 "kpm_node_indications_total{node=\"%zu\",nb_id=\"%u\","
+                 "sm=\"%s\"} %" PRIu64 "\n",
+                 n->slot, n->id.nb_id.nb_id, node_sub_name[s],
+                 atomic_load_explicit(&n->lat[s].ind, memory_order_relaxed));
+    }
+  }
+
+  out_printf(&o, "# HELP kpm_exporter_scrapes_total Scrapes served\n"
+                 "# TYPE kpm_exporter_scrapes_total counter\n"
+                 "kpm_exporter_scrapes_total %" PRIu64 "\n",
+             ++h->scrapes);
+
+  return o.oom ? 0 : o.len;
+}
+
+static size_t render(metrics_http_t *h) {
+  size_t live[NODE_CTX_MAX], n_live = 0;
+
+  pthread_mutex_lock(&h->watch->mtx);
+  for (size_t i = 0; i < NODE_CTX_MAX; i++) {
+    if (h->watch->listed[i])
+      live[n_live++] = i;
+  }
+  size_t const len = render_nodes(h, h->watch->slot, live, n_live);
+  pthread_mutex_unlock(&h->watch->mtx);
+  return len;
+}
+
+// --- HTTP --------------------------------------------------------------------
+
+static bool send_all(int fd, char const *p, size_t len) {
+  while (len > 0) {
+    ssize_t const n = send(fd, p, len, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    p += n;
+    len -= (size_t)n;
+  }
+  return true;
+}
+
+static void respond(int fd, char const *status, char const *type,
+                    char const *body, size_t len) {
+  char head[256];
+  int const n = snprintf(head, sizeof(head),
+                         "HTTP/1.1 %s\r\n"
+                         "Content-Type: %s\r\n"
+                         "Content-Length: %zu\r\n"
+                         "Connection: close\r\n\r\n",
+                         status, type, len);
+  if (send_all(fd, head, (size_t)n))
+    send_all(fd, body, len);
+}
+
+// Reads up to the end of the request head; the body (if any) is ignored
+static bool read_request(int fd, char *buf, size_t cap) {
+  size_t len = 0;
+  while (len + 1 < cap) {
+    ssize_t const n = recv(fd, buf + len, cap - 1 - len, 0);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    len += (size_t)n;
+    buf[len] = '\0';
+    if (strstr(buf, "\r\n\r\n") || strstr(buf, "\n\n"))
+      return true;
+  }
+  return false;
+}
+
+static void serve_client(metrics_http_t *h, int fd) {
+  // One client at a time, so a stalled one must not hold the others up
+  struct timeval const tv = {.tv_sec = HTTP_IO_TIMEOUT_S};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+  char req[HTTP_MAX_REQUEST];
+  if (!read_request(fd, req, sizeof(req)))
+    return;
+
+  static char const text[] = "text/plain; charset=utf-8";
+  if (strncmp(req, "GET ", 4) != 0) {
+    respond(fd, "405 Method Not Allowed", text, "", 0);
+    return;
+  }
+
+  char const *path = req + 4;
+  size_t const path_len = strcspn(path, " ?\r\n");
+  if (path_len == 8 && memcmp(path, "/metrics", 8) == 0) {
+    size_t const len = render(h);
+    if (len == 0) {
+      respond(fd, "500 Internal Server Error", text, "", 0);
+      return;
+    }
+    respond(fd, "200 OK", "text/plain; version=0.0.4; charset=utf-8", h->body,
+            len);
+  } else if (path_len == 1 && path[0] == '/') {
+    static char const index[] = "KPM metrics collector: see /metrics\n";
+    respond(fd, "200 OK", text, index, sizeof(index) - 1);
+  } else {
+    respond(fd, "404 Not Found", text, "", 0);
+  }
+}
+
+static void *serve(void *arg) {
+  metrics_http_t *h = arg;
+  struct pollfd p[2] = {
+      {.fd = h->listen_fd, .events = POLLIN},
+      {.fd = h->wake_fd, .events = POLLIN},
+  };
+
+  for (;;) {
+    if (poll(p, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("metrics_http: poll");
+      break;
+    }
+    if (p[1].revents)
+      break;
+    if (!(p[0].revents & POLLIN))
+      continue;
+
+    int const fd = accept(h->listen_fd, NULL, NULL);
+    if (fd < 0)
+      continue;
+    serve_client(h, fd);
+    close(fd);
+  }
+  return NULL;
+}
+
+bool metrics_http_start(metrics_http_t *h, char const *addr, uint32_t port,
+                        node_watch_t *watch) {
+  memset(h, 0, sizeof(*h));
+  h->listen_fd = h->wake_fd = -1;
+  h->watch = watch;
+
+  struct sockaddr_in sa = {.sin_family = AF_INET, .sin_port = htons(port)};
+  if (inet_pton(AF_INET, addr, &sa.sin_addr) != 1) {
+    fprintf(stderr, "metrics_http: bad listen address '%s'\n", addr);
+    return false;
+  }
+
+  h->snap = malloc(NODE_CTX_MAX * UE_TABLE_MAX_LOAD * sizeof(*h->snap));
+  h->body_cap = 64u << 10;
+  h->body = malloc(h->body_cap);
+  h->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  h->wake_fd = eventfd(0, EFD_CLOEXEC);
+  if (!h->snap || !h->body || h->listen_fd < 0 || h->wake_fd < 0)
+    goto fail;
+
+  int const one = 1;
+  setsockopt(h->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if (bind(h->listen_fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 ||
+      listen(h->listen_fd, 16) < 0)
+    goto fail;
+
+  if (pthread_create(&h->thread, NULL, serve, h) != 0)
+    goto fail;
+  return true;
+
+fail:
+  perror("metrics_http");
+  if (h->listen_fd >= 0)
+    close(h->listen_fd);
+  if (h->wake_fd >= 0)
+    close(h->wake_fd);
+  free(h->snap);
+  free(h->body);
+  memset(h, 0, sizeof(*h));
+  h->listen_fd = h->wake_fd = -1;
+  return false;
+}
+
+void metrics_http_stop(metrics_http_t *h) {
+  if (h->listen_fd < 0)
+    return;
+
+  uint64_t const one = 1;
+  ssize_t const rc = write(h->wake_fd, &one, sizeof(one));
+  (void)rc;
+  pthread_join(h->thread, NULL);
+
+  close(h->listen_fd);
+  close(h->wake_fd);
+  free(h->snap);
+  free(h->body);
+  h->listen_fd = h->wake_fd = -1;
+}
@@ -0,0 +1,54 @@
+/*
+ * Metrics endpoint
+ * ================
+ *
+ * Minimal HTTP server on its own thread that answers GET /metrics in the
+ * Prometheus text exposition format (version 0.0.4, which OpenMetrics
+ * scrapers also accept). Per-UE gauges are read straight from each node's
+ * UE table through its sequence counts (see ue_table.h), and the counters
+ * are atomics, so serving a scrape never takes a lock the SM callbacks
+ * use, however often it is scraped.
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#ifndef METRICS_HTTP_H
+#define METRICS_HTTP_H
+
+#include "node_ctx.h"
+#include "node_watch.h"
+#include "ue_table.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// UEs whose latest MAC sample is older than this are left out of a scrape;
+// with ue-ttl=0 the UE table never forgets an RNTI. Age is measured from
+// the newest sample seen, so it holds for a replay too.
+#define METRICS_HTTP_STALE_S 30
+
+typedef struct {
+  int listen_fd;
+  int wake_fd;
+  pthread_t thread;
+
+  node_watch_t *watch;
+
+  // Server thread only
+  ue_metrics_t *snap; // UE_TABLE_MAX_LOAD per node slot
+  char *body;
+  size_t body_cap;
+  uint64_t scrapes;
+  int64_t sample_ts;      // Newest MAC sample seen (us)
+  int64_t sample_wall_us; // Wall time it was first seen
+} metrics_http_t;
+
+// Binds addr:port (IPv4) and starts serving the watcher's listed nodes.
+// The watcher must outlive metrics_http_stop.
+bool metrics_http_start(metrics_http_t *h, char const *addr, uint32_t port,
+                        node_watch_t *watch);
+void metrics_http_stop(metrics_http_t *h);
+
+#endif
@@ -0,0 +1,243 @@
+/*
+ * Per-E2-node collector state
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#include "node_ctx.h"
+#include "rot_sink.h"
+#include "row_agg.h"
+#include "row_pub.h"
+#include "ue_feat.h"
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+_Static_assert(NODE_CTX_MAX <= ROW_WRITER_SLOTS,
+               "every node slot needs its own row writer cache slot");
+
+// "/tmp/kpm.csv" -> "/tmp/kpm_nb3584.csv", "/tmp/kpm_nb3584_1.csv" for a
+// CU/DU, "/tmp/kpm_nb3584_r2.csv" for its third attach. The suffix goes
+// before the extension so the sink choice is kept.
+static bool node_path(char *dst, size_t len, char const *base,
+                      global_e2_node_id_t const *id, bool shard,
+                      unsigned gen) {
+  char const *slash = strrchr(base, '/');
+  char const *dot = strrchr(slash ? slash : base, '.');
+  size_t const stem = dot ? (size_t)(dot - base) : strlen(base);
+  char const *ext = dot ? dot : "";
+
+  char sfx[64] = "";
+  size_t k = 0;
+  if (shard && id->cu_du_id)
+    k = (size_t)snprintf(sfx, sizeof(sfx), "_nb%u_%" PRIu64, id->nb_id.nb_id,
+                         *id->cu_du_id);
+  else if (shard)
+    k = (size_t)snprintf(sfx, sizeof(sfx), "_nb%u", id->nb_id.nb_id);
+  if (gen)
+    snprintf(sfx + k, sizeof(sfx) - k, "_r%u", gen);
+
+  int const n = snprintf(dst, len, "%.*s%s%s", (int)stem, base, sfx, ext);
+  return n > 0 && (size_t)n < len;
+}
+
+bool node_ctx_open(node_ctx_t *n, size_t slot, global_e2_node_id_t const *id,
+                   unsigned gen, collector_cfg_t const *cfg, bool shard) {
+  memset(n, 0, sizeof(*n));
+  n->slot = slot;
+  n->gen = gen;
+
+  if (!node_path(n->path, sizeof(n->path), cfg->output, id, shard, gen)) {
+    printf("ERROR: Output path too long for node %zu\n", slot);
+    return false;
+  }
+  if (cfg->shm_name[0] && !node_path(n->shm_name, sizeof(n->shm_name),
+                                     cfg->shm_name, id, shard, gen)) {
+    printf("ERROR: shm name too long for node %zu\n", slot);
+    return false;
+  }
+
+  // Window summaries replace the raw rows in the files only; the taps
+  // below still see every row
+  if (collector_cfg_windowed(cfg))
+    n->sink = row_agg_open(n->path, cfg->window_ms, cfg->max_samples);
+  else if (rot_policy_active(&cfg->rotate))
+    n->sink = rot_sink_open(n->path, cfg->csv_flush, &cfg->rotate);
+  else
+    n->sink = row_sink_open(n->path, cfg->csv_flush);
+  if (!n->sink) {
+    perror(n->path);
+    return false;
+  }
+
+  if (n->shm_name[0] || row_pub_zmq_active()) {
+    row_sink_t *tap =
+        row_pub_tap(n->sink, n->shm_name[0] ? n->shm_name : NULL,
+                    cfg->shm_slots, id->nb_id.nb_id);
+    if (!tap) {
+      n->sink->close(n->sink);
+      return false;
+    }
+    n->sink = tap;
+  }
+
+  if (cfg->feat.n) {
+    row_sink_t *tap = ue_feat_tap(n->sink, n->path, &cfg->feat);
+    if (!tap) {
+      n->sink->close(n->sink);
+      return false;
+    }
+    n->sink = tap;
+  }
+
+  if (cfg->trig.n) {
+    n->trig = trig_node_new(cfg->trig_history);
+    if (!n->trig) {
+      printf("ERROR: No memory for the triggers of node %zu\n", slot);
+      n->sink->close(n->sink);
+      return false;
+    }
+  }
+
+  ue_table_init(&n->ues);
+  pthread_mutex_init(&n->mtx, NULL);
+  n->start_ns = lat_now_ns();
+  if (!row_writer_start(&n->writer, slot, n->sink, cfg->print_interval,
+                        &n->row_ns)) {
+    printf("ERROR: Failed to start writer thread for node %zu\n", slot);
+    pthread_mutex_destroy(&n->mtx);
+    n->sink->close(n->sink);
+    trig_node_free(n->trig);
+    return false;
+  }
+
+  n->id = cp_global_e2_node_id(id);
+  return true;
+}
+
+void node_ctx_stop(node_ctx_t *n) { row_writer_stop(&n->writer); }
+
+size_t node_ctx_snapshot(node_ctx_t *n, ue_metrics_t *out, size_t cap) {
+  size_t k = 0;
+  for (size_t i = 0; i < UE_TABLE_MAX_LOAD && k < cap; i++) {
+    if (ue_table_read(&n->ues, i, &out[k]))
+      k++;
+  }
+  return k;
+}
+
+char const *const node_sub_name[NODE_SUB_COUNT] = {
+    [NODE_SUB_MAC] = "MAC", [NODE_SUB_RLC] = "RLC", [NODE_SUB_PDCP] = "PDCP",
+    [NODE_SUB_GTP] = "GTP", [NODE_SUB_KPM] = "KPM",
+};
+
+static void print_lat(lat_snap_t const *s, double div, char const *unit) {
+  printf(" %.1f/%.1f/%.1f %s", (double)lat_snap_quantile(s, 0.5) / div,
+         (double)lat_snap_quantile(s, 0.99) / div,
+         (double)lat_snap_quantile(s, 0.999) / div, unit);
+}
+
+// cb in us, e2 in ms, rows in ms; p50/p99/p999
+static void print_lat_lines(node_ctx_t *n, lat_snap_t const *const *cb,
+                            lat_snap_t const *const *e2, uint64_t const *ind,
+                            lat_snap_t const *row, double secs) {
+  for (size_t s = 0; s < NODE_SUB_COUNT; s++) {
+    if (!n->sub[s].success)
+      continue;
+    printf("    %-4s %8.1f ind/s  cb", node_sub_name[s],
+           secs > 0 ? (double)ind[s] / secs : 0.0);
+    print_lat(cb[s], 1e3, "us");
+    if (e2[s]->count) {
+      printf("  e2");
+      print_lat(e2[s], 1e3, "ms");
+    }
+    printf("\n");
+  }
+  printf("    rows %8.1f row/s  queue->sink",
+         secs > 0 ? (double)row->count / secs : 0.0);
+  print_lat(row, 1e6, "ms");
+  printf("\n");
+}
+
+void node_ctx_report_latency(node_ctx_t *n, double secs) {
+  // Only the main thread reports, so the interval snapshots can be static
+  static lat_snap_t cb[NODE_SUB_COUNT], e2[NODE_SUB_COUNT], row;
+  lat_snap_t const *cb_p[NODE_SUB_COUNT], *e2_p[NODE_SUB_COUNT];
+  uint64_t ind[NODE_SUB_COUNT];
+
+  for (size_t s = 0; s < NODE_SUB_COUNT; s++) {
+    sub_lat_t *l = &n->lat[s];
+    memset(&cb[s], 0, sizeof(cb[s]));
+    memset(&e2[s], 0, sizeof(e2[s]));
+    lat_hist_drain(&l->cb_ns, &cb[s]);
+    lat_hist_drain(&l->e2_us, &e2[s]);
+    lat_snap_merge(&l->cb_tot, &cb[s]);
+    lat_snap_merge(&l->e2_tot, &e2[s]);
+    cb_p[s] = &cb[s];
+    e2_p[s] = &e2[s];
+
+    uint64_t const total = atomic_load_explicit(&l->ind, memory_order_relaxed);
+    ind[s] = total - l->ind_reported;
+    l->ind_reported = total;
+  }
+
+  memset(&row, 0, sizeof(row));
+  lat_hist_drain(&n->row_ns, &row);
+  lat_snap_merge(&n->row_tot, &row);
+
+  printf("[stats] node %zu (nb_id %u), last %.1f s, p50/p99/p999:\n", n->slot,
+         n->id.nb_id.nb_id, secs);
+  print_lat_lines(n, cb_p, e2_p, ind, &row, secs);
+}
+
+void node_ctx_print_stats(node_ctx_t *n) {
+  spsc_ring_stats_t const rs = row_writer_stats(&n->writer);
+
+  printf("  Node %zu (nb_id %u): %lu rows, %zu UEs -> %s\n", n->slot,
+         n->id.nb_id.nb_id, n->writer.rows, ue_table_len(&n->ues), n->path);
+  printf("    Aligned: %lu complete, %lu partial, %lu incomplete dropped\n",
+         n->rows_complete, n->rows_partial, n->rows_dropped);
+  printf("    Counters: %lu wraps, %lu resets\n", n->ctr_wraps, n->ctr_resets);
+  ue_index_t const *ix = &n->ues.ix;
+  printf("    UE table: %zu/%d used, peak %zu, %lu evicted, %lu refused\n",
+         ix->len, UE_TABLE_MAX_LOAD, ix->peak, ix->removed, ix->refused);
+  if (n->trig)
+    printf("    Triggers: %lu fired, %lu interval switches, %lu rows held, "
+           "%lu written from history\n",
+           n->trig->fired, n->trig->switches, n->trig->held,
+           n->trig->replayed);
+  printf("    Ring high-water: %zu, dropped: %lu\n", rs.high_water,
+         rs.dropped);
+  if (n->sink->print_stats)
+    n->sink->print_stats(n->sink);
+
+  // Fold in whatever arrived after the last periodic report
+  double const secs = (double)(lat_now_ns() - n->start_ns) / 1e9;
+  lat_snap_t const *cb_p[NODE_SUB_COUNT], *e2_p[NODE_SUB_COUNT];
+  uint64_t ind[NODE_SUB_COUNT];
+  for (size_t s = 0; s < NODE_SUB_COUNT; s++) {
+    sub_lat_t *l = &n->lat[s];
+    lat_hist_drain(&l->cb_ns, &l->cb_tot);
+    lat_hist_drain(&l->e2_us, &l->e2_tot);
+    cb_p[s] = &l->cb_tot;
+    e2_p[s] = &l->e2_tot;
+    ind[s] = atomic_load_explicit(&l->ind, memory_order_relaxed);
+  }
+  lat_hist_drain(&n->row_ns, &n->row_tot);
+
+  printf("    Latency over %.1f s, p50/p99/p999:\n", secs);
+  print_lat_lines(n, cb_p, e2_p, ind, &n->row_tot, secs);
+}
+
+uint64_t node_ctx_bytes(node_ctx_t *n) {
+  return n->sink->bytes ? n->sink->bytes(n->sink) : 0;
+}
+
+void node_ctx_close(node_ctx_t *n) {
+  n->sink->close(n->sink);
+  pthread_mutex_destroy(&n->mtx);
+  trig_node_free(n->trig);
+  free_global_e2_node_id(&n->id);
+}
@@ -0,0 +1,165 @@
+/*
+ * Per-E2-node collector state
+ * ===========================
+ *
+ * Every subscribed E2 node gets its own UE table, KPM totals, lock, writer
+ * thread and output file, so nodes never contend with each other and a
+ * UE on one gNB cannot overwrite a UE with the same RNTI on another.
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#ifndef NODE_CTX_H
+#define NODE_CTX_H
+
+#include "../../../../src/xApp/e42_xapp_api.h"
+
+#include "collector_cfg.h"
+#include "lat_hist.h"
+#include "row_writer.h"
+#include "trigger.h"
+#include "ue_table.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// FlexRIC callbacks carry no user pointer, so each node slot has its own
+// trampoline (see xapp_kpm_metrics_collector_v2.c). Nodes past this are
+// not subscribed.
+#define NODE_CTX_MAX 32
+
+typedef enum {
+  NODE_SUB_MAC = 0,
+  NODE_SUB_RLC,
+  NODE_SUB_PDCP,
+  NODE_SUB_GTP,
+  NODE_SUB_KPM,
+
+  NODE_SUB_COUNT
+} node_sub_e;
+
+extern char const *const node_sub_name[NODE_SUB_COUNT];
+
+// KPM Format 3 identifies UEs by E2SM UE ID, which carries no RNTI to join
+// on, so KPM is kept as node-level totals and stamped onto every row
+typedef struct {
+  double dl_thp_kbps;
+  double ul_thp_kbps;
+  double rlc_sdu_delay_us;
+  int32_t pdcp_sdu_vol_dl_kb;
+  int32_t pdcp_sdu_vol_ul_kb;
+  int32_t prb_tot_dl;
+  int32_t prb_tot_ul;
+  int kpm_valid;
+  int64_t ts; // Receive time of the report, us
+  uint32_t seq; // Reports received, stamped on rows as kpm_ver
+} kpm_totals_t;
+
+// Latency of one SM subscription. The hists are recorded lock-free from
+// the callback; the snapshots belong to whoever reports (the main thread).
+typedef struct {
+  lat_hist_t cb_ns; // Time spent in the callback
+  lat_hist_t e2_us; // E2 node timestamp to callback entry, where present
+  _Atomic uint64_t ind;
+
+  lat_snap_t cb_tot, e2_tot;
+  uint64_t ind_reported;
+} sub_lat_t;
+
+typedef struct {
+  size_t slot;
+  global_e2_node_id_t id;
+  unsigned gen; // Times this node was attached before, for the file names
+  char path[CFG_MAX_PATH];
+  char shm_name[CFG_MAX_PATH]; // Empty unless rows go to shared memory
+
+  // Guards ues and kpm; taken only by this node's callbacks. Other threads
+  // copy UEs out with node_ctx_snapshot, which does not take it.
+  pthread_mutex_t mtx;
+  ue_table_t ues;
+  kpm_totals_t kpm;
+
+  row_sink_t *sink;
+  row_writer_t writer;
+
+  // Alignment outcome of every MAC sample, under mtx
+  uint64_t rows_complete; // All required sources fresh
+  uint64_t rows_partial;  // Emitted with a stale source (partial policy)
+  uint64_t rows_dropped;  // Never completed (wait-all policy)
+
+  // Counter steps seen while deriving rates (see ctr_rate.h), under mtx
+  uint64_t ctr_wraps;
+  uint64_t ctr_resets; // Also counts gaps
+
+  // Stream time of the last idle-UE scan (see ue_ttl_ms), under mtx
+  int64_t evict_ts;
+  _Atomic uint64_t evicted; // For readers off the callbacks
+
+  // Sampling trigger state (see trigger.h), NULL without rules
+  trig_node_t *trig;
+
+  sm_ans_xapp_t sub[NODE_SUB_COUNT];
+
+  // Callbacks only touch the node while live; in_cb lets a detach wait
+  // out the ones already inside (see node_ctx_retire)
+  _Atomic bool live;
+  _Atomic unsigned in_cb;
+
+  sub_lat_t lat[NODE_SUB_COUNT];
+  lat_hist_t row_ns; // Queued for the writer to handed to the sink
+  lat_snap_t row_tot;
+  int64_t start_ns;
+} node_ctx_t;
+
+// Opens the node's output and starts its writer thread. With shard set the
+// file name (and shm ring name) gets a per-node suffix, otherwise the
+// configured names are used as is. A node attached again (gen > 0) gets
+// "_r<gen>" on top so the earlier output is kept. The node is not live yet.
+bool node_ctx_open(node_ctx_t *n, size_t slot, global_e2_node_id_t const *id,
+                   unsigned gen, collector_cfg_t const *cfg, bool shard);
+
+// Brackets a callback; false (and nothing to leave) if the node is not live.
+// Both sides are seq_cst so a retire never misses a callback that got in.
+static inline bool node_ctx_enter(node_ctx_t *n) {
+  atomic_fetch_add(&n->in_cb, 1);
+  if (atomic_load(&n->live))
+    return true;
+  atomic_fetch_sub(&n->in_cb, 1);
+  return false;
+}
+
+static inline void node_ctx_leave(node_ctx_t *n) {
+  atomic_fetch_sub(&n->in_cb, 1);
+}
+
+// Stops new callbacks and waits for the running ones to return, so the
+// node's state can be torn down while its subscriptions still exist
+static inline void node_ctx_retire(node_ctx_t *n) {
+  atomic_store(&n->live, false);
+  while (atomic_load(&n->in_cb) != 0)
+    sched_yield();
+}
+
+// Copies up to cap of the node's UEs into out, from any thread and without
+// the node's mtx; returns how many. Each copy is torn-free (see
+// ue_table_read), but UEs are copied one by one, not all at one instant.
+size_t node_ctx_snapshot(node_ctx_t *n, ue_metrics_t *out, size_t cap);
+
+// Subscriptions must already be removed. Drains and joins the writer; the
+// stats stay readable until node_ctx_close.
+void node_ctx_stop(node_ctx_t *n);
+void node_ctx_print_stats(node_ctx_t *n);
+
+// Bytes of row output the node's sink produced (see row_sink_t.bytes).
+// Only after node_ctx_stop, as the sink belongs to the writer until then.
+uint64_t node_ctx_bytes(node_ctx_t *n);
+
+// Rates and p50/p99/p999 since the previous call (secs long), which are
+// also folded into the run totals that node_ctx_print_stats reports
+void node_ctx_report_latency(node_ctx_t *n, double secs);
+void node_ctx_close(node_ctx_t *n);
+
+#endif
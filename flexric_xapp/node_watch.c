@@ -0,0 +1,262 @@
+/*
+ * E2 node watcher
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#include "node_watch.h"
+#include "rot_sink.h"
+#include "row_agg.h"
+
+#include "../../../../src/util/ngran_types.h"
+#include "../../../../src/util/time_now_us.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Only monolithic nodes run MAC, RLC and PDCP together
+static bool wanted(ngran_node_t t) { return t == ngran_gNB || t == ngran_eNB; }
+
+bool node_watch_init(node_watch_t *w, collector_cfg_t const *cfg,
+                     node_subscribe_fn subscribe, void *arg) {
+  memset(w, 0, sizeof(*w));
+  w->slot = calloc(NODE_CTX_MAX, sizeof(node_ctx_t));
+  if (!w->slot)
+    return false;
+  pthread_mutex_init(&w->mtx, NULL);
+  w->cfg = cfg;
+  w->subscribe = subscribe;
+  w->arg = arg;
+  return true;
+}
+
+static bool attached_as(node_watch_t const *w, global_e2_node_id_t const *id) {
+  for (size_t i = 0; i < NODE_CTX_MAX; i++) {
+    if (w->used[i] && eq_global_e2_node_id(&w->slot[i].id, id))
+      return true;
+  }
+  return false;
+}
+
+// Previous attaches of this node; once the table is full, new ids count
+// as first seen
+static unsigned seen_gen(node_watch_t const *w, global_e2_node_id_t const *id,
+                         size_t *idx) {
+  for (size_t i = 0; i < w->n_seen; i++) {
+    if (eq_global_e2_node_id(&w->seen[i], id)) {
+      *idx = i;
+      return w->seen_count[i];
+    }
+  }
+  *idx = w->n_seen;
+  return 0;
+}
+
+static void attach(node_watch_t *w, e2_node_connected_xapp_t const *e2,
+                   bool shard) {
+  size_t i = 0;
+  while (i < NODE_CTX_MAX && w->used[i])
+    i++;
+  if (i == NODE_CTX_MAX) {
+    if (!w->full_warned)
+      printf("WARNING: All %d node slots in use, nb_id %u not subscribed\n",
+             NODE_CTX_MAX, e2->id.nb_id.nb_id);
+    w->full_warned = true;
+    return;
+  }
+
+  size_t seen;
+  unsigned const gen = seen_gen(w, &e2->id, &seen);
+  node_ctx_t *n = &w->slot[i];
+  if (!node_ctx_open(n, i, &e2->id, gen, w->cfg, shard))
+    return;
+
+  if (seen < NODE_WATCH_SEEN_MAX) {
+    if (seen == w->n_seen)
+      w->seen[w->n_seen++] = cp_global_e2_node_id(&e2->id);
+    w->seen_count[seen]++;
+  }
+
+  printf("Node %zu attached (nb_id %u) RAN Functions: ", i,
+         e2->id.nb_id.nb_id);
+  for (size_t j = 0; j < e2->len_rf; j++)
+    printf("%d ", e2->rf[j].id);
+  printf("\n");
+  char sum[CFG_MAX_PATH + 16];
+  if (collector_cfg_windowed(w->cfg)) {
+    for (size_t k = 0; k < ROW_AGG_COUNT; k++) {
+      if (w->cfg->window_ms[k] &&
+          row_agg_path(sum, sizeof(sum), n->path, (row_agg_src_e)k))
+        printf("  Output: %s\n", sum);
+    }
+  } else if (rot_policy_active(&w->cfg->rotate) &&
+             rot_sink_segment_path(sum, sizeof(sum), n->path, 0)) {
+    printf("  Output: %s%s, ...\n", sum,
+           w->cfg->rotate.zstd_level ? ".zst" : "");
+  } else {
+    printf("  Output: %s\n", n->path);
+  }
+  if (n->shm_name[0])
+    printf("  Shm: /dev/shm%s\n", n->shm_name);
+
+  // Live before subscribing, so the first indications are kept
+  atomic_store(&n->live, true);
+  sub_req_t *req = &w->batch[w->n_batch];
+  size_t const n_req = w->subscribe(n, e2, req, w->arg);
+  for (size_t k = 0; k < n_req; k++)
+    req[k].group = i;
+  w->n_batch += n_req;
+
+  // Listed once its subscriptions are answered (see subscribed)
+  if (n_req == 0) {
+    pthread_mutex_lock(&w->mtx);
+    w->listed[i] = true;
+    pthread_mutex_unlock(&w->mtx);
+  }
+  w->used[i] = true;
+  w->n_used++;
+  w->attached++;
+}
+
+// Fan-out hook: a node's subscriptions are all answered. Runs on a
+// fan-out thread while the other nodes' requests are still out.
+static void subscribed(sub_req_t const *req, size_t n_req, void *arg) {
+  node_watch_t *w = arg;
+  node_ctx_t *n = &w->slot[req[0].group];
+
+  // One printf, so the lines of two nodes do not interleave
+  char buf[512];
+  int len = snprintf(buf, sizeof(buf), "Node %zu subscribed after %.1f ms\n",
+                     n->slot, (double)(lat_now_ns() - w->batch_ns) / 1e6);
+  for (size_t k = 0; k < n_req; k++) {
+    sub_req_t const *r = &req[k];
+    n->sub[r->tag] = r->ans;
+    if (len >= 0 && (size_t)len < sizeof(buf))
+      len += snprintf(buf + len, sizeof(buf) - len, "  %s (%u): %s %.1f ms\n",
+                      node_sub_name[r->tag], r->ran_func,
+                      r->ans.success ? "OK" : "FAIL", (double)r->us / 1e3);
+  }
+  fputs(buf, stdout);
+
+  pthread_mutex_lock(&w->mtx);
+  w->listed[n->slot] = true;
+  pthread_mutex_unlock(&w->mtx);
+}
+
+static void unsubscribe(node_watch_t const *w, node_ctx_t *n) {
+  for (size_t s = 0; s < NODE_SUB_COUNT && !w->offline; s++) {
+    if (n->sub[s].success)
+      rm_report_sm_xapp_api(n->sub[s].u.handle);
+  }
+}
+
+// The node has left the RIC, but the xApp still holds its subscriptions.
+// Left in place they would keep calling the slot's trampoline, and a node
+// that comes back would get every indication twice.
+static void detach(node_watch_t *w, size_t i) {
+  node_ctx_t *n = &w->slot[i];
+
+  pthread_mutex_lock(&w->mtx);
+  w->listed[i] = false;
+  pthread_mutex_unlock(&w->mtx);
+
+  unsubscribe(w, n);
+  node_ctx_retire(n);
+  node_ctx_stop(n);
+  printf("\nNode %zu (nb_id %u) left the RIC\n", i, n->id.nb_id.nb_id);
+  node_ctx_print_stats(n);
+  w->departed_rows += n->writer.rows;
+  w->departed_bytes += node_ctx_bytes(n);
+  node_ctx_close(n);
+
+  w->used[i] = false;
+  w->n_used--;
+  w->departed++;
+  w->full_warned = false;
+}
+
+size_t node_watch_sync(node_watch_t *w, e2_node_arr_xapp_t const *nodes) {
+  for (size_t i = 0; i < NODE_CTX_MAX; i++) {
+    if (!w->used[i])
+      continue;
+    bool found = false;
+    for (size_t j = 0; j < nodes->len && !found; j++)
+      found = eq_global_e2_node_id(&w->slot[i].id, &nodes->n[j].id);
+    if (!found)
+      detach(w, i);
+  }
+
+  // The nodes of the first attach keep the configured names if there is
+  // only one; anything that shows up later gets its own
+  size_t n_ran = 0;
+  for (size_t j = 0; j < nodes->len; j++)
+    n_ran += wanted(nodes->n[j].id.type);
+  bool const shard = w->attached > 0 || n_ran > 1;
+
+  uint64_t const before = w->attached;
+  w->n_batch = 0;
+  for (size_t j = 0; j < nodes->len; j++) {
+    e2_node_connected_xapp_t const *e2 = &nodes->n[j];
+    if (wanted(e2->id.type) && !attached_as(w, &e2->id))
+      attach(w, e2, shard);
+  }
+
+  if (w->n_batch) {
+    w->batch_ns = lat_now_ns();
+    sub_fanout_run(w->batch, w->n_batch, w->cfg->sub_threads, subscribed, w);
+    printf("Subscribed %zu nodes in %.1f ms (%zu subscriptions, %u at "
+           "once)\n",
+           (size_t)(w->attached - before),
+           (double)(lat_now_ns() - w->batch_ns) / 1e6, w->n_batch,
+           w->cfg->sub_threads);
+  }
+  return (size_t)(w->attached - before);
+}
+
+size_t node_watch_poll(node_watch_t *w) {
+  e2_node_arr_xapp_t nodes = e2_nodes_xapp_api();
+
+  // Logged ahead of the attaches, so a replay subscribes a node before
+  // its first indication
+  if (w->log)
+    ind_log_write_nodes(w->log, time_now_us(), &nodes);
+  size_t const n = node_watch_sync(w, &nodes);
+  free_e2_node_arr_xapp(&nodes);
+  return n;
+}
+
+uint32_t node_watch_period_ms(node_watch_t const *w) {
+  return w->n_used ? w->cfg->node_poll_ms : NODE_WATCH_FAST_MS;
+}
+
+void node_watch_stop(node_watch_t *w) {
+  pthread_mutex_lock(&w->mtx);
+  memset(w->listed, 0, sizeof(w->listed));
+  pthread_mutex_unlock(&w->mtx);
+
+  // Unsubscribe everything before draining, so every producer is done
+  for (size_t i = 0; i < NODE_CTX_MAX; i++) {
+    if (!w->used[i])
+      continue;
+    node_ctx_t *n = &w->slot[i];
+    node_ctx_retire(n);
+    unsubscribe(w, n);
+  }
+  for (size_t i = 0; i < NODE_CTX_MAX; i++) {
+    if (w->used[i])
+      node_ctx_stop(&w->slot[i]);
+  }
+}
+
+void node_watch_free(node_watch_t *w) {
+  for (size_t i = 0; i < NODE_CTX_MAX; i++) {
+    if (w->used[i])
+      node_ctx_close(&w->slot[i]);
+  }
+  for (size_t i = 0; i < w->n_seen; i++)
+    free_global_e2_node_id(&w->seen[i]);
+  pthread_mutex_destroy(&w->mtx);
+  free(w->slot);
+  memset(w, 0, sizeof(*w));
+}
@@ -0,0 +1,105 @@
+/*
+ * E2 node watcher
+ * ===============
+ *
+ * gNB pods restart independently of the RIC, so the node set is not fixed
+ * at startup. Every poll diffs e2_nodes_xapp_api() against the attached
+ * nodes: a new RAN node gets a free slot, its output and subscriptions; a
+ * node that left is retired, its output flushed and closed, and its slot
+ * freed for the next one.
+ *
+ * node_watch_sync does the diff against any node list, so a replay (see
+ * ind_log.h) can drive the same attaches from a recorded one.
+ *
+ * The nodes attached by one diff are subscribed together: their requests
+ * go out as one fan-out (see sub_fanout.h) on cfg->sub_threads threads,
+ * and each node is listed once its own subscriptions are answered. The
+ * node is live before its requests go out, so no early indication is lost.
+ *
+ * Polls run on the main thread. Indications are handled on the FlexRIC and
+ * writer threads, so attaching or retiring one node never holds up the
+ * others. Other threads that walk the nodes (the metrics endpoint) take
+ * mtx and look only at listed slots.
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#ifndef NODE_WATCH_H
+#define NODE_WATCH_H
+
+#include "collector_cfg.h"
+#include "ind_log.h"
+#include "node_ctx.h"
+#include "sub_fanout.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Poll period until the first node is attached
+#define NODE_WATCH_FAST_MS 100
+
+// Node ids remembered for the reattach file suffix
+#define NODE_WATCH_SEEN_MAX 256
+
+// Fills in the subscriptions a freshly opened node wants, at most
+// NODE_SUB_COUNT tagged with their NODE_SUB_*, and returns how many; the
+// answers land in n->sub[]. The caller owns the trampolines, so the slot
+// picks the callback. A node that needs none sets n->sub[] itself.
+typedef size_t (*node_subscribe_fn)(node_ctx_t *n,
+                                    e2_node_connected_xapp_t const *e2,
+                                    sub_req_t *req, void *arg);
+
+typedef struct {
+  node_ctx_t *slot; // NODE_CTX_MAX
+  bool used[NODE_CTX_MAX]; // Main thread only
+  size_t n_used;
+
+  pthread_mutex_t mtx;
+  bool listed[NODE_CTX_MAX]; // Under mtx: open, subscribed and live
+
+  collector_cfg_t const *cfg;
+  node_subscribe_fn subscribe;
+  void *arg;
+
+  // Set before the first poll: every polled list is recorded here
+  ind_log_writer_t *log;
+  // Replay: the subscriptions are not the RIC's, so nothing is unsubscribed
+  bool offline;
+
+  // Subscriptions of the nodes attached by one diff, issued together
+  sub_req_t batch[NODE_CTX_MAX * NODE_SUB_COUNT];
+  size_t n_batch;
+  int64_t batch_ns;
+
+  // Attach count per node id, for node_ctx_open's gen
+  global_e2_node_id_t seen[NODE_WATCH_SEEN_MAX];
+  unsigned seen_count[NODE_WATCH_SEEN_MAX];
+  size_t n_seen;
+
+  bool full_warned;
+  uint64_t attached;
+  uint64_t departed;
+  uint64_t departed_rows;
+  uint64_t departed_bytes;
+} node_watch_t;
+
+bool node_watch_init(node_watch_t *w, collector_cfg_t const *cfg,
+                     node_subscribe_fn subscribe, void *arg);
+
+// One diff against the RIC's node list; returns the nodes attached now
+size_t node_watch_poll(node_watch_t *w);
+
+// Same, against the given list
+size_t node_watch_sync(node_watch_t *w, e2_node_arr_xapp_t const *nodes);
+
+// Milliseconds until the next poll is due
+uint32_t node_watch_period_ms(node_watch_t const *w);
+
+// Shutdown: unsubscribes and retires every node, then drains and joins the
+// writers. The nodes stay readable for stats until node_watch_free.
+void node_watch_stop(node_watch_t *w);
+void node_watch_free(node_watch_t *w);
+
+#endif
@@ -0,0 +1,548 @@
+/*
+ * Rotating segment sink
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#include "rot_sink.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef KPM_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#define ROT_MAX_PATH 320
+#define ROT_CHECK_ROWS 1024 // Rows between size checks
+#define ROT_IO_BUF (1u << 20)
+#define ROT_RETRY_US 1000000 // Between attempts to open a segment
+#define ROT_NICE 10          // Compressor thread priority
+
+typedef struct {
+  uint32_t seq;
+  bool compress;
+  int64_t first_ts, last_ts;
+  uint64_t rows;
+  uint64_t raw_bytes;
+  uint64_t stored_bytes;
+  char path[ROT_MAX_PATH]; // Plain segment, then whatever is left on disk
+} seg_t;
+
+typedef struct {
+  row_sink_t base;
+  char path[ROT_MAX_PATH];
+  char manifest[ROT_MAX_PATH];
+  csv_flush_policy_t csv_policy;
+  rot_policy_t pol;
+
+  // Writer thread only
+  row_sink_t *inner; // Open segment, NULL between segments
+  seg_t cur;
+  int64_t cur_opened_us;
+  int64_t failed_us; // Last failed open, 0 = none
+  uint32_t next_seq;
+  uint32_t since_check;
+
+  // Handoff to the compressor, under mtx
+  pthread_mutex_t mtx;
+  pthread_cond_t cv;
+  seg_t *queue;
+  size_t q_len, q_cap;
+  size_t q_compress; // Queued segments still to be compressed
+  bool stop;
+  pthread_t thr;
+
+  // Finished segments on disk, compressor thread only
+  seg_t *done;
+  size_t n_done, cap_done;
+
+  // Stats, under mtx
+  uint64_t closed;
+  uint64_t left_plain; // Compressor behind or failed
+  uint64_t deleted;
+  uint64_t raw_total, stored_total;
+  uint64_t rows_dropped;
+} rot_sink_t;
+
+static int64_t mono_us(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (int64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+bool rot_policy_active(rot_policy_t const *p) {
+  return p->max_mb || p->max_s;
+}
+
+bool rot_sink_zstd_available(void) {
+#ifdef KPM_WITH_ZSTD
+  return true;
+#else
+  return false;
+#endif
+}
+
+// "/tmp/kpm.csv" -> stem "/tmp/kpm", ext ".csv"
+static void split_ext(char const *path, size_t *stem, char const **ext) {
+  char const *slash = strrchr(path, '/');
+  char const *dot = strrchr(slash ? slash : path, '.');
+  *stem = dot ? (size_t)(dot - path) : strlen(path);
+  *ext = dot ? dot : "";
+}
+
+bool rot_sink_segment_path(char *dst, size_t len, char const *path,
+                           uint32_t seq) {
+  size_t stem;
+  char const *ext;
+  split_ext(path, &stem, &ext);
+  int const n = snprintf(dst, len, "%.*s_s%05u%s", (int)stem, path, seq, ext);
+  return n > 0 && (size_t)n < len;
+}
+
+// --- Compressor thread -------------------------------------------------------
+
+#ifdef KPM_WITH_ZSTD
+static bool write_all(int fd, void const *buf, size_t len) {
+  char const *p = buf;
+  while (len > 0) {
+    ssize_t const n = write(fd, p, len);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    p += n;
+    len -= (size_t)n;
+  }
+  return true;
+}
+
+typedef struct {
+  ZSTD_CCtx *cctx;
+  uint8_t *in;
+  uint8_t *out;
+  size_t out_cap;
+} zstd_ctx_t;
+
+// Compresses s->path to s->path + ".zst" with the index footer; the plain
+// file is removed only once the compressed one is on disk
+static bool compress_seg(rot_sink_t *r, zstd_ctx_t *z, seg_t *s) {
+  char dst[ROT_MAX_PATH];
+  size_t const len = strlen(s->path);
+  if (len + sizeof(".zst") > sizeof(dst))
+    return false;
+  memcpy(dst, s->path, len);
+  memcpy(dst + len, ".zst", sizeof(".zst"));
+
+  int const in = open(s->path, O_RDONLY | O_CLOEXEC);
+  if (in < 0) {
+    perror(s->path);
+    return false;
+  }
+  int const out = open(dst, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (out < 0) {
+    perror(dst);
+    close(in);
+    return false;
+  }
+
+  ZSTD_CCtx_reset(z->cctx, ZSTD_reset_session_only);
+  ZSTD_CCtx_setParameter(z->cctx, ZSTD_c_compressionLevel,
+                         (int)r->pol.zstd_level);
+  ZSTD_CCtx_setParameter(z->cctx, ZSTD_c_checksumFlag, 1);
+
+  bool ok = true;
+  for (;;) {
+    ssize_t const n = read(in, z->in, ROT_IO_BUF);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0) {
+      perror(s->path);
+      ok = false;
+      break;
+    }
+
+    ZSTD_EndDirective const mode = n == 0 ? ZSTD_e_end : ZSTD_e_continue;
+    ZSTD_inBuffer ib = {z->in, (size_t)n, 0};
+    bool finished;
+    do {
+      ZSTD_outBuffer ob = {z->out, z->out_cap, 0};
+      size_t const left = ZSTD_compressStream2(z->cctx, &ob, &ib, mode);
+      if (ZSTD_isError(left)) {
+        fprintf(stderr, "%s: %s\n", dst, ZSTD_getErrorName(left));
+        ok = false;
+        break;
+      }
+      if (!write_all(out, z->out, ob.pos)) {
+        perror(dst);
+        ok = false;
+        break;
+      }
+      finished = mode == ZSTD_e_end ? left == 0 : ib.pos == ib.size;
+    } while (!finished);
+    if (!ok || n == 0)
+      break;
+  }
+
+  if (ok) {
+    rot_index_t const idx = {
+        .magic = ROT_INDEX_MAGIC,
+        .version = ROT_INDEX_VERSION,
+        .seq = s->seq,
+        .first_ts = s->first_ts,
+        .last_ts = s->last_ts,
+        .rows = s->rows,
+        .raw_bytes = s->raw_bytes,
+    };
+    uint8_t frame[ROT_INDEX_FRAME];
+    uint32_t const hdr[2] = {ROT_INDEX_FRAME_MAGIC, (uint32_t)sizeof(idx)};
+    memcpy(frame, hdr, sizeof(hdr));
+    memcpy(frame + sizeof(hdr), &idx, sizeof(idx));
+    ok = write_all(out, frame, sizeof(frame)) && fdatasync(out) == 0;
+    if (!ok)
+      perror(dst);
+  }
+
+  struct stat st;
+  if (ok && fstat(out, &st) == 0)
+    s->stored_bytes = (uint64_t)st.st_size;
+  close(in);
+  if (close(out) != 0)
+    ok = false;
+
+  if (!ok) {
+    unlink(dst);
+    return false;
+  }
+  unlink(s->path);
+  memcpy(s->path, dst, len + sizeof(".zst"));
+  return true;
+}
+#endif
+
+// Rewritten whole, then renamed over the old one, so readers never see a
+// half-written list
+static void write_manifest(rot_sink_t *r) {
+  char tmp[ROT_MAX_PATH + 8];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", r->manifest);
+  FILE *f = fopen(tmp, "w");
+  if (!f) {
+    perror(tmp);
+    return;
+  }
+
+  fputs("seq,file,first_ts,last_ts,rows,raw_bytes,stored_bytes\n", f);
+  for (size_t i = 0; i < r->n_done; i++) {
+    seg_t const *s = &r->done[i];
+    char const *slash = strrchr(s->path, '/');
+    fprintf(f, "%u,%s,%lld,%lld,%lu,%lu,%lu\n", s->seq,
+            slash ? slash + 1 : s->path, (long long)s->first_ts,
+            (long long)s->last_ts, s->rows, s->raw_bytes, s->stored_bytes);
+  }
+
+  if (fclose(f) != 0 || rename(tmp, r->manifest) != 0) {
+    perror(r->manifest);
+    unlink(tmp);
+  }
+}
+
+static void finish_seg(rot_sink_t *r, seg_t const *s) {
+  if (r->n_done == r->cap_done) {
+    size_t const cap = r->cap_done ? r->cap_done * 2 : 64;
+    seg_t *d = realloc(r->done, cap * sizeof(*d));
+    if (!d) {
+      fprintf(stderr, "rot_sink: out of memory, %s not indexed\n", s->path);
+      return;
+    }
+    r->done = d;
+    r->cap_done = cap;
+  }
+  r->done[r->n_done++] = *s;
+
+  uint64_t deleted = 0;
+  if (r->pol.keep && r->n_done > r->pol.keep) {
+    size_t const drop = r->n_done - r->pol.keep;
+    for (size_t i = 0; i < drop; i++) {
+      if (unlink(r->done[i].path) != 0 && errno != ENOENT)
+        perror(r->done[i].path);
+    }
+    memmove(r->done, r->done + drop, r->pol.keep * sizeof(*r->done));
+    r->n_done = r->pol.keep;
+    deleted = drop;
+  }
+  write_manifest(r);
+
+  pthread_mutex_lock(&r->mtx);
+  r->stored_total += s->stored_bytes;
+  r->deleted += deleted;
+  pthread_mutex_unlock(&r->mtx);
+}
+
+static void *compressor(void *arg) {
+  rot_sink_t *r = arg;
+
+  // Linux applies a nice value per thread; keep the writer ahead of us
+  setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), ROT_NICE);
+
+#ifdef KPM_WITH_ZSTD
+  zstd_ctx_t z = {0};
+  if (r->pol.zstd_level) {
+    z.cctx = ZSTD_createCCtx();
+    z.in = malloc(ROT_IO_BUF);
+    z.out_cap = ZSTD_CStreamOutSize();
+    z.out = malloc(z.out_cap);
+  }
+#endif
+
+  for (;;) {
+    pthread_mutex_lock(&r->mtx);
+    while (r->q_len == 0 && !r->stop)
+      pthread_cond_wait(&r->cv, &r->mtx);
+    if (r->q_len == 0) {
+      pthread_mutex_unlock(&r->mtx);
+      break;
+    }
+    seg_t s = r->queue[0];
+    memmove(r->queue, r->queue + 1, (r->q_len - 1) * sizeof(*r->queue));
+    r->q_len--;
+    pthread_mutex_unlock(&r->mtx);
+
+    s.stored_bytes = s.raw_bytes;
+    bool packed = false;
+#ifdef KPM_WITH_ZSTD
+    if (s.compress && z.cctx && z.in && z.out)
+      packed = compress_seg(r, &z, &s);
+#endif
+
+    pthread_mutex_lock(&r->mtx);
+    if (s.compress)
+      r->q_compress--;
+    if (r->pol.zstd_level && !packed)
+      r->left_plain++;
+    pthread_mutex_unlock(&r->mtx);
+
+    finish_seg(r, &s);
+  }
+
+#ifdef KPM_WITH_ZSTD
+  ZSTD_freeCCtx(z.cctx);
+  free(z.in);
+  free(z.out);
+#endif
+  return NULL;
+}
+
+// --- Writer side -------------------------------------------------------------
+
+static bool open_seg(rot_sink_t *r) {
+  seg_t *s = &r->cur;
+  memset(s, 0, sizeof(*s));
+  s->seq = r->next_seq;
+  // Room is left for the ".zst" the compressor appends
+  if (!rot_sink_segment_path(s->path, sizeof(s->path) - 4, r->path, s->seq)) {
+    fprintf(stderr, "rot_sink: path too long: %s\n", r->path);
+    return false;
+  }
+  r->inner = row_sink_open(s->path, r->csv_policy);
+  if (!r->inner) {
+    perror(s->path);
+    return false;
+  }
+  r->next_seq++;
+  r->cur_opened_us = mono_us();
+  r->since_check = 0;
+  return true;
+}
+
+static void close_seg(rot_sink_t *r) {
+  seg_t *s = &r->cur;
+  r->inner->close(r->inner);
+  r->inner = NULL;
+
+  struct stat st;
+  s->raw_bytes = stat(s->path, &st) == 0 ? (uint64_t)st.st_size : 0;
+
+  pthread_mutex_lock(&r->mtx);
+  if (r->q_len == r->q_cap) {
+    size_t const cap = r->q_cap * 2;
+    seg_t *q = realloc(r->queue, cap * sizeof(*q));
+    if (!q) {
+      // Left on disk, just not indexed
+      pthread_mutex_unlock(&r->mtx);
+      fprintf(stderr, "rot_sink: out of memory, %s not indexed\n", s->path);
+      return;
+    }
+    r->queue = q;
+    r->q_cap = cap;
+  }
+  s->compress = r->pol.zstd_level && r->q_compress < ROT_SINK_MAX_PENDING;
+  r->q_compress += s->compress;
+  r->queue[r->q_len++] = *s;
+  r->closed++;
+  r->raw_total += s->raw_bytes;
+  pthread_cond_signal(&r->cv);
+  pthread_mutex_unlock(&r->mtx);
+}
+
+static bool seg_due(rot_sink_t *r, int64_t now, bool check_size) {
+  int64_t const max_us = (int64_t)r->pol.max_s * 1000000;
+  if (max_us && now - r->cur_opened_us >= max_us)
+    return true;
+  if (r->pol.max_mb && check_size) {
+    struct stat st;
+    return stat(r->cur.path, &st) == 0 &&
+           (uint64_t)st.st_size >= (uint64_t)r->pol.max_mb << 20;
+  }
+  return false;
+}
+
+static void rot_write(row_sink_t *base, ue_metrics_t const *m) {
+  rot_sink_t *r = (rot_sink_t *)base;
+  int64_t const now = mono_us();
+
+  if (!r->inner) {
+    if (r->failed_us && now - r->failed_us < ROT_RETRY_US) {
+      r->rows_dropped++;
+      return;
+    }
+    if (!open_seg(r)) {
+      r->failed_us = now;
+      r->rows_dropped++;
+      return;
+    }
+    r->failed_us = 0;
+  }
+
+  seg_t *s = &r->cur;
+  if (s->rows == 0)
+    s->first_ts = m->timestamp;
+  s->last_ts = m->timestamp;
+  s->rows++;
+  r->inner->write(r->inner, m);
+
+  bool const check_size = ++r->since_check >= ROT_CHECK_ROWS;
+  if (check_size)
+    r->since_check = 0;
+  if (seg_due(r, now, check_size))
+    close_seg(r);
+}
+
+static void rot_flush(row_sink_t *base) {
+  rot_sink_t *r = (rot_sink_t *)base;
+  if (r->inner)
+    r->inner->flush(r->inner);
+}
+
+static void rot_tick(row_sink_t *base) {
+  rot_sink_t *r = (rot_sink_t *)base;
+  if (!r->inner)
+    return;
+  if (r->inner->tick)
+    r->inner->tick(r->inner);
+  if (seg_due(r, mono_us(), true))
+    close_seg(r);
+}
+
+static void rot_print_stats(row_sink_t *base) {
+  rot_sink_t *r = (rot_sink_t *)base;
+  pthread_mutex_lock(&r->mtx);
+  printf("    Segments: %lu closed%s, %zu queued, %lu left plain, "
+         "%lu deleted; %.1f MB raw",
+         r->closed, r->inner ? " + 1 open" : "", r->q_len, r->left_plain,
+         r->deleted, (double)r->raw_total / (1 << 20));
+  if (r->pol.zstd_level && r->stored_total)
+    printf(" -> %.1f MB stored (%.1fx)", (double)r->stored_total / (1 << 20),
+           (double)r->raw_total / (double)r->stored_total);
+  pthread_mutex_unlock(&r->mtx);
+  printf("\n");
+  if (r->rows_dropped)
+    printf("    Segments: %lu rows dropped (open failed)\n", r->rows_dropped);
+}
+
+// Raw segment bytes; compression and the manifest are not row output
+static uint64_t rot_bytes(row_sink_t *base) {
+  rot_sink_t *r = (rot_sink_t *)base;
+  pthread_mutex_lock(&r->mtx);
+  uint64_t bytes = r->raw_total;
+  pthread_mutex_unlock(&r->mtx);
+  if (r->inner && r->inner->bytes)
+    bytes += r->inner->bytes(r->inner);
+  return bytes;
+}
+
+static void rot_close(row_sink_t *base) {
+  rot_sink_t *r = (rot_sink_t *)base;
+  if (r->inner)
+    close_seg(r);
+
+  // The compressor drains the queue before it exits
+  pthread_mutex_lock(&r->mtx);
+  r->stop = true;
+  pthread_cond_signal(&r->cv);
+  pthread_mutex_unlock(&r->mtx);
+  pthread_join(r->thr, NULL);
+
+  pthread_cond_destroy(&r->cv);
+  pthread_mutex_destroy(&r->mtx);
+  free(r->queue);
+  free(r->done);
+  free(r);
+}
+
+row_sink_t *rot_sink_open(char const *path, csv_flush_policy_t csv_policy,
+                          rot_policy_t const *rot) {
+  rot_sink_t *r = calloc(1, sizeof(*r));
+  if (!r)
+    return NULL;
+
+  size_t stem;
+  char const *ext;
+  split_ext(path, &stem, &ext);
+  int const n = snprintf(r->manifest, sizeof(r->manifest), "%.*s_segments.csv",
+                         (int)stem, path);
+  if (strlen(path) >= sizeof(r->path) || n < 0 ||
+      (size_t)n >= sizeof(r->manifest)) {
+    fprintf(stderr, "rot_sink: path too long: %s\n", path);
+    free(r);
+    return NULL;
+  }
+  memcpy(r->path, path, strlen(path) + 1);
+  r->csv_policy = csv_policy;
+  r->pol = *rot;
+
+  r->q_cap = ROT_SINK_MAX_PENDING * 2;
+  r->queue = calloc(r->q_cap, sizeof(*r->queue));
+  if (!r->queue) {
+    free(r);
+    return NULL;
+  }
+
+  pthread_mutex_init(&r->mtx, NULL);
+  pthread_cond_init(&r->cv, NULL);
+  if (pthread_create(&r->thr, NULL, compressor, r) != 0) {
+    fprintf(stderr, "rot_sink: cannot start the compressor thread\n");
+    pthread_cond_destroy(&r->cv);
+    pthread_mutex_destroy(&r->mtx);
+    free(r->queue);
+    free(r);
+    return NULL;
+  }
+
+  r->base.write = rot_write;
+  r->base.flush = rot_flush;
+  r->base.close = rot_close;
+  r->base.tick = rot_tick;
+  r->base.print_stats = rot_print_stats;
+  r->base.bytes = rot_bytes;
+  return &r->base;
+}
@@ -0,0 +1,84 @@
+/*
+ * Rotating segment sink
+ * =====================
+ *
+ * Splits a node's raw rows into numbered segments next to the output path
+ * ("kpm.csv" -> "kpm_s00000.csv", "kpm_s00001.csv", ...), using whatever
+ * format the path selects. A segment is closed once it reaches max_mb or
+ * has been open for max_s seconds, then handed to a background thread that
+ * compresses it to "<segment>.zst" and removes the plain file. Compression
+ * never runs on the writer thread. If the thread falls behind, segments are
+ * left uncompressed rather than holding up the writer.
+ *
+ * Each compressed segment ends with a zstd skippable frame holding a
+ * rot_index_t: the segment's row count and time range. zstd and other
+ * decoders skip it, and a reader can find it in the last ROT_INDEX_FRAME
+ * bytes without decompressing anything. The same facts for every segment
+ * still on disk go to "<stem>_segments.csv", rewritten after each segment,
+ * so analysis can pick segments by time without opening them.
+ *
+ * With keep > 0 only the newest `keep` finished segments are kept; older
+ * ones are deleted. Disk use is then bounded by keep + 1 segments.
+ *
+ * Compression needs the collector built with -DKPM_WITH_ZSTD=ON. Without it
+ * segments stay plain and have no footer.
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#ifndef ROT_SINK_H
+#define ROT_SINK_H
+
+#include "row_sink.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ROT_SINK_ZSTD_LEVEL 3
+
+// Segments waiting for the compressor; more are left plain
+#define ROT_SINK_MAX_PENDING 8
+
+typedef struct {
+  uint32_t max_mb;     // Close at this size, 0 = no size limit
+  uint32_t max_s;      // Close after this long, 0 = no time limit
+  uint32_t keep;       // Finished segments kept on disk, 0 = all
+  uint32_t zstd_level; // 0 = no compression
+} rot_policy_t;
+
+// Footer of a compressed segment, little endian. The skippable frame is the
+// 4-byte magic ROT_INDEX_FRAME_MAGIC, the 4-byte payload size (sizeof), then
+// this struct.
+#define ROT_INDEX_FRAME_MAGIC 0x184d2a5bu
+#define ROT_INDEX_MAGIC 0x494d504bu // "KPMI"
+#define ROT_INDEX_VERSION 1
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t seq;
+  uint32_t reserved;
+  int64_t first_ts; // Row timestamps (us since epoch)
+  int64_t last_ts;
+  uint64_t rows;
+  uint64_t raw_bytes; // Size before compression
+} rot_index_t;
+
+_Static_assert(sizeof(rot_index_t) == 48, "rot_index_t layout changed");
+
+#define ROT_INDEX_FRAME (8 + sizeof(rot_index_t))
+
+bool rot_policy_active(rot_policy_t const *p);
+
+// False if the collector was built without zstd
+bool rot_sink_zstd_available(void);
+
+// Opens the first segment lazily, on the first row
+row_sink_t *rot_sink_open(char const *path, csv_flush_policy_t csv_policy,
+                          rot_policy_t const *rot);
+
+// Path of a segment file before compression
+bool rot_sink_segment_path(char *dst, size_t len, char const *path,
+                           uint32_t seq);
+
+#endif
@@ -0,0 +1,472 @@
+/*
+ * Window aggregation
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#include "row_agg.h"
+#include "stop_event.h"
+
+#include "../../../../src/util/time_now_us.h"
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define AGG_MAX_PATH 320
+#define AGG_FILE_BUF (256u << 10)
+
+typedef struct {
+  ue_field_t fld;
+  unsigned prec; // Decimals of min/max/last; the mean gets at least 2
+} field_def_t;
+
+#define FLD(name, type, field, prec) {UE_FIELD(name, type, field), prec}
+
+// Same names as the raw CSV columns
+static field_def_t const mac_fields[] = {
+    FLD("cqi", U8, cqi, 0),
+    FLD("pusch_snr", F32, pusch_snr, 2),
+    FLD("pucch_snr", F32, pucch_snr, 2),
+    FLD("dl_bler", F32, dl_bler, 4),
+    FLD("ul_bler", F32, ul_bler, 4),
+    FLD("dl_mcs1", U8, dl_mcs1, 0),
+    FLD("dl_mcs2", U8, dl_mcs2, 0),
+    FLD("ul_mcs1", U8, ul_mcs1, 0),
+    FLD("ul_mcs2", U8, ul_mcs2, 0),
+    FLD("dl_tbs", U64, dl_tbs, 0),
+    FLD("ul_tbs", U64, ul_tbs, 0),
+    FLD("dl_aggr_tbs", U64, dl_aggr_tbs, 0),
+    FLD("ul_aggr_tbs", U64, ul_aggr_tbs, 0),
+    FLD("dl_prb", U32, dl_prb, 0),
+    FLD("ul_prb", U32, ul_prb, 0),
+    FLD("dl_sched_rb", U32, dl_sched_rb, 0),
+    FLD("ul_sched_rb", U32, ul_sched_rb, 0),
+    FLD("bsr", U32, bsr, 0),
+    FLD("phr", I8, phr, 0),
+    FLD("dl_mac_kbps", F64, dl_mac_kbps, 2),
+    FLD("ul_mac_kbps", F64, ul_mac_kbps, 2),
+    FLD("dl_goodput_kbps", F64, dl_goodput_kbps, 2),
+    FLD("ul_goodput_kbps", F64, ul_goodput_kbps, 2),
+};
+
+static field_def_t const rlc_fields[] = {
+    FLD("rlc_tx_pkts", U32, rlc_tx_pkts, 0),
+    FLD("rlc_tx_bytes", U32, rlc_tx_bytes, 0),
+    FLD("rlc_rx_pkts", U32, rlc_rx_pkts, 0),
+    FLD("rlc_rx_bytes", U32, rlc_rx_bytes, 0),
+    FLD("rlc_txbuf", U32, rlc_txbuf, 0),
+    FLD("rlc_rxbuf", U32, rlc_rxbuf, 0),
+    FLD("rlc_retx", U32, rlc_retx, 0),
+    FLD("rlc_tx_kbps", F64, rlc_tx_kbps, 2),
+    FLD("rlc_rx_kbps", F64, rlc_rx_kbps, 2),
+    FLD("rlc_retx_per_s", F64, rlc_retx_per_s, 2),
+};
+
+static field_def_t const pdcp_fields[] = {
+    FLD("pdcp_tx_pkts", U32, pdcp_tx_pkts, 0),
+    FLD("pdcp_tx_bytes", U32, pdcp_tx_bytes, 0),
+    FLD("pdcp_rx_pkts", U32, pdcp_rx_pkts, 0),
+    FLD("pdcp_rx_bytes", U32, pdcp_rx_bytes, 0),
+    FLD("pdcp_tx_kbps", F64, pdcp_tx_kbps, 2),
+    FLD("pdcp_rx_kbps", F64, pdcp_rx_kbps, 2),
+};
+
+static field_def_t const kpm_fields[] = {
+    FLD("dl_thp_kbps", F64, dl_thp_kbps, 2),
+    FLD("ul_thp_kbps", F64, ul_thp_kbps, 2),
+    FLD("rlc_sdu_delay_us", F64, rlc_sdu_delay_us, 2),
+    FLD("pdcp_vol_dl_kb", I32, pdcp_sdu_vol_dl_kb, 0),
+    FLD("pdcp_vol_ul_kb", I32, pdcp_sdu_vol_ul_kb, 0),
+    FLD("prb_tot_dl", I32, prb_tot_dl, 0),
+    FLD("prb_tot_ul", I32, prb_tot_ul, 0),
+};
+
+#undef FLD
+
+#define N_FIELDS(a) (sizeof(a) / sizeof(a[0]))
+
+typedef struct {
+  field_def_t const *f;
+  size_t n;
+} field_set_t;
+
+static field_set_t const sets[ROW_AGG_COUNT] = {
+    [ROW_AGG_MAC] = {mac_fields, N_FIELDS(mac_fields)},
+    [ROW_AGG_RLC] = {rlc_fields, N_FIELDS(rlc_fields)},
+    [ROW_AGG_PDCP] = {pdcp_fields, N_FIELDS(pdcp_fields)},
+    [ROW_AGG_KPM] = {kpm_fields, N_FIELDS(kpm_fields)},
+};
+
+_Static_assert(N_FIELDS(mac_fields) <= ROW_AGG_MAX_FIELDS &&
+                   N_FIELDS(rlc_fields) <= ROW_AGG_MAX_FIELDS &&
+                   N_FIELDS(pdcp_fields) <= ROW_AGG_MAX_FIELDS &&
+                   N_FIELDS(kpm_fields) <= ROW_AGG_MAX_FIELDS,
+               "raise ROW_AGG_MAX_FIELDS");
+
+char const *const row_agg_src_name[ROW_AGG_COUNT] = {
+    [ROW_AGG_MAC] = "mac",
+    [ROW_AGG_RLC] = "rlc",
+    [ROW_AGG_PDCP] = "pdcp",
+    [ROW_AGG_KPM] = "kpm",
+};
+
+// --- Accumulators ------------------------------------------------------------
+
+typedef struct {
+  int64_t win; // Window index: start time / window length
+  uint32_t n;  // 0 = no window open
+  uint32_t cnt[ROW_AGG_MAX_FIELDS]; // Samples that were not NaN
+  double sum[ROW_AGG_MAX_FIELDS];
+  double min[ROW_AGG_MAX_FIELDS];
+  double max[ROW_AGG_MAX_FIELDS];
+  double last[ROW_AGG_MAX_FIELDS];
+} acc_t;
+
+// KPM is per node, the other sources per UE
+#define UE_SRCS ROW_AGG_KPM
+
+typedef struct {
+  acc_t acc[UE_SRCS];
+} agg_ue_t;
+
+typedef struct {
+  row_sink_t base;
+  int64_t window_us[ROW_AGG_COUNT];
+  FILE *out[ROW_AGG_COUNT];
+  char path[ROW_AGG_COUNT][AGG_MAX_PATH];
+
+  // Keyed by RNTI like ue_table_t, which it shadows on the writer thread
+  ue_index_t ix;
+  agg_ue_t ues[UE_TABLE_MAX_LOAD];
+  acc_t kpm;
+
+  int64_t last_sweep_us;
+
+  // Stream clock: windows close by row time, not wall time, so a replayed
+  // log is cut into the same windows at any speed. Between rows it runs on
+  // with the wall clock.
+  int64_t row_ts;
+  int64_t row_wall_us;
+
+  uint64_t max_summaries; // 0 = no limit
+
+  // Stats
+  uint64_t rows;
+  uint64_t reports;
+  uint64_t summaries[ROW_AGG_COUNT];
+  uint64_t over_budget; // Windows dropped once max_summaries was reached
+} agg_sink_t;
+
+// Summaries written by every window sink, against max_summaries
+static _Atomic uint64_t summaries_total;
+
+// Reserves one summary of the shared budget
+static bool take_budget(agg_sink_t *a) {
+  uint64_t const target = a->max_summaries;
+  uint64_t c = atomic_load_explicit(&summaries_total, memory_order_relaxed);
+  do {
+    if (target && c >= target)
+      return false;
+  } while (!atomic_compare_exchange_weak_explicit(
+      &summaries_total, &c, c + 1, memory_order_relaxed,
+      memory_order_relaxed));
+
+  if (c + 1 == target) {
+    printf("\nReached target of %lu window summaries\n", target);
+    stop_event_raise();
+  }
+  return true;
+}
+
+static agg_ue_t *agg_ue(agg_sink_t *a, uint32_t rnti) {
+  bool added;
+  int const e = ue_index_insert(&a->ix, rnti, &added);
+  if (e < 0)
+    return NULL;
+  if (added)
+    memset(&a->ues[e], 0, sizeof(a->ues[e]));
+  return &a->ues[e];
+}
+
+uint64_t row_agg_summaries(void) {
+  return atomic_load_explicit(&summaries_total, memory_order_relaxed);
+}
+
+static void emit(agg_sink_t *a, row_agg_src_e src, acc_t *acc,
+                 uint32_t const *rnti) {
+  field_set_t const *set = &sets[src];
+  FILE *f = a->out[src];
+
+  if (!take_budget(a)) {
+    acc->n = 0;
+    a->over_budget++;
+    return;
+  }
+
+  fprintf(f, "%lld,%lld,", (long long)(acc->win * a->window_us[src]),
+          (long long)(a->window_us[src] / 1000));
+  if (rnti)
+    fprintf(f, "%u,", *rnti);
+  fprintf(f, "%u", acc->n);
+
+  for (size_t i = 0; i < set->n; i++) {
+    int const p = (int)set->f[i].prec;
+    if (acc->cnt[i] == 0) {
+      fputs(",nan,nan,nan,nan", f);
+      continue;
+    }
+    fprintf(f, ",%.*f,%.*f,%.*f,%.*f", p < 2 ? 2 : p,
+            acc->sum[i] / acc->cnt[i], p, acc->min[i], p, acc->max[i], p,
+            acc->last[i]);
+  }
+  fputc('\n', f);
+
+  acc->n = 0;
+  a->summaries[src]++;
+}
+
+static void add(agg_sink_t *a, row_agg_src_e src, acc_t *acc,
+                ue_metrics_t const *m, int64_t ts, uint32_t const *rnti) {
+  field_set_t const *set = &sets[src];
+  int64_t const win = ts / a->window_us[src];
+
+  // Late samples count towards the open window
+  if (acc->n && win > acc->win)
+    emit(a, src, acc, rnti);
+
+  if (acc->n == 0) {
+    acc->win = win;
+    for (size_t i = 0; i < set->n; i++) {
+      acc->cnt[i] = 0;
+      acc->sum[i] = 0;
+      acc->min[i] = INFINITY;
+      acc->max[i] = -INFINITY;
+    }
+  }
+
+  for (size_t i = 0; i < set->n; i++) {
+    double const v = ue_field_value(m, &set->f[i].fld);
+    if (isnan(v))
+      continue;
+    acc->cnt[i]++;
+    acc->sum[i] += v;
+    if (v < acc->min[i])
+      acc->min[i] = v;
+    if (v > acc->max[i])
+      acc->max[i] = v;
+    acc->last[i] = v;
+  }
+  acc->n++;
+}
+
+// --- Sink --------------------------------------------------------------------
+
+// Receive time of what the record carries
+static int64_t rec_ts(ue_metrics_t const *m) {
+  switch (m->rec) {
+  case UE_REC_RLC:
+    return m->rlc_ts;
+  case UE_REC_PDCP:
+    return m->pdcp_ts;
+  case UE_REC_KPM:
+    return m->kpm_ts;
+  default:
+    return m->timestamp;
+  }
+}
+
+// A lone RLC/PDCP/KPM report (see ue_rec_e)
+static void agg_report(agg_sink_t *a, ue_metrics_t const *m, int64_t ts) {
+  a->reports++;
+  if (m->rec == UE_REC_KPM) {
+    if (a->out[ROW_AGG_KPM])
+      add(a, ROW_AGG_KPM, &a->kpm, m, ts, NULL);
+    return;
+  }
+
+  row_agg_src_e const src = m->rec == UE_REC_RLC ? ROW_AGG_RLC : ROW_AGG_PDCP;
+  if (!a->out[src])
+    return;
+  agg_ue_t *u = agg_ue(a, m->rnti);
+  if (u)
+    add(a, src, &u->acc[src], m, ts, &m->rnti);
+}
+
+static void agg_write(row_sink_t *s, ue_metrics_t const *m) {
+  agg_sink_t *a = (agg_sink_t *)s;
+  int64_t const ts = rec_ts(m);
+  if (ts > a->row_ts) {
+    a->row_ts = ts;
+    a->row_wall_us = time_now_us();
+  }
+
+  // RLC, PDCP and KPM are summed from their own reports, so one that came
+  // and went between two MAC rows still counts; rows only add MAC
+  if (m->rec != UE_REC_ROW) {
+    agg_report(a, m, ts);
+    return;
+  }
+  a->rows++;
+
+  // An evicted UE's windows end with it. The final row repeats its last
+  // state, so it is not a sample.
+  if (m->final) {
+    int const e = ue_index_find(&a->ix, m->rnti);
+    if (e >= 0) {
+      for (size_t src = 0; src < UE_SRCS; src++) {
+        if (a->ues[e].acc[src].n)
+          emit(a, (row_agg_src_e)src, &a->ues[e].acc[src], &m->rnti);
+      }
+      ue_index_remove(&a->ix, m->rnti);
+    }
+    return;
+  }
+
+  agg_ue_t *u = agg_ue(a, m->rnti);
+  if (u && a->out[ROW_AGG_MAC])
+    add(a, ROW_AGG_MAC, &u->acc[ROW_AGG_MAC], m, m->timestamp, &m->rnti);
+}
+
+// Writes out the windows that ended before cutoff (every one with
+// cutoff = INT64_MAX)
+static void sweep(agg_sink_t *a, int64_t cutoff) {
+  for (size_t i = 0; i < UE_TABLE_MAX_LOAD; i++) {
+    if (a->ix.owner[i] == UE_TABLE_EMPTY)
+      continue;
+    for (size_t src = 0; src < UE_SRCS; src++) {
+      acc_t *acc = &a->ues[i].acc[src];
+      if (acc->n && (acc->win + 1) * a->window_us[src] <= cutoff)
+        emit(a, (row_agg_src_e)src, acc, &a->ix.owner[i]);
+    }
+  }
+  if (a->kpm.n &&
+      (a->kpm.win + 1) * a->window_us[ROW_AGG_KPM] <= cutoff)
+    emit(a, ROW_AGG_KPM, &a->kpm, NULL);
+}
+
+static void agg_flush(row_sink_t *s) {
+  agg_sink_t *a = (agg_sink_t *)s;
+  for (size_t i = 0; i < ROW_AGG_COUNT; i++) {
+    if (a->out[i])
+      fflush(a->out[i]);
+  }
+}
+
+static void agg_tick(row_sink_t *s) {
+  agg_sink_t *a = (agg_sink_t *)s;
+  int64_t const wall = time_now_us();
+  if (wall - a->last_sweep_us < (int64_t)ROW_AGG_GRACE_MS * 1000)
+    return;
+  a->last_sweep_us = wall;
+  int64_t const now = a->row_ts ? a->row_ts + (wall - a->row_wall_us) : wall;
+  sweep(a, now - (int64_t)ROW_AGG_GRACE_MS * 1000);
+  agg_flush(s);
+}
+
+static void agg_print_stats(row_sink_t *s) {
+  agg_sink_t *a = (agg_sink_t *)s;
+  printf("    Aggregated: %lu rows and %lu reports into", a->rows,
+         a->reports);
+  for (size_t i = 0; i < ROW_AGG_COUNT; i++) {
+    if (a->out[i])
+      printf(" %s %lu", row_agg_src_name[i], a->summaries[i]);
+  }
+  printf(" summaries\n");
+  if (a->over_budget)
+    printf("    Aggregated: %lu windows past the samples target dropped\n",
+           a->over_budget);
+}
+
+static uint64_t agg_bytes(row_sink_t *s) {
+  agg_sink_t *a = (agg_sink_t *)s;
+  uint64_t bytes = 0;
+  for (size_t i = 0; i < ROW_AGG_COUNT; i++) {
+    long const pos = a->out[i] ? ftell(a->out[i]) : 0;
+    if (pos > 0)
+      bytes += (uint64_t)pos;
+  }
+  return bytes;
+}
+
+static void agg_close(row_sink_t *s) {
+  agg_sink_t *a = (agg_sink_t *)s;
+
+  // The last windows are partial; their sample count says so
+  sweep(a, INT64_MAX);
+  for (size_t i = 0; i < ROW_AGG_COUNT; i++) {
+    if (a->out[i] && fclose(a->out[i]) != 0)
+      perror(a->path[i]);
+  }
+  free(a);
+}
+
+bool row_agg_path(char *dst, size_t len, char const *path,
+                  row_agg_src_e src) {
+  char const *slash = strrchr(path, '/');
+  char const *dot = strrchr(slash ? slash : path, '.');
+  size_t const stem = dot ? (size_t)(dot - path) : strlen(path);
+  int const n = snprintf(dst, len, "%.*s_%s.csv", (int)stem, path,
+                         row_agg_src_name[src]);
+  return n > 0 && (size_t)n < len;
+}
+
+static bool open_out(agg_sink_t *a, row_agg_src_e src, char const *path) {
+  if (!row_agg_path(a->path[src], sizeof(a->path[src]), path, src)) {
+    fprintf(stderr, "row_agg: path too long: %s\n", path);
+    return false;
+  }
+  a->out[src] = fopen(a->path[src], "w");
+  if (!a->out[src]) {
+    perror(a->path[src]);
+    return false;
+  }
+  setvbuf(a->out[src], NULL, _IOFBF, AGG_FILE_BUF);
+
+  FILE *f = a->out[src];
+  fputs(src == ROW_AGG_KPM ? "window_start,window_ms,samples"
+                           : "window_start,window_ms,rnti,samples",
+        f);
+  for (size_t i = 0; i < sets[src].n; i++) {
+    char const *n = sets[src].f[i].fld.name;
+    fprintf(f, ",%s_mean,%s_min,%s_max,%s_last", n, n, n, n);
+  }
+  fputc('\n', f);
+  return true;
+}
+
+row_sink_t *row_agg_open(char const *path,
+                         uint32_t const window_ms[ROW_AGG_COUNT],
+                         uint64_t max_summaries) {
+  agg_sink_t *a = calloc(1, sizeof(*a));
+  if (!a)
+    return NULL;
+  a->max_summaries = max_summaries;
+
+  ue_index_init(&a->ix);
+
+  for (size_t i = 0; i < ROW_AGG_COUNT; i++) {
+    a->window_us[i] = (int64_t)window_ms[i] * 1000;
+    if (window_ms[i] && !open_out(a, (row_agg_src_e)i, path)) {
+      for (size_t j = 0; j < i; j++) {
+        if (a->out[j])
+          fclose(a->out[j]);
+      }
+      free(a);
+      return NULL;
+    }
+  }
+
+  a->last_sweep_us = time_now_us();
+  a->base.write = agg_write;
+  a->base.flush = agg_flush;
+  a->base.close = agg_close;
+  a->base.tick = agg_tick;
+  a->base.print_stats = agg_print_stats;
+  a->base.bytes = agg_bytes;
+  return &a->base;
+}
@@ -0,0 +1,68 @@
+/*
+ * Window aggregation
+ * ==================
+ *
+ * MAC, RLC and PDCP arrive every few ms per UE, but many studies only need
+ * 100 ms or 1 s statistics. This sink folds the row stream into tumbling
+ * windows and writes one summary line per UE and window: the sample count
+ * and mean/min/max/last of every field, so extrema survive the
+ * downsampling.
+ *
+ * Each SM has its own window length and its own CSV next to the output
+ * ("kpm.csv" -> "kpm_mac.csv", "kpm_rlc.csv", ...). Windows are aligned
+ * to multiples of their length in wall time, so summaries line up across
+ * UEs and nodes. MAC is summed from the rows; RLC, PDCP and KPM from their
+ * own reports (the UE_REC_* records, see ue_table.h), each counted once by
+ * its receive time whether or not a MAC row was joined to it. KPM is node
+ * level, so its summaries have no RNTI.
+ *
+ * The sample budget counts summaries here, not rows: every window sink in
+ * the process draws on one shared count, raises the stop event when it
+ * reaches max_summaries and drops windows past it.
+ *
+ * Every sample costs O(fields) adds and compares; nothing is kept per
+ * sample. NaN values (a rate without a baseline yet) are left out of that
+ * field's statistics.
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#ifndef ROW_AGG_H
+#define ROW_AGG_H
+
+#include "row_sink.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+  ROW_AGG_MAC = 0,
+  ROW_AGG_RLC,
+  ROW_AGG_PDCP,
+  ROW_AGG_KPM,
+
+  ROW_AGG_COUNT
+} row_agg_src_e;
+
+#define ROW_AGG_MAX_FIELDS 24
+
+// A window still open this long after its end is written out even without
+// a later sample, e.g. for a UE that left
+#define ROW_AGG_GRACE_MS 1000
+
+extern char const *const row_agg_src_name[ROW_AGG_COUNT];
+
+// window_ms per SM; 0 leaves that SM out. path names the raw output, the
+// summaries go to "<stem>_<sm>.csv". max_summaries 0 = no limit.
+row_sink_t *row_agg_open(char const *path,
+                         uint32_t const window_ms[ROW_AGG_COUNT],
+                         uint64_t max_summaries);
+
+// Summaries written so far by every window sink
+uint64_t row_agg_summaries(void);
+
+// The summary file of one SM for the raw output path
+bool row_agg_path(char *dst, size_t len, char const *path, row_agg_src_e src);
+
+#endif
@@ -0,0 +1,325 @@
+/*
+ * Row publishing
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#include "row_pub.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef KPM_WITH_ZMQ
+#include <zmq.h>
+#endif
+
+void row_pub_encode(row_pub_rec_t *r, ue_metrics_t const *m, uint32_t nb_id) {
+  memset(r, 0, sizeof(*r));
+  r->timestamp = m->timestamp;
+  r->first_ts = m->first_ts;
+  r->dl_tbs = m->dl_tbs;
+  r->ul_tbs = m->ul_tbs;
+  r->dl_aggr_tbs = m->dl_aggr_tbs;
+  r->ul_aggr_tbs = m->ul_aggr_tbs;
+  r->dl_thp_kbps = m->dl_thp_kbps;
+  r->ul_thp_kbps = m->ul_thp_kbps;
+  r->rlc_sdu_delay_us = m->rlc_sdu_delay_us;
+  r->rlc_age_ms = m->rlc_age_ms;
+  r->pdcp_age_ms = m->pdcp_age_ms;
+  r->kpm_age_ms = m->kpm_age_ms;
+  r->dl_mac_kbps = m->dl_mac_kbps;
+  r->ul_mac_kbps = m->ul_mac_kbps;
+  r->dl_goodput_kbps = m->dl_goodput_kbps;
+  r->ul_goodput_kbps = m->ul_goodput_kbps;
+  r->rlc_tx_kbps = m->rlc_tx_kbps;
+  r->rlc_rx_kbps = m->rlc_rx_kbps;
+  r->rlc_retx_per_s = m->rlc_retx_per_s;
+  r->pdcp_tx_kbps = m->pdcp_tx_kbps;
+  r->pdcp_rx_kbps = m->pdcp_rx_kbps;
+
+  r->nb_id = nb_id;
+  r->rnti = m->rnti;
+  r->dl_prb = m->dl_prb;
+  r->ul_prb = m->ul_prb;
+  r->dl_sched_rb = m->dl_sched_rb;
+  r->ul_sched_rb = m->ul_sched_rb;
+  r->bsr = m->bsr;
+  r->rlc_tx_pkts = m->rlc_tx_pkts;
+  r->rlc_tx_bytes = m->rlc_tx_bytes;
+  r->rlc_rx_pkts = m->rlc_rx_pkts;
+  r->rlc_rx_bytes = m->rlc_rx_bytes;
+  r->rlc_txbuf = m->rlc_txbuf;
+  r->rlc_rxbuf = m->rlc_rxbuf;
+  r->rlc_retx = m->rlc_retx;
+  r->pdcp_tx_pkts = m->pdcp_tx_pkts;
+  r->pdcp_tx_bytes = m->pdcp_tx_bytes;
+  r->pdcp_rx_pkts = m->pdcp_rx_pkts;
+  r->pdcp_rx_bytes = m->pdcp_rx_bytes;
+  r->gtp_teid_gnb = m->gtp_teid_gnb;
+  r->gtp_teid_upf = m->gtp_teid_upf;
+  r->ue_rows = m->ue_rows;
+  r->mac_ver = m->mac_ver;
+  r->rlc_ver = m->rlc_ver;
+  r->pdcp_ver = m->pdcp_ver;
+  r->gtp_ver = m->gtp_ver;
+  r->kpm_ver = m->kpm_ver;
+  r->pdcp_sdu_vol_dl_kb = m->pdcp_sdu_vol_dl_kb;
+  r->pdcp_sdu_vol_ul_kb = m->pdcp_sdu_vol_ul_kb;
+  r->prb_tot_dl = m->prb_tot_dl;
+  r->prb_tot_ul = m->prb_tot_ul;
+  r->pusch_snr = m->pusch_snr;
+  r->pucch_snr = m->pucch_snr;
+  r->dl_bler = m->dl_bler;
+  r->ul_bler = m->ul_bler;
+
+  r->frame = m->frame;
+  r->slot = m->slot;
+  r->cqi = m->cqi;
+  r->dl_mcs1 = m->dl_mcs1;
+  r->dl_mcs2 = m->dl_mcs2;
+  r->ul_mcs1 = m->ul_mcs1;
+  r->ul_mcs2 = m->ul_mcs2;
+  r->phr = m->phr;
+  r->gtp_qfi = m->gtp_qfi;
+  r->gtp_tunnels = m->gtp_tunnels;
+  r->trig = m->trig;
+  r->valid = (m->mac_valid ? ROW_PUB_MAC : 0) |
+             (m->rlc_valid ? ROW_PUB_RLC : 0) |
+             (m->pdcp_valid ? ROW_PUB_PDCP : 0) |
+             (m->kpm_valid ? ROW_PUB_KPM : 0) |
+             (m->final ? ROW_PUB_FINAL : 0) |
+             (m->gtp_valid ? ROW_PUB_GTP : 0);
+}
+
+// --- ZeroMQ ------------------------------------------------------------------
+
+// Every node's writer thread publishes on the one socket, so sends are
+// serialised; ZMQ_DONTWAIT keeps a slow subscriber from stalling them
+static struct {
+  void *ctx;
+  void *sock;
+  pthread_mutex_t mtx;
+} zmq_pub;
+
+#ifdef KPM_WITH_ZMQ
+
+bool row_pub_zmq_open(char const *endpoint) {
+  zmq_pub.ctx = zmq_ctx_new();
+  zmq_pub.sock = zmq_pub.ctx ? zmq_socket(zmq_pub.ctx, ZMQ_PUB) : NULL;
+  int const linger = 0;
+  if (!zmq_pub.sock ||
+      zmq_setsockopt(zmq_pub.sock, ZMQ_LINGER, &linger, sizeof(linger)) != 0 ||
+      zmq_bind(zmq_pub.sock, endpoint) != 0) {
+    fprintf(stderr, "ZeroMQ: cannot bind %s: %s\n", endpoint,
+            zmq_strerror(zmq_errno()));
+    row_pub_zmq_close();
+    return false;
+  }
+  pthread_mutex_init(&zmq_pub.mtx, NULL);
+  return true;
+}
+
+void row_pub_zmq_close(void) {
+  if (zmq_pub.sock) {
+    zmq_close(zmq_pub.sock);
+    pthread_mutex_destroy(&zmq_pub.mtx);
+  }
+  if (zmq_pub.ctx)
+    zmq_ctx_term(zmq_pub.ctx);
+  zmq_pub.sock = zmq_pub.ctx = NULL;
+}
+
+static bool zmq_publish(char const *topic, size_t topic_len,
+                        row_pub_rec_t const *r) {
+  pthread_mutex_lock(&zmq_pub.mtx);
+  bool const ok =
+      zmq_send(zmq_pub.sock, topic, topic_len, ZMQ_SNDMORE | ZMQ_DONTWAIT) >=
+          0 &&
+      zmq_send(zmq_pub.sock, r, sizeof(*r), ZMQ_DONTWAIT) >= 0;
+  pthread_mutex_unlock(&zmq_pub.mtx);
+  return ok;
+}
+
+#else
+
+bool row_pub_zmq_open(char const *endpoint) {
+  fprintf(stderr, "ZeroMQ: cannot publish on %s, built without KPM_WITH_ZMQ\n",
+          endpoint);
+  return false;
+}
+
+void row_pub_zmq_close(void) {}
+
+static bool zmq_publish(char const *topic, size_t topic_len,
+                        row_pub_rec_t const *r) {
+  (void)topic;
+  (void)topic_len;
+  (void)r;
+  return false;
+}
+
+#endif
+
+bool row_pub_zmq_active(void) { return zmq_pub.sock != NULL; }
+
+// --- Tap sink ----------------------------------------------------------------
+
+typedef struct {
+  row_sink_t base;
+  row_sink_t *inner;
+  uint32_t nb_id;
+
+  // Shared memory ring, NULL if none
+  char shm_name[256];
+  row_pub_shm_hdr_t *hdr;
+  row_pub_slot_t *slots;
+  size_t map_len;
+  uint64_t head; // Writer thread's copy of hdr->head
+
+  char topic[32];
+  size_t topic_len;
+
+  // Stats
+  uint64_t published;
+  uint64_t zmq_dropped;
+} pub_sink_t;
+
+static void shm_publish(pub_sink_t *p, row_pub_rec_t const *r) {
+  uint64_t const n = p->head;
+  row_pub_slot_t *s = &p->slots[n & (p->hdr->capacity - 1)];
+
+  // Odd seq marks the slot as being rewritten for readers racing the copy
+  atomic_store_explicit(&s->seq, 2 * n + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  memcpy(&s->rec, r, sizeof(*r));
+  atomic_store_explicit(&s->seq, 2 * n + 2, memory_order_release);
+
+  p->head = n + 1;
+  atomic_store_explicit(&p->hdr->head, n + 1, memory_order_release);
+}
+
+static void pub_write(row_sink_t *s, ue_metrics_t const *m) {
+  pub_sink_t *p = (pub_sink_t *)s;
+  if (m->rec != UE_REC_ROW) {
+    p->inner->write(p->inner, m);
+    return;
+  }
+
+  row_pub_rec_t r;
+  row_pub_encode(&r, m, p->nb_id);
+  if (p->hdr)
+    shm_publish(p, &r);
+  if (zmq_pub.sock && !zmq_publish(p->topic, p->topic_len, &r))
+    p->zmq_dropped++;
+  p->published++;
+
+  p->inner->write(p->inner, m);
+}
+
+static void pub_flush(row_sink_t *s) {
+  pub_sink_t *p = (pub_sink_t *)s;
+  p->inner->flush(p->inner);
+}
+
+static void pub_tick(row_sink_t *s) {
+  pub_sink_t *p = (pub_sink_t *)s;
+  p->inner->tick(p->inner);
+}
+
+static void pub_print_stats(row_sink_t *s) {
+  pub_sink_t *p = (pub_sink_t *)s;
+  printf("    Published: %lu rows", p->published);
+  if (p->hdr)
+    printf(", shm %s (%u slots)", p->shm_name, p->hdr->capacity);
+  if (zmq_pub.sock)
+    printf(", ZeroMQ dropped %lu", p->zmq_dropped);
+  printf("\n");
+
+  if (p->inner->print_stats)
+    p->inner->print_stats(p->inner);
+}
+
+static uint64_t pub_bytes(row_sink_t *s) {
+  pub_sink_t *p = (pub_sink_t *)s;
+  return p->inner->bytes ? p->inner->bytes(p->inner) : 0;
+}
+
+static void pub_close(row_sink_t *s) {
+  pub_sink_t *p = (pub_sink_t *)s;
+  p->inner->close(p->inner);
+
+  // Readers that still have it mapped can finish; new ones get ENOENT
+  if (p->hdr) {
+    atomic_store_explicit(&p->hdr->closed, 1, memory_order_release);
+    munmap(p->hdr, p->map_len);
+    shm_unlink(p->shm_name);
+  }
+  free(p);
+}
+
+static bool shm_create(pub_sink_t *p, char const *name, uint32_t slots) {
+  snprintf(p->shm_name, sizeof(p->shm_name), "%s", name);
+  p->map_len =
+      sizeof(row_pub_shm_hdr_t) + (size_t)slots * sizeof(row_pub_slot_t);
+
+  int const fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "shm_open %s: %s\n", name, strerror(errno));
+    return false;
+  }
+  void *map = MAP_FAILED;
+  if (ftruncate(fd, (off_t)p->map_len) == 0)
+    map = mmap(NULL, p->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  int const err = errno;
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "shm %s: %s\n", name, strerror(err));
+    shm_unlink(name);
+    return false;
+  }
+
+  // The fresh mapping is zero-filled, so every seq already reads "empty"
+  p->hdr = map;
+  p->slots = (row_pub_slot_t *)(p->hdr + 1);
+  p->hdr->version = ROW_PUB_VERSION;
+  p->hdr->rec_size = sizeof(row_pub_rec_t);
+  p->hdr->slot_size = sizeof(row_pub_slot_t);
+  p->hdr->capacity = slots;
+  p->hdr->nb_id = p->nb_id;
+  // Magic last: a reader that sees it sees a complete header
+  atomic_thread_fence(memory_order_release);
+  p->hdr->magic = ROW_PUB_MAGIC;
+  return true;
+}
+
+row_sink_t *row_pub_tap(row_sink_t *inner, char const *shm_name,
+                        uint32_t shm_slots, uint32_t nb_id) {
+  pub_sink_t *p = calloc(1, sizeof(*p));
+  if (!p)
+    return NULL;
+
+  p->inner = inner;
+  p->nb_id = nb_id;
+  int const n = snprintf(p->topic, sizeof(p->topic), "kpm/%u", nb_id);
+  p->topic_len = (size_t)n;
+
+  if (shm_name && !shm_create(p, shm_name, shm_slots)) {
+    free(p);
+    return NULL;
+  }
+
+  p->base.write = pub_write;
+  p->base.flush = pub_flush;
+  p->base.close = pub_close;
+  p->base.tick = inner->tick ? pub_tick : NULL;
+  p->base.print_stats = pub_print_stats;
+  p->base.bytes = pub_bytes;
+  return &p->base;
+}
@@ -0,0 +1,131 @@
+/*
+ * Row publishing
+ * ==============
+ *
+ * Fans every row a node writes out to other processes, so analytics
+ * consumers share the collector's subscriptions instead of opening their
+ * own. Two transports, either or both:
+ *
+ * - Shared memory: one broadcast ring per node in /dev/shm. Any number of
+ *   local readers map it and read records in place (see kpm_shm.py). The
+ *   writer never waits for readers. A reader that falls more than a ring
+ *   behind sees it in the slot sequence and skips ahead.
+ * - ZeroMQ PUB (built with KPM_WITH_ZMQ): one socket for the process. Each
+ *   message is a "kpm/<nb_id>" topic frame plus one record frame. Slow
+ *   subscribers drop at the high-water mark.
+ *
+ * Both carry row_pub_rec_t: native byte order, explicit widths, no
+ * implicit padding.
+ *
+ * Shared memory layout:
+ *   row_pub_shm_hdr_t    64 bytes
+ *   row_pub_slot_t       x capacity (a power of two)
+ *
+ * Record n is in slot n % capacity. Its seq is 2n + 1 while it is being
+ * written and 2n + 2 once complete. A reader copies the record and then
+ * re-checks seq; if seq changed, the slot was overwritten during the copy.
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#ifndef ROW_PUB_H
+#define ROW_PUB_H
+
+#include "row_sink.h"
+#include "ue_table.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ROW_PUB_MAGIC 0x524d504bu // "KPMR"
+#define ROW_PUB_VERSION 4
+#define ROW_PUB_SHM_SLOTS 65536
+
+// Bits of row_pub_rec_t.valid
+#define ROW_PUB_MAC (1u << 0)
+#define ROW_PUB_RLC (1u << 1)
+#define ROW_PUB_PDCP (1u << 2)
+#define ROW_PUB_KPM (1u << 3)
+#define ROW_PUB_FINAL (1u << 4) // The UE's last row before eviction
+#define ROW_PUB_GTP (1u << 5)
+
+// One row, the same values as a CSV line
+typedef struct {
+  int64_t timestamp;
+  int64_t first_ts; // The UE's first report
+  uint64_t dl_tbs, ul_tbs;
+  uint64_t dl_aggr_tbs, ul_aggr_tbs;
+  double dl_thp_kbps, ul_thp_kbps;
+  double rlc_sdu_delay_us;
+  double rlc_age_ms, pdcp_age_ms, kpm_age_ms;
+  double dl_mac_kbps, ul_mac_kbps;
+  double dl_goodput_kbps, ul_goodput_kbps;
+  double rlc_tx_kbps, rlc_rx_kbps, rlc_retx_per_s;
+  double pdcp_tx_kbps, pdcp_rx_kbps;
+
+  uint32_t nb_id;
+  uint32_t rnti;
+  uint32_t dl_prb, ul_prb;
+  uint32_t dl_sched_rb, ul_sched_rb;
+  uint32_t bsr;
+  uint32_t rlc_tx_pkts, rlc_tx_bytes;
+  uint32_t rlc_rx_pkts, rlc_rx_bytes;
+  uint32_t rlc_txbuf, rlc_rxbuf;
+  uint32_t rlc_retx;
+  uint32_t pdcp_tx_pkts, pdcp_tx_bytes;
+  uint32_t pdcp_rx_pkts, pdcp_rx_bytes;
+  uint32_t gtp_teid_gnb, gtp_teid_upf;
+  uint32_t ue_rows;
+  uint32_t mac_ver, rlc_ver, pdcp_ver, gtp_ver, kpm_ver;
+  int32_t pdcp_sdu_vol_dl_kb, pdcp_sdu_vol_ul_kb;
+  int32_t prb_tot_dl, prb_tot_ul;
+  float pusch_snr, pucch_snr;
+  float dl_bler, ul_bler;
+
+  uint16_t frame, slot;
+  uint8_t cqi;
+  uint8_t dl_mcs1, dl_mcs2, ul_mcs1, ul_mcs2;
+  int8_t phr;
+  uint8_t gtp_qfi, gtp_tunnels;
+  uint8_t trig; // TRIG_ROW_*, see trigger.h
+  uint8_t valid; // ROW_PUB_* bits
+  uint8_t reserved[2];
+} row_pub_rec_t;
+
+_Static_assert(sizeof(row_pub_rec_t) == 320, "row_pub_rec_t layout changed");
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t rec_size;  // sizeof(row_pub_rec_t)
+  uint32_t slot_size; // sizeof(row_pub_slot_t)
+  uint32_t capacity;  // Slots
+  uint32_t nb_id;
+  _Atomic uint32_t closed; // Set once the collector is done writing
+  _Atomic uint64_t head;   // Records published so far
+  uint8_t reserved[32];
+} row_pub_shm_hdr_t;
+
+_Static_assert(sizeof(row_pub_shm_hdr_t) == 64, "header must stay 64 bytes");
+
+typedef struct {
+  _Atomic uint64_t seq;
+  row_pub_rec_t rec;
+} row_pub_slot_t;
+
+void row_pub_encode(row_pub_rec_t *r, ue_metrics_t const *m, uint32_t nb_id);
+
+// Process-wide ZeroMQ publisher, bound before any node opens. False (after
+// printing why) if the endpoint cannot be bound or ZeroMQ is not built in.
+bool row_pub_zmq_open(char const *endpoint);
+bool row_pub_zmq_active(void);
+void row_pub_zmq_close(void);
+
+// Publishes every row to the shared memory ring shm_name (NULL = none) and
+// to the ZeroMQ publisher if open, then forwards it to inner. Closing the
+// tap closes inner and unlinks the ring.
+row_sink_t *row_pub_tap(row_sink_t *inner, char const *shm_name,
+                        uint32_t shm_slots, uint32_t nb_id);
+
+#endif
@@ -0,0 +1,59 @@
+/*
+ * Row sinks
+ * =========
+ *
+ * Output back-ends driven by the writer thread. A sink is a small vtable;
+ * every call happens on the writer thread, so sinks need no locking.
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#ifndef ROW_SINK_H
+#define ROW_SINK_H
+
+#include "ue_table.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct row_sink_s row_sink_t;
+
+struct row_sink_s {
+  void (*write)(row_sink_t *s, ue_metrics_t const *m);
+  void (*flush)(row_sink_t *s);
+  // Flushes, closes the file and frees the sink
+  void (*close)(row_sink_t *s);
+
+  // Optional (may be NULL). tick is called when the writer thread is idle,
+  // so time-based flush deadlines still fire with no rows arriving.
+  void (*tick)(row_sink_t *s);
+  void (*print_stats)(row_sink_t *s);
+
+  // Optional. Bytes of row output so far, including what close has yet to
+  // write out. Taps report their inner sink's, not their own files.
+  uint64_t (*bytes)(row_sink_t *s);
+};
+
+// When buffered CSV text is handed to write(2). A threshold of 0 disables
+// that trigger; with both at 0 the buffer is only written when full and on
+// close.
+typedef struct {
+  size_t max_bytes;
+  uint32_t max_ms;
+} csv_flush_policy_t;
+
+#define CSV_SINK_BUF_SIZE (1u << 20)
+#define CSV_SINK_FLUSH_BYTES (256u << 10)
+#define CSV_SINK_FLUSH_MS 1000
+
+// Text CSV, one line per row, formatted into a user-space buffer
+row_sink_t *csv_sink_open(char const *path, csv_flush_policy_t policy);
+
+// Native columnar format (see col_sink.c), rows buffered per chunk
+#define COL_SINK_CHUNK_ROWS 65536
+row_sink_t *col_sink_open(char const *path, size_t chunk_rows);
+
+// Picks the sink from the file extension: ".kpmc" is columnar, else CSV
+row_sink_t *row_sink_open(char const *path, csv_flush_policy_t csv_policy);
+
+#endif
@@ -0,0 +1,187 @@
+/*
+ * Row writer
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#include "row_writer.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Idle back-off of the writer thread when every ring is empty
+#define ROW_WRITER_IDLE_NS 1000000L
+
+// Per-thread cache of the ring this thread owns in each writer, by writer
+// slot. An entry only counts for the generation it was filled for: a node
+// that reattaches gets the same slot, and the same address, for a new
+// writer whose rings the old entry no longer points at.
+static _Thread_local struct {
+  uint64_t gen; // 0 = empty
+  spsc_ring_t *r;
+} tls_rings[ROW_WRITER_SLOTS];
+
+static _Atomic uint64_t writer_gen;
+
+static void write_row(row_writer_t *w, ue_metrics_t const *m) {
+  w->sink->write(w->sink, m);
+  if (m->rec != UE_REC_ROW)
+    return;
+  uint64_t const rows =
+      atomic_load_explicit(&w->rows, memory_order_relaxed) + 1;
+  atomic_store_explicit(&w->rows, rows, memory_order_relaxed);
+
+  if (w->row_lat && m->enq_ns)
+    lat_hist_record(w->row_lat, (uint64_t)(lat_now_ns() - m->enq_ns));
+
+  if (w->print_interval && rows % w->print_interval == 0) {
+    printf("[%lu] RNTI=%x SNR=%.1fdB BLER=%.3f MCS=%u "
+           "DL_Thp=%.1fkbps UL_Thp=%.1fkbps PRB=%u/%u\n",
+           rows, m->rnti, m->pusch_snr, m->dl_bler, m->dl_mcs1,
+           m->dl_thp_kbps, m->ul_thp_kbps, m->dl_prb, m->ul_prb);
+  }
+}
+
+// Returns the number of records written
+static size_t drain(row_writer_t *w) {
+  size_t const n = atomic_load_explicit(&w->n_rings, memory_order_acquire);
+  size_t total = 0;
+  ue_metrics_t m;
+
+  for (size_t i = 0; i < n; i++) {
+    while (spsc_ring_pop(&w->rings[i], &m)) {
+      write_row(w, &m);
+      total++;
+    }
+  }
+  return total;
+}
+
+static void *writer_thread(void *arg) {
+  row_writer_t *w = arg;
+  struct timespec const idle = {0, ROW_WRITER_IDLE_NS};
+
+  while (!atomic_load_explicit(&w->stop, memory_order_acquire)) {
+    if (drain(w) == 0) {
+      if (w->sink->tick)
+        w->sink->tick(w->sink);
+      nanosleep(&idle, NULL);
+    }
+  }
+
+  // Producers are gone by now; pick up whatever they left behind
+  drain(w);
+  w->sink->flush(w->sink);
+  return NULL;
+}
+
+bool row_writer_start(row_writer_t *w, size_t slot, row_sink_t *sink,
+                      uint64_t print_interval, lat_hist_t *row_lat) {
+  memset(w, 0, sizeof(*w));
+  w->slot = slot;
+  w->gen = atomic_fetch_add_explicit(&writer_gen, 1, memory_order_relaxed) + 1;
+  w->sink = sink;
+  w->print_interval = print_interval;
+  w->row_lat = row_lat;
+  atomic_init(&w->stop, false);
+  atomic_init(&w->n_rings, 0);
+  atomic_init(&w->unringed, 0);
+  pthread_mutex_init(&w->reg_mtx, NULL);
+
+  return pthread_create(&w->thread, NULL, writer_thread, w) == 0;
+}
+
+void row_writer_stop(row_writer_t *w) {
+  atomic_store_explicit(&w->stop, true, memory_order_release);
+  pthread_join(w->thread, NULL);
+
+  size_t const n = atomic_load_explicit(&w->n_rings, memory_order_acquire);
+  for (size_t i = 0; i < n; i++)
+    spsc_ring_free(&w->rings[i]);
+  pthread_mutex_destroy(&w->reg_mtx);
+}
+
+// Slow path: first push from this thread into this writer
+static spsc_ring_t *register_ring(row_writer_t *w) {
+  pthread_t const self = pthread_self();
+  spsc_ring_t *r = NULL;
+
+  pthread_mutex_lock(&w->reg_mtx);
+  size_t const n = atomic_load_explicit(&w->n_rings, memory_order_relaxed);
+  for (size_t i = 0; i < n; i++) {
+    if (pthread_equal(w->owners[i], self)) {
+      r = &w->rings[i];
+      break;
+    }
+  }
+  if (!r && n < ROW_WRITER_MAX_RINGS &&
+      spsc_ring_init(&w->rings[n], ROW_WRITER_RING_CAP, sizeof(ue_metrics_t))) {
+    w->owners[n] = self;
+    r = &w->rings[n];
+    atomic_store_explicit(&w->n_rings, n + 1, memory_order_release);
+  }
+  pthread_mutex_unlock(&w->reg_mtx);
+
+  if (!r)
+    return NULL;
+
+  if (w->slot < ROW_WRITER_SLOTS) {
+    tls_rings[w->slot].gen = w->gen;
+    tls_rings[w->slot].r = r;
+  }
+  return r;
+}
+
+// This thread's ring in w, NULL if it cannot have one
+static spsc_ring_t *own_ring(row_writer_t *w) {
+  if (w->slot < ROW_WRITER_SLOTS && tls_rings[w->slot].gen == w->gen)
+    return tls_rings[w->slot].r;
+  return register_ring(w);
+}
+
+row_writer_push_e row_writer_try_push(row_writer_t *w, ue_metrics_t const *m) {
+  spsc_ring_t *r = own_ring(w);
+  if (!r)
+    return ROW_WRITER_NO_RING;
+  return spsc_ring_try_push(r, m) ? ROW_WRITER_OK : ROW_WRITER_FULL;
+}
+
+void row_writer_drop(row_writer_t *w) {
+  spsc_ring_t *r = own_ring(w);
+  if (r)
+    spsc_ring_drop(r);
+  else
+    atomic_fetch_add_explicit(&w->unringed, 1, memory_order_relaxed);
+}
+
+spsc_ring_stats_t row_writer_stats(row_writer_t *w) {
+  spsc_ring_stats_t tot = {0};
+  size_t const n = atomic_load_explicit(&w->n_rings, memory_order_acquire);
+
+  for (size_t i = 0; i < n; i++) {
+    spsc_ring_stats_t const s = spsc_ring_stats(&w->rings[i]);
+    tot.capacity += s.capacity;
+    tot.depth += s.depth;
+    if (s.high_water > tot.high_water)
+      tot.high_water = s.high_water;
+    tot.pushed += s.pushed;
+    tot.dropped += s.dropped;
+  }
+  tot.dropped += atomic_load_explicit(&w->unringed, memory_order_relaxed);
+  return tot;
+}
+
+void row_writer_print_stats(row_writer_t *w) {
+  size_t const n = atomic_load_explicit(&w->n_rings, memory_order_acquire);
+
+  for (size_t i = 0; i < n; i++) {
+    spsc_ring_stats_t const s = spsc_ring_stats(&w->rings[i]);
+    printf("  Ring %zu: depth=%zu/%zu high_water=%zu pushed=%lu dropped=%lu\n",
+           i, s.depth, s.capacity, s.high_water, s.pushed, s.dropped);
+  }
+  uint64_t const unringed =
+      atomic_load_explicit(&w->unringed, memory_order_relaxed);
+  if (unringed)
+    printf("  No ring: dropped=%lu\n", unringed);
+}
@@ -0,0 +1,82 @@
+/*
+ * Row writer
+ * ==========
+ *
+ * Moves row formatting and file I/O off the FlexRIC indication thread.
+ * Each producer thread gets its own SPSC ring on first push; a dedicated
+ * writer thread drains every ring and hands the rows to a row_sink_t.
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#ifndef ROW_WRITER_H
+#define ROW_WRITER_H
+
+#include "lat_hist.h"
+#include "row_sink.h"
+#include "spsc_ring.h"
+#include "ue_table.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ROW_WRITER_MAX_RINGS 8
+#define ROW_WRITER_RING_CAP 8192
+
+// Writer slots a producer thread caches its ring for, one per node slot
+// (NODE_CTX_MAX). A writer past the last slot takes the slow path on
+// every push.
+#define ROW_WRITER_SLOTS 32
+
+typedef struct {
+  size_t slot; // Index into the per-thread ring cache
+  uint64_t gen; // Unique per start, so a reused slot misses the cache
+  row_sink_t *sink;
+  uint64_t print_interval;
+  lat_hist_t *row_lat; // Optional: enq_ns to hand-off to the sink, ns
+
+  pthread_t thread;
+  _Atomic bool stop;
+
+  // Rings are appended under reg_mtx and published through n_rings
+  pthread_mutex_t reg_mtx;
+  spsc_ring_t rings[ROW_WRITER_MAX_RINGS];
+  pthread_t owners[ROW_WRITER_MAX_RINGS];
+  _Atomic size_t n_rings;
+
+  // Written by the writer thread only, read from anywhere
+  _Atomic uint64_t rows;
+
+  // Records from threads that could not get a ring of their own (more than
+  // ROW_WRITER_MAX_RINGS producers, or no memory for one)
+  _Atomic uint64_t unringed;
+} row_writer_t;
+
+typedef enum {
+  ROW_WRITER_OK = 0,
+  ROW_WRITER_FULL,    // Worth retrying once the writer catches up
+  ROW_WRITER_NO_RING, // This thread has no ring; retrying cannot help
+} row_writer_push_e;
+
+// Starts the writer thread; the sink is only touched from that thread.
+// Writers running at the same time need distinct slots. row_lat may be
+// NULL.
+bool row_writer_start(row_writer_t *w, size_t slot, row_sink_t *sink,
+                      uint64_t print_interval, lat_hist_t *row_lat);
+
+// Drains all rings, then joins the writer thread. Does not close the sink.
+void row_writer_stop(row_writer_t *w);
+
+// Safe from any thread; never blocks. A full ring is not counted as a
+// drop, so a producer may retry; row_writer_drop counts a record it then
+// gives up on.
+row_writer_push_e row_writer_try_push(row_writer_t *w, ue_metrics_t const *m);
+void row_writer_drop(row_writer_t *w);
+
+// Aggregated over all rings; dropped includes the unringed records
+spsc_ring_stats_t row_writer_stats(row_writer_t *w);
+void row_writer_print_stats(row_writer_t *w);
+
+#endif
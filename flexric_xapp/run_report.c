@@ -0,0 +1,127 @@
+/*
+ * Run report
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#include "run_report.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+
+void run_report_begin(run_report_t *r, char const *source) {
+  memset(r, 0, sizeof(*r));
+  r->source = source;
+}
+
+// {"p50":..,"p99":..,"p999":..} in units of div
+static void put_lat(FILE *f, char const *key, lat_snap_t const *s, double div) {
+  fprintf(f, "\"%s\": {\"count\": %lu, \"p50\": %.3f, \"p99\": %.3f, "
+             "\"p999\": %.3f}",
+          key, s->count, (double)lat_snap_quantile(s, 0.5) / div,
+          (double)lat_snap_quantile(s, 0.99) / div,
+          (double)lat_snap_quantile(s, 0.999) / div);
+}
+
+static double per_s(uint64_t v, double secs) {
+  return secs > 0 ? (double)v / secs : 0.0;
+}
+
+bool run_report_write(run_report_t const *r, char const *path,
+                      node_watch_t *w, ind_proc_t const *p) {
+  collector_cfg_t const *cfg = p->cfg;
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+
+  // Run totals over every node still attached; the snapshots are large
+  static lat_snap_t cb[NODE_SUB_COUNT], e2[NODE_SUB_COUNT], cb_all, row;
+  memset(cb, 0, sizeof(cb));
+  memset(e2, 0, sizeof(e2));
+  memset(&cb_all, 0, sizeof(cb_all));
+  memset(&row, 0, sizeof(row));
+  uint64_t ind[NODE_SUB_COUNT] = {0};
+  uint64_t ind_all = 0, rows = w->departed_rows, ring_drops = 0;
+  uint64_t bytes = w->departed_bytes;
+  uint64_t incomplete = 0, ues = 0, ues_peak = 0, refused = 0;
+
+  for (size_t i = 0; i < NODE_CTX_MAX; i++) {
+    if (!w->used[i])
+      continue;
+    node_ctx_t *n = &w->slot[i];
+    for (size_t s = 0; s < NODE_SUB_COUNT; s++) {
+      lat_snap_merge(&cb[s], &n->lat[s].cb_tot);
+      lat_snap_merge(&e2[s], &n->lat[s].e2_tot);
+      lat_snap_merge(&cb_all, &n->lat[s].cb_tot);
+      uint64_t const k =
+          atomic_load_explicit(&n->lat[s].ind, memory_order_relaxed);
+      ind[s] += k;
+      ind_all += k;
+    }
+    lat_snap_merge(&row, &n->row_tot);
+    rows += atomic_load_explicit(&n->writer.rows, memory_order_relaxed);
+    ring_drops += row_writer_stats(&n->writer).dropped;
+    bytes += node_ctx_bytes(n);
+    incomplete += n->rows_dropped;
+    ues += ue_table_len(&n->ues);
+    ues_peak += n->ues.ix.peak;
+    refused += n->ues.ix.refused;
+  }
+
+  double const secs =
+      r->collect_ns ? (double)(r->end_ns - r->collect_ns) / 1e9 : 0.0;
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+
+  fprintf(f, "{\n  \"report_version\": %d,\n  \"source\": \"%s\",\n",
+          RUN_REPORT_VERSION, r->source);
+  if (cfg->replay[0])
+    fprintf(f, "  \"replay\": {\"speed\": %u, \"lossy\": %s, "
+               "\"indications\": %lu, \"unmatched\": %lu, "
+               "\"max_lag_ms\": %ld},\n",
+            cfg->replay_speed, cfg->replay_lossy ? "true" : "false",
+            r->played, r->unmatched, r->max_lag_ms);
+  fprintf(f, "  \"seconds\": %.3f,\n", secs);
+  fprintf(f, "  \"nodes\": {\"attached\": %lu, \"departed\": %lu},\n",
+          w->attached, w->departed);
+  fprintf(f, "  \"ues\": {\"tracked\": %lu, \"peak\": %lu, \"refused\": "
+             "%lu},\n",
+          ues, ues_peak, refused);
+
+  fprintf(f, "  \"indications\": {\"total\": %lu, \"per_s\": %.1f, ",
+          ind_all, per_s(ind_all, secs));
+  put_lat(f, "callback_us", &cb_all, 1e3);
+  fprintf(f, ",\n    \"by_sm\": {");
+  bool first = true;
+  for (size_t s = 0; s < NODE_SUB_COUNT; s++) {
+    if (!(cfg->sms & CFG_SMS_BIT(s)))
+      continue;
+    fprintf(f, "%s\n      \"%s\": {\"count\": %lu, \"per_s\": %.1f, ",
+            first ? "" : ",", node_sub_name[s], ind[s], per_s(ind[s], secs));
+    put_lat(f, "callback_us", &cb[s], 1e3);
+    fprintf(f, ", ");
+    put_lat(f, "e2_ms", &e2[s], 1e3);
+    fprintf(f, "}");
+    first = false;
+  }
+  fprintf(f, "}},\n");
+
+  fprintf(f, "  \"rows\": {\"written\": %lu, \"per_s\": %.1f, "
+             "\"dropped_ring\": %lu, \"dropped_incomplete\": %lu, ",
+          rows, per_s(rows, secs), ring_drops, incomplete);
+  put_lat(f, "queue_to_sink_ms", &row, 1e6);
+  fprintf(f, "},\n");
+
+  fprintf(f, "  \"memory\": {\"max_rss_kb\": %ld},\n", ru.ru_maxrss);
+  fprintf(f, "  \"output\": {\"bytes\": %lu, \"mb_per_s\": %.3f}\n}\n", bytes,
+          per_s(bytes, secs) / 1e6);
+
+  if (fclose(f) != 0) {
+    perror(path);
+    return false;
+  }
+  return true;
+}
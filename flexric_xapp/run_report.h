@@ -0,0 +1,52 @@
+/*
+ * Run report
+ * ==========
+ *
+ * --report=FILE writes one JSON object when the collector stops:
+ *
+ *   collection time, nodes and UEs, indications and indications/s per SM,
+ *   rows handed to the output and dropped on the way, callback, E2 and
+ *   queue-to-sink latency percentiles over the whole run, peak memory and
+ *   bytes of row output per second
+ *
+ * It is what the load test (loadtest.sh) keeps per run, to be compared
+ * across releases. So keys are only ever added, and report_version goes up
+ * if an existing one has to change meaning.
+ *
+ * Rates count from the first attached node to the last drained row. The
+ * latencies are the nodes' run totals, so the report is written after
+ * node_ctx_print_stats has folded in the last of them, and after the
+ * writers stopped, so the sinks' byte counts are final. A node that left
+ * during the run counts in rows and bytes only.
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#ifndef RUN_REPORT_H
+#define RUN_REPORT_H
+
+#include "ind_proc.h"
+#include "node_watch.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define RUN_REPORT_VERSION 1
+
+typedef struct {
+  char const *source; // "live" or "replay"
+  int64_t collect_ns; // First node attached, 0 = never
+  int64_t end_ns; // Last row drained
+
+  // Replay only
+  uint64_t played;
+  uint64_t unmatched;
+  int64_t max_lag_ms; // Furthest behind the recorded pace
+} run_report_t;
+
+void run_report_begin(run_report_t *r, char const *source);
+
+bool run_report_write(run_report_t const *r, char const *path,
+                      node_watch_t *w, ind_proc_t const *p);
+
+#endif
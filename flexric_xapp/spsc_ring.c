@@ -0,0 +1,92 @@
+/*
+ * Lock-free single-producer/single-consumer ring
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#include "spsc_ring.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+bool spsc_ring_init(spsc_ring_t *r, size_t capacity, size_t rec_size) {
+  size_t cap = 1;
+  while (cap < capacity)
+    cap <<= 1;
+
+  memset(r, 0, sizeof(*r));
+  r->buf = calloc(cap, rec_size);
+  if (!r->buf)
+    return false;
+
+  r->mask = cap - 1;
+  r->rec_size = rec_size;
+  atomic_init(&r->head, 0);
+  atomic_init(&r->tail, 0);
+  atomic_init(&r->high_water, 0);
+  atomic_init(&r->dropped, 0);
+  atomic_init(&r->pushed, 0);
+  return true;
+}
+
+void spsc_ring_free(spsc_ring_t *r) {
+  free(r->buf);
+  r->buf = NULL;
+}
+
+bool spsc_ring_push(spsc_ring_t *r, void const *rec) {
+  if (spsc_ring_try_push(r, rec))
+    return true;
+  spsc_ring_drop(r);
+  return false;
+}
+
+void spsc_ring_drop(spsc_ring_t *r) {
+  atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+}
+
+bool spsc_ring_try_push(spsc_ring_t *r, void const *rec) {
+  size_t const head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  size_t const tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+  size_t const depth = head - tail;
+
+  if (depth > r->mask)
+    return false;
+
+  memcpy(r->buf + (head & r->mask) * r->rec_size, rec, r->rec_size);
+  atomic_store_explicit(&r->head, head + 1, memory_order_release);
+  atomic_fetch_add_explicit(&r->pushed, 1, memory_order_relaxed);
+
+  // Only the producer writes high_water, so load/store is enough
+  if (depth + 1 > atomic_load_explicit(&r->high_water, memory_order_relaxed))
+    atomic_store_explicit(&r->high_water, depth + 1, memory_order_relaxed);
+  return true;
+}
+
+bool spsc_ring_pop(spsc_ring_t *r, void *rec) {
+  size_t const tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  size_t const head = atomic_load_explicit(&r->head, memory_order_acquire);
+
+  if (head == tail)
+    return false;
+
+  memcpy(rec, r->buf + (tail & r->mask) * r->rec_size, r->rec_size);
+  atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+  return true;
+}
+
+size_t spsc_ring_depth(spsc_ring_t const *r) {
+  size_t const head = atomic_load_explicit(&r->head, memory_order_acquire);
+  size_t const tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+  return head - tail;
+}
+
+spsc_ring_stats_t spsc_ring_stats(spsc_ring_t const *r) {
+  spsc_ring_stats_t s = {0};
+  s.capacity = r->mask + 1;
+  s.depth = spsc_ring_depth(r);
+  s.high_water = atomic_load_explicit(&r->high_water, memory_order_relaxed);
+  s.pushed = atomic_load_explicit(&r->pushed, memory_order_relaxed);
+  s.dropped = atomic_load_explicit(&r->dropped, memory_order_relaxed);
+  return s;
+}
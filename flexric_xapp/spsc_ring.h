@@ -0,0 +1,67 @@
+/*
+ * Lock-free single-producer/single-consumer ring
+ * ==============================================
+ *
+ * Fixed-size binary records, power-of-two capacity. The producer never
+ * blocks: when the ring is full the record is counted as dropped. A
+ * producer that retries instead uses spsc_ring_try_push and counts a drop
+ * with spsc_ring_drop only once it gives the record up.
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SPSC_CACHE_LINE 64
+
+typedef struct {
+  // Producer side
+  alignas(SPSC_CACHE_LINE) _Atomic size_t head;
+  _Atomic size_t high_water;
+  _Atomic uint64_t dropped;
+  _Atomic uint64_t pushed;
+
+  // Consumer side
+  alignas(SPSC_CACHE_LINE) _Atomic size_t tail;
+
+  // Read-only after init
+  alignas(SPSC_CACHE_LINE) size_t mask;
+  size_t rec_size;
+  uint8_t *buf;
+} spsc_ring_t;
+
+typedef struct {
+  size_t capacity;
+  size_t depth;
+  size_t high_water;
+  uint64_t pushed;
+  uint64_t dropped;
+} spsc_ring_stats_t;
+
+// capacity is rounded up to a power of two. Returns false on OOM.
+bool spsc_ring_init(spsc_ring_t *r, size_t capacity, size_t rec_size);
+void spsc_ring_free(spsc_ring_t *r);
+
+// Producer only
+bool spsc_ring_push(spsc_ring_t *r, void const *rec);
+
+// Producer only. Like spsc_ring_push, but a full ring is not a drop.
+bool spsc_ring_try_push(spsc_ring_t *r, void const *rec);
+
+// Producer only. Counts one record given up on.
+void spsc_ring_drop(spsc_ring_t *r);
+
+// Consumer only. Returns false when empty.
+bool spsc_ring_pop(spsc_ring_t *r, void *rec);
+
+size_t spsc_ring_depth(spsc_ring_t const *r);
+spsc_ring_stats_t spsc_ring_stats(spsc_ring_t const *r);
+
+#endif
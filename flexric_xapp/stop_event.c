@@ -0,0 +1,82 @@
+/*
+ * Stop event
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#include "stop_event.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+static int efd = -1;
+static _Atomic bool raised = false;
+
+bool stop_event_init(void) {
+  efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  return efd >= 0;
+}
+
+void stop_event_close(void) {
+  if (efd >= 0)
+    close(efd);
+  efd = -1;
+}
+
+// The counter only has to become non-zero; a full counter is fine too
+static void wake(void) {
+  uint64_t const one = 1;
+  ssize_t const rc = write(efd, &one, sizeof(one));
+  (void)rc;
+}
+
+void stop_event_raise(void) {
+  atomic_store_explicit(&raised, true, memory_order_release);
+  wake();
+}
+
+void stop_event_nudge(void) { wake(); }
+
+bool stop_event_raised(void) {
+  return atomic_load_explicit(&raised, memory_order_acquire);
+}
+
+static int64_t mono_ms(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (int64_t)t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
+bool stop_event_wait(int64_t timeout_ms) {
+  int64_t const deadline = timeout_ms < 0 ? -1 : mono_ms() + timeout_ms;
+  struct pollfd p = {.fd = efd, .events = POLLIN};
+
+  while (!stop_event_raised()) {
+    int wait_ms = -1;
+    if (deadline >= 0) {
+      int64_t const left = deadline - mono_ms();
+      if (left <= 0)
+        break;
+      wait_ms = left > 1000000 ? 1000000 : (int)left;
+    }
+
+    // Signals interrupt poll with EINTR; the loop re-checks the flag
+    int const rc = poll(&p, 1, wait_ms);
+    if (rc < 0 && errno != EINTR)
+      break;
+
+    // A nudge: clear it so the next wait sleeps again. Once raised, the
+    // flag is set before the write, so a raise is never missed.
+    if (rc > 0 && !stop_event_raised()) {
+      uint64_t v;
+      ssize_t const r = read(efd, &v, sizeof(v));
+      (void)r;
+      break;
+    }
+  }
+  return stop_event_raised();
+}
@@ -0,0 +1,36 @@
+/*
+ * Stop event
+ * ==========
+ *
+ * Process-wide "time to shut down" flag backed by an eventfd, so the main
+ * thread sleeps in poll() and wakes the moment a signal handler or a
+ * callback raises it instead of noticing on the next one-second tick.
+ * stop_event_nudge wakes it the same way without stopping, for work a
+ * callback hands to the main thread.
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#ifndef STOP_EVENT_H
+#define STOP_EVENT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+bool stop_event_init(void);
+void stop_event_close(void);
+
+// Async-signal-safe; may be called any number of times from any thread
+void stop_event_raise(void);
+
+// Cheap enough for the indication hot path
+bool stop_event_raised(void);
+
+// Async-signal-safe; ends the current stop_event_wait early
+void stop_event_nudge(void);
+
+// Blocks until the event is raised, a nudge or timeout_ms passes (-1 waits
+// forever). Returns stop_event_raised().
+bool stop_event_wait(int64_t timeout_ms);
+
+#endif
@@ -0,0 +1,106 @@
+/*
+ * Subscription fan-out
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#include "sub_fanout.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Per request: the first request of its group; the first one also keeps
+// the group's size and the answers still out
+typedef struct {
+  size_t first;
+  size_t n;
+  _Atomic size_t left;
+} group_t;
+
+typedef struct {
+  sub_req_t *req;
+  size_t n;
+  group_t *grp;
+  _Atomic size_t next;
+  sub_group_fn done;
+  void *arg;
+} run_t;
+
+static int64_t now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void issue(sub_req_t *r) {
+  int64_t const t0 = now_us();
+  r->ans = report_sm_xapp_api(r->id, r->ran_func, r->data, r->cb);
+  r->us = now_us() - t0;
+}
+
+static void *worker(void *arg) {
+  run_t *run = arg;
+  for (;;) {
+    size_t const i =
+        atomic_fetch_add_explicit(&run->next, 1, memory_order_relaxed);
+    if (i >= run->n)
+      return NULL;
+    issue(&run->req[i]);
+
+    // acq_rel: the last one in sees every answer of the group
+    group_t *g = &run->grp[run->grp[i].first];
+    if (atomic_fetch_sub_explicit(&g->left, 1, memory_order_acq_rel) == 1)
+      run->done(&run->req[run->grp[i].first], g->n, run->arg);
+  }
+}
+
+static void run_serial(sub_req_t *req, size_t n, sub_group_fn done,
+                       void *arg) {
+  size_t first = 0;
+  for (size_t i = 0; i < n; i++) {
+    issue(&req[i]);
+    if (i + 1 == n || req[i + 1].group != req[i].group) {
+      done(&req[first], i + 1 - first, arg);
+      first = i + 1;
+    }
+  }
+}
+
+void sub_fanout_run(sub_req_t *req, size_t n, unsigned threads,
+                    sub_group_fn done, void *arg) {
+  if (threads > SUB_FANOUT_MAX_THREADS)
+    threads = SUB_FANOUT_MAX_THREADS;
+  if (threads > n)
+    threads = (unsigned)n;
+
+  // Without memory for the groups the batch still goes out, one at a time
+  group_t *grp = threads > 1 ? calloc(n, sizeof(*grp)) : NULL;
+  if (!grp) {
+    run_serial(req, n, done, arg);
+    return;
+  }
+  for (size_t i = 0; i < n; i++) {
+    grp[i].first = i > 0 && req[i].group == req[i - 1].group ? grp[i - 1].first
+                                                             : i;
+    grp[grp[i].first].n++;
+  }
+  for (size_t i = 0; i < n; i++)
+    atomic_init(&grp[i].left, grp[i].first == i ? grp[i].n : 0);
+
+  run_t run = {.req = req, .n = n, .grp = grp, .done = done, .arg = arg};
+  atomic_init(&run.next, 0);
+
+  // A thread that does not start leaves its share to the others
+  pthread_t th[SUB_FANOUT_MAX_THREADS];
+  unsigned started = 0;
+  for (unsigned k = 1; k < threads; k++) {
+    if (pthread_create(&th[started], NULL, worker, &run) == 0)
+      started++;
+  }
+  worker(&run);
+  for (unsigned k = 0; k < started; k++)
+    pthread_join(th[k], NULL);
+  free(grp);
+}
@@ -0,0 +1,56 @@
+/*
+ * Subscription fan-out
+ * ====================
+ *
+ * report_sm_xapp_api blocks for a round trip to the RIC and on to the E2
+ * node. With five SMs on a dozen nodes, issuing them one after the other
+ * puts sixty round trips between a pod restart and the last node's first
+ * sample.
+ *
+ * A fan-out issues a batch of subscriptions from a few threads, the
+ * caller's included, so the round trips overlap. Requests are claimed in
+ * order and grouped, one group per node. A group is handed back as soon as
+ * its own requests are answered, so a node can start collecting before
+ * the rest of the batch is done.
+ *
+ * Each request records how long its answer took. The threads live for one
+ * batch only; nodes attach rarely, and idle threads would be a poor trade
+ * for saving a pthread_create per subscription.
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#ifndef SUB_FANOUT_H
+#define SUB_FANOUT_H
+
+#include "../../../../src/xApp/e42_xapp_api.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SUB_FANOUT_MAX_THREADS 16
+
+typedef struct {
+  global_e2_node_id_t *id;
+  uint32_t ran_func;
+  void *data; // Passed to report_sm_xapp_api as is
+  sm_cb cb;
+  unsigned tag; // The caller's, e.g. which SM
+  size_t group; // Requests of one group are next to each other
+
+  // Filled in by the run
+  sm_ans_xapp_t ans;
+  int64_t us; // Request to answer
+} sub_req_t;
+
+// Called once per group with its requests, on the thread that got the last
+// answer. Calls for different groups can run at the same time.
+typedef void (*sub_group_fn)(sub_req_t const *req, size_t n, void *arg);
+
+// Issues req[0..n) on up to threads threads (1 = one at a time on the
+// caller) and returns once every group has been handed to done
+void sub_fanout_run(sub_req_t *req, size_t n, unsigned threads,
+                    sub_group_fn done, void *arg);
+
+#endif
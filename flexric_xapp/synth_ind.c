@@ -0,0 +1,129 @@
+/*
+ * Synthetic indications
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#include "synth_ind.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool synth_ind_build(synth_ind_t *s, uint32_t ues, uint32_t meas) {
+  memset(s, 0, sizeof(*s));
+  if (ues < 1 || ues > SYNTH_MAX_UES || meas < 1 || meas > KPM_MAX_MEAS)
+    return false;
+  s->ues = ues;
+  s->meas = meas;
+
+  for (uint32_t u = 0; u < ues; u++) {
+    uint16_t const rnti = (uint16_t)(0x4000 + u);
+    s->mac[u] = (mac_ue_stats_impl_t){
+        .rnti = rnti, .wb_cqi = 12, .pusch_snr = 25.0f, .dl_bler = 0.01,
+        .dl_mcs1 = 20, .ul_mcs1 = 10, .dl_sched_rb = 50, .ul_sched_rb = 10};
+    s->rlc[u] = (rlc_radio_bearer_stats_t){.rnti = rnti, .rbid = 1};
+    s->pdcp[u] = (pdcp_radio_bearer_stats_t){.rnti = rnti, .rbid = 1};
+    s->gtp[u] = (gtp_ngu_t_stats_t){
+        .rnti = rnti, .teidgnb = u + 1, .qfi = 1, .teidupf = 0x1000 + u};
+  }
+
+  // The known names first, in kpm_meas[] order, then unknown ones
+  for (uint32_t j = 0; j < meas; j++) {
+    char *name = s->kpm_name[j];
+    if (j < KPM_MEAS_COUNT)
+      snprintf(name, sizeof(s->kpm_name[j]), "%s", kpm_meas[j].name);
+    else
+      snprintf(name, sizeof(s->kpm_name[j]), "Bench.Meas%u", j);
+    meas_info_format_1_lst_t *info = &s->kpm_info[j];
+    info->meas_type.type = NAME_MEAS_TYPE;
+    info->meas_type.name.buf = (uint8_t *)name;
+    info->meas_type.name.len = strlen(name);
+  }
+
+  s->kpm_rec = calloc((size_t)ues * meas, sizeof(meas_record_lst_t));
+  if (!s->kpm_rec)
+    return false;
+  for (uint32_t u = 0; u < ues; u++) {
+    meas_record_lst_t *rec = &s->kpm_rec[(size_t)u * meas];
+    for (uint32_t j = 0; j < meas; j++)
+      rec[j].value = j < KPM_MEAS_COUNT ? kpm_meas[j].value
+                                        : INTEGER_MEAS_VALUE;
+    s->kpm_data[u].meas_record_lst = rec;
+    s->kpm_data[u].meas_record_len = meas;
+
+    kpm_ind_msg_format_1_t *f1 = &s->kpm_ue[u].ind_msg_format_1;
+    f1->meas_info_lst = s->kpm_info;
+    f1->meas_info_lst_len = meas;
+    f1->meas_data_lst = &s->kpm_data[u];
+    f1->meas_data_lst_len = 1;
+  }
+
+  for (size_t k = 0; k < NODE_SUB_COUNT; k++)
+    s->rd[k].type = INDICATION_MSG_AGENT_IF_ANS_V0;
+  s->rd[NODE_SUB_MAC].ind.type = MAC_STATS_V0;
+  s->rd[NODE_SUB_MAC].ind.mac.msg =
+      (mac_ind_msg_t){.len_ue_stats = ues, .ue_stats = s->mac};
+  s->rd[NODE_SUB_RLC].ind.type = RLC_STATS_V0;
+  s->rd[NODE_SUB_RLC].ind.rlc.msg = (rlc_ind_msg_t){.len = ues, .rb = s->rlc};
+  s->rd[NODE_SUB_PDCP].ind.type = PDCP_STATS_V0;
+  s->rd[NODE_SUB_PDCP].ind.pdcp.msg =
+      (pdcp_ind_msg_t){.len = ues, .rb = s->pdcp};
+  s->rd[NODE_SUB_GTP].ind.type = GTP_STATS_V0;
+  s->rd[NODE_SUB_GTP].ind.gtp.msg =
+      (gtp_ind_msg_t){.len = ues, .ngut = s->gtp};
+  s->rd[NODE_SUB_KPM].ind.type = KPM_STATS_V3_0;
+  kpm_ind_data_t *kpm = &s->rd[NODE_SUB_KPM].ind.kpm.ind;
+  kpm->msg.type = FORMAT_3_INDICATION_MESSAGE;
+  kpm->msg.frm_3.meas_report_per_ue = s->kpm_ue;
+  kpm->msg.frm_3.ue_meas_report_lst_len = ues;
+  return true;
+}
+
+void synth_ind_advance(synth_ind_t *s, uint64_t tick, int64_t ts) {
+  for (uint32_t u = 0; u < s->ues; u++) {
+    mac_ue_stats_impl_t *m = &s->mac[u];
+    m->frame = (uint16_t)(tick % 1024);
+    m->slot = (uint16_t)(tick % 20);
+    m->dl_curr_tbs = 1000 + u;
+    m->ul_curr_tbs = 200;
+    m->dl_aggr_tbs += m->dl_curr_tbs;
+    m->ul_aggr_tbs += m->ul_curr_tbs;
+    m->dl_aggr_prb += 50;
+    m->ul_aggr_prb += 10;
+
+    s->rlc[u].txpdu_pkts += 10;
+    s->rlc[u].txpdu_bytes += 12000;
+    s->rlc[u].rxpdu_pkts += 2;
+    s->rlc[u].rxpdu_bytes += 300;
+    s->rlc[u].txbuf_occ_bytes = (uint32_t)(tick % 7) * 1000;
+    s->pdcp[u].txpdu_pkts += 10;
+    s->pdcp[u].txpdu_bytes += 11500;
+    s->pdcp[u].rxpdu_pkts += 2;
+    s->pdcp[u].rxpdu_bytes += 280;
+
+    meas_record_lst_t *rec = &s->kpm_rec[(size_t)u * s->meas];
+    for (uint32_t j = 0; j < s->meas; j++) {
+      if (rec[j].value == REAL_MEAS_VALUE)
+        rec[j].real_val = 9600.0 + (double)(tick % 100);
+      else
+        rec[j].int_val = (uint32_t)(tick % 1000);
+    }
+  }
+  synth_ind_stamp(s, ts);
+}
+
+void synth_ind_stamp(synth_ind_t *s, int64_t ts) {
+  s->rd[NODE_SUB_MAC].ind.mac.msg.tstamp = ts;
+  s->rd[NODE_SUB_RLC].ind.rlc.msg.tstamp = ts;
+  s->rd[NODE_SUB_PDCP].ind.pdcp.msg.tstamp = ts;
+  s->rd[NODE_SUB_GTP].ind.gtp.msg.tstamp = ts;
+  s->rd[NODE_SUB_KPM]
+      .ind.kpm.ind.hdr.kpm_ric_ind_hdr_format_1.collectStartTime =
+      (uint64_t)ts;
+}
+
+void synth_ind_free(synth_ind_t *s) {
+  free(s->kpm_rec);
+  s->kpm_rec = NULL;
+}
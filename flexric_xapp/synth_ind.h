@@ -0,0 +1,58 @@
+/*
+ * Synthetic indications
+ * =====================
+ *
+ * One node's MAC, RLC, PDCP, GTP and KPM (Format 3) indications for a fixed
+ * set of UEs, as FlexRIC would hand them to the callbacks. The payloads are
+ * built once. synth_ind_advance then moves every counter on by one 10 ms
+ * round of steady traffic, so successive reports give sane rates without
+ * rebuilding anything.
+ *
+ * bench_pipeline feeds them straight into the pipeline, and loadtest_gen
+ * writes them into an indication log for a replay.
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#ifndef SYNTH_IND_H
+#define SYNTH_IND_H
+
+#include "kpm_meas.h"
+#include "node_ctx.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SYNTH_MAX_UES 512
+
+typedef struct {
+  uint32_t ues;
+  uint32_t meas;
+
+  mac_ue_stats_impl_t mac[SYNTH_MAX_UES];
+  rlc_radio_bearer_stats_t rlc[SYNTH_MAX_UES];
+  pdcp_radio_bearer_stats_t pdcp[SYNTH_MAX_UES];
+  gtp_ngu_t_stats_t gtp[SYNTH_MAX_UES];
+
+  meas_report_per_ue_t kpm_ue[SYNTH_MAX_UES];
+  meas_data_lst_t kpm_data[SYNTH_MAX_UES];
+  meas_record_lst_t *kpm_rec; // ues * meas
+  meas_info_format_1_lst_t kpm_info[KPM_MAX_MEAS];
+  char kpm_name[KPM_MAX_MEAS][32];
+
+  sm_ag_if_rd_t rd[NODE_SUB_COUNT]; // By node_sub_e
+} synth_ind_t;
+
+// ues 1..SYNTH_MAX_UES; meas 1..KPM_MAX_MEAS records per UE, the known
+// names first and past KPM_MEAS_COUNT names the collector does not know
+bool synth_ind_build(synth_ind_t *s, uint32_t ues, uint32_t meas);
+
+// One round of traffic; ts (us) becomes every report's timestamp
+void synth_ind_advance(synth_ind_t *s, uint64_t tick, int64_t ts);
+
+// Only the timestamps, e.g. for the same round sent by another node
+void synth_ind_stamp(synth_ind_t *s, int64_t ts);
+
+void synth_ind_free(synth_ind_t *s);
+
+#endif
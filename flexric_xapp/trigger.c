@@ -0,0 +1,234 @@
+/*
+ * Sampling triggers
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#include "trigger.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FLD(name, src, type, field) {UE_FIELD(name, type, field), src}
+
+trig_field_t const trig_field[] = {
+    FLD("cqi", TRIG_SRC_MAC, U8, cqi),
+    FLD("pusch_snr", TRIG_SRC_MAC, F32, pusch_snr),
+    FLD("pucch_snr", TRIG_SRC_MAC, F32, pucch_snr),
+    FLD("dl_bler", TRIG_SRC_MAC, F32, dl_bler),
+    FLD("ul_bler", TRIG_SRC_MAC, F32, ul_bler),
+    FLD("dl_mcs1", TRIG_SRC_MAC, U8, dl_mcs1),
+    FLD("ul_mcs1", TRIG_SRC_MAC, U8, ul_mcs1),
+    FLD("dl_prb", TRIG_SRC_MAC, U32, dl_prb),
+    FLD("ul_prb", TRIG_SRC_MAC, U32, ul_prb),
+    FLD("bsr", TRIG_SRC_MAC, U32, bsr),
+    FLD("phr", TRIG_SRC_MAC, I8, phr),
+    FLD("dl_mac_kbps", TRIG_SRC_MAC, F64, dl_mac_kbps),
+    FLD("ul_mac_kbps", TRIG_SRC_MAC, F64, ul_mac_kbps),
+    FLD("rlc_txbuf", TRIG_SRC_RLC, U32, rlc_txbuf),
+    FLD("rlc_rxbuf", TRIG_SRC_RLC, U32, rlc_rxbuf),
+    FLD("rlc_retx_per_s", TRIG_SRC_RLC, F64, rlc_retx_per_s),
+    FLD("rlc_tx_kbps", TRIG_SRC_RLC, F64, rlc_tx_kbps),
+    FLD("rlc_rx_kbps", TRIG_SRC_RLC, F64, rlc_rx_kbps),
+};
+
+#undef FLD
+
+size_t const trig_field_count = sizeof(trig_field) / sizeof(trig_field[0]);
+
+_Static_assert(sizeof(trig_field) / sizeof(trig_field[0]) <= UINT8_MAX,
+               "trig_rule_t.field is a uint8_t");
+
+static char const op_char[] = {[TRIG_ABOVE] = '>', [TRIG_BELOW] = '<',
+                               [TRIG_DEV] = '~'};
+
+// --- Rules -------------------------------------------------------------------
+
+static bool parse_rule(trig_rule_t *r, char const *s, size_t len) {
+  size_t const name_len = strcspn(s, "<>~");
+  if (name_len >= len) {
+    fprintf(stderr, "Trigger rule '%.*s' has no <, > or ~\n", (int)len, s);
+    return false;
+  }
+
+  size_t f = 0;
+  while (f < trig_field_count &&
+         !(strlen(trig_field[f].fld.name) == name_len &&
+           memcmp(trig_field[f].fld.name, s, name_len) == 0))
+    f++;
+  if (f == trig_field_count) {
+    fprintf(stderr, "Unknown trigger field '%.*s'\n", (int)name_len, s);
+    return false;
+  }
+
+  char num[32];
+  size_t const num_len = len - name_len - 1;
+  char *end = NULL;
+  if (num_len == 0 || num_len >= sizeof(num)) {
+    fprintf(stderr, "Trigger rule '%.*s' has no value\n", (int)len, s);
+    return false;
+  }
+  memcpy(num, s + name_len + 1, num_len);
+  num[num_len] = '\0';
+  double const v = strtod(num, &end);
+  if (*end != '\0' || !isfinite(v)) {
+    fprintf(stderr, "Trigger rule '%.*s': bad value\n", (int)len, s);
+    return false;
+  }
+
+  char const op = s[name_len];
+  r->field = (uint8_t)f;
+  r->op = op == '>' ? TRIG_ABOVE : op == '<' ? TRIG_BELOW : TRIG_DEV;
+  r->v = v;
+  if (r->op == TRIG_DEV && v <= 0) {
+    fprintf(stderr, "Trigger rule '%.*s': deviations must be > 0\n",
+            (int)len, s);
+    return false;
+  }
+  return true;
+}
+
+bool trig_rules_parse(trig_rules_t *rs, char const *s) {
+  trig_rules_t out = {.n = 0};
+  while (*s) {
+    size_t const len = strcspn(s, ",");
+    if (out.n == TRIG_MAX_RULES) {
+      fprintf(stderr, "At most %d trigger rules\n", TRIG_MAX_RULES);
+      return false;
+    }
+    if (!parse_rule(&out.r[out.n], s, len))
+      return false;
+    out.n++;
+    s += len;
+    if (*s == ',')
+      s++;
+  }
+  *rs = out;
+  return true;
+}
+
+void trig_rules_print(trig_rules_t const *rs) {
+  for (size_t i = 0; i < rs->n; i++)
+    printf("%s%s%c%g", i ? "," : "", trig_field[rs->r[i].field].fld.name,
+           op_char[rs->r[i].op], rs->r[i].v);
+}
+
+// --- Evaluation --------------------------------------------------------------
+
+// Tests x against the UE's running mean and variance, then folds it in.
+// The weight grows with the time since the last sample, so the EWMA
+// forgets at the same pace at any report interval.
+static bool deviates(trig_ue_t *u, size_t i, double x, double k, int64_t ts,
+                     int64_t tau_us) {
+  if (u->ts[i] == 0 || ts <= u->ts[i]) {
+    if (u->ts[i] == 0) {
+      u->mean[i] = x;
+      u->var[i] = 0;
+      u->n[i] = 1;
+    }
+    u->ts[i] = ts > u->ts[i] ? ts : u->ts[i];
+    return false;
+  }
+
+  double const d = x - u->mean[i];
+  bool const out = u->n[i] >= TRIG_WARMUP && u->var[i] > 0 &&
+                   d * d > k * k * u->var[i];
+
+  double const a = 1.0 - exp(-(double)(ts - u->ts[i]) / (double)tau_us);
+  u->mean[i] += a * d;
+  u->var[i] = (1.0 - a) * (u->var[i] + a * d * d);
+  u->ts[i] = ts;
+  if (u->n[i] < TRIG_WARMUP)
+    u->n[i]++;
+  return out;
+}
+
+bool trig_eval(trig_rules_t const *rs, trig_src_e src, trig_ue_t *u,
+               ue_metrics_t const *m, int64_t ts, int64_t tau_us) {
+  bool fired = false;
+  for (size_t i = 0; i < rs->n; i++) {
+    trig_rule_t const *r = &rs->r[i];
+    trig_field_t const *f = &trig_field[r->field];
+    if (f->src != src)
+      continue;
+    double const x = ue_field_value(m, &f->fld);
+    if (isnan(x))
+      continue;
+
+    switch (r->op) {
+    case TRIG_ABOVE:
+      fired |= x > r->v;
+      break;
+    case TRIG_BELOW:
+      fired |= x < r->v;
+      break;
+    case TRIG_DEV:
+      // Every EWMA is updated, even once another rule has fired
+      fired |= deviates(u, i, x, r->v, ts, tau_us);
+      break;
+    }
+  }
+  return fired;
+}
+
+// --- Node state --------------------------------------------------------------
+
+trig_node_t *trig_node_new(size_t history) {
+  trig_node_t *t = calloc(1, sizeof(*t));
+  if (!t)
+    return NULL;
+  if (history) {
+    t->hist = malloc(history * sizeof(*t->hist));
+    if (!t->hist) {
+      free(t);
+      return NULL;
+    }
+  }
+  t->hist_cap = history;
+  atomic_init(&t->want_fine, false);
+  return t;
+}
+
+void trig_node_free(trig_node_t *t) {
+  if (!t)
+    return;
+  free(t->hist);
+  free(t);
+}
+
+void trig_node_hold(trig_node_t *t, ue_metrics_t const *m) {
+  if (t->hist_cap == 0)
+    return;
+  size_t const i = (t->hist_head + t->hist_len) % t->hist_cap;
+  t->hist[i] = *m;
+  if (t->hist_len < t->hist_cap)
+    t->hist_len++;
+  else
+    t->hist_head = (t->hist_head + 1) % t->hist_cap;
+  t->held++;
+}
+
+size_t trig_node_release(trig_node_t *t, uint32_t rnti,
+                         bool (*emit)(void *arg, ue_metrics_t *m),
+                         void *arg) {
+  size_t n = 0;
+  for (size_t k = 0; k < t->hist_len; k++) {
+    ue_metrics_t *m = &t->hist[(t->hist_head + k) % t->hist_cap];
+    if (m->rnti != rnti)
+      continue;
+    if (emit && emit(arg, m))
+      n++;
+    m->rnti = UE_TABLE_EMPTY;
+  }
+
+  // Taken rows at the old end need not be kept
+  while (t->hist_len &&
+         t->hist[t->hist_head].rnti == UE_TABLE_EMPTY) {
+    t->hist_head = (t->hist_head + 1) % t->hist_cap;
+    t->hist_len--;
+  }
+  t->replayed += n;
+  return n;
+}
@@ -0,0 +1,133 @@
+/*
+ * Sampling triggers
+ * =================
+ *
+ * Most of the time a 10 ms MAC/RLC stream is mostly redundant; what
+ * matters is the detail around an incident. With --trigger set, a node's
+ * MAC and RLC are subscribed at the coarse --trigger-coarse interval. The
+ * rules are evaluated on every report, per UE, in the callbacks. A UE for
+ * which one fires is *hot* for --trigger-hold ms, and its node is switched
+ * to the fine --mac-interval/--rlc-interval while it has a hot UE.
+ *
+ * A rule is a per-UE field and a test:
+ *
+ *   dl_bler>0.1    above a threshold
+ *   cqi<7          below a threshold
+ *   pusch_snr~3    more than 3 standard deviations from the UE's EWMA
+ *
+ * The EWMA has a time constant of --trigger-tau ms rather than a weight
+ * per sample, so it means the same at either interval. A deviation rule
+ * waits for TRIG_WARMUP samples of the UE before it can fire.
+ *
+ * The switch itself (rm_report_sm_xapp_api, then report_sm_xapp_api) is
+ * made on the main thread: the callbacks only flag the node and wake it.
+ *
+ * While a node runs fine for one UE, the rows of its quiet UEs are thinned
+ * to the coarse rate. The rest go into a ring of the node's last
+ * --trigger-history rows instead of the output. When one of those UEs
+ * turns hot, its rows in the ring are written out first, so the output
+ * has the run-up to the incident.
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#ifndef TRIGGER_H
+#define TRIGGER_H
+
+#include "ue_table.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TRIG_MAX_RULES 8
+#define TRIG_MAX_HISTORY 4096
+#define TRIG_WARMUP 10
+
+// ue_metrics_t.trig
+#define TRIG_ROW_STEADY 0  // Written at the coarse rate
+#define TRIG_ROW_HOT 1     // The UE was hot
+#define TRIG_ROW_HISTORY 2 // Held in the ring, written when the UE turned hot
+
+// Report a field is updated by, and so evaluated on
+typedef enum { TRIG_SRC_MAC = 0, TRIG_SRC_RLC } trig_src_e;
+
+typedef enum { TRIG_ABOVE = 0, TRIG_BELOW, TRIG_DEV } trig_op_e;
+
+typedef struct {
+  uint8_t field; // Into trig_field[]
+  uint8_t op;    // trig_op_e
+  double v;      // Threshold, or deviations for TRIG_DEV
+} trig_rule_t;
+
+typedef struct {
+  trig_rule_t r[TRIG_MAX_RULES];
+  size_t n;
+} trig_rules_t;
+
+typedef struct {
+  ue_field_t fld; // Named as the CSV column
+  trig_src_e src;
+} trig_field_t;
+
+extern trig_field_t const trig_field[];
+extern size_t const trig_field_count;
+
+// "field>v,field<v,field~k"; prints why and returns false on a bad rule
+bool trig_rules_parse(trig_rules_t *rs, char const *s);
+
+// The rules in the same syntax
+void trig_rules_print(trig_rules_t const *rs);
+
+// Per-UE state, one per UE table entry
+typedef struct {
+  double mean[TRIG_MAX_RULES];
+  double var[TRIG_MAX_RULES];
+  int64_t ts[TRIG_MAX_RULES]; // Last sample, 0 = none
+  uint32_t n[TRIG_MAX_RULES];
+  int64_t hot_until; // Stream time (us) the UE stays hot until
+  int64_t out_ts;    // Last row written at the coarse rate
+} trig_ue_t;
+
+// Evaluates the rules on fields of src against the UE's latest report at
+// ts and folds it into the EWMAs. True if a rule fired.
+bool trig_eval(trig_rules_t const *rs, trig_src_e src, trig_ue_t *u,
+               ue_metrics_t const *m, int64_t ts, int64_t tau_us);
+
+// Per-node state, allocated only when there are rules. The callbacks own
+// everything under the node's mtx; want_fine is how they tell the main
+// thread, which alone owns is_fine and switches.
+typedef struct {
+  trig_ue_t ue[UE_TABLE_MAX_LOAD];
+
+  // Ring of held rows; a taken row has rnti UE_TABLE_EMPTY
+  ue_metrics_t *hist;
+  size_t hist_cap, hist_head, hist_len;
+
+  int64_t fine_until; // Stream time the node stays fine until
+  _Atomic bool want_fine;
+  bool is_fine;
+
+  // Stats
+  uint64_t fired;    // Times a UE turned hot
+  uint64_t switches; // Interval changes made
+  uint64_t held;     // Rows put in the ring
+  uint64_t replayed; // Held rows written on a trigger
+} trig_node_t;
+
+// A node's state with a ring of history rows (0 = none). NULL if out of
+// memory.
+trig_node_t *trig_node_new(size_t history);
+void trig_node_free(trig_node_t *t);
+
+// Keeps a copy of the row; the oldest drops out of a full ring
+void trig_node_hold(trig_node_t *t, ue_metrics_t const *m);
+
+// Calls emit on each held row of the RNTI, oldest first, and takes it out
+// of the ring; a NULL emit just drops them. Returns how many were emitted.
+size_t trig_node_release(trig_node_t *t, uint32_t rnti,
+                         bool (*emit)(void *arg, ue_metrics_t *m),
+                         void *arg);
+
+#endif
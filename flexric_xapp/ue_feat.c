@@ -0,0 +1,398 @@
+/*
+ * Rolling UE features
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#include "ue_feat.h"
+
+#include "../../../../src/util/time_now_us.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FEAT_MAX_PATH 320
+#define FEAT_FILE_BUF (256u << 10)
+
+// Same names as the raw CSV columns
+static ue_field_t const fields[] = {
+    UE_FIELD("pusch_snr", F32, pusch_snr),
+    UE_FIELD("pucch_snr", F32, pucch_snr),
+    UE_FIELD("dl_mcs1", U8, dl_mcs1),
+    UE_FIELD("ul_mcs1", U8, ul_mcs1),
+    UE_FIELD("dl_bler", F32, dl_bler),
+    UE_FIELD("ul_bler", F32, ul_bler),
+    UE_FIELD("dl_mac_kbps", F64, dl_mac_kbps),
+    UE_FIELD("ul_mac_kbps", F64, ul_mac_kbps),
+    UE_FIELD("dl_prb", U32, dl_prb),
+    UE_FIELD("ul_prb", U32, ul_prb),
+};
+
+#define N_FIELDS (sizeof(fields) / sizeof(fields[0]))
+
+// --- Windows -----------------------------------------------------------------
+
+bool feat_windows_parse(feat_windows_t *fw, char const *s) {
+  feat_windows_t out = {.n = 0};
+  if (strcmp(s, "0") == 0) {
+    *fw = out;
+    return true;
+  }
+
+  while (*s) {
+    char *end = NULL;
+    unsigned long const v = strtoul(s, &end, 10);
+    if (end == s || (*end != ',' && *end != '\0')) {
+      fprintf(stderr, "--features: expected sample counts, e.g. 10,50\n");
+      return false;
+    }
+    if (v < 2 || v > FEAT_MAX_SAMPLES) {
+      fprintf(stderr, "--features: a window must be 2..%d samples\n",
+              FEAT_MAX_SAMPLES);
+      return false;
+    }
+    if (out.n == FEAT_MAX_WINDOWS) {
+      fprintf(stderr, "--features: at most %d windows\n", FEAT_MAX_WINDOWS);
+      return false;
+    }
+    if (out.n && v <= out.w[out.n - 1]) {
+      fprintf(stderr, "--features: windows must be ascending\n");
+      return false;
+    }
+    out.w[out.n++] = (uint32_t)v;
+    s = *end ? end + 1 : end;
+  }
+  *fw = out;
+  return true;
+}
+
+void feat_windows_print(feat_windows_t const *fw) {
+  for (size_t i = 0; i < fw->n; i++)
+    printf("%s%u", i ? "," : "", fw->w[i]);
+}
+
+// --- Rolling sums ------------------------------------------------------------
+
+// One field over one window: sums of x - k and of t, t in s after the
+// window's oldest row
+typedef struct {
+  double s, q, t, t2, p;
+  uint32_t n; // Samples that were not NaN
+} win_sums_t;
+
+typedef struct {
+  int64_t last_ts;
+  uint64_t rows;
+
+  // Ring of the UE's last rows; the rows' values are in the sink's buffers
+  uint32_t head, len;
+  uint32_t since_sync;
+
+  double k[N_FIELDS];                 // Shift of x, NaN until a sample
+  int64_t origin[FEAT_MAX_WINDOWS];   // Time of the window's oldest row
+  win_sums_t sum[FEAT_MAX_WINDOWS][N_FIELDS];
+} feat_ue_t;
+
+typedef struct {
+  row_sink_t base;
+  row_sink_t *inner;
+  FILE *out;
+  char path[FEAT_MAX_PATH];
+
+  feat_windows_t fw;
+  uint32_t cap; // Largest window: rows kept per UE
+
+  // Keyed by RNTI like ue_table_t, which it shadows on the writer thread.
+  // Row i of pool entry e is at e * cap + i.
+  ue_index_t ix;
+  feat_ue_t ues[UE_TABLE_MAX_LOAD];
+  int64_t *ts;
+  double *x; // N_FIELDS per row
+
+  int64_t flush_us;
+
+  // Stats
+  uint64_t rows;
+  uint64_t late;
+  uint64_t ended;
+} feat_sink_t;
+
+// Logical row i of a UE (0 = oldest)
+static size_t slot_of(feat_sink_t const *a, size_t e, feat_ue_t const *u,
+                      uint32_t i) {
+  return e * a->cap + (u->head + i) % a->cap;
+}
+
+static void sums_add(win_sums_t *w, double x, double t) {
+  w->s += x;
+  w->q += x * x;
+  w->t += t;
+  w->t2 += t * t;
+  w->p += t * x;
+  w->n++;
+}
+
+// Moves the time origin d s later
+static void sums_shift(win_sums_t *w, double d) {
+  w->p -= d * w->s;
+  w->t2 += w->n * d * d - 2 * d * w->t;
+  w->t -= w->n * d;
+}
+
+// Rebuilds the sums of every window from the ring, about the newest values
+static void resync(feat_sink_t *a, size_t e, feat_ue_t *u) {
+  double const *nx = &a->x[slot_of(a, e, u, u->len - 1) * N_FIELDS];
+  for (size_t f = 0; f < N_FIELDS; f++) {
+    if (!isnan(nx[f]))
+      u->k[f] = nx[f];
+  }
+
+  for (size_t j = 0; j < a->fw.n; j++) {
+    uint32_t const nw = u->len < a->fw.w[j] ? u->len : a->fw.w[j];
+    uint32_t const first = u->len - nw;
+    u->origin[j] = a->ts[slot_of(a, e, u, first)];
+    memset(u->sum[j], 0, sizeof(u->sum[j]));
+    for (uint32_t i = first; i < u->len; i++) {
+      size_t const r = slot_of(a, e, u, i);
+      double const t = (double)(a->ts[r] - u->origin[j]) * 1e-6;
+      for (size_t f = 0; f < N_FIELDS; f++) {
+        double const v = a->x[r * N_FIELDS + f];
+        if (!isnan(v))
+          sums_add(&u->sum[j][f], v - u->k[f], t);
+      }
+    }
+  }
+  u->since_sync = 0;
+}
+
+static void add_row(feat_sink_t *a, size_t e, feat_ue_t *u,
+                    ue_metrics_t const *m) {
+  double v[N_FIELDS];
+  for (size_t f = 0; f < N_FIELDS; f++) {
+    v[f] = ue_field_value(m, &fields[f]);
+    if (isnan(u->k[f]) && !isnan(v[f]))
+      u->k[f] = v[f];
+  }
+
+  // Into every window, and the oldest row out of the full ones. This reads
+  // the ring before the push below can overwrite its oldest row.
+  uint32_t const len = u->len;
+  for (size_t j = 0; j < a->fw.n; j++) {
+    uint32_t const w = a->fw.w[j];
+    if (len == 0)
+      u->origin[j] = m->timestamp;
+    double const t = (double)(m->timestamp - u->origin[j]) * 1e-6;
+    for (size_t f = 0; f < N_FIELDS; f++) {
+      if (!isnan(v[f]))
+        sums_add(&u->sum[j][f], v[f] - u->k[f], t);
+    }
+    if (len < w)
+      continue;
+
+    // The oldest row is at the origin, so it only carries x and x^2
+    double const *old = &a->x[slot_of(a, e, u, len - w) * N_FIELDS];
+    int64_t const next = a->ts[slot_of(a, e, u, len - w + 1)];
+    double const d = (double)(next - u->origin[j]) * 1e-6;
+    for (size_t f = 0; f < N_FIELDS; f++) {
+      win_sums_t *s = &u->sum[j][f];
+      if (!isnan(old[f])) {
+        double const x = old[f] - u->k[f];
+        s->s -= x;
+        s->q -= x * x;
+        s->n--;
+      }
+      sums_shift(s, d);
+    }
+    u->origin[j] = next;
+  }
+
+  uint32_t i = len;
+  if (len == a->cap) {
+    u->head = (u->head + 1) % a->cap;
+    i = len - 1;
+  } else {
+    u->len++;
+  }
+  size_t const r = slot_of(a, e, u, i);
+  a->ts[r] = m->timestamp;
+  memcpy(&a->x[r * N_FIELDS], v, sizeof(v));
+
+  u->last_ts = m->timestamp;
+  u->rows++;
+  if (++u->since_sync >= a->cap)
+    resync(a, e, u);
+}
+
+static void emit(feat_sink_t *a, feat_ue_t const *u, ue_metrics_t const *m) {
+  FILE *f = a->out;
+  fprintf(f, "%lld,%u,%lu", (long long)m->timestamp, m->rnti, u->rows);
+
+  for (size_t j = 0; j < a->fw.n; j++) {
+    for (size_t k = 0; k < N_FIELDS; k++) {
+      win_sums_t const *s = &u->sum[j][k];
+      if (s->n == 0) {
+        fputs(",nan,nan,nan", f);
+        continue;
+      }
+      double const n = s->n;
+      double const mean = u->k[k] + s->s / n;
+      if (s->n < 2) {
+        fprintf(f, ",%.6g,nan,nan", mean);
+        continue;
+      }
+      double var = (s->q - s->s * s->s / n) / (n - 1);
+      if (var < 0)
+        var = 0;
+      double const den = n * s->t2 - s->t * s->t;
+      if (den > 0)
+        fprintf(f, ",%.6g,%.6g,%.6g", mean, var,
+                (n * s->p - s->t * s->s) / den);
+      else
+        fprintf(f, ",%.6g,%.6g,nan", mean, var);
+    }
+  }
+  fputc('\n', f);
+}
+
+// --- Tap sink ----------------------------------------------------------------
+
+static void feat_write(row_sink_t *s, ue_metrics_t const *m) {
+  feat_sink_t *a = (feat_sink_t *)s;
+  if (m->rec != UE_REC_ROW) {
+    a->inner->write(a->inner, m);
+    return;
+  }
+
+  // An evicted UE's windows end with it; the final row is not a sample
+  if (m->final) {
+    if (ue_index_remove(&a->ix, m->rnti) >= 0)
+      a->ended++;
+  } else {
+    bool added;
+    int const e = ue_index_insert(&a->ix, m->rnti, &added);
+    if (e >= 0) {
+      feat_ue_t *u = &a->ues[e];
+      if (added) {
+        memset(u, 0, sizeof(*u));
+        for (size_t f = 0; f < N_FIELDS; f++)
+          u->k[f] = NAN;
+      }
+      if (!added && m->timestamp <= u->last_ts) {
+        a->late++;
+      } else {
+        add_row(a, (size_t)e, u, m);
+        emit(a, u, m);
+        a->rows++;
+      }
+    }
+  }
+
+  a->inner->write(a->inner, m);
+}
+
+static void feat_flush(row_sink_t *s) {
+  feat_sink_t *a = (feat_sink_t *)s;
+  fflush(a->out);
+  a->flush_us = time_now_us();
+  a->inner->flush(a->inner);
+}
+
+// A model reading the file should not wait for the 256 KiB buffer
+static void feat_tick(row_sink_t *s) {
+  feat_sink_t *a = (feat_sink_t *)s;
+  int64_t const now = time_now_us();
+  if (now - a->flush_us >= (int64_t)CSV_SINK_FLUSH_MS * 1000) {
+    fflush(a->out);
+    a->flush_us = now;
+  }
+  if (a->inner->tick)
+    a->inner->tick(a->inner);
+}
+
+// The feature file is not row output
+static uint64_t feat_bytes(row_sink_t *s) {
+  feat_sink_t *a = (feat_sink_t *)s;
+  return a->inner->bytes ? a->inner->bytes(a->inner) : 0;
+}
+
+static void feat_print_stats(row_sink_t *s) {
+  feat_sink_t *a = (feat_sink_t *)s;
+  printf("    Features: %lu rows, %lu late rows left out, %lu UEs ended\n",
+         a->rows, a->late, a->ended);
+  if (a->inner->print_stats)
+    a->inner->print_stats(a->inner);
+}
+
+static void feat_close(row_sink_t *s) {
+  feat_sink_t *a = (feat_sink_t *)s;
+  if (fclose(a->out) != 0)
+    perror(a->path);
+  a->inner->close(a->inner);
+  free(a->ts);
+  free(a->x);
+  free(a);
+}
+
+bool ue_feat_path(char *dst, size_t len, char const *path) {
+  char const *slash = strrchr(path, '/');
+  char const *dot = strrchr(slash ? slash : path, '.');
+  size_t const stem = dot ? (size_t)(dot - path) : strlen(path);
+  int const n = snprintf(dst, len, "%.*s_feat.csv", (int)stem, path);
+  return n > 0 && (size_t)n < len;
+}
+
+static bool open_out(feat_sink_t *a, char const *path) {
+  if (!ue_feat_path(a->path, sizeof(a->path), path)) {
+    fprintf(stderr, "ue_feat: path too long: %s\n", path);
+    return false;
+  }
+  a->out = fopen(a->path, "w");
+  if (!a->out) {
+    perror(a->path);
+    return false;
+  }
+  setvbuf(a->out, NULL, _IOFBF, FEAT_FILE_BUF);
+
+  fputs("timestamp,rnti,samples", a->out);
+  for (size_t j = 0; j < a->fw.n; j++) {
+    for (size_t k = 0; k < N_FIELDS; k++) {
+      char const *n = fields[k].name;
+      unsigned const w = a->fw.w[j];
+      fprintf(a->out, ",%s_mean%u,%s_var%u,%s_slope%u", n, w, n, w, n, w);
+    }
+  }
+  fputc('\n', a->out);
+  return true;
+}
+
+row_sink_t *ue_feat_tap(row_sink_t *inner, char const *path,
+                        feat_windows_t const *fw) {
+  feat_sink_t *a = calloc(1, sizeof(*a));
+  if (!a)
+    return NULL;
+
+  a->inner = inner;
+  a->fw = *fw;
+  a->cap = fw->w[fw->n - 1];
+  size_t const rows = (size_t)UE_TABLE_MAX_LOAD * a->cap;
+  a->ts = malloc(rows * sizeof(*a->ts));
+  a->x = malloc(rows * N_FIELDS * sizeof(*a->x));
+  if (!a->ts || !a->x || !open_out(a, path)) {
+    free(a->ts);
+    free(a->x);
+    free(a);
+    return NULL;
+  }
+  ue_index_init(&a->ix);
+
+  a->flush_us = time_now_us();
+  a->base.write = feat_write;
+  a->base.flush = feat_flush;
+  a->base.close = feat_close;
+  a->base.tick = feat_tick;
+  a->base.print_stats = feat_print_stats;
+  a->base.bytes = feat_bytes;
+  return &a->base;
+}
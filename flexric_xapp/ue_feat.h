@@ -0,0 +1,66 @@
+/*
+ * Rolling UE features
+ * ===================
+ *
+ * The model behind the dataset works on rolling statistics of the radio
+ * fields rather than on single reports. This stage computes them on the
+ * writer thread as the rows go by, so they can be fed to inference as the
+ * collector runs instead of from the dataset offline.
+ *
+ * For every UE and every window of the last N MAC samples (--features,
+ * e.g. "10,50") it keeps the mean, the sample variance and the least
+ * squares slope per second of
+ *
+ *   pusch_snr pucch_snr dl_mcs1 ul_mcs1 dl_bler ul_bler
+ *   dl_mac_kbps ul_mac_kbps dl_prb ul_prb
+ *
+ * and writes one line per row to "<stem>_feat.csv" next to the output.
+ *
+ * Each field has a circular buffer of its last N samples, N the largest
+ * window. A window keeps running sums of x, x^2, t, t^2 and t*x, so a
+ * sample costs O(windows) adds whatever the window length. The sums are
+ * taken about the window's oldest sample (t) and a recent value (x), not
+ * about zero, which keeps the variance and slope from cancelling out on
+ * large values; they are rebuilt from the buffer every N samples so the
+ * rounding cannot build up.
+ *
+ * NaN values (a rate without a baseline yet) are not samples of their
+ * field. Rows older than the UE's last one (history rows written out by a
+ * trigger, see trigger.h) are left out, and a final row ends the UE.
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#ifndef UE_FEAT_H
+#define UE_FEAT_H
+
+#include "row_sink.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FEAT_MAX_WINDOWS 4
+#define FEAT_MAX_SAMPLES 1024
+
+// Window lengths in samples, ascending; n = 0 is off
+typedef struct {
+  uint32_t w[FEAT_MAX_WINDOWS];
+  size_t n;
+} feat_windows_t;
+
+// "10,50"; prints why and returns false on a bad list
+bool feat_windows_parse(feat_windows_t *fw, char const *s);
+
+// The windows in the same syntax
+void feat_windows_print(feat_windows_t const *fw);
+
+// The feature file for the raw output path
+bool ue_feat_path(char *dst, size_t len, char const *path);
+
+// Computes the features of every row into "<stem>_feat.csv", then
+// forwards the row to inner. Closing the tap closes inner.
+row_sink_t *ue_feat_tap(row_sink_t *inner, char const *path,
+                        feat_windows_t const *fw);
+
+#endif
@@ -0,0 +1,158 @@
+/*
+ * Per-UE metrics table
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#include "ue_table.h"
+
+#include <math.h>
+#include <sched.h>
+#include <string.h>
+
+#define UE_TABLE_MASK (UE_TABLE_CAP - 1)
+
+_Static_assert(UE_TABLE_MAX_LOAD <= UINT16_MAX, "pool entries are uint16_t");
+
+// --- Index -------------------------------------------------------------------
+
+void ue_index_init(ue_index_t *x) {
+  for (size_t i = 0; i < UE_TABLE_CAP; i++)
+    x->keys[i] = UE_TABLE_EMPTY;
+  for (size_t i = 0; i < UE_TABLE_MAX_LOAD; i++) {
+    x->owner[i] = UE_TABLE_EMPTY;
+    x->free[i] = (uint16_t)(UE_TABLE_MAX_LOAD - 1 - i);
+  }
+  x->n_free = UE_TABLE_MAX_LOAD;
+  x->len = 0;
+  x->peak = 0;
+  x->inserts = x->removed = x->refused = 0;
+}
+
+// Hash slot of the RNTI, or of the empty slot ending its probe run
+static size_t probe(ue_index_t const *x, uint32_t rnti) {
+  size_t i = ue_table_hash(rnti);
+  while (x->keys[i] != rnti && x->keys[i] != UE_TABLE_EMPTY)
+    i = (i + 1) & UE_TABLE_MASK;
+  return i;
+}
+
+int ue_index_find(ue_index_t const *x, uint32_t rnti) {
+  size_t const i = probe(x, rnti);
+  return x->keys[i] == rnti ? x->idx[i] : -1;
+}
+
+int ue_index_insert(ue_index_t *x, uint32_t rnti, bool *added) {
+  size_t const i = probe(x, rnti);
+  *added = false;
+  if (x->keys[i] == rnti)
+    return x->idx[i];
+
+  if (x->n_free == 0) {
+    x->refused++;
+    return -1;
+  }
+
+  uint16_t const e = x->free[--x->n_free];
+  x->keys[i] = rnti;
+  x->idx[i] = e;
+  x->owner[e] = rnti;
+  if (++x->len > x->peak)
+    x->peak = x->len;
+  x->inserts++;
+  *added = true;
+  return e;
+}
+
+int ue_index_remove(ue_index_t *x, uint32_t rnti) {
+  size_t i = probe(x, rnti);
+  if (x->keys[i] != rnti)
+    return -1;
+  uint16_t const e = x->idx[i];
+
+  // Backward-shift deletion: move up every later key in the run whose home
+  // slot is not between the hole and itself, so lookups never stop early
+  for (size_t j = (i + 1) & UE_TABLE_MASK; x->keys[j] != UE_TABLE_EMPTY;
+       j = (j + 1) & UE_TABLE_MASK) {
+    size_t const home = ue_table_hash(x->keys[j]);
+    if (((j - home) & UE_TABLE_MASK) >= ((j - i) & UE_TABLE_MASK)) {
+      x->keys[i] = x->keys[j];
+      x->idx[i] = x->idx[j];
+      i = j;
+    }
+  }
+  x->keys[i] = UE_TABLE_EMPTY;
+
+  x->owner[e] = UE_TABLE_EMPTY;
+  x->free[x->n_free++] = e;
+  x->len--;
+  x->removed++;
+  return e;
+}
+
+// --- Table -------------------------------------------------------------------
+
+void ue_table_init(ue_table_t *t) {
+  ue_index_init(&t->ix);
+  for (size_t i = 0; i < UE_TABLE_MAX_LOAD; i++) {
+    t->ues[i].rnti = UE_TABLE_EMPTY;
+    atomic_init(&t->seq[i], 0);
+  }
+}
+
+ue_metrics_t *ue_table_find(ue_table_t *t, uint32_t rnti) {
+  int const e = ue_index_find(&t->ix, rnti);
+  return e >= 0 ? &t->ues[e] : NULL;
+}
+
+ue_metrics_t *ue_table_upsert(ue_table_t *t, uint32_t rnti) {
+  bool added;
+  int const e = ue_index_insert(&t->ix, rnti, &added);
+  if (e < 0)
+    return NULL;
+
+  ue_metrics_t *m = &t->ues[e];
+  if (!added)
+    return m;
+
+  // Until the record is reset its rnti is still UE_TABLE_EMPTY, which a
+  // reader takes as unused
+  bool const open = ue_table_write_begin(t, m);
+  memset(m, 0, sizeof(*m));
+  memset(t->ctr[e], 0, sizeof(t->ctr[e]));
+  m->rnti = rnti;
+  m->dl_mac_kbps = m->ul_mac_kbps = NAN;
+  m->dl_goodput_kbps = m->ul_goodput_kbps = NAN;
+  m->rlc_tx_kbps = m->rlc_rx_kbps = m->rlc_retx_per_s = NAN;
+  m->pdcp_tx_kbps = m->pdcp_rx_kbps = NAN;
+  if (open)
+    ue_table_write_end(t, m);
+  return m;
+}
+
+bool ue_table_remove(ue_table_t *t, uint32_t rnti) {
+  int const e = ue_index_find(&t->ix, rnti);
+  if (e < 0)
+    return false;
+  ue_metrics_t *m = &t->ues[e];
+  ue_table_write_begin(t, m);
+  ue_index_remove(&t->ix, rnti);
+  m->rnti = UE_TABLE_EMPTY;
+  ue_table_write_end(t, m);
+  return true;
+}
+
+bool ue_table_read(ue_table_t const *t, size_t i, ue_metrics_t *out) {
+  _Atomic uint32_t const *q = &t->seq[i];
+  for (;;) {
+    uint32_t const s0 = atomic_load_explicit(q, memory_order_acquire);
+    if (s0 & 1) {
+      sched_yield();
+      continue;
+    }
+    memcpy(out, &t->ues[i], sizeof(*out));
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(q, memory_order_relaxed) == s0)
+      return out->rnti != UE_TABLE_EMPTY;
+  }
+}
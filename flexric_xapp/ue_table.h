@@ -0,0 +1,285 @@
+/*
+ * Per-UE metrics table
+ * ====================
+ *
+ * Open-addressing hash table keyed by RNTI. Keys live in their own dense
+ * array so a probe touches one or two cache lines before the (larger) metric
+ * record is dereferenced. Linear probing, no tombstones: a removal shifts
+ * the rest of its probe run back instead.
+ *
+ * Records sit in a fixed pool of UE_TABLE_MAX_LOAD entries that the index
+ * hands out and takes back, so memory is bounded however many UEs come and
+ * go, and a record keeps its address for as long as its UE is tracked.
+ *
+ * Each record has a sequence count that is odd while a writer is changing
+ * it. Writers are serialized by their owner (a node's mtx); readers on
+ * other threads take no lock at all: ue_table_read copies the record and
+ * retries if the count moved meanwhile, so a copy never mixes two
+ * indications of one SM. The *_ver fields then say which report of each
+ * SM the copy holds.
+ *
+ * License: OAI Public License, Version 1.1
+ */
+
+#ifndef UE_TABLE_H
+#define UE_TABLE_H
+
+#include "ctr_rate.h"
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Slots per table. Inserts are refused past 3/4 load, which leaves room for
+// 384 UEs per E2 node.
+#define UE_TABLE_BITS 9
+#define UE_TABLE_CAP (1u << UE_TABLE_BITS)
+#define UE_TABLE_MAX_LOAD (UE_TABLE_CAP / 4 * 3)
+
+// RNTIs are 16 bit, so this can never collide with a real key
+#define UE_TABLE_EMPTY UINT32_MAX
+
+// RNTI -> pool entry
+typedef struct {
+  uint32_t keys[UE_TABLE_CAP];
+  uint16_t idx[UE_TABLE_CAP];         // Pool entry of keys[i]
+  uint32_t owner[UE_TABLE_MAX_LOAD];  // RNTI of each pool entry, or EMPTY
+  uint16_t free[UE_TABLE_MAX_LOAD];   // Unused pool entries, lowest on top
+  size_t n_free;
+  size_t len;
+
+  // Stats
+  size_t peak;
+  uint64_t inserts;
+  uint64_t removed;
+  uint64_t refused; // Inserts turned away while full
+} ue_index_t;
+
+void ue_index_init(ue_index_t *x);
+
+// Pool entry of the RNTI, -1 if not tracked
+int ue_index_find(ue_index_t const *x, uint32_t rnti);
+
+// Pool entry of the RNTI, taken from the pool if new (*added set). -1 if
+// full.
+int ue_index_insert(ue_index_t *x, uint32_t rnti, bool *added);
+
+// Stops tracking the RNTI and hands its entry back to the pool. Returns
+// the entry, -1 if the RNTI was not tracked.
+int ue_index_remove(ue_index_t *x, uint32_t rnti);
+
+// What a record in a writer ring carries. Window summaries (see row_agg.h)
+// need every RLC/PDCP/KPM report, not just those joined onto a MAC row, so
+// with windows on each report is also queued on its own. Such a record is
+// not a row: sinks other than the summaries pass it on untouched.
+typedef enum {
+  UE_REC_ROW = 0,
+  UE_REC_RLC,
+  UE_REC_PDCP,
+  UE_REC_KPM,
+} ue_rec_e;
+
+// One CSV row worth of state for a single UE
+typedef struct {
+  int64_t timestamp;
+  // MAC metrics
+  uint32_t rnti;
+  uint8_t cqi;
+  float pusch_snr;
+  float pucch_snr;
+  float dl_bler;
+  float ul_bler;
+  uint8_t dl_mcs1, dl_mcs2, ul_mcs1, ul_mcs2;
+  uint64_t dl_tbs, ul_tbs;
+  uint64_t dl_aggr_tbs, ul_aggr_tbs;
+  uint32_t dl_prb, ul_prb;
+  uint32_t dl_sched_rb, ul_sched_rb;
+  uint32_t bsr;
+  int8_t phr;
+  uint16_t frame, slot;
+  int mac_valid;
+  // RLC metrics (summed over the UE's radio bearers)
+  uint32_t rlc_tx_pkts, rlc_tx_bytes;
+  uint32_t rlc_rx_pkts, rlc_rx_bytes;
+  uint32_t rlc_txbuf, rlc_rxbuf;
+  uint32_t rlc_retx;
+  int rlc_valid;
+  // PDCP metrics (summed over the UE's radio bearers)
+  uint32_t pdcp_tx_pkts, pdcp_tx_bytes;
+  uint32_t pdcp_rx_pkts, pdcp_rx_bytes;
+  int pdcp_valid;
+  // GTP NG-U tunnels of the UE. The SM reports tunnel ids only, no traffic
+  // counters, so the row has the lowest-QFI tunnel and the tunnel count.
+  uint32_t gtp_teid_gnb, gtp_teid_upf;
+  uint8_t gtp_qfi;
+  uint8_t gtp_tunnels;
+  int gtp_valid;
+  // UE lifetime: receive time of its first report (us), rows emitted for it
+  // so far including this one, and 1 on the summary row written when it is
+  // evicted (see ue_ttl_ms in collector_cfg.h)
+  int64_t first_ts;
+  uint32_t ue_rows;
+  uint8_t final;
+  // Why the row was written when sampling triggers are on (TRIG_ROW_*,
+  // see trigger.h); 0 without them
+  uint8_t trig;
+  // UE_REC_*; anything but UE_REC_ROW is never written out
+  uint8_t rec;
+  // Reports folded into the record so far, per SM; kpm_ver is the node's
+  // KPM report the row's totals come from (0 = none)
+  uint32_t mac_ver, rlc_ver, pdcp_ver, gtp_ver, kpm_ver;
+  // KPM throughput metrics (node level, copied in when the row is emitted)
+  double dl_thp_kbps;
+  double ul_thp_kbps;
+  double rlc_sdu_delay_us;
+  int32_t pdcp_sdu_vol_dl_kb;
+  int32_t pdcp_sdu_vol_ul_kb;
+  int32_t prb_tot_dl;
+  int32_t prb_tot_ul;
+  int kpm_valid;
+  // Receive time of the UE's latest RLC/PDCP/GTP report (us, 0 = none yet)
+  int64_t rlc_ts, pdcp_ts, gtp_ts;
+  // Receive time of the node KPM report copied in (us). Not written out.
+  int64_t kpm_ts;
+  // Rates derived from the cumulative counters above (see ctr_rate.h), NaN
+  // until a source has two reports in a row. Goodput is the MAC rate
+  // weighted by (1 - BLER).
+  double dl_mac_kbps, ul_mac_kbps;
+  double dl_goodput_kbps, ul_goodput_kbps;
+  double rlc_tx_kbps, rlc_rx_kbps, rlc_retx_per_s;
+  double pdcp_tx_kbps, pdcp_rx_kbps;
+  // Source age relative to timestamp, filled in when the row is emitted.
+  // Negative if the source arrived after the MAC sample, NaN if never seen.
+  double rlc_age_ms, pdcp_age_ms, kpm_age_ms;
+  // Alignment: the MAC sample is held until the other sources catch up.
+  // Not written out.
+  int pending;
+  // Monotonic time the row was queued for the writer (ns). Not written out.
+  int64_t enq_ns;
+} ue_metrics_t;
+
+// A numeric field of ue_metrics_t, for the tables that pick fields by name:
+// window summaries, UE features, sampling triggers and /metrics
+typedef enum {
+  UE_FIELD_U8,
+  UE_FIELD_I8,
+  UE_FIELD_U32,
+  UE_FIELD_I32,
+  UE_FIELD_U64,
+  UE_FIELD_F32,
+  UE_FIELD_F64
+} ue_field_type_e;
+
+typedef struct {
+  char const *name; // The CSV column's, or the metric's on /metrics
+  ue_field_type_e type;
+  size_t off;
+} ue_field_t;
+
+// UE_FIELD("dl_prb", U32, dl_prb)
+#define UE_FIELD(name, type, field)                                            \
+  {name, UE_FIELD_##type, offsetof(ue_metrics_t, field)}
+
+static inline double ue_field_value(ue_metrics_t const *m,
+                                    ue_field_t const *f) {
+  char const *p = (char const *)m + f->off;
+  switch (f->type) {
+  case UE_FIELD_U8:
+    return *(uint8_t const *)p;
+  case UE_FIELD_I8:
+    return *(int8_t const *)p;
+  case UE_FIELD_U32:
+    return *(uint32_t const *)p;
+  case UE_FIELD_I32:
+    return *(int32_t const *)p;
+  case UE_FIELD_U64:
+    return (double)*(uint64_t const *)p;
+  case UE_FIELD_F32:
+    return *(float const *)p;
+  case UE_FIELD_F64:
+    return *(double const *)p;
+  }
+  return NAN;
+}
+
+// Counters a rate is derived from
+typedef enum {
+  UE_CTR_DL_TBS = 0,
+  UE_CTR_UL_TBS,
+  UE_CTR_RLC_TX,
+  UE_CTR_RLC_RX,
+  UE_CTR_RLC_RETX,
+  UE_CTR_PDCP_TX,
+  UE_CTR_PDCP_RX,
+
+  UE_CTR_COUNT
+} ue_ctr_e;
+
+// The rate baselines are kept beside the records rather than in them, so
+// they are not copied to the writer with every row
+typedef struct {
+  ue_index_t ix;
+  ue_metrics_t ues[UE_TABLE_MAX_LOAD];
+  ctr_rate_t ctr[UE_TABLE_MAX_LOAD][UE_CTR_COUNT];
+  _Atomic uint32_t seq[UE_TABLE_MAX_LOAD]; // Odd while being written
+} ue_table_t;
+
+// Home slot of an RNTI. Fibonacci hashing spreads the mostly sequential
+// RNTIs OAI hands out.
+static inline size_t ue_table_hash(uint32_t rnti) {
+  return (uint32_t)(rnti * 2654435769u) >> (32 - UE_TABLE_BITS);
+}
+
+void ue_table_init(ue_table_t *t);
+
+// Returns NULL if the RNTI is not tracked
+ue_metrics_t *ue_table_find(ue_table_t *t, uint32_t rnti);
+
+// Returns the existing record, or a zeroed one with .rnti set, the rates NaN
+// and no rate baselines. NULL if full.
+ue_metrics_t *ue_table_upsert(ue_table_t *t, uint32_t rnti);
+
+// Forgets the UE; a later upsert starts it afresh. False if not tracked.
+bool ue_table_remove(ue_table_t *t, uint32_t rnti);
+
+// Tracked UEs
+static inline size_t ue_table_len(ue_table_t const *t) { return t->ix.len; }
+
+// Pool entry i (0 <= i < UE_TABLE_MAX_LOAD), NULL if unused. Entries are
+// handed out lowest first, so a table without churn is a dense prefix.
+static inline ue_metrics_t *ue_table_at(ue_table_t *t, size_t i) {
+  return t->ix.owner[i] != UE_TABLE_EMPTY ? &t->ues[i] : NULL;
+}
+
+// Opens a write of the record, unless one is already open. True if this
+// call opened it, i.e. on a UE's first change in an indication.
+static inline bool ue_table_write_begin(ue_table_t *t, ue_metrics_t const *m) {
+  _Atomic uint32_t *q = &t->seq[m - t->ues];
+  uint32_t const s = atomic_load_explicit(q, memory_order_relaxed);
+  if (s & 1)
+    return false;
+  atomic_store_explicit(q, s + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  return true;
+}
+
+// Publishes the record's changes, if a write is open
+static inline void ue_table_write_end(ue_table_t *t, ue_metrics_t const *m) {
+  _Atomic uint32_t *q = &t->seq[m - t->ues];
+  uint32_t const s = atomic_load_explicit(q, memory_order_relaxed);
+  if (s & 1)
+    atomic_store_explicit(q, s + 1, memory_order_release);
+}
+
+// Copies pool entry i from any thread, without the writers' lock. False if
+// the entry is unused.
+bool ue_table_read(ue_table_t const *t, size_t i, ue_metrics_t *out);
+
+// Rate baselines of a record returned by find/upsert
+static inline ctr_rate_t *ue_table_ctr(ue_table_t *t, ue_metrics_t const *m) {
+  return t->ctr[m - t->ues];
+}
+
+#endif
@@ -25,8 +25,21 @@
 #include "../../../../src/sm/rlc_sm/rlc_sm_id.h"
 #include "../../../../src/util/ngran_types.h"
 
+#include "collector_cfg.h"
+#include "ind_log.h"
+#include "ind_proc.h"
+#include "kpm_sub.h"
+#include "metrics_http.h"
+#include "node_ctx.h"
+#include "node_watch.h"
+#include "row_pub.h"
+#include "run_report.h"
+#include "stop_event.h"
+
 #include <pthread.h>
+#include <math.h>
 #include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -34,471 +47,417 @@
 #include <time.h>
 #include <unistd.h>
 
-// Configuration
-#define CSV_FILE "/tmp/kpm_metrics_dataset.csv"
-#define PRINT_INTERVAL 100
-
 // Global state
-static FILE *csv_file = NULL;
-static pthread_mutex_t csv_mutex = PTHREAD_MUTEX_INITIALIZER;
-static volatile int running = 1;
-static uint64_t sample_count = 0;
-static uint64_t target_samples = 1000;
-
-// Latest metrics from each SM
-static struct {
-  int64_t timestamp;
-  // MAC metrics
-  uint32_t rnti;
-  uint8_t cqi;
-  float pusch_snr;
-  float pucch_snr;
-  float dl_bler;
-  float ul_bler;
-  uint8_t dl_mcs1, dl_mcs2, ul_mcs1, ul_mcs2;
-  uint64_t dl_tbs, ul_tbs;
-  uint64_t dl_aggr_tbs, ul_aggr_tbs;
-  uint32_t dl_prb, ul_prb;
-  uint32_t dl_sched_rb, ul_sched_rb;
-  uint32_t bsr;
-  int8_t phr;
-  uint16_t frame, slot;
-  int mac_valid;
-  // RLC metrics
-  uint32_t rlc_tx_pkts, rlc_tx_bytes;
-  uint32_t rlc_rx_pkts, rlc_rx_bytes;
-  uint32_t rlc_txbuf, rlc_rxbuf;
-  uint32_t rlc_retx;
-  int rlc_valid;
-  // PDCP metrics
-  uint32_t pdcp_tx_pkts, pdcp_tx_bytes;
-  uint32_t pdcp_rx_pkts, pdcp_rx_bytes;
-  int pdcp_valid;
-  // KPM throughput metrics
-  double dl_thp_kbps;
-  double ul_thp_kbps;
-  double rlc_sdu_delay_us;
-  int32_t pdcp_sdu_vol_dl_kb;
-  int32_t pdcp_sdu_vol_ul_kb;
-  int32_t prb_tot_dl;
-  int32_t prb_tot_ul;
-  int kpm_valid;
-} metrics = {0};
-
-static void signal_handler(int sig) {
-  (void)sig;
-  running = 0;
-}
+static collector_cfg_t cfg;
+static ind_proc_t proc;
+static kpm_pool_t kpm_pool;
 
-static void write_csv_header(void) {
-  fprintf(csv_file, "timestamp,rnti,cqi,pusch_snr,pucch_snr,"
-                    "dl_bler,ul_bler,dl_mcs1,dl_mcs2,ul_mcs1,ul_mcs2,"
-                    "dl_tbs,ul_tbs,dl_aggr_tbs,ul_aggr_tbs,"
-                    "dl_prb,ul_prb,dl_sched_rb,ul_sched_rb,"
-                    "bsr,phr,frame,slot,"
-                    "rlc_tx_pkts,rlc_tx_bytes,rlc_rx_pkts,rlc_rx_bytes,"
-                    "rlc_txbuf,rlc_rxbuf,rlc_retx,"
-                    "pdcp_tx_pkts,pdcp_tx_bytes,pdcp_rx_pkts,pdcp_rx_bytes,"
-                    "dl_thp_kbps,ul_thp_kbps,rlc_sdu_delay_us,"
-                    "pdcp_vol_dl_kb,pdcp_vol_ul_kb,prb_tot_dl,prb_tot_ul\n");
-  fflush(csv_file);
-}
+// Subscribed E2 nodes, indexed by trampoline slot
+static node_watch_t watch;
 
-static void write_csv_row(void) {
-  if (!csv_file || !metrics.mac_valid)
-    return;
+// --record, safe from every indication thread
+static ind_log_writer_t rec_log;
+static bool recording;
 
-  pthread_mutex_lock(&csv_mutex);
-
-  fprintf(csv_file,
-          "%ld,%u,%u,%.2f,%.2f,"
-          "%.4f,%.4f,%u,%u,%u,%u,"
-          "%lu,%lu,%lu,%lu,"
-          "%u,%u,%u,%u,"
-          "%u,%d,%u,%u,"
-          "%u,%u,%u,%u,"
-          "%u,%u,%u,"
-          "%u,%u,%u,%u,"
-          "%.2f,%.2f,%.2f,"
-          "%d,%d,%d,%d\n",
-          metrics.timestamp, metrics.rnti, metrics.cqi, metrics.pusch_snr,
-          metrics.pucch_snr, metrics.dl_bler, metrics.ul_bler, metrics.dl_mcs1,
-          metrics.dl_mcs2, metrics.ul_mcs1, metrics.ul_mcs2, metrics.dl_tbs,
-          metrics.ul_tbs, metrics.dl_aggr_tbs, metrics.ul_aggr_tbs,
-          metrics.dl_prb, metrics.ul_prb, metrics.dl_sched_rb,
-          metrics.ul_sched_rb, metrics.bsr, metrics.phr, metrics.frame,
-          metrics.slot, metrics.rlc_tx_pkts, metrics.rlc_tx_bytes,
-          metrics.rlc_rx_pkts, metrics.rlc_rx_bytes, metrics.rlc_txbuf,
-          metrics.rlc_rxbuf, metrics.rlc_retx, metrics.pdcp_tx_pkts,
-          metrics.pdcp_tx_bytes, metrics.pdcp_rx_pkts, metrics.pdcp_rx_bytes,
-          metrics.dl_thp_kbps, metrics.ul_thp_kbps, metrics.rlc_sdu_delay_us,
-          metrics.pdcp_sdu_vol_dl_kb, metrics.pdcp_sdu_vol_ul_kb,
-          metrics.prb_tot_dl, metrics.prb_tot_ul);
-
-  sample_count++;
-  metrics.mac_valid = 0;
-
-  if (sample_count % PRINT_INTERVAL == 0) {
-    printf("[%lu] SNR=%.1fdB BLER=%.3f MCS=%u DL_Thp=%.1fkbps UL_Thp=%.1fkbps "
-           "PRB=%u/%u\n",
-           sample_count, metrics.pusch_snr, metrics.dl_bler, metrics.dl_mcs1,
-           metrics.dl_thp_kbps, metrics.ul_thp_kbps, metrics.dl_prb,
-           metrics.ul_prb);
-    fflush(csv_file);
-  }
+// --replay runs every callback on the main thread, on the recorded clock
+static bool replaying;
 
-  if (sample_count >= target_samples) {
-    printf("\nReached target of %lu samples\n", target_samples);
-    running = 0;
-  }
+// --report, filled in as the run goes
+static run_report_t report;
 
-  pthread_mutex_unlock(&csv_mutex);
+static void signal_handler(int sig) {
+  (void)sig;
+  stop_event_raise();
 }
 
-// MAC callback
-static void sm_cb_mac(sm_ag_if_rd_t const *rd) {
-  assert(rd != NULL);
-  assert(rd->type == INDICATION_MSG_AGENT_IF_ANS_V0);
-  assert(rd->ind.type == MAC_STATS_V0);
-
-  mac_ind_msg_t const *msg = &rd->ind.mac.msg;
-  if (msg->len_ue_stats == 0)
-    return;
-
-  mac_ue_stats_impl_t const *ue = &msg->ue_stats[0];
-
-  pthread_mutex_lock(&csv_mutex);
-
-  metrics.timestamp = time_now_us();
-  metrics.rnti = ue->rnti;
-  metrics.cqi = ue->wb_cqi;
-  metrics.pusch_snr = ue->pusch_snr;
-  metrics.pucch_snr = ue->pucch_snr;
-  metrics.dl_bler = ue->dl_bler;
-  metrics.ul_bler = ue->ul_bler;
-  metrics.dl_mcs1 = ue->dl_mcs1;
-  metrics.dl_mcs2 = ue->dl_mcs2;
-  metrics.ul_mcs1 = ue->ul_mcs1;
-  metrics.ul_mcs2 = ue->ul_mcs2;
-  metrics.dl_tbs = ue->dl_curr_tbs;
-  metrics.ul_tbs = ue->ul_curr_tbs;
-  metrics.dl_aggr_tbs = ue->dl_aggr_tbs;
-  metrics.ul_aggr_tbs = ue->ul_aggr_tbs;
-  metrics.dl_prb = ue->dl_aggr_prb;
-  metrics.ul_prb = ue->ul_aggr_prb;
-  metrics.dl_sched_rb = ue->dl_sched_rb;
-  metrics.ul_sched_rb = ue->ul_sched_rb;
-  metrics.bsr = ue->bsr;
-  metrics.phr = ue->phr;
-  metrics.frame = ue->frame;
-  metrics.slot = ue->slot;
-  metrics.mac_valid = 1;
-
-  pthread_mutex_unlock(&csv_mutex);
-
-  write_csv_row();
-}
+// sm_cb has no user pointer, so the node is baked into one trampoline per
+// slot. Every SM subscription of a node uses that node's trampoline.
+//
+// Each slot has two, for alternate attaches: a node that left and came
+// back subscribes through the other one, and slot_gen says which is
+// current. An indication the old subscription was still delivering when
+// it was removed then cannot land on the new node.
+#define NODE_SLOTS(X)                                                          \
+  X(0) X(1) X(2) X(3) X(4) X(5) X(6) X(7) X(8) X(9) X(10) X(11) X(12) X(13)   \
+  X(14) X(15) X(16) X(17) X(18) X(19) X(20) X(21) X(22) X(23) X(24) X(25)     \
+  X(26) X(27) X(28) X(29) X(30) X(31)
+
+static _Atomic unsigned slot_gen[NODE_CTX_MAX];
+
+#define DEF_NODE_CB_GEN(i, g)                                                  \
+  static void node_cb_##i##_##g(sm_ag_if_rd_t const *rd) {                     \
+    if (atomic_load(&slot_gen[i]) == g)                                        \
+      ind_proc_handle(&proc, &watch.slot[i], rd);                              \
+  }
+#define DEF_NODE_CB(i) DEF_NODE_CB_GEN(i, 0) DEF_NODE_CB_GEN(i, 1)
+NODE_SLOTS(DEF_NODE_CB)
+#undef DEF_NODE_CB
+#undef DEF_NODE_CB_GEN
 
-// RLC callback
-static void sm_cb_rlc(sm_ag_if_rd_t const *rd) {
-  assert(rd != NULL);
-  assert(rd->type == INDICATION_MSG_AGENT_IF_ANS_V0);
-  assert(rd->ind.type == RLC_STATS_V0);
+#define NODE_CB_ENTRY(i) {node_cb_##i##_0, node_cb_##i##_1},
+static sm_cb const node_cb[][2] = {NODE_SLOTS(NODE_CB_ENTRY)};
+#undef NODE_CB_ENTRY
 
-  rlc_ind_msg_t const *msg = &rd->ind.rlc.msg;
-  if (msg->len == 0)
-    return;
+_Static_assert(sizeof(node_cb) / sizeof(node_cb[0]) == NODE_CTX_MAX,
+               "NODE_SLOTS must list NODE_CTX_MAX slots");
 
-  rlc_radio_bearer_stats_t const *rb = &msg->rb[0];
-
-  pthread_mutex_lock(&csv_mutex);
-  metrics.rlc_tx_pkts = rb->txpdu_pkts;
-  metrics.rlc_tx_bytes = rb->txpdu_bytes;
-  metrics.rlc_rx_pkts = rb->rxpdu_pkts;
-  metrics.rlc_rx_bytes = rb->rxpdu_bytes;
-  metrics.rlc_txbuf = rb->txbuf_occ_bytes;
-  metrics.rlc_rxbuf = rb->rxbuf_occ_bytes;
-  metrics.rlc_retx = rb->txpdu_retx_pkts;
-  metrics.rlc_valid = 1;
-  pthread_mutex_unlock(&csv_mutex);
+// The trampoline of the node's current attach
+static sm_cb node_cb_of(node_ctx_t const *n) {
+  return node_cb[n->slot][atomic_load(&slot_gen[n->slot])];
 }
 
-// PDCP callback
-static void sm_cb_pdcp(sm_ag_if_rd_t const *rd) {
-  assert(rd != NULL);
-  assert(rd->type == INDICATION_MSG_AGENT_IF_ANS_V0);
-  assert(rd->ind.type == PDCP_STATS_V0);
-
-  pdcp_ind_msg_t const *msg = &rd->ind.pdcp.msg;
-  if (msg->len == 0)
-    return;
-
-  pdcp_radio_bearer_stats_t const *rb = &msg->rb[0];
+// RAN function ids, in cfg_sm_e order
+static uint16_t const ran_func[CFG_SM_COUNT] = {
+    [CFG_SM_MAC] = 142, [CFG_SM_RLC] = 143, [CFG_SM_PDCP] = 144,
+    [CFG_SM_GTP] = 148};
+
+// node_watch hook: the subscriptions of a node that just attached, one per
+// configured SM, through the node's own trampoline. node_watch issues them
+// and logs the answers.
+static size_t subscribe_node(node_ctx_t *n, e2_node_connected_xapp_t const *e2,
+                             sub_req_t *req, void *arg) {
+  kpm_sub_cache_t *kpm_tmpl = arg;
+  // A new attach: whatever the slot's last subscriptions still deliver is
+  // dropped from here on
+  atomic_store(&slot_gen[n->slot], atomic_load(&slot_gen[n->slot]) ^ 1u);
+  sm_cb const cb = node_cb_of(n);
+  size_t n_req = 0;
+
+  for (size_t s = 0; s < CFG_SM_COUNT; s++) {
+    if (!(cfg.sms & CFG_SMS_BIT(s))) {
+      printf("  %s (%u): OFF\n", node_sub_name[s], ran_func[s]);
+      continue;
+    }
+    char const *ival = collector_cfg_interval_str(
+        collector_cfg_sub_interval(&cfg, (cfg_sm_e)s, false));
+    req[n_req++] = (sub_req_t){.id = &n->id,
+                               .ran_func = ran_func[s],
+                               .data = (void *)ival,
+                               .cb = cb,
+                               .tag = (unsigned)s};
+  }
 
-  pthread_mutex_lock(&csv_mutex);
-  metrics.pdcp_tx_pkts = rb->txpdu_pkts;
-  metrics.pdcp_tx_bytes = rb->txpdu_bytes;
-  metrics.pdcp_rx_pkts = rb->rxpdu_pkts;
-  metrics.pdcp_rx_bytes = rb->rxpdu_bytes;
-  metrics.pdcp_valid = 1;
-  pthread_mutex_unlock(&csv_mutex);
+  // Subscribe to KPM for throughput
+  kpm_sub_data_t *kpm_sub =
+      cfg.sms & CFG_SMS_KPM ? kpm_sub_for(kpm_tmpl, e2->id.type) : NULL;
+  if (kpm_sub)
+    req[n_req++] = (sub_req_t){.id = &n->id,
+                               .ran_func = 2,
+                               .data = kpm_sub,
+                               .cb = cb,
+                               .tag = NODE_SUB_KPM};
+  else
+    printf("  KPM (2): %s\n", cfg.sms & CFG_SMS_KPM ? "SKIP" : "OFF");
+  return n_req;
 }
 
-// GTP callback
-static void sm_cb_gtp(sm_ag_if_rd_t const *rd) {
-  assert(rd != NULL);
-  assert(rd->type == INDICATION_MSG_AGENT_IF_ANS_V0);
-  assert(rd->ind.type == GTP_STATS_V0);
-  // GTP stats monitored but not saved
+// node_watch hook for --replay: the node was subscribed when the log was
+// recorded, so its indications are taken as they come
+static size_t replay_subscribe(node_ctx_t *n,
+                               e2_node_connected_xapp_t const *e2,
+                               sub_req_t *req, void *arg) {
+  (void)req;
+  kpm_sub_cache_t *kpm_tmpl = arg;
+  printf("  Replayed:");
+  for (size_t s = 0; s < NODE_SUB_COUNT; s++) {
+    bool on = cfg.sms & CFG_SMS_BIT(s);
+    if (s == NODE_SUB_KPM)
+      on = on && kpm_sub_for(kpm_tmpl, e2->id.type) != NULL;
+    n->sub[s] = (sm_ans_xapp_t){.success = on};
+    if (on)
+      printf(" %s", node_sub_name[s]);
+  }
+  printf("\n");
+  return 0;
 }
 
-// KPM callback - for throughput metrics
-static void sm_cb_kpm(sm_ag_if_rd_t const *rd) {
-  assert(rd != NULL);
-  assert(rd->type == INDICATION_MSG_AGENT_IF_ANS_V0);
-  assert(rd->ind.type == KPM_STATS_V3_0);
-
-  kpm_ind_data_t const *ind = &rd->ind.kpm.ind;
-  kpm_ind_msg_format_3_t const *msg_frm_3 = &ind->msg.frm_3;
+// Moves MAC and RLC of every node whose triggers changed state to the
+// fine or the coarse interval. Only the main thread subscribes, so this
+// is where the callbacks' requests are carried out.
+static void retune_nodes(void) {
+  static cfg_sm_e const switched[] = {CFG_SM_MAC, CFG_SM_RLC};
+
+  for (size_t i = 0; i < NODE_CTX_MAX; i++) {
+    node_ctx_t *n = &watch.slot[i];
+    if (!watch.used[i] || !n->trig)
+      continue;
+    bool const fine =
+        atomic_load_explicit(&n->trig->want_fine, memory_order_relaxed);
+    if (fine == n->trig->is_fine)
+      continue;
+
+    global_e2_node_id_t id = n->id;
+    printf("[trigger] node %zu:", n->slot);
+    for (size_t k = 0; k < sizeof(switched) / sizeof(switched[0]); k++) {
+      cfg_sm_e const s = switched[k];
+      if (!n->sub[s].success)
+        continue;
+      uint32_t const ms = collector_cfg_sub_interval(&cfg, s, fine);
+      rm_report_sm_xapp_api(n->sub[s].u.handle);
+      sm_ans_xapp_t const a =
+          report_sm_xapp_api(&id, ran_func[s],
+                             (void *)collector_cfg_interval_str(ms),
+                             node_cb_of(n));
+      pthread_mutex_lock(&watch.mtx);
+      n->sub[s] = a;
+      pthread_mutex_unlock(&watch.mtx);
+      printf(" %s %s", node_sub_name[s], a.success ? "" : "FAIL");
+      if (a.success)
+        printf("%u ms", ms);
+    }
+    printf("\n");
+    n->trig->is_fine = fine;
+    n->trig->switches++;
+  }
+}
 
-  if (msg_frm_3->ue_meas_report_lst_len == 0)
+// Latency/rate summary of every node once stats_ms have passed
+static void stats_tick(int64_t stats_ms, int64_t *last_ms) {
+  int64_t const t_ms = lat_now_ns() / 1000000;
+  if (!stats_ms || t_ms - *last_ms < stats_ms)
     return;
-
-  pthread_mutex_lock(&csv_mutex);
-
-  for (size_t i = 0; i < msg_frm_3->ue_meas_report_lst_len; i++) {
-    kpm_ind_msg_format_1_t const *msg_frm_1 =
-        &msg_frm_3->meas_report_per_ue[i].ind_msg_format_1;
-
-    for (size_t j = 0; j < msg_frm_1->meas_data_lst_len; j++) {
-      for (size_t z = 0; z < msg_frm_1->meas_data_lst[j].meas_record_len; z++) {
-        if (msg_frm_1->meas_info_lst_len == 0)
-          continue;
-        if (msg_frm_1->meas_info_lst[z].meas_type.type != NAME_MEAS_TYPE)
-          continue;
-
-        // Get measurement name
-        char name[64] = {0};
-        size_t len = msg_frm_1->meas_info_lst[z].meas_type.name.len;
-        if (len >= sizeof(name))
-          len = sizeof(name) - 1;
-        memcpy(name, msg_frm_1->meas_info_lst[z].meas_type.name.buf, len);
-
-        // Extract values
-        meas_record_lst_t const *rec =
-            &msg_frm_1->meas_data_lst[j].meas_record_lst[z];
-
-        if (rec->value == REAL_MEAS_VALUE) {
-          if (strcmp(name, "DRB.UEThpDl") == 0) {
-            metrics.dl_thp_kbps = rec->real_val;
-          } else if (strcmp(name, "DRB.UEThpUl") == 0) {
-            metrics.ul_thp_kbps = rec->real_val;
-          } else if (strcmp(name, "DRB.RlcSduDelayDl") == 0) {
-            metrics.rlc_sdu_delay_us = rec->real_val;
-          }
-        } else if (rec->value == INTEGER_MEAS_VALUE) {
-          if (strcmp(name, "DRB.PdcpSduVolumeDL") == 0) {
-            metrics.pdcp_sdu_vol_dl_kb = rec->int_val;
-          } else if (strcmp(name, "DRB.PdcpSduVolumeUL") == 0) {
-            metrics.pdcp_sdu_vol_ul_kb = rec->int_val;
-          } else if (strcmp(name, "RRU.PrbTotDl") == 0) {
-            metrics.prb_tot_dl = rec->int_val;
-          } else if (strcmp(name, "RRU.PrbTotUl") == 0) {
-            metrics.prb_tot_ul = rec->int_val;
-          }
-        }
-      }
-    }
+  for (size_t i = 0; i < NODE_CTX_MAX; i++) {
+    if (watch.used[i])
+      node_ctx_report_latency(&watch.slot[i],
+                              (double)(t_ms - *last_ms) / 1e3);
   }
-  metrics.kpm_valid = 1;
-  pthread_mutex_unlock(&csv_mutex);
+  *last_ms = t_ms;
 }
 
-// Generate measurement info with label
-static meas_info_format_1_lst_t gen_meas_info(const char *name) {
-  meas_info_format_1_lst_t dst = {0};
-  dst.meas_type.type = NAME_MEAS_TYPE;
-  dst.meas_type.name = cp_str_to_ba(name);
+// Wakes on the sample target, SIGINT/SIGTERM or the duration limit, for
+// every node poll and every stats interval in between. The duration
+// starts with the first attached node.
+static void run_live(void) {
+  printf("Waiting for E2 nodes...\n");
+
+  int64_t const stats_ms = (int64_t)cfg.stats_interval_s * 1000;
+  int64_t end_ms = -1;
+  int64_t last_ms = lat_now_ns() / 1000000;
+  int64_t poll_ms = last_ms;
+
+  for (;;) {
+    int64_t now_ms = lat_now_ns() / 1000000;
+    if (end_ms >= 0 && now_ms >= end_ms)
+      break;
+
+    if (now_ms >= poll_ms) {
+      bool const first = watch.attached == 0;
+      if (node_watch_poll(&watch) && first) {
+        printf("\nCollecting metrics...\n\n");
+        report.collect_ns = lat_now_ns();
+        last_ms = now_ms = report.collect_ns / 1000000;
+        if (cfg.duration_s)
+          end_ms = now_ms + (int64_t)cfg.duration_s * 1000;
+      }
+      poll_ms = now_ms + node_watch_period_ms(&watch);
+    }
 
-  // Required: Label info
-  dst.label_info_lst_len = 1;
-  dst.label_info_lst = calloc(1, sizeof(label_info_lst_t));
-  dst.label_info_lst[0].noLabel = calloc(1, sizeof(enum_value_e));
-  *dst.label_info_lst[0].noLabel = TRUE_ENUM_VALUE;
+    int64_t wake_ms = poll_ms;
+    if (end_ms >= 0 && end_ms < wake_ms)
+      wake_ms = end_ms;
+    if (stats_ms && watch.n_used && last_ms + stats_ms < wake_ms)
+      wake_ms = last_ms + stats_ms;
+    if (stop_event_wait(wake_ms > now_ms ? wake_ms - now_ms : 0))
+      break;
 
-  return dst;
+    retune_nodes();
+    stats_tick(stats_ms, &last_ms);
+  }
 }
 
-// Generate filter predicate for S-NSSAI
-static test_info_lst_t gen_filter_predicate(void) {
-  test_info_lst_t dst = {0};
-  dst.test_cond_type = S_NSSAI_TEST_COND_TYPE;
-  dst.S_NSSAI = TRUE_TEST_COND_TYPE;
-  dst.test_cond = calloc(1, sizeof(test_cond_e));
-  *dst.test_cond = EQUAL_TEST_COND;
-  dst.test_cond_value = calloc(1, sizeof(test_cond_value_t));
-  dst.test_cond_value->type = INTEGER_TEST_COND_VALUE;
-  dst.test_cond_value->int_value = calloc(1, sizeof(int64_t));
-  *dst.test_cond_value->int_value = 1; // SST = 1
-  return dst;
-}
+// Feeds a recorded log through ind_proc_handle on this thread, paced by the
+// recorded arrival times over the speed, or not at all at speed 0. The
+// duration counts in recorded time, from the first attached node.
+static void run_replay(ind_log_reader_t *r) {
+  printf("Replaying %s...\n", cfg.replay);
+
+  int64_t const stats_ms = (int64_t)cfg.stats_interval_s * 1000;
+  int64_t const start_ns = lat_now_ns();
+  int64_t last_ms = start_ns / 1000000;
+  int64_t first_us = 0;
+  int64_t end_us = -1;
+  uint64_t played = 0, unmatched = 0;
+  ind_log_entry_t e;
+
+  while (!stop_event_raised() && ind_log_reader_next(r, &e)) {
+    if (first_us == 0)
+      first_us = e.ts;
+    if (end_us >= 0 && e.ts >= end_us)
+      break;
+
+    if (cfg.replay_speed) {
+      int64_t const due_ms = start_ns / 1000000 +
+                             (e.ts - first_us) / 1000 / cfg.replay_speed;
+      // A trigger's nudge ends a wait early; replay keeps the pace
+      int64_t now_ms = lat_now_ns() / 1000000;
+      while (due_ms > now_ms && !stop_event_wait(due_ms - now_ms))
+        now_ms = lat_now_ns() / 1000000;
+      if (stop_event_raised())
+        break;
+      if (now_ms - due_ms > report.max_lag_ms)
+        report.max_lag_ms = now_ms - due_ms;
+    }
+    proc.clock_us = e.ts;
+
+    if (e.type == IND_LOG_NODES) {
+      bool const first = watch.attached == 0;
+      if (node_watch_sync(&watch, &e.nodes) && first) {
+        printf("\nCollecting metrics...\n\n");
+        report.collect_ns = lat_now_ns();
+        if (cfg.duration_s)
+          end_us = e.ts + (int64_t)cfg.duration_s * 1000000;
+      }
+    } else if (e.slot < NODE_CTX_MAX && watch.used[e.slot] &&
+               watch.slot[e.slot].id.nb_id.nb_id == e.nb_id) {
+      ind_proc_handle(&proc, &watch.slot[e.slot], &e.rd);
+      played++;
+    } else {
+      // The node did not get the same slot as when it was recorded
+      unmatched++;
+    }
 
-// Generate KPM subscription action definition
-static kpm_act_def_t gen_kpm_act_def(void) {
-  kpm_act_def_t act_def = {0};
-
-  // Format 4 for UE-level measurements
-  act_def.type = FORMAT_4_ACTION_DEFINITION;
-
-  // Matching condition for S-NSSAI
-  act_def.frm_4.matching_cond_lst_len = 1;
-  act_def.frm_4.matching_cond_lst =
-      calloc(1, sizeof(matching_condition_format_4_lst_t));
-  act_def.frm_4.matching_cond_lst[0].test_info_lst = gen_filter_predicate();
-
-  // Request measurements
-  const char *meas_names[] = {"DRB.UEThpDl",         "DRB.UEThpUl",
-                              "DRB.RlcSduDelayDl",   "DRB.PdcpSduVolumeDL",
-                              "DRB.PdcpSduVolumeUL", "RRU.PrbTotDl",
-                              "RRU.PrbTotUl"};
-  size_t num_meas = sizeof(meas_names) / sizeof(meas_names[0]);
-
-  act_def.frm_4.action_def_format_1.gran_period_ms = 100;
-  act_def.frm_4.action_def_format_1.meas_info_lst_len = num_meas;
-  act_def.frm_4.action_def_format_1.meas_info_lst =
-      calloc(num_meas, sizeof(meas_info_format_1_lst_t));
-
-  for (size_t i = 0; i < num_meas; i++) {
-    act_def.frm_4.action_def_format_1.meas_info_lst[i] =
-        gen_meas_info(meas_names[i]);
+    stats_tick(stats_ms, &last_ms);
   }
 
-  return act_def;
+  double const secs = (double)(lat_now_ns() - start_ns) / 1e9;
+  printf("\nReplayed %lu indications in %.2f s (%.0f/s)", played, secs,
+         secs > 0 ? (double)played / secs : 0.0);
+  if (unmatched)
+    printf(", %lu for nodes not attached", unmatched);
+  printf("\n");
+  report.played = played;
+  report.unmatched = unmatched;
 }
 
 int main(int argc, char *argv[]) {
-  // Hard-coded settings
-  const char *output = "/tmp/kpm_metrics_dataset.csv";
-  target_samples = 1000;
+  // Collector flags are consumed here; the rest is left for FlexRIC
+  collector_cfg_defaults(&cfg);
+  if (!collector_cfg_parse(&cfg, &argc, argv))
+    return 1;
 
   printf("\n========================================\n");
   printf("  KPM Metrics Collector xApp v2.0\n");
   printf("  (MAC + RLC + PDCP + KPM Throughput)\n");
   printf("========================================\n");
-  printf("Target: %lu samples\n", target_samples);
-  printf("Output: %s\n\n", output);
-
-  signal(SIGINT, signal_handler);
-  signal(SIGTERM, signal_handler);
+  collector_cfg_print(&cfg);
 
-  csv_file = fopen(output, "w");
-  if (!csv_file) {
-    perror("Failed to open output file");
+  if (!stop_event_init()) {
+    perror("eventfd");
     return 1;
   }
-  write_csv_header();
+  struct sigaction sa = {.sa_handler = signal_handler};
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
 
-  fr_args_t args = init_fr_args(argc, argv);
-  init_xapp_api(&args);
-  sleep(1);
+  // Bound before any node opens so every node's tap publishes on it
+  if (cfg.zmq_endpoint[0] && !row_pub_zmq_open(cfg.zmq_endpoint))
+    return 1;
 
-  e2_node_arr_xapp_t nodes = e2_nodes_xapp_api();
-  defer({ free_e2_node_arr_xapp(&nodes); });
+  // One action definition per node type, shared by every node of it and
+  // kept for the nodes that attach later
+  replaying = cfg.replay[0] != '\0';
+  ind_proc_init(&proc, &cfg);
+  proc.lossless = replaying && !cfg.replay_lossy;
+  run_report_begin(&report, replaying ? "replay" : "live");
+  // Without the pool every report is decoded on the callback's thread
+  if ((cfg.sms & CFG_SMS_KPM) && cfg.kpm_workers) {
+    if (kpm_pool_start(&kpm_pool, cfg.kpm_workers))
+      proc.kpm_pool = &kpm_pool;
+    else
+      printf("WARNING: KPM decode workers not started\n");
+  }
+  kpm_sub_cache_t kpm_tmpl;
+  if (!kpm_sub_cache_init(&kpm_tmpl, collector_cfg_kpm_meas(&cfg),
+                          cfg.kpm_period_ms, cfg.kpm_gran_ms) ||
+      !node_watch_init(&watch, &cfg,
+                       replaying ? replay_subscribe : subscribe_node,
+                       &kpm_tmpl))
+    return 1;
+  watch.offline = replaying;
 
-  if (nodes.len == 0) {
-    printf("ERROR: No E2 nodes connected!\n");
-    fclose(csv_file);
+  ind_log_reader_t replay_log;
+  if (replaying && !ind_log_reader_open(&replay_log, cfg.replay))
     return 1;
+  if (cfg.record[0]) {
+    if (!ind_log_writer_open(&rec_log, cfg.record))
+      return 1;
+    recording = true;
+    proc.log = &rec_log;
+    watch.log = &rec_log;
   }
 
-  printf("Connected E2 nodes: %d\n", nodes.len);
-
-  const char *interval = "10_ms";
-  sm_ans_xapp_t *mac_h = calloc(nodes.len, sizeof(sm_ans_xapp_t));
-  sm_ans_xapp_t *rlc_h = calloc(nodes.len, sizeof(sm_ans_xapp_t));
-  sm_ans_xapp_t *pdcp_h = calloc(nodes.len, sizeof(sm_ans_xapp_t));
-  sm_ans_xapp_t *gtp_h = calloc(nodes.len, sizeof(sm_ans_xapp_t));
-  sm_ans_xapp_t *kpm_h = calloc(nodes.len, sizeof(sm_ans_xapp_t));
-
-  for (int i = 0; i < (int)nodes.len; i++) {
-    e2_node_connected_xapp_t *n = &nodes.n[i];
-
-    printf("Node %d RAN Functions: ", i);
-    for (size_t j = 0; j < n->len_rf; j++)
-      printf("%d ", n->rf[j].id);
-    printf("\n");
-
-    if (n->id.type == ngran_gNB || n->id.type == ngran_eNB) {
-      // Subscribe to MAC
-      mac_h[i] = report_sm_xapp_api(&n->id, 142, (void *)interval, sm_cb_mac);
-      printf("  MAC (142): %s\n", mac_h[i].success ? "OK" : "FAIL");
-
-      // Subscribe to RLC
-      rlc_h[i] = report_sm_xapp_api(&n->id, 143, (void *)interval, sm_cb_rlc);
-      printf("  RLC (143): %s\n", rlc_h[i].success ? "OK" : "FAIL");
-
-      // Subscribe to PDCP
-      pdcp_h[i] = report_sm_xapp_api(&n->id, 144, (void *)interval, sm_cb_pdcp);
-      printf("  PDCP (144): %s\n", pdcp_h[i].success ? "OK" : "FAIL");
-
-      // Subscribe to GTP
-      gtp_h[i] = report_sm_xapp_api(&n->id, 148, (void *)interval, sm_cb_gtp);
-      printf("  GTP (148): %s\n", gtp_h[i].success ? "OK" : "FAIL");
-
-      // Subscribe to KPM for throughput
-      kpm_sub_data_t kpm_sub = {0};
-      kpm_sub.ev_trg_def.type = FORMAT_1_RIC_EVENT_TRIGGER;
-      kpm_sub.ev_trg_def.kpm_ric_event_trigger_format_1.report_period_ms = 100;
-      kpm_sub.sz_ad = 1;
-      kpm_sub.ad = calloc(1, sizeof(kpm_act_def_t));
-      kpm_sub.ad[0] = gen_kpm_act_def();
-
-      kpm_h[i] = report_sm_xapp_api(&n->id, 2, &kpm_sub, sm_cb_kpm);
-      printf("  KPM (2): %s\n", kpm_h[i].success ? "OK" : "FAIL");
-
-      free_kpm_sub_data(&kpm_sub);
-    }
+  // A replay stands in for the RIC
+  if (!replaying) {
+    fr_args_t args = init_fr_args(argc, argv);
+    init_xapp_api(&args);
   }
 
-  printf("\nCollecting metrics...\n\n");
+  // Scrapes only read the gauge snapshots, so a failure here does not
+  // stop the collection
+  metrics_http_t http;
+  bool http_on = false;
+  if (cfg.metrics_port) {
+    http_on =
+        metrics_http_start(&http, cfg.metrics_addr, cfg.metrics_port, &watch);
+    if (!http_on)
+      printf("WARNING: Metrics endpoint not started\n");
+  }
 
-  while (running && sample_count < target_samples)
-    sleep(1);
+  if (replaying)
+    run_replay(&replay_log);
+  else
+    run_live();
+  stop_event_raise();
 
   printf("\nStopping...\n");
 
-  for (int i = 0; i < (int)nodes.len; i++) {
-    if (mac_h[i].success)
-      rm_report_sm_xapp_api(mac_h[i].u.handle);
-    if (rlc_h[i].success)
-      rm_report_sm_xapp_api(rlc_h[i].u.handle);
-    if (pdcp_h[i].success)
-      rm_report_sm_xapp_api(pdcp_h[i].u.handle);
-    if (gtp_h[i].success)
-      rm_report_sm_xapp_api(gtp_h[i].u.handle);
-    if (kpm_h[i].success)
-      rm_report_sm_xapp_api(kpm_h[i].u.handle);
-  }
-
-  free(mac_h);
-  free(rlc_h);
-  free(pdcp_h);
-  free(gtp_h);
-  free(kpm_h);
-
-  if (csv_file) {
-    fflush(csv_file);
-    fclose(csv_file);
+  if (http_on)
+    metrics_http_stop(&http);
+
+  // Unsubscribes, so every producer is done pushing, then drains
+  node_watch_stop(&watch);
+  report.end_ns = lat_now_ns();
+  if (replaying)
+    ind_log_reader_close(&replay_log);
+  if (recording)
+    ind_log_writer_close(&rec_log);
+  uint64_t rows = watch.departed_rows;
+  for (size_t i = 0; i < NODE_CTX_MAX; i++) {
+    if (watch.used[i])
+      rows += watch.slot[i].writer.rows;
   }
 
   printf("\n========================================\n");
   printf("  Collection Complete\n");
-  printf("  Samples: %lu\n", sample_count);
-  printf("  Output: %s\n", output);
+  if (collector_cfg_windowed(&cfg))
+    printf("  Samples: %lu window summaries\n", row_agg_summaries());
+  else
+    printf("  Samples: %lu\n", atomic_load(&proc.samples));
+  printf("  Rows written: %lu\n", rows);
+  printf("  Nodes: %lu attached, %lu departed\n", watch.attached,
+         watch.departed);
+  if (proc.kpm_pool)
+    kpm_pool_print_stats(proc.kpm_pool);
+  for (size_t i = 0; i < NODE_CTX_MAX; i++) {
+    if (watch.used[i])
+      node_ctx_print_stats(&watch.slot[i]);
+  }
+  if (cfg.report[0] && run_report_write(&report, cfg.report, &watch, &proc))
+    printf("  Report: %s\n", cfg.report);
   printf("========================================\n\n");
 
-  while (try_stop_xapp_api() == false)
+  // The callbacks are all done once the nodes are unsubscribed
+  if (proc.kpm_pool)
+    kpm_pool_stop(proc.kpm_pool);
+
+  node_watch_free(&watch);
+  kpm_sub_cache_free(&kpm_tmpl);
+  row_pub_zmq_close();
+
+  while (!replaying && try_stop_xapp_api() == false)
     usleep(1000);
 
+  stop_event_close();
   return 0;
 }
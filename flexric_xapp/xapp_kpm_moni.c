@@ -0,0 +1,559 @@
+/*
+ * Licensed to the OpenAirInterface (OAI) Software Alliance under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The OpenAirInterface Software Alliance licenses this file to You under
+ * the OAI Public License, Version 1.1  (the "License"); you may not use this file
+ * except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.openairinterface.org/?page_id=698
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BAS
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *-------------------------------------------------------------------------------
+ * For more information about the OpenAirInterface (OAI) Software Alliance:
+ *      contact@openairinterface.org
+ */
+
+#include "../../../../src/xApp/e42_xapp_api.h"
+#include "../../../../src/util/alg_ds/alg/defer.h"
+#include "../../../../src/util/time_now_us.h"
+#include "../../../../src/util/alg_ds/ds/lock_guard/lock_guard.h"
+
+#include "kpm_meas.h"
+#include "kpm_sub.h"
+#include "sub_fanout.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+
+
+static
+pthread_mutex_t mtx;
+
+static
+void print_unknown_meas(meas_info_format_1_lst_t const* info)
+{
+  printf("Measurement Name not yet implemented %.*s\n", (int)info->meas_type.name.len, (char const*)info->meas_type.name.buf);
+  //assert(false && "Measurement Name not yet implemented");
+}
+
+// With --ndjson=FILE ("-" for stdout) every UE report becomes one JSON
+// object per granularity period instead of the human-readable dump:
+//
+//   {"ind":1,"collect_start_us":...,"recv_us":...,"latency_us":...,
+//    "ue_type":"gNB","ue_id":...,"period":0,"incomplete":false,
+//    "meas":{"DRB.UEThpDl":12.5,...}}
+//
+// The lines are formatted outside mtx and written with a single fwrite
+// per indication.
+static
+FILE* ndjson_out = NULL;
+
+typedef struct {
+  char* buf;
+  size_t len;
+  size_t cap;
+} jbuf_t;
+
+static
+void jbuf_printf(jbuf_t* b, const char* fmt, ...)
+{
+  for(;;){
+    va_list ap;
+    va_start(ap, fmt);
+    int const n = vsnprintf(b->buf + b->len, b->cap - b->len, fmt, ap);
+    va_end(ap);
+    assert(n >= 0);
+    if ((size_t)n < b->cap - b->len) {
+      b->len += n;
+      return;
+    }
+    b->cap = 2 * b->cap + n;
+    b->buf = realloc(b->buf, b->cap);
+    assert(b->buf != NULL && "Memory exhausted");
+  }
+}
+
+// Measurement names come from the E2 node, so escape them
+static
+void jbuf_str(jbuf_t* b, const char* s, size_t len)
+{
+  jbuf_printf(b, "\"");
+  for (size_t i = 0; i < len; i++) {
+    unsigned char const c = s[i];
+    if (c == '"' || c == '\\')
+      jbuf_printf(b, "\\%c", c);
+    else if (c < 0x20)
+      jbuf_printf(b, "\\u%04x", c);
+    else
+      jbuf_printf(b, "%c", c);
+  }
+  jbuf_printf(b, "\"");
+}
+
+static
+void jbuf_ue_id(jbuf_t* b, ue_id_e2sm_t const* ue)
+{
+  switch (ue->type)
+  {
+  case GNB_UE_ID_E2SM:
+    if (ue->gnb.gnb_cu_ue_f1ap_lst != NULL && ue->gnb.gnb_cu_ue_f1ap_lst_len > 0)
+      jbuf_printf(b, "\"ue_type\":\"gNB-CU\",\"ue_id\":%u", ue->gnb.gnb_cu_ue_f1ap_lst[0]);
+    else
+      jbuf_printf(b, "\"ue_type\":\"gNB\",\"ue_id\":%lu", ue->gnb.amf_ue_ngap_id);
+    if (ue->gnb.ran_ue_id != NULL)
+      jbuf_printf(b, ",\"ran_ue_id\":%lu", *ue->gnb.ran_ue_id);
+    break;
+
+  case GNB_DU_UE_ID_E2SM:
+    jbuf_printf(b, "\"ue_type\":\"gNB-DU\",\"ue_id\":%u", ue->gnb_du.gnb_cu_ue_f1ap);
+    break;
+
+  case GNB_CU_UP_UE_ID_E2SM:
+    jbuf_printf(b, "\"ue_type\":\"gNB-CU-UP\",\"ue_id\":%u", ue->gnb_cu_up.gnb_cu_cp_ue_e1ap);
+    break;
+
+  default:
+    jbuf_printf(b, "\"ue_type\":null,\"ue_id\":null");
+  }
+}
+
+static
+void write_ndjson(kpm_ind_data_t const* ind, int counter, int64_t now)
+{
+  kpm_ric_ind_hdr_format_1_t const* hdr_frm_1 = &ind->hdr.kpm_ric_ind_hdr_format_1;
+  kpm_ind_msg_format_3_t const* msg_frm_3 = &ind->msg.frm_3;
+
+  jbuf_t b = {.cap = 4096};
+  b.buf = malloc(b.cap);
+  assert(b.buf != NULL && "Memory exhausted");
+
+  for (size_t i = 0; i < msg_frm_3->ue_meas_report_lst_len; i++) {
+    meas_report_per_ue_t const* rep = &msg_frm_3->meas_report_per_ue[i];
+    kpm_ind_msg_format_1_t const* msg_frm_1 = &rep->ind_msg_format_1;
+
+    for (size_t j = 0; j < msg_frm_1->meas_data_lst_len; j++) {
+      meas_data_lst_t const* data = &msg_frm_1->meas_data_lst[j];
+      bool const incomplete = data->incomplete_flag && *data->incomplete_flag == TRUE_ENUM_VALUE;
+
+      jbuf_printf(&b, "{\"ind\":%d,\"collect_start_us\":%lu,\"recv_us\":%ld,\"latency_us\":%ld,",
+                  counter, hdr_frm_1->collectStartTime, now, now - (int64_t)hdr_frm_1->collectStartTime);
+      jbuf_ue_id(&b, &rep->ue_meas_report_lst);
+      jbuf_printf(&b, ",\"period\":%zu,\"incomplete\":%s,\"meas\":{", j, incomplete ? "true" : "false");
+
+      // Records without a name (ID_MEAS_TYPE) are keyed by their position
+      char const* sep = "";
+      for (size_t z = 0; z < data->meas_record_len; z++) {
+        meas_record_lst_t const* rec = &data->meas_record_lst[z];
+        jbuf_printf(&b, "%s", sep);
+        sep = ",";
+
+        if (z < msg_frm_1->meas_info_lst_len && msg_frm_1->meas_info_lst[z].meas_type.type == NAME_MEAS_TYPE) {
+          byte_array_t const* name = &msg_frm_1->meas_info_lst[z].meas_type.name;
+          jbuf_str(&b, (char const*)name->buf, name->len);
+        } else {
+          jbuf_printf(&b, "\"#%zu\"", z);
+        }
+
+        if (rec->value == INTEGER_MEAS_VALUE)
+          jbuf_printf(&b, ":%d", rec->int_val);
+        else if (rec->value == REAL_MEAS_VALUE && isfinite(rec->real_val))
+          jbuf_printf(&b, ":%.15g", rec->real_val);
+        else
+          jbuf_printf(&b, ":null");
+      }
+      jbuf_printf(&b, "}}\n");
+    }
+  }
+
+  {
+    lock_guard(&mtx);
+    fwrite(b.buf, 1, b.len, ndjson_out);
+    fflush(ndjson_out);
+  }
+  free(b.buf);
+}
+
+static
+void sm_cb_kpm(sm_ag_if_rd_t const* rd)
+{
+  assert(rd != NULL);
+  assert(rd->type == INDICATION_MSG_AGENT_IF_ANS_V0);
+  assert(rd->ind.type == KPM_STATS_V3_0);
+
+  // Reading Indication Message Format 3
+  kpm_ind_data_t const* ind = &rd->ind.kpm.ind;
+  kpm_ric_ind_hdr_format_1_t const* hdr_frm_1 = &ind->hdr.kpm_ric_ind_hdr_format_1;
+  kpm_ind_msg_format_3_t const* msg_frm_3 = &ind->msg.frm_3;
+  
+
+  int64_t const now = time_now_us();
+  static _Atomic int counter = 1;
+
+  if (ndjson_out != NULL) {
+    write_ndjson(ind, counter++, now);
+    return;
+  }
+
+  {
+    lock_guard(&mtx);
+
+    printf("\n%7d KPM ind_msg latency = %ld [μs]\n", counter, now - hdr_frm_1->collectStartTime);  // xApp <-> E2 Node
+
+    // Reported list of measurements per UE
+    for (size_t i = 0; i < msg_frm_3->ue_meas_report_lst_len; i++)
+    {
+      switch (msg_frm_3->meas_report_per_ue[i].ue_meas_report_lst.type)
+      {
+      case GNB_UE_ID_E2SM:
+        if (msg_frm_3->meas_report_per_ue[i].ue_meas_report_lst.gnb.gnb_cu_ue_f1ap_lst != NULL)
+        {
+          for (size_t j = 0; j < msg_frm_3->meas_report_per_ue[i].ue_meas_report_lst.gnb.gnb_cu_ue_f1ap_lst_len; j++)
+          {
+            printf("UE ID type = gNB-CU, gnb_cu_ue_f1ap = %u\n", msg_frm_3->meas_report_per_ue[i].ue_meas_report_lst.gnb.gnb_cu_ue_f1ap_lst[j]);
+          }
+        }
+        else
+        {
+          printf("UE ID type = gNB, amf_ue_ngap_id = %lu\n", msg_frm_3->meas_report_per_ue[i].ue_meas_report_lst.gnb.amf_ue_ngap_id);
+        }
+        break;
+
+      case GNB_DU_UE_ID_E2SM:
+        printf("UE ID type = gNB-DU, gnb_cu_ue_f1ap = %u\n", msg_frm_3->meas_report_per_ue[i].ue_meas_report_lst.gnb_du.gnb_cu_ue_f1ap);
+        break;
+
+      case GNB_CU_UP_UE_ID_E2SM:
+        printf("UE ID type = gNB-CU-UP, gnb_cu_cp_ue_e1ap = %u\n", msg_frm_3->meas_report_per_ue[i].ue_meas_report_lst.gnb_cu_up.gnb_cu_cp_ue_e1ap);
+        break;
+      
+      default:
+        assert(false && "UE ID type not yet implemented");
+      }
+
+      kpm_ind_msg_format_1_t const* msg_frm_1 = &msg_frm_3->meas_report_per_ue[i].ind_msg_format_1;
+
+      // Resolve every Measurement Name once per UE report
+      kpm_meas_e slot[KPM_MAX_MEAS];
+      size_t const n_meas = kpm_meas_resolve(msg_frm_1->meas_info_lst, msg_frm_1->meas_info_lst_len, slot);
+
+      // UE Measurements per granularity period
+      for (size_t j = 0; j<msg_frm_1->meas_data_lst_len; j++)
+      {
+        for (size_t z = 0; z<msg_frm_1->meas_data_lst[j].meas_record_len; z++)
+        {
+          if (msg_frm_1->meas_info_lst_len > 0)
+          {
+            switch (msg_frm_1->meas_info_lst[z].meas_type.type)
+            {
+            case NAME_MEAS_TYPE:
+            {
+              meas_record_lst_t const* rec = &msg_frm_1->meas_data_lst[j].meas_record_lst[z];
+              kpm_meas_e const s = z < n_meas ? slot[z] : KPM_MEAS_UNKNOWN;
+              double v = 0;
+              bool const known = kpm_meas_value(rec, s, &v);
+
+              // Get the value of the Measurement
+              switch (rec->value)
+              {
+              case REAL_MEAS_VALUE:
+                if (known)
+                  printf("%s = %.2f [%s]\n", kpm_meas[s].name, v, kpm_meas[s].unit);
+                else
+                  print_unknown_meas(&msg_frm_1->meas_info_lst[z]);
+                break;
+
+              case INTEGER_MEAS_VALUE:
+                if (known)
+                  printf("%s = %d [%s]\n", kpm_meas[s].name, rec->int_val, kpm_meas[s].unit);
+                else
+                  print_unknown_meas(&msg_frm_1->meas_info_lst[z]);
+                break;
+
+              default:
+                assert(0 != 0 && "Value not recognized");
+              }
+              
+              break;
+            }
+            case ID_MEAS_TYPE: 
+                printf(" ID_MEAS_TYPE \n");
+                break;
+          
+            default:
+              assert(false && "Measurement Type not yet implemented");
+            }
+          }
+          
+
+          if (msg_frm_1->meas_data_lst[j].incomplete_flag && *msg_frm_1->meas_data_lst[j].incomplete_flag == TRUE_ENUM_VALUE)
+            printf("Measurement Record not reliable");
+        }        
+      }
+    }
+    counter++;
+  }
+}
+
+// Takes --NAME=VALUE / --NAME VALUE out of argv before FlexRIC parses it
+static
+const char* take_arg(int* argc, char* argv[], const char* name)
+{
+  size_t const len = strlen(name);
+  const char* val = NULL;
+  int out = 1;
+  for (int i = 1; i < *argc; i++) {
+    char const* a = argv[i];
+    if (strncmp(a, "--", 2) == 0 && strncmp(a + 2, name, len) == 0 && a[2 + len] == '=') {
+      val = a + 3 + len;
+    } else if (strncmp(a, "--", 2) == 0 && strcmp(a + 2, name) == 0 && i + 1 < *argc) {
+      val = argv[++i];
+    } else {
+      argv[out++] = argv[i];
+    }
+  }
+  argv[out] = NULL;
+  *argc = out;
+  return val;
+}
+
+// E2 nodes holding a KPM subscription of ours. A node that leaves the RIC
+// is unsubscribed before its entry is dropped, so a node that comes back
+// gets one fresh subscription rather than a second one.
+#define MAX_KPM_NODES 64
+
+typedef struct {
+  global_e2_node_id_t id;
+  sm_ans_xapp_t handle;
+} kpm_node_t;
+
+static
+kpm_node_t kpm_nodes[MAX_KPM_NODES];
+
+static
+size_t kpm_nodes_len = 0;
+
+static
+const int KPM_ran_function = 2;
+
+// One action definition per NG-RAN type, shared by every node of it
+static
+kpm_sub_cache_t kpm_tmpl;
+
+static
+const uint32_t kpm_period_ms = 1000;
+
+// Until the first node shows up the RIC is asked more often
+static
+const int64_t node_poll_ms = 1000;
+
+static
+const int64_t first_node_poll_ms = 100;
+
+// New nodes are subscribed together, this many requests in flight at once
+// (--sub-threads=N). Opt-in: FlexRIC does not promise report_sm_xapp_api
+// is safe from several threads, so the default sends them one at a time.
+static
+unsigned sub_threads = 1;
+
+// CU-CP nodes get no subscription; false and nothing to request
+static
+bool subscribe_kpm(e2_node_connected_xapp_t* n, global_e2_node_id_t* id, sub_req_t* req)
+{
+  for (size_t j = 0; j < n->len_rf; j++){
+    printf("[xApp]: registered node %lu ran func id = %d \n ", j, n->rf[j].id);
+  }
+
+  // The measurement names are fixed per NG-RAN type (see kpm_meas.h); so
+  // are the ones this binary is built with
+  kpm_sub_data_t* kpm_sub = kpm_sub_for(&kpm_tmpl, n->id.type);
+  if (kpm_sub == NULL) {
+    printf("[xApp]: no KPM measurements for NG-RAN type %d\n", n->id.type);
+    return false;
+  }
+
+  printf("[xApp]: reporting period = %u [ms]\n", kpm_period_ms);
+  printf("[xApp]: Filter UEs by S-NSSAI criteria where SST = %lu\n", *kpm_sub->ad[0].frm_4.matching_cond_lst[0].test_info_lst.test_cond_value->int_value);
+
+  *req = (sub_req_t){.id = id, .ran_func = KPM_ran_function, .data = kpm_sub, .cb = sm_cb_kpm};
+  return true;
+}
+
+// Fan-out hook: group is the node's kpm_nodes index
+static
+void kpm_subscribed(sub_req_t const* req, size_t n, void* arg)
+{
+  (void)n;
+  (void)arg;
+  kpm_nodes[req->group].handle = req->ans;
+  printf("[xApp]: E2 node nb_id %u KPM subscription %s after %.1f ms\n", req->id->nb_id.nb_id, req->ans.success ? "OK" : "FAILED", req->us / 1000.0);
+}
+
+// Diffs the RIC's node list against kpm_nodes: departed nodes are
+// unsubscribed and forgotten, new ones subscribed. Runs on the main thread only.
+static
+void watch_nodes(void)
+{
+  e2_node_arr_xapp_t nodes = e2_nodes_xapp_api();
+  defer({ free_e2_node_arr_xapp(&nodes); });
+
+  for (size_t i = 0; i < kpm_nodes_len; ){
+    bool found = false;
+    for (int j = 0; j < nodes.len && found == false; j++)
+      found = eq_global_e2_node_id(&kpm_nodes[i].id, &nodes.n[j].id);
+
+    if (found == true){
+      ++i;
+      continue;
+    }
+    printf("[xApp]: E2 node nb_id %u left the RIC\n", kpm_nodes[i].id.nb_id.nb_id);
+    if (kpm_nodes[i].handle.success == true)
+      rm_report_sm_xapp_api(kpm_nodes[i].handle.u.handle);
+    free_global_e2_node_id(&kpm_nodes[i].id);
+    kpm_nodes[i] = kpm_nodes[--kpm_nodes_len];
+  }
+
+  size_t const first_new = kpm_nodes_len;
+  sub_req_t req[MAX_KPM_NODES];
+  size_t n_req = 0;
+  for (int j = 0; j < nodes.len; j++){
+    e2_node_connected_xapp_t* n = &nodes.n[j];
+    bool known = false;
+    for (size_t i = 0; i < kpm_nodes_len && known == false; i++)
+      known = eq_global_e2_node_id(&kpm_nodes[i].id, &n->id);
+    if (known == true)
+      continue;
+
+    if (kpm_nodes_len == MAX_KPM_NODES){
+      printf("[xApp]: more than %d E2 nodes, nb_id %u not subscribed\n", MAX_KPM_NODES, n->id.nb_id.nb_id);
+      continue;
+    }
+
+    printf("[xApp]: E2 node nb_id %u connected\n", n->id.nb_id.nb_id);
+    kpm_node_t* k = &kpm_nodes[kpm_nodes_len];
+    k->id = cp_global_e2_node_id(&n->id);
+    k->handle = (sm_ans_xapp_t){0};
+    if (subscribe_kpm(n, &k->id, &req[n_req])){
+      req[n_req].group = kpm_nodes_len;
+      n_req++;
+    }
+    kpm_nodes_len++;
+  }
+
+  if (n_req == 0)
+    return;
+  sub_fanout_run(req, n_req, sub_threads, kpm_subscribed, NULL);
+  for (size_t i = 0; i < n_req; i++)
+    assert(kpm_nodes[req[i].group].handle.success == true);
+  printf("[xApp]: %lu of %lu new E2 nodes subscribed\n", n_req, kpm_nodes_len - first_new);
+}
+
+// Milliseconds between two timespecs
+static
+int64_t elapsed_ms(struct timespec const* t0, struct timespec const* t1)
+{
+  return (t1->tv_sec - t0->tv_sec) * 1000 + (t1->tv_nsec - t0->tv_nsec) / 1000000;
+}
+
+int main(int argc, char *argv[])
+{
+  const char* ndjson_path = take_arg(&argc, argv, "ndjson");
+  const char* threads_arg = take_arg(&argc, argv, "sub-threads");
+  if (threads_arg != NULL) {
+    char* end = NULL;
+    unsigned long const v = strtoul(threads_arg, &end, 10);
+    if (*threads_arg == '\0' || *end != '\0' || v == 0 || v > SUB_FANOUT_MAX_THREADS) {
+      fprintf(stderr, "--sub-threads must be 1..%d\n", SUB_FANOUT_MAX_THREADS);
+      return EXIT_FAILURE;
+    }
+    sub_threads = v;
+  }
+  if (ndjson_path != NULL) {
+    ndjson_out = strcmp(ndjson_path, "-") == 0 ? stdout : fopen(ndjson_path, "w");
+    if (ndjson_out == NULL) {
+      perror(ndjson_path);
+      return EXIT_FAILURE;
+    }
+  }
+
+  fr_args_t args = init_fr_args(argc, argv);
+
+  // SIGINT/SIGTERM are waited for synchronously below. Block them before
+  // the xApp threads are spawned so that every thread inherits the mask.
+  sigset_t stop_set;
+  sigemptyset(&stop_set);
+  sigaddset(&stop_set, SIGINT);
+  sigaddset(&stop_set, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &stop_set, NULL);
+
+  if (!kpm_sub_cache_init(&kpm_tmpl, KPM_MEAS_SET, kpm_period_ms, 1000)) {
+    fprintf(stderr, "Memory exhausted\n");
+    return EXIT_FAILURE;
+  }
+
+  pthread_mutexattr_t attr = {0};
+  int rc = pthread_mutex_init(&mtx, &attr);
+  assert(rc == 0);
+
+  //Init the xApp
+  init_xapp_api(&args);
+
+  // Run for up to 5000 s, but tear down as soon as a stop signal arrives.
+  // Nodes are picked up as they connect, so a gNB restarted after the
+  // RIC is subscribed again.
+  printf("[xApp]: waiting for E2 nodes\n");
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  int sig = -1;
+  for(;;){
+    watch_nodes();
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t const left_ms = 5000 * 1000 - elapsed_ms(&start, &now);
+    if(left_ms <= 0)
+      break;
+
+    int64_t wait_ms = kpm_nodes_len > 0 ? node_poll_ms : first_node_poll_ms;
+    if(wait_ms > left_ms)
+      wait_ms = left_ms;
+    struct timespec const poll_time = {.tv_sec = wait_ms / 1000, .tv_nsec = (wait_ms % 1000) * 1000000};
+    sig = sigtimedwait(&stop_set, NULL, &poll_time);
+    if(sig > 0)
+      break;
+  }
+
+  if(sig > 0)
+    printf("[xApp]: signal %d received, stopping\n", sig);
+
+  for(size_t i = 0; i < kpm_nodes_len; ++i){
+    // Remove the handle previously returned
+    if (kpm_nodes[i].handle.success == true)
+      rm_report_sm_xapp_api(kpm_nodes[i].handle.u.handle);
+    free_global_e2_node_id(&kpm_nodes[i].id);
+  }
+  kpm_nodes_len = 0;
+
+  //Stop the xApp
+  while(try_stop_xapp_api() == false)
+    usleep(1000);
+
+  if (ndjson_out != NULL && ndjson_out != stdout)
+    fclose(ndjson_out);
+  kpm_sub_cache_free(&kpm_tmpl);
+
+  printf("Test xApp run SUCCESSFULLY\n");
+}
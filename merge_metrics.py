@@ -1,10 +1,30 @@
+import numpy as np
 import pandas as pd
 import re
 import sys
 import os
 import argparse
+import bisect
+import shutil
+import subprocess
+import tempfile
 from datetime import datetime
 
+XAPP_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'flexric_xapp')
+sys.path.insert(0, XAPP_DIR)
+from kpm_columnar import load_dataset
+
+# A row takes its UE's latest log entry at most this many frames back
+LOOKBACK_FRAMES = 200
+FRAMES = 1024
+
+# parse_gnb_logs field -> output column, in merge_gnb_log's column order
+LOG_COLUMNS = {
+    'rsrp': 'log_rsrp', 'ph': 'log_ph', 'pcmax': 'log_pcmax',
+    'sync': 'log_sync', 'harq_dl': 'log_harq_dl', 'harq_ul': 'log_harq_ul',
+    'dlsch_err': 'log_dlsch_err', 'ulsch_err': 'log_ulsch_err',
+}
+
 def parse_gnb_logs(log_file):
     """
     Parses gNB logs to extract RSRP mapped by Frame/Slot.
@@ -100,6 +120,76 @@ def parse_gnb_logs(log_file):
     
     return metrics
 
+def join_gnb_metrics(df, log_metrics, lookback=LOOKBACK_FRAMES):
+    """
+    Joins parse_gnb_logs() output to the dataset rows on (rnti, frame, slot).
+    Each row takes its UE's latest entry at or before the row's frame and
+    slot, at most `lookback` frames back across the 1024 frame wrap; the
+    same rule merge_gnb_log applies. Returns the log columns, row aligned.
+    """
+    by_rnti = {}
+    for (f, s, r), data in log_metrics.items():
+        if 0 <= f < FRAMES:
+            by_rnti.setdefault(r, []).append((f, s, data))
+    keys = {}
+    for r, entries in by_rnti.items():
+        entries.sort(key=lambda e: (e[0], e[1]))
+        keys[r] = [(f, s) for f, s, _ in entries]
+
+    cols = {c: [] for c in LOG_COLUMNS.values()}
+    for f, s, r in zip(df['frame'], df['slot'], df['rnti']):
+        match = None
+        try:
+            f, s, r = int(f) % FRAMES, int(s), int(r)
+            entries = by_rnti.get(r)
+            if entries:
+                i = bisect.bisect_right(keys[r], (f, s))
+                e = entries[i - 1] if i else entries[-1]
+                if f - e[0] + (0 if i else FRAMES) < lookback:
+                    match = e[2]
+        except (TypeError, ValueError):
+            pass
+        for field, col in LOG_COLUMNS.items():
+            cols[col].append(match.get(field) if match else None)
+
+    return pd.DataFrame(cols, index=df.index)
+
+def find_native_merger(path=None):
+    """The merge_gnb_log binary: the given path, a build next to this
+    script, or one on PATH. None if there is none."""
+    if path:
+        return path if os.access(path, os.X_OK) else None
+    for cand in (os.path.join(XAPP_DIR, 'merge_gnb_log'),
+                 os.path.join(XAPP_DIR, 'build', 'merge_gnb_log')):
+        if os.access(cand, os.X_OK):
+            return cand
+    return shutil.which('merge_gnb_log')
+
+def run_native_merger(tool, df, dataset, log_file, lookback, threads=None):
+    """Log columns for df from merge_gnb_log, or None if it failed."""
+    with tempfile.TemporaryDirectory() as tmp:
+        # The tool reads plain CSV and .kpmc itself; anything else (segment
+        # lists, .zst) goes through a file of just the join keys
+        if not (dataset.endswith('.kpmc') or (dataset.endswith('.csv')
+                and not dataset.endswith('_segments.csv'))):
+            dataset = os.path.join(tmp, 'keys.csv')
+            df[['rnti', 'frame', 'slot']].to_csv(dataset, index=False)
+
+        out = os.path.join(tmp, 'log_columns.csv')
+        cmd = [tool, f'--lookback={lookback}']
+        if threads:
+            cmd.append(f'--threads={threads}')
+        cmd += [dataset, log_file, out]
+        if subprocess.run(cmd).returncode != 0:
+            return None
+        log_df = pd.read_csv(out)
+
+    if len(log_df) != len(df):
+        print(f"[WARN] merge_gnb_log returned {len(log_df)} rows for {len(df)}")
+        return None
+    log_df.index = df.index
+    return log_df
+
 def parse_cn_logs(log_file, nf_type):
     """
     Parses CN logs (AMF, SMF, UPF).
@@ -145,19 +235,30 @@ def parse_cn_logs(log_file, nf_type):
         
     return stats
 
-def merge_data(csv_file, log_file, output_file, amf_log=None, smf_log=None, upf_log=None):
+def merge_data(csv_file, log_file, output_file, amf_log=None, smf_log=None, upf_log=None,
+               native=None, use_native=True, lookback=LOOKBACK_FRAMES, threads=None):
     print(f"[INFO] Merging {csv_file} with metrics from gNB and CN logs...")
     
-    # 1. Load xApp CSV
+    # 1. Load xApp dataset (CSV or columnar .kpmc)
     try:
-        df = pd.read_csv(csv_file)
+        df = load_dataset(csv_file)
     except Exception as e:
         print(f"[ERROR] Could not read CSV: {e}")
         return
 
-    # 2. Parse gNB Logs
-    log_metrics = parse_gnb_logs(log_file)
-    print(f"[INFO] Extracted {len(log_metrics)} gNB log data points.")
+    # 2. Parse gNB Logs and join them to the rows on (rnti, frame, slot).
+    # merge_gnb_log does both natively; the regex parser is the fallback.
+    log_df = None
+    tool = find_native_merger(native) if use_native else None
+    if tool:
+        print(f"[INFO] Joining gNB log with {tool}")
+        log_df = run_native_merger(tool, df, csv_file, log_file, lookback, threads)
+        if log_df is None:
+            print("[WARN] merge_gnb_log failed, falling back to the Python parser")
+    if log_df is None:
+        log_metrics = parse_gnb_logs(log_file)
+        print(f"[INFO] Extracted {len(log_metrics)} gNB log data points.")
+        log_df = join_gnb_metrics(df, log_metrics, lookback)
     
     # 3. Parse CN Logs
     amf_stats = parse_cn_logs(amf_log, 'AMF')
@@ -166,99 +267,16 @@ def merge_data(csv_file, log_file, output_file, amf_log=None, smf_log=None, upf_
     
     print(f"[INFO] CN Stats: AMF={amf_stats}, SMF={smf_stats}")
 
-    # 3. Merge gNB Data (Lookback)
-    # Logs are sparse (e.g. every 128 slots). xApp is frequent (every 10ms).
-    log_map = {}
-    for (f, s, r), data in log_metrics.items():
-        log_map[f] = data
-        
-    rsrp_list = []
-    ph_list = []
-    pcmax_list = []
-    sync_list = []
-    harq_dl_list = []
-    harq_ul_list = []
-    dlsch_err_list = []
-    ulsch_err_list = []
-    
-    rsrq_list = []
-    sinr_dl_list = []
-    
-    for index, row in df.iterrows():
-        # 1. Fill from Logs (Lookback)
-        try:
-            current_f = int(row['frame'])
-            match = None
-            for offset in range(200):
-                check_f = (current_f - offset) % 1024
-                if check_f in log_map:
-                    match = log_map[check_f]
-                    break
-            
-            if match:
-                rsrp = match.get('rsrp')
-                ph = match.get('ph')
-                pcmax = match.get('pcmax')
-                sync = match.get('sync')
-                harq_dl = match.get('harq_dl')
-                harq_ul = match.get('harq_ul')
-                dlsch_err = match.get('dlsch_err')
-                ulsch_err = match.get('ulsch_err')
-                
-                rsrp_list.append(rsrp)
-                ph_list.append(ph)
-                pcmax_list.append(pcmax)
-                sync_list.append(sync)
-                harq_dl_list.append(harq_dl)
-                harq_ul_list.append(harq_ul)
-                dlsch_err_list.append(dlsch_err)
-                ulsch_err_list.append(ulsch_err)
-                
-                # Estimate RSRQ: RSRP + 100 - 90 (from reference script)
-                if rsrp is not None:
-                    rsrq_list.append(rsrp + 10.0)
-                else:
-                    rsrq_list.append(None)
-            else:
-                rsrp_list.append(None)
-                ph_list.append(None)
-                pcmax_list.append(None)
-                sync_list.append(None)
-                harq_dl_list.append(None)
-                harq_ul_list.append(None)
-                dlsch_err_list.append(None)
-                ulsch_err_list.append(None)
-                rsrq_list.append(None)
-                
-        except Exception:
-            rsrp_list.append(None)
-            # ... fill Nones for others ...
-            ph_list.append(None); pcmax_list.append(None); sync_list.append(None)
-            harq_dl_list.append(None); harq_ul_list.append(None)
-            dlsch_err_list.append(None); ulsch_err_list.append(None)
-            rsrq_list.append(None)
+    for col in LOG_COLUMNS.values():
+        df[col] = log_df[col]
 
-        # 2. Estimate DL SINR from DL BLER (xApp data)
-        try:
-            bler = float(row['dl_bler'])
-            if bler < 0.001: sinr_dl_list.append(25.0)
-            elif bler < 0.01: sinr_dl_list.append(20.0)
-            elif bler < 0.1: sinr_dl_list.append(15.0)
-            else: sinr_dl_list.append(10.0)
-        except Exception:
-            sinr_dl_list.append(None)
+    # Estimate RSRQ: RSRP + 100 - 90 (from reference script)
+    df['est_rsrq'] = pd.to_numeric(df['log_rsrp']) + 10.0
 
-    df['log_rsrp'] = rsrp_list
-    df['log_ph'] = ph_list
-    df['log_pcmax'] = pcmax_list
-    df['log_sync'] = sync_list
-    df['log_harq_dl'] = harq_dl_list
-    df['log_harq_ul'] = harq_ul_list
-    df['log_dlsch_err'] = dlsch_err_list
-    df['log_ulsch_err'] = ulsch_err_list
-    
-    df['est_rsrq'] = rsrq_list
-    df['est_sinr_dl'] = sinr_dl_list
+    # Estimate DL SINR from DL BLER (xApp data)
+    bler = pd.to_numeric(df['dl_bler'], errors='coerce')
+    df['est_sinr_dl'] = np.select([bler < 0.001, bler < 0.01, bler < 0.1],
+                                  [25.0, 20.0, 15.0], 10.0)
 
     # 4. Add CN Columns (Duplicate Global State across all rows)
     # Since these are slow-changing/event-based, we just apply the experiment state
@@ -307,13 +325,18 @@ def merge_data(csv_file, log_file, output_file, amf_log=None, smf_log=None, upf_
 
 if __name__ == "__main__":
     parser = argparse.ArgumentParser(description="Merge xApp CSV with gNB and CN logs")
-    parser.add_argument("kpm_csv", help="Input kpm_metrics.csv")
+    parser.add_argument("kpm_csv", help="Input kpm_metrics.csv or .kpmc")
     parser.add_argument("gnb_log", help="Input gnb_logs.txt")
     parser.add_argument("out_csv", help="Output final dataset.csv")
     parser.add_argument("--amf", help="AMF log file", default=None)
     parser.add_argument("--smf", help="SMF log file", default=None)
     parser.add_argument("--upf", help="UPF log file", default=None)
+    parser.add_argument("--native", help="merge_gnb_log binary (default: look next to this script, then PATH)", default=None)
+    parser.add_argument("--no-native", help="Use the Python log parser even if merge_gnb_log is there", action="store_true")
+    parser.add_argument("--lookback", help="Max frames between a row and its log entry", type=int, default=LOOKBACK_FRAMES)
+    parser.add_argument("--threads", help="merge_gnb_log threads (default: all cores)", type=int, default=None)
     
     args = parser.parse_args()
     
-    merge_data(args.kpm_csv, args.gnb_log, args.out_csv, args.amf, args.smf, args.upf)
+    merge_data(args.kpm_csv, args.gnb_log, args.out_csv, args.amf, args.smf, args.upf,
+               args.native, not args.no_native, args.lookback, args.threads)
@@ -8,6 +8,7 @@ SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
 NAMESPACE="blueprint"
 DURATION=${1:-60}  # Default 60 seconds
 BANDWIDTH=${2:-20M}
+XAPP_ARGS=${XAPP_ARGS:-}  # Extra collector flags, e.g. "--samples=0 --interval=100"
 
 echo "╔═══════════════════════════════════════════════════════════════╗"
 echo "║      5G Traffic Generation & xApp Data Collection             ║"
@@ -53,25 +54,35 @@ kubectl exec -n $NAMESPACE $UPF_POD -- iperf3 -s -p 5201 -D 2>/dev/null
 # ------------------------------------------------------------------
 echo ""
 echo "[INFO] Deploying KPM xApp to FlexRIC..."
-XAPP_SRC="$SCRIPT_DIR/flexric_xapp/xapp_kpm_metrics_collector_v2.c"
+XAPP_DIR="$SCRIPT_DIR/flexric_xapp"
+XAPP_SOURCES="xapp_kpm_metrics_collector_v2.c ue_table.c spsc_ring.c row_writer.c csv_sink.c col_sink.c kpm_meas.c kpm_sub.c collector_cfg.c node_ctx.c node_watch.c stop_event.c lat_hist.c metrics_http.c row_pub.c row_agg.c ctr_rate.c rot_sink.c ind_log.c ind_proc.c trigger.c ue_feat.c kpm_pool.c sub_fanout.c run_report.c"
+XAPP_HEADERS="ue_table.h spsc_ring.h row_writer.h row_sink.h kpm_meas.h kpm_sub.h collector_cfg.h node_ctx.h node_watch.h stop_event.h lat_hist.h metrics_http.h row_pub.h row_agg.h ctr_rate.h rot_sink.h ind_log.h ind_proc.h trigger.h ue_feat.h kpm_pool.h sub_fanout.h run_report.h"
 REMOTE_DIR="/flexric/examples/xApp/c/monitor"
 
-if [ ! -f "$XAPP_SRC" ]; then
-    echo "[ERROR] Source file not found: $XAPP_SRC"
-    exit 1
-fi
+for f in $XAPP_SOURCES $XAPP_HEADERS; do
+    if [ ! -f "$XAPP_DIR/$f" ]; then
+        echo "[ERROR] Source file not found: $XAPP_DIR/$f"
+        exit 1
+    fi
+done
 
-# Copy Source
-kubectl cp "$XAPP_SRC" "$NAMESPACE/$FLEXRIC_POD:$REMOTE_DIR/xapp_kpm_metrics_collector_v2.c"
+# Copy Sources
+for f in $XAPP_SOURCES $XAPP_HEADERS; do
+    kubectl cp "$XAPP_DIR/$f" "$NAMESPACE/$FLEXRIC_POD:$REMOTE_DIR/$f"
+done
 
 # Compile
 echo "[INFO] Compiling xApp..."
 kubectl exec -n $NAMESPACE $FLEXRIC_POD -- bash -c "
 cd $REMOTE_DIR
-gcc -o xapp_kpm_v2 xapp_kpm_metrics_collector_v2.c \
+# Rotated segments are compressed when the pod has the zstd headers
+ZSTD_FLAGS=''
+[ -f /usr/include/zstd.h ] && ZSTD_FLAGS='-DKPM_WITH_ZSTD -lzstd'
+gcc -o xapp_kpm_v2 $XAPP_SOURCES \
     -I/flexric/src -I/flexric/build/src \
     -DKPM_V3_00 -DE2AP_V3 \
-    -L/flexric/build/src/xApp -le42_xapp_shared -lpthread -lsctp
+    -L/flexric/build/src/xApp -le42_xapp_shared -lpthread -lsctp -lm -lrt \
+    \$ZSTD_FLAGS
 cp xapp_kpm_v2 /flexric/build/examples/xApp/c/monitor/
 "
 
@@ -87,7 +98,7 @@ POD_OUTPUT="/tmp/kpm_metrics.csv"
 # We use stdbuf to avoid buffering issues and timeout to stop it automatically
 kubectl exec -n $NAMESPACE $FLEXRIC_POD -- bash -c "
     export LD_LIBRARY_PATH=/flexric/build/src/xApp:/usr/local/lib:\$LD_LIBRARY_PATH
-    timeout $((DURATION + 5)) /flexric/build/examples/xApp/c/monitor/xapp_kpm_v2 > $POD_OUTPUT 2>&1
+    timeout $((DURATION + 5)) /flexric/build/examples/xApp/c/monitor/xapp_kpm_v2 --duration=$DURATION $XAPP_ARGS > $POD_OUTPUT 2>&1
 " &
 XAPP_PID=$!
 
@@ -147,6 +158,12 @@ if kubectl cp "$NAMESPACE/$FLEXRIC_POD:/tmp/kpm_metrics_dataset.csv" "$LOCAL_FIL
     # Merge Data
     echo ""
     echo "[INFO] Merging with gNB and Core Network logs..."
+    # The native log merger; merge_metrics.py falls back to Python without it
+    if command -v gcc >/dev/null 2>&1 && \
+       [ "$XAPP_DIR/merge_gnb_log.c" -nt "$XAPP_DIR/merge_gnb_log" ]; then
+        gcc -O2 -march=native -pthread -o "$XAPP_DIR/merge_gnb_log" \
+            "$XAPP_DIR/merge_gnb_log.c" || echo "[WARN] Could not build merge_gnb_log"
+    fi
     # Pass all log files to the python script
     python3 "$SCRIPT_DIR/merge_metrics.py" "$LOCAL_FILE" "$LOG_FILE" "$FINAL_FILE" "--amf" "$LOG_AMF" "--smf" "$LOG_SMF" "--upf" "$LOG_UPF"
     
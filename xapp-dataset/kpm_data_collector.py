@@ -4,17 +4,20 @@ KPM Data Collector for FlexRIC
 Collects KPM metrics from FlexRIC xApp and exports to CSV for dataset creation.
 
 This script runs the xapp_kpm_moni binary and parses its output to create
-a structured dataset of 5G network performance metrics.
+a structured dataset of 5G network performance metrics. The xApp is run
+with --ndjson=- so every record carries its collectStartTime; the text
+patterns are kept for binaries built before NDJSON support.
 """
 
 import subprocess
 import re
 import csv
+import json
 import time
 import sys
 import signal
 import os
-from datetime import datetime
+from datetime import datetime, timezone
 from collections import defaultdict
 
 # Configuration
@@ -44,6 +47,11 @@ class KPMDataCollector:
         
     def parse_kpm_output(self, line, current_record):
         """Parse a single line from xapp_kpm_moni output."""
+
+        # NDJSON: one complete record per UE, stamped at capture time
+        if line.startswith('{'):
+            self.save_record(self.ndjson_record(json.loads(line)))
+            return current_record
         
         # Parse KPM indication header
         kpm_match = re.match(r'\s*(\d+)\s+KPM ind_msg latency = (\d+)', line)
@@ -81,6 +89,30 @@ class KPMDataCollector:
                 
         return current_record
     
+    @staticmethod
+    def ndjson_record(obj):
+        """Map an NDJSON line onto the CSV fields."""
+        names = {
+            'DRB.PdcpSduVolumeDL': 'pdcp_sdu_volume_dl_kb',
+            'DRB.PdcpSduVolumeUL': 'pdcp_sdu_volume_ul_kb',
+            'DRB.RlcSduDelayDl': 'rlc_sdu_delay_dl_us',
+            'DRB.UEThpDl': 'ue_throughput_dl_kbps',
+            'DRB.UEThpUl': 'ue_throughput_ul_kbps',
+            'RRU.PrbTotDl': 'prb_total_dl',
+            'RRU.PrbTotUl': 'prb_total_ul',
+        }
+        ts = datetime.fromtimestamp(obj['collect_start_us'] / 1e6, timezone.utc)
+        record = {
+            'sample_id': obj['ind'],
+            'timestamp': ts.isoformat(),
+            'latency_us': obj['latency_us'],
+            'ue_id': obj['ue_id'],
+        }
+        for name, value in obj['meas'].items():
+            if name in names:
+                record[names[name]] = value
+        return record
+
     def save_record(self, record):
         """Save a complete KPM record to CSV."""
         if not self.csv_writer:
@@ -126,7 +158,7 @@ class KPMDataCollector:
         try:
             # Start xApp process
             process = subprocess.Popen(
-                [XAPP_BINARY],
+                [XAPP_BINARY, '--ndjson=-'],
                 stdout=subprocess.PIPE,
                 stderr=subprocess.STDOUT,
                 text=True,
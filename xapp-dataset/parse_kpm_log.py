@@ -1,12 +1,43 @@
 #!/usr/bin/env python3
 """
 Parse KPM xApp raw output and convert to CSV dataset.
+
+Accepts either the human-readable output of xapp_kpm_moni or its NDJSON
+output (--ndjson=FILE). Only NDJSON carries the capture time
+(collectStartTime); for text logs the rows are stamped at parse time.
 """
 
 import re
 import csv
+import json
 import sys
-from datetime import datetime
+from datetime import datetime, timezone
+
+# KPM measurement name -> CSV column
+MEAS_FIELDS = {
+    'DRB.PdcpSduVolumeDL': 'pdcp_sdu_volume_dl_kb',
+    'DRB.PdcpSduVolumeUL': 'pdcp_sdu_volume_ul_kb',
+    'DRB.RlcSduDelayDl': 'rlc_sdu_delay_dl_us',
+    'DRB.UEThpDl': 'ue_throughput_dl_kbps',
+    'DRB.UEThpUl': 'ue_throughput_ul_kbps',
+    'RRU.PrbTotDl': 'prb_total_dl',
+    'RRU.PrbTotUl': 'prb_total_ul',
+}
+
+
+def ndjson_record(obj):
+    """One CSV record from an xapp_kpm_moni NDJSON line."""
+    ts = datetime.fromtimestamp(obj['collect_start_us'] / 1e6, timezone.utc)
+    rec = {
+        'sample_id': obj['ind'],
+        'timestamp': ts.isoformat(),
+        'latency_us': obj['latency_us'],
+        'ue_id': obj['ue_id'],
+    }
+    for name, value in obj['meas'].items():
+        if name in MEAS_FIELDS:
+            rec[MEAS_FIELDS[name]] = value
+    return rec
 
 def parse_kpm_log(input_file, output_file):
     """Parse KPM log file and create CSV dataset."""
@@ -17,6 +48,11 @@ def parse_kpm_log(input_file, output_file):
     with open(input_file, 'r') as f:
         for line in f:
             line = line.strip()
+
+            # NDJSON: one complete record per line, other output is skipped
+            if line.startswith('{'):
+                records.append(ndjson_record(json.loads(line)))
+                continue
             
             # Parse sample header
             match = re.match(r'\s*(\d+)\s+KPM ind_msg latency\s*=\s*(\d+)', line)